@@ -115,11 +115,35 @@ extern Print_t PrintExtra;
 /* Forward declaration */
 struct _EFI_FS;
 
+/* A directory entry, as recorded in a directory snapshot */
+typedef struct _GRUB_DIR_ENTRY {
+	UINTN                  NameOffset;
+	UINT32                 Dir:1;
+	UINT32                 MtimeSet:1;
+	UINT32                 SizeSet:1;
+	INT32                  Mtime;
+	UINT64                 Size;
+} GRUB_DIR_ENTRY;
+
+/* The listing of a directory, taken by the first FileReadDir() of a pass over
+ * it and dropped on rewind, on reopen of the root and on close
+ */
+typedef struct _GRUB_DIR_CACHE {
+	GRUB_DIR_ENTRY        *Entries;
+	UINTN                  NrEntries;
+	UINTN                  MaxEntries;
+	CHAR8                 *Names;
+	UINTN                  NamesLen;
+	UINTN                  NamesMax;
+	EFI_STATUS             Status;
+} GRUB_DIR_CACHE;
+
 /* A file instance */
 typedef struct _EFI_GRUB_FILE {
 	EFI_FILE               EfiFile;
 	BOOLEAN                IsDir;
 	INT64                  DirIndex;
+	GRUB_DIR_CACHE        *DirCache;
 	INT32                  Mtime;
 	CHAR8                 *path;
 	CHAR8                 *basename;
@@ -142,6 +166,7 @@ typedef struct _EFI_FS {
 	EFI_GRUB_FILE         *RootFile;
 	VOID                  *GrubDevice;
 	CHAR16                *DevicePathString;
+	struct _GRUB_DISK_CACHE *DiskCache;
 } EFI_FS;
 
 /* Mirrors a similar construct from GRUB, while EFI-zing it */
@@ -173,6 +198,9 @@ extern CHAR16 *GrubGetUuid(EFI_FS *This);
 extern BOOLEAN GrubFSProbe(EFI_FS *This);
 extern EFI_STATUS GrubDeviceInit(EFI_FS *This);
 extern EFI_STATUS GrubDeviceExit(EFI_FS *This);
+extern EFI_STATUS GrubCacheInit(EFI_FS *This);
+extern VOID GrubCacheExit(EFI_FS *This);
+extern VOID GrubCacheStats(EFI_FS *This);
 extern VOID GrubTimeToEfiTime(const INT32 t, EFI_TIME *tp);
 extern VOID CopyPathRelative(CHAR8 *dest, CHAR8 *src, INTN len);
 extern EFI_STATUS GrubOpen(EFI_GRUB_FILE *File);
@@ -183,6 +211,7 @@ extern EFI_STATUS GrubRead(EFI_GRUB_FILE *File, VOID *Data, UINTN *Len);
 extern EFI_STATUS GrubLabel(EFI_GRUB_FILE *File, CHAR8 **label);
 extern EFI_STATUS GrubCreateFile(EFI_GRUB_FILE **File, EFI_FS *This);
 extern VOID GrubDestroyFile(EFI_GRUB_FILE *File);
+extern VOID GrubDropDirCache(EFI_GRUB_FILE *File);
 extern UINT64 GrubGetFileSize(EFI_GRUB_FILE *File);
 extern UINT64 GrubGetFileOffset(EFI_GRUB_FILE *File);
 extern VOID GrubSetFileOffset(EFI_GRUB_FILE *File, UINT64 Offset);
@@ -138,6 +138,7 @@ FileOpen(EFI_FILE_HANDLE This, EFI_FILE_HANDLE *New,
 		*New = &File->FileSystem->RootFile->EfiFile;
 		/* Must make sure that DirIndex is reset too (NB: no concurrent access!) */
 		File->FileSystem->RootFile->DirIndex = 0;
+		GrubDropDirCache(File->FileSystem->RootFile);
 		PrintInfo(L"  RET: %llx\n", (UINTN) *New);
 		return EFI_SUCCESS;
 	}
@@ -231,9 +232,11 @@ FileClose(EFI_FILE_HANDLE This)
 	PrintInfo(L"Close(%llx|'%s') %s\n", (UINTN) This, FileName(File),
 		IS_ROOT(File)?L"<ROOT>":L"");
 
-	/* Nothing to do it this is the root */
-	if (IS_ROOT(File))
+	/* Nothing to do it this is the root, but don't keep its listing */
+	if (IS_ROOT(File)) {
+		GrubDropDirCache(File);
 		return EFI_SUCCESS;
+	}
 
 	if (--File->RefCount == 0) {
 		/* Close the file if it's a regular one */
@@ -275,51 +278,96 @@ FileDelete(EFI_FILE_HANDLE This)
 
 /* GRUB uses a callback for each directory entry, whereas EFI uses repeated
  * firmware generated calls to FileReadDir() to get the info for each entry,
- * so we have to reconcile the twos. For now, we'll re-issue a call to GRUB
- * dir(), and run through all the entries (to find the one we
- * are interested in)  multiple times. Maybe later we'll try to optimize this
- * by building a one-off chained list of entries that we can parse...
+ * so we have to reconcile the twos. The first read of an open directory
+ * runs GRUB dir() once and records every entry in a snapshot, from which
+ * this and the following reads are served. A rewind, a reopen of the root
+ * or a close drops the snapshot, so a new pass sees the directory as it
+ * is now.
  */
 static INT32
 DirHook(const CHAR8 *name, const GRUB_DIRHOOK_INFO *DirInfo, VOID *Data)
 {
-	EFI_STATUS Status;
-	EFI_FILE_INFO *Info = (EFI_FILE_INFO *) Data;
-	INT64 *Index = (INT64 *) &Info->FileSize;
-	CHAR8 *filename = (CHAR8 *) ((UINTN)Info->PhysicalSize);
-	EFI_TIME Time = { 1970, 01, 01, 00, 00, 00, 0, 0, 0, 0, 0};
+	GRUB_DIR_CACHE *Cache = (GRUB_DIR_CACHE *) Data;
+	GRUB_DIR_ENTRY *Entry;
+	UINTN Len, NewMax;
+	VOID *NewBuf;
 
 	// Eliminate '.' or '..'
 	if ((name[0] ==  '.') && ((name[1] == 0) || ((name[1] == '.') && (name[2] == 0))))
 		return 0;
 
-	/* Ignore any entry that doesn't match our index */
-	if ((*Index)-- != 0)
-		return 0;
-
-	strcpya(filename, name);
+	if (Cache->NrEntries == Cache->MaxEntries) {
+		NewMax = (Cache->MaxEntries == 0) ? 32 : 2 * Cache->MaxEntries;
+		NewBuf = ReallocatePool(Cache->MaxEntries * sizeof(GRUB_DIR_ENTRY),
+				NewMax * sizeof(GRUB_DIR_ENTRY), Cache->Entries);
+		if (NewBuf == NULL)
+			goto oom;
+		Cache->Entries = NewBuf;
+		Cache->MaxEntries = NewMax;
+	}
 
-	Status = Utf8ToUtf16NoAlloc(filename, Info->FileName, Info->Size - sizeof(EFI_FILE_INFO));
-	if (EFI_ERROR(Status)) {
-		if (Status != EFI_BUFFER_TOO_SMALL)
-			PrintStatusError(Status, L"Could not convert directory entry to UTF-8");
-		return Status;
+	Len = strlena(name) + 1;
+	if (Cache->NamesLen + Len > Cache->NamesMax) {
+		NewMax = (Cache->NamesMax == 0) ? 1024 : 2 * Cache->NamesMax;
+		while (NewMax < Cache->NamesLen + Len)
+			NewMax *= 2;
+		NewBuf = ReallocatePool(Cache->NamesMax, NewMax, Cache->Names);
+		if (NewBuf == NULL)
+			goto oom;
+		Cache->Names = NewBuf;
+		Cache->NamesMax = NewMax;
 	}
-	/* The Info struct size already accounts for the extra NUL */
-	Info->Size = sizeof(*Info) + StrLen(Info->FileName) * sizeof(CHAR16);
 
-	// Oh, and of course GRUB uses a 32 bit signed mtime value (seriously, wtf guys?!?)
-	if (DirInfo->MtimeSet)
-		GrubTimeToEfiTime(DirInfo->Mtime, &Time);
-	CopyMem(&Info->CreateTime, &Time, sizeof(Time));
-	CopyMem(&Info->LastAccessTime, &Time, sizeof(Time));
-	CopyMem(&Info->ModificationTime, &Time, sizeof(Time));
-
-	Info->Attribute = EFI_FILE_READ_ONLY;
-	if (DirInfo->Dir)
-		Info->Attribute |= EFI_FILE_DIRECTORY;
+	Entry = &Cache->Entries[Cache->NrEntries++];
+	ZeroMem(Entry, sizeof(*Entry));
+	Entry->NameOffset = Cache->NamesLen;
+	Entry->Dir = DirInfo->Dir;
+	Entry->MtimeSet = DirInfo->MtimeSet;
+	Entry->Mtime = DirInfo->Mtime;
+	CopyMem(&Cache->Names[Cache->NamesLen], name, Len);
+	Cache->NamesLen += Len;
 
 	return 0;
+
+oom:
+	Cache->Status = EFI_OUT_OF_RESOURCES;
+	return 1;
+}
+
+/**
+ * Take the directory snapshot
+ *
+ * @v file			EFI file
+ * @ret Status		EFI status code
+ */
+static EFI_STATUS
+DirSnapshot(EFI_GRUB_FILE *File)
+{
+	EFI_STATUS Status;
+	GRUB_DIR_CACHE *Cache;
+
+	Cache = AllocateZeroPool(sizeof(*Cache));
+	if (Cache == NULL)
+		return EFI_OUT_OF_RESOURCES;
+
+	/* Invoke GRUB's directory listing */
+	Status = GrubDir(File, File->path, DirHook, Cache);
+	if (Cache->Status == EFI_OUT_OF_RESOURCES) {
+		PrintError(L"Could not allocate directory snapshot\n");
+		if (Cache->Entries != NULL)
+			FreePool(Cache->Entries);
+		if (Cache->Names != NULL)
+			FreePool(Cache->Names);
+		FreePool(Cache);
+		return EFI_OUT_OF_RESOURCES;
+	}
+	/* Serve whatever was listed before an error */
+	if (EFI_ERROR(Status))
+		PrintStatusError(Status, L"Directory listing failed");
+
+	PrintDebug(L"'%s': %d directory entries\n", FileName(File), Cache->NrEntries);
+	File->DirCache = Cache;
+	return EFI_SUCCESS;
 }
 
 /**
@@ -335,10 +383,9 @@ FileReadDir(EFI_GRUB_FILE *File, UINTN *Len, VOID *Data)
 {
 	EFI_FILE_INFO *Info = (EFI_FILE_INFO *) Data;
 	EFI_STATUS Status;
-	/* We temporarily repurpose the FileSize as a *signed* entry index */
-	INT64 *Index = (INT64 *) &Info->FileSize;
-	/* And PhysicalSize as a pointer to our filename */
-	CHAR8 **basename = (CHAR8 **) &Info->PhysicalSize;
+	EFI_TIME Time = { 1970, 01, 01, 00, 00, 00, 0, 0, 0, 0, 0};
+	GRUB_DIR_ENTRY *Entry;
+	CHAR8 *name;
 	CHAR8 path[MAX_PATH];
 	EFI_GRUB_FILE *TmpFile = NULL;
 	INTN len;
@@ -349,35 +396,54 @@ FileReadDir(EFI_GRUB_FILE *File, UINTN *Len, VOID *Data)
 		return EFI_BUFFER_TOO_SMALL;
 	}
 
-	/* Populate our Info template */
-	ZeroMem(Data, *Len);
-	Info->Size = *Len;
-	*Index = File->DirIndex;
-	strcpya(path, File->path);
-	len = strlena(path);
-	if (path[len-1] != '/')
-		path[len++] = '/';
-	*basename = &path[len];
+	if (File->DirCache == NULL) {
+		Status = DirSnapshot(File);
+		if (EFI_ERROR(Status))
+			return Status;
+	}
 
-	/* Invoke GRUB's directory listing */
-	Status = GrubDir(File, File->path, DirHook, Data);
-	if (*Index >= 0) {
+	if (File->DirIndex >= (INT64) File->DirCache->NrEntries) {
 		/* No more entries */
 		*Len = 0;
 		return EFI_SUCCESS;
 	}
+	Entry = &File->DirCache->Entries[File->DirIndex];
+	name = &File->DirCache->Names[Entry->NameOffset];
+
+	/* Populate our Info template */
+	ZeroMem(Data, *Len);
+	Info->Size = *Len;
 
+	Status = Utf8ToUtf16NoAlloc(name, Info->FileName, Info->Size - sizeof(EFI_FILE_INFO));
 	if (EFI_ERROR(Status)) {
-		PrintStatusError(Status, L"Directory listing failed");
+		if (Status != EFI_BUFFER_TOO_SMALL)
+			PrintStatusError(Status, L"Could not convert directory entry to UTF-8");
 		return Status;
 	}
+	/* The Info struct size already accounts for the extra NUL */
+	Info->Size = sizeof(*Info) + StrLen(Info->FileName) * sizeof(CHAR16);
 
-	/* Our Index/FileSize must be reset */
-	Info->FileSize = 0;
-	Info->PhysicalSize = 0;
+	// Oh, and of course GRUB uses a 32 bit signed mtime value (seriously, wtf guys?!?)
+	if (Entry->MtimeSet)
+		GrubTimeToEfiTime(Entry->Mtime, &Time);
+	CopyMem(&Info->CreateTime, &Time, sizeof(Time));
+	CopyMem(&Info->LastAccessTime, &Time, sizeof(Time));
+	CopyMem(&Info->ModificationTime, &Time, sizeof(Time));
+
+	Info->Attribute = EFI_FILE_READ_ONLY;
+	if (Entry->Dir)
+		Info->Attribute |= EFI_FILE_DIRECTORY;
+
+	/* For regular files, we still need the size, which GRUB's dir() hook
+	 * does not provide. It is looked up once and kept in the snapshot.
+	 */
+	if (!Entry->Dir && !Entry->SizeSet) {
+		strcpya(path, File->path);
+		len = strlena(path);
+		if (path[len-1] != '/')
+			path[len++] = '/';
+		strcpya(&path[len], name);
 
-	/* For regular files, we still need to fill the size */
-	if (!(Info->Attribute & EFI_FILE_DIRECTORY)) {
 		/* Open the file and read its size */
 		Status = GrubCreateFile(&TmpFile, File->FileSystem);
 		if (EFI_ERROR(Status)) {
@@ -392,12 +458,14 @@ FileReadDir(EFI_GRUB_FILE *File, UINTN *Len, VOID *Data)
 			PrintStatusError(Status, L"Unable to obtain the size of '%s'", Info->FileName);
 			/* Non fatal error */
 		} else {
-			Info->FileSize = GrubGetFileSize(TmpFile);
-			Info->PhysicalSize = GrubGetFileSize(TmpFile);
+			Entry->Size = GrubGetFileSize(TmpFile);
 			GrubClose(TmpFile);
 		}
 		GrubDestroyFile(TmpFile);
+		Entry->SizeSet = 1;
 	}
+	Info->FileSize = Entry->Size;
+	Info->PhysicalSize = Entry->Size;
 
 	*Len = (UINTN) Info->Size;
 	/* Advance to the next entry */
@@ -482,6 +550,7 @@ FileSetPosition(EFI_FILE_HANDLE This, UINT64 Position)
 		if (Position != 0)
 			return EFI_INVALID_PARAMETER;
 		File->DirIndex = 0;
+		GrubDropDirCache(File);
 		return EFI_SUCCESS;
 	}
 
@@ -702,6 +771,7 @@ FileOpenVolume(EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *This, EFI_FILE_HANDLE *Root)
 	EFI_FS *FSInstance = _CR(This, EFI_FS, FileIoInterface);
 
 //	PrintInfo(L"OpenVolume\n");
+	GrubCacheStats(FSInstance);
 	*Root = &FSInstance->RootFile->EfiFile;
 
 	return EFI_SUCCESS;
@@ -725,6 +795,11 @@ FSInstall(EFI_FS *This, EFI_HANDLE ControllerHandle)
 
 //	PrintInfo(L"FSInstall: %s\n", This->DevicePathString);
 
+	/* The block cache is an optimization only, run without it if we must */
+	Status = GrubCacheInit(This);
+	if (EFI_ERROR(Status))
+		PrintStatusError(Status, L"Could not create block cache");
+
 	/* Initialize the root handle */
 	Status = GrubCreateFile(&This->RootFile, This);
 	if (EFI_ERROR(Status)) {
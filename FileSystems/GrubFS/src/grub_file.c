@@ -137,13 +137,295 @@ grub_device_iterate(grub_device_iterate_hook_t hook, void *hook_data)
 */
 grub_disk_read_hook_t grub_file_progress_hook = NULL;
 
+/*
+ * Block cache
+ *
+ * Every GRUB sector request used to go straight to DiskIo. Metadata heavy
+ * file systems re-read the same inode and tree blocks many times while a
+ * boot menu scans for kernels, so each EFI_FS keeps an LRU cache of 4 KB
+ * blocks. When reads are sequential (kernels, initrds) the missing blocks
+ * are fetched GRUB_CACHE_READAHEAD at a time in one disk read, and put at
+ * the cold end of the LRU so that streaming does not evict the metadata.
+ * Requests of read-ahead size or larger bypass the cache.
+ */
+#define GRUB_CACHE_BLOCK_SHIFT  12
+#define GRUB_CACHE_BLOCK_SIZE   (1 << GRUB_CACHE_BLOCK_SHIFT)
+#define GRUB_CACHE_NR_BLOCKS    256     /* 1 MB */
+#define GRUB_CACHE_HASH_SIZE    512     /* must be a power of 2 */
+#define GRUB_CACHE_READAHEAD    16      /* blocks */
+#define GRUB_CACHE_NONE         (-1)
+
+typedef struct _GRUB_CACHE_BLOCK {
+	UINT64                 Block;
+	INTN                   Prev;        /* towards the MRU end */
+	INTN                   Next;        /* towards the LRU end */
+	INTN                   HashNext;
+	BOOLEAN                Valid;
+} GRUB_CACHE_BLOCK;
+
+typedef struct _GRUB_DISK_CACHE {
+	GRUB_CACHE_BLOCK       Blocks[GRUB_CACHE_NR_BLOCKS];
+	INTN                   Hash[GRUB_CACHE_HASH_SIZE];
+	INTN                   Mru;
+	INTN                   Lru;
+	UINT8                 *Data;        /* GRUB_CACHE_NR_BLOCKS blocks */
+	UINT8                 *ReadBuf;     /* GRUB_CACHE_READAHEAD blocks */
+	UINT32                 MediaId;
+	UINT64                 NrBlocks;    /* whole cache blocks on the disk */
+	UINT64                 NextOffset;  /* end of the previous request */
+	UINT64                 Hits;
+	UINT64                 Misses;
+	UINT64                 ReadAheads;
+	UINT64                 Bypassed;
+} GRUB_DISK_CACHE;
+
+static EFI_BLOCK_IO_MEDIA *
+GetMedia(EFI_FS *FileSystem)
+{
+	if (FileSystem->BlockIo2 != NULL)
+		return FileSystem->BlockIo2->Media;
+	return FileSystem->BlockIo->Media;
+}
+
+static EFI_STATUS
+DiskRead(EFI_FS *FileSystem, UINT64 Offset, UINTN Size, VOID *Buf)
+{
+	EFI_BLOCK_IO_MEDIA *Media = GetMedia(FileSystem);
+
+	if (FileSystem->DiskIo2 != NULL)
+		return FileSystem->DiskIo2->ReadDiskEx(FileSystem->DiskIo2, Media->MediaId,
+				Offset, &(FileSystem->DiskIo2Token), Size, Buf);
+	return FileSystem->DiskIo->ReadDisk(FileSystem->DiskIo, Media->MediaId,
+			Offset, Size, Buf);
+}
+
+static VOID
+CacheUnlink(GRUB_DISK_CACHE *Cache, INTN i)
+{
+	GRUB_CACHE_BLOCK *b = &Cache->Blocks[i];
+
+	if (b->Prev != GRUB_CACHE_NONE)
+		Cache->Blocks[b->Prev].Next = b->Next;
+	else
+		Cache->Mru = b->Next;
+	if (b->Next != GRUB_CACHE_NONE)
+		Cache->Blocks[b->Next].Prev = b->Prev;
+	else
+		Cache->Lru = b->Prev;
+}
+
+static VOID
+CacheLink(GRUB_DISK_CACHE *Cache, INTN i, BOOLEAN Cold)
+{
+	GRUB_CACHE_BLOCK *b = &Cache->Blocks[i];
+
+	if (Cold) {
+		b->Next = GRUB_CACHE_NONE;
+		b->Prev = Cache->Lru;
+		if (Cache->Lru != GRUB_CACHE_NONE)
+			Cache->Blocks[Cache->Lru].Next = i;
+		else
+			Cache->Mru = i;
+		Cache->Lru = i;
+	} else {
+		b->Prev = GRUB_CACHE_NONE;
+		b->Next = Cache->Mru;
+		if (Cache->Mru != GRUB_CACHE_NONE)
+			Cache->Blocks[Cache->Mru].Prev = i;
+		else
+			Cache->Lru = i;
+		Cache->Mru = i;
+	}
+}
+
+static VOID
+CacheReset(GRUB_DISK_CACHE *Cache, EFI_BLOCK_IO_MEDIA *Media)
+{
+	INTN i;
+
+	for (i = 0; i < GRUB_CACHE_HASH_SIZE; i++)
+		Cache->Hash[i] = GRUB_CACHE_NONE;
+	Cache->Mru = Cache->Lru = GRUB_CACHE_NONE;
+	for (i = 0; i < GRUB_CACHE_NR_BLOCKS; i++) {
+		Cache->Blocks[i].Valid = FALSE;
+		CacheLink(Cache, i, TRUE);
+	}
+	Cache->MediaId = Media->MediaId;
+	/* A partial block at the end of the disk is never cached */
+	Cache->NrBlocks = MultU64x32(Media->LastBlock + 1, Media->BlockSize) >> GRUB_CACHE_BLOCK_SHIFT;
+	Cache->NextOffset = 0;
+}
+
+static INTN
+CacheLookup(GRUB_DISK_CACHE *Cache, UINT64 Block)
+{
+	INTN i;
+
+	for (i = Cache->Hash[Block & (GRUB_CACHE_HASH_SIZE - 1)]; i != GRUB_CACHE_NONE;
+			i = Cache->Blocks[i].HashNext) {
+		if (Cache->Blocks[i].Block == Block)
+			return i;
+	}
+	return GRUB_CACHE_NONE;
+}
+
+/* Recycle the least recently used block for Block, and make it the most recent */
+static INTN
+CacheEvict(GRUB_DISK_CACHE *Cache, UINT64 Block)
+{
+	INTN i = Cache->Lru, *p;
+	GRUB_CACHE_BLOCK *b = &Cache->Blocks[i];
+
+	if (b->Valid) {
+		for (p = &Cache->Hash[b->Block & (GRUB_CACHE_HASH_SIZE - 1)]; *p != i;
+				p = &Cache->Blocks[*p].HashNext)
+			;
+		*p = b->HashNext;
+	}
+	b->Block = Block;
+	b->Valid = TRUE;
+	b->HashNext = Cache->Hash[Block & (GRUB_CACHE_HASH_SIZE - 1)];
+	Cache->Hash[Block & (GRUB_CACHE_HASH_SIZE - 1)] = i;
+	CacheUnlink(Cache, i);
+	CacheLink(Cache, i, FALSE);
+	return i;
+}
+
+EFI_STATUS
+GrubCacheInit(EFI_FS *FileSystem)
+{
+	GRUB_DISK_CACHE *Cache;
+
+	Cache = AllocateZeroPool(sizeof(*Cache));
+	if (Cache == NULL)
+		return EFI_OUT_OF_RESOURCES;
+	Cache->Data = AllocatePool((GRUB_CACHE_NR_BLOCKS + GRUB_CACHE_READAHEAD) * GRUB_CACHE_BLOCK_SIZE);
+	if (Cache->Data == NULL) {
+		FreePool(Cache);
+		return EFI_OUT_OF_RESOURCES;
+	}
+	Cache->ReadBuf = Cache->Data + GRUB_CACHE_NR_BLOCKS * GRUB_CACHE_BLOCK_SIZE;
+	CacheReset(Cache, GetMedia(FileSystem));
+	FileSystem->DiskCache = Cache;
+
+	PrintInfo(L"Block cache: %d KB, read-ahead %d KB\n",
+			(GRUB_CACHE_NR_BLOCKS * GRUB_CACHE_BLOCK_SIZE) >> 10,
+			(GRUB_CACHE_READAHEAD * GRUB_CACHE_BLOCK_SIZE) >> 10);
+	return EFI_SUCCESS;
+}
+
+VOID
+GrubCacheStats(EFI_FS *FileSystem)
+{
+	GRUB_DISK_CACHE *Cache = FileSystem->DiskCache;
+
+	if (Cache == NULL)
+		return;
+	PrintDebug(L"Block cache %s: %ld hits, %ld misses, %ld read-aheads, %ld bypassed\n",
+			FileSystem->DevicePathString, Cache->Hits, Cache->Misses,
+			Cache->ReadAheads, Cache->Bypassed);
+}
+
+VOID
+GrubCacheExit(EFI_FS *FileSystem)
+{
+	GRUB_DISK_CACHE *Cache = FileSystem->DiskCache;
+
+	if (Cache == NULL)
+		return;
+	GrubCacheStats(FileSystem);
+	FreePool(Cache->Data);
+	FreePool(Cache);
+	FileSystem->DiskCache = NULL;
+}
+
+/* Cached read of [Offset, Offset + Size), which spans at most GRUB_CACHE_READAHEAD blocks */
+static EFI_STATUS
+CacheRead(EFI_FS *FileSystem, UINT64 Offset, UINTN Size, UINT8 *Buf)
+{
+	GRUB_DISK_CACHE *Cache = FileSystem->DiskCache;
+	EFI_STATUS Status;
+	BOOLEAN Sequential = (Offset == Cache->NextOffset);
+	UINT64 Block = Offset >> GRUB_CACHE_BLOCK_SHIFT;
+	UINT64 Last = (Offset + Size - 1) >> GRUB_CACHE_BLOCK_SHIFT;
+	UINTN Skip = (UINTN)(Offset & (GRUB_CACHE_BLOCK_SIZE - 1));
+	UINTN Count, Len, j;
+	INTN i, Slots[GRUB_CACHE_READAHEAD];
+
+	Cache->NextOffset = Offset + Size;
+
+	while (Block <= Last) {
+		i = CacheLookup(Cache, Block);
+		if (i != GRUB_CACHE_NONE) {
+			Cache->Hits++;
+			/* Streamed data stays at the cold end */
+			if (!Sequential) {
+				CacheUnlink(Cache, i);
+				CacheLink(Cache, i, FALSE);
+			}
+			Len = MIN(Size, GRUB_CACHE_BLOCK_SIZE - Skip);
+			CopyMem(Buf, Cache->Data + i * GRUB_CACHE_BLOCK_SIZE + Skip, Len);
+			Buf += Len;
+			Size -= Len;
+			Skip = 0;
+			Block++;
+			continue;
+		}
+
+		/* Miss: read the run of missing blocks, or a read-ahead window if sequential */
+		Count = GRUB_CACHE_READAHEAD;
+		if (!Sequential && (Last - Block + 1 < Count))
+			Count = (UINTN)(Last - Block + 1);
+		if (Block + Count > Cache->NrBlocks)
+			Count = (UINTN)(Cache->NrBlocks - Block);
+		for (j = 1; j < Count; j++) {
+			if (CacheLookup(Cache, Block + j) != GRUB_CACHE_NONE)
+				break;
+		}
+		Count = j;
+
+		Cache->Misses++;
+		if (Block + Count - 1 > Last)
+			Cache->ReadAheads++;
+		Status = DiskRead(FileSystem, Block << GRUB_CACHE_BLOCK_SHIFT,
+				Count * GRUB_CACHE_BLOCK_SIZE, Cache->ReadBuf);
+		if (EFI_ERROR(Status))
+			return Status;
+
+		for (j = 0; j < Count; j++) {
+			i = Slots[j] = CacheEvict(Cache, Block + j);
+			CopyMem(Cache->Data + i * GRUB_CACHE_BLOCK_SIZE,
+					Cache->ReadBuf + j * GRUB_CACHE_BLOCK_SIZE, GRUB_CACHE_BLOCK_SIZE);
+			if (Block + j <= Last) {
+				Len = MIN(Size, GRUB_CACHE_BLOCK_SIZE - Skip);
+				CopyMem(Buf, Cache->ReadBuf + j * GRUB_CACHE_BLOCK_SIZE + Skip, Len);
+				Buf += Len;
+				Size -= Len;
+				Skip = 0;
+			}
+		}
+		/* Streamed data goes to the cold end, once all victims have been picked */
+		if (Sequential) {
+			for (j = 0; j < Count; j++) {
+				CacheUnlink(Cache, Slots[j]);
+				CacheLink(Cache, Slots[j], TRUE);
+			}
+		}
+		Block += Count;
+	}
+
+	return EFI_SUCCESS;
+}
+
 grub_err_t
 grub_disk_read(grub_disk_t disk, grub_disk_addr_t sector,
 		grub_off_t offset, grub_size_t size, void *buf)
 {
 	EFI_STATUS Status;
 	EFI_FS* FileSystem = (EFI_FS *) disk->data;
-  EFI_BLOCK_IO_MEDIA *Media;
+	GRUB_DISK_CACHE *Cache;
+	EFI_BLOCK_IO_MEDIA *Media;
+	UINT64 Offset;
 
 //	ASSERT(FileSystem != NULL);
 //	ASSERT(FileSystem->DiskIo != NULL);
@@ -154,23 +436,30 @@ grub_disk_read(grub_disk_t disk, grub_disk_addr_t sector,
     return GRUB_ERR_BAD_ARGUMENT;
   }
 
-    if (FileSystem->BlockIo2 != NULL)
-    {
-      Media = FileSystem->BlockIo2->Media;
-    } else {
-      Media = FileSystem->BlockIo->Media;
-    }
 	/* NB: We could get the actual blocksize through FileSystem->BlockIo->Media->BlockSize
 	 * but GRUB uses the fixed GRUB_DISK_SECTOR_SIZE, so we follow suit
 	 */
-    if (FileSystem->DiskIo2 != NULL)
-    {
-      Status = FileSystem->DiskIo2->ReadDiskEx(FileSystem->DiskIo2, Media->MediaId,
-                                               sector * GRUB_DISK_SECTOR_SIZE + offset, &(FileSystem->DiskIo2Token), size, buf);
-    } else {
-        Status = FileSystem->DiskIo->ReadDisk(FileSystem->DiskIo, Media->MediaId,
-			sector * GRUB_DISK_SECTOR_SIZE + offset, size, buf);
-    }
+	Offset = sector * GRUB_DISK_SECTOR_SIZE + offset;
+	Cache = FileSystem->DiskCache;
+	if (size == 0)
+		return 0;
+
+	if (Cache != NULL) {
+		Media = GetMedia(FileSystem);
+		if (Media->MediaId != Cache->MediaId)
+			CacheReset(Cache, Media);
+	}
+
+	if ((Cache == NULL) || (size >= GRUB_CACHE_READAHEAD * GRUB_CACHE_BLOCK_SIZE) ||
+			(((Offset + size - 1) >> GRUB_CACHE_BLOCK_SHIFT) >= Cache->NrBlocks)) {
+		if (Cache != NULL) {
+			Cache->Bypassed++;
+			Cache->NextOffset = Offset + size;
+		}
+		Status = DiskRead(FileSystem, Offset, size, buf);
+	} else {
+		Status = CacheRead(FileSystem, Offset, size, buf);
+	}
 
 	if (EFI_ERROR(Status)) {
 		PrintStatusError(Status, L"Could not read block at address %08x", sector);
@@ -291,6 +580,7 @@ GrubDeviceInit(EFI_FS *FileSystem)
 EFI_STATUS
 GrubDeviceExit(EFI_FS *FileSystem)
 {
+	GrubCacheExit(FileSystem);
 	grub_device_close_2((grub_device_t) FileSystem->GrubDevice);
 	RemoveEntryList((LIST_ENTRY *)FileSystem);
 
@@ -328,9 +618,26 @@ GrubCreateFile(EFI_GRUB_FILE **File, EFI_FS *FileSystem)
 	return EFI_SUCCESS;
 }
 
+/* Free the directory snapshot, the next read of the directory takes a new one */
+VOID
+GrubDropDirCache(EFI_GRUB_FILE *File)
+{
+    if (File->DirCache != NULL)
+    {
+        if (File->DirCache->Entries != NULL)
+            FreePool(File->DirCache->Entries);
+        if (File->DirCache->Names != NULL)
+            FreePool(File->DirCache->Names);
+        FreePool(File->DirCache);
+        File->DirCache = NULL;
+    }
+}
+
 VOID
 GrubDestroyFile(EFI_GRUB_FILE *File)
 {
+    GrubDropDirCache(File);
+
     if (File->GrubFile != NULL)
     {
         FreePool(File->GrubFile);
@@ -60,6 +60,29 @@ MachoInitializeContext (
   IN  UINT32            FileSize
   );
 
+/**
+  Initializes a Mach-O Context for an image that has been loaded to its
+  virtual layout, such as the kernel placed in memory by boot.efi.  The
+  segment with file offset 0 must hold the Mach-O Header, every other segment
+  is found at its virtual address relative to it.
+
+  Only the Load Commands and the symbol services may be used with such a
+  Context.  File offsets are not translated and relocations are unavailable.
+
+  @param[out] Context       Mach-O Context to initialize.
+  @param[in]  ImageData     Pointer to the loaded Mach-O Header.
+  @param[in]  MaxImageSize  Upper bound of the memory mapped at ImageData.
+
+  @return  Whether Context has been initialized successfully.
+
+**/
+BOOLEAN
+MachoInitializeLoadedContext (
+  OUT OC_MACHO_CONTEXT  *Context,
+  IN  VOID              *ImageData,
+  IN  UINT32            MaxImageSize
+  );
+
 /**
   Returns the Mach-O Header structure.
 
@@ -413,6 +436,25 @@ MachoSymbolGetFileOffset64 (
   OUT    UINT32                *MaxSize OPTIONAL
   );
 
+/**
+  Retrieves the size of the code or data Symbol labels.  It extends to the
+  next higher section symbol or to the end of Symbol's section.
+
+  @param[in,out] Context  Context of the Mach-O.
+  @param[in]     Symbol   Symbol to retrieve the size of.
+  @param[out]    Size     Pointer the size is returned into.
+                          If FALSE is returned, the output is undefined.
+
+  @returns  Whether Symbol labels a valid section address.
+
+**/
+BOOLEAN
+MachoSymbolGetSize64 (
+  IN OUT OC_MACHO_CONTEXT     *Context,
+  IN     CONST MACH_NLIST_64  *Symbol,
+  OUT    UINT64               *Size
+  );
+
 /**
   Returns whether Name is pure virtual.
 
@@ -995,6 +995,188 @@ InternalRetrieveSymtabs64 (
   return TRUE;
 }
 
+/**
+  Returns the offset from the Mach-O Header at which the loaded image holds
+  the data found at FileOffset in the file.
+
+  @param[in,out] Context        Context of the loaded Mach-O.
+  @param[in]     HeaderAddress  Virtual address of the Mach-O Header.
+  @param[in]     ImageSize      Size of the loaded image.
+  @param[in]     FileOffset     File offset of the data.
+  @param[in]     Size           Size of the data.
+
+  @retval MAX_UINT64  The data is not contained in a single segment.
+
+**/
+STATIC
+UINT64
+InternalGetLoadedOffset64 (
+  IN OUT OC_MACHO_CONTEXT  *Context,
+  IN     UINT64            HeaderAddress,
+  IN     UINT64            ImageSize,
+  IN     UINT64            FileOffset,
+  IN     UINT64            Size
+  )
+{
+  CONST MACH_SEGMENT_COMMAND_64 *Segment;
+  UINT64                        TopOfData;
+  UINT64                        LoadedOffset;
+
+  if (OcOverflowAddU64 (FileOffset, Size, &TopOfData)) {
+    return MAX_UINT64;
+  }
+
+  for (
+    Segment = MachoGetNextSegment64 (Context, NULL);
+    Segment != NULL;
+    Segment = MachoGetNextSegment64 (Context, Segment)
+    ) {
+    if ((FileOffset >= Segment->FileOffset)
+     && (TopOfData <= (Segment->FileOffset + Segment->FileSize))) {
+      if (Segment->VirtualAddress < HeaderAddress) {
+        return MAX_UINT64;
+      }
+
+      LoadedOffset = (Segment->VirtualAddress - HeaderAddress)
+                       + (FileOffset - Segment->FileOffset);
+      if (OcOverflowAddU64 (LoadedOffset, Size, &TopOfData)
+       || (TopOfData > ImageSize)) {
+        return MAX_UINT64;
+      }
+
+      return LoadedOffset;
+    }
+  }
+
+  return MAX_UINT64;
+}
+
+/**
+  Initializes a Mach-O Context for an image that has been loaded to its
+  virtual layout, such as the kernel placed in memory by boot.efi.  The
+  segment with file offset 0 must hold the Mach-O Header, every other segment
+  is found at its virtual address relative to it.
+
+  Only the Load Commands and the symbol services may be used with such a
+  Context.  File offsets are not translated and relocations are unavailable.
+
+  @param[out] Context       Mach-O Context to initialize.
+  @param[in]  ImageData     Pointer to the loaded Mach-O Header.
+  @param[in]  MaxImageSize  Upper bound of the memory mapped at ImageData.
+
+  @return  Whether Context has been initialized successfully.
+
+**/
+BOOLEAN
+MachoInitializeLoadedContext (
+  OUT OC_MACHO_CONTEXT  *Context,
+  IN  VOID              *ImageData,
+  IN  UINT32            MaxImageSize
+  )
+{
+  CONST MACH_SEGMENT_COMMAND_64 *Segment;
+  CONST MACH_SEGMENT_COMMAND_64 *HeaderSegment;
+  MACH_SYMTAB_COMMAND           *Symtab;
+  UINT64                        LastAddress;
+  UINT64                        TopOfSegment;
+  UINT64                        ImageSize;
+  UINT64                        SymbolsOffset;
+  UINT64                        StringsOffset;
+  MACH_NLIST_64                 *SymbolTable;
+  CHAR8                         *StringTable;
+
+  ASSERT (Context != NULL);
+  ASSERT (ImageData != NULL);
+
+  if (!MachoInitializeContext (Context, ImageData, MaxImageSize)) {
+    return FALSE;
+  }
+
+  HeaderSegment = NULL;
+  LastAddress   = 0;
+
+  for (
+    Segment = MachoGetNextSegment64 (Context, NULL);
+    Segment != NULL;
+    Segment = MachoGetNextSegment64 (Context, Segment)
+    ) {
+    if ((HeaderSegment == NULL)
+     && (Segment->FileOffset == 0)
+     && (Segment->FileSize > 0)) {
+      HeaderSegment = Segment;
+    }
+
+    if (OcOverflowAddU64 (Segment->VirtualAddress, Segment->Size, &TopOfSegment)) {
+      return FALSE;
+    }
+
+    if (TopOfSegment > LastAddress) {
+      LastAddress = TopOfSegment;
+    }
+  }
+
+  if (HeaderSegment == NULL) {
+    return FALSE;
+  }
+
+  ImageSize = LastAddress - HeaderSegment->VirtualAddress;
+  if (ImageSize > MaxImageSize) {
+    return FALSE;
+  }
+
+  Symtab = (MACH_SYMTAB_COMMAND *)(
+             InternalGetNextCommand64 (
+               Context,
+               MACH_LOAD_COMMAND_SYMTAB,
+               NULL
+               )
+             );
+  if ((Symtab == NULL)
+   || !OC_ALIGNED (Symtab)
+   || (Symtab->CommandSize != sizeof (*Symtab))
+   || (Symtab->NumSymbols == 0)
+   || (Symtab->StringsSize == 0)) {
+    return FALSE;
+  }
+
+  SymbolsOffset = InternalGetLoadedOffset64 (
+                    Context,
+                    HeaderSegment->VirtualAddress,
+                    ImageSize,
+                    Symtab->SymbolsOffset,
+                    MultU64x32 (sizeof (MACH_NLIST_64), Symtab->NumSymbols)
+                    );
+  StringsOffset = InternalGetLoadedOffset64 (
+                    Context,
+                    HeaderSegment->VirtualAddress,
+                    ImageSize,
+                    Symtab->StringsOffset,
+                    Symtab->StringsSize
+                    );
+  if ((SymbolsOffset == MAX_UINT64) || (StringsOffset == MAX_UINT64)) {
+    return FALSE;
+  }
+
+  StringTable = (CHAR8 *)((UINTN)Context->MachHeader + (UINTN)StringsOffset);
+  if (StringTable[Symtab->StringsSize - 1] != '\0') {
+    return FALSE;
+  }
+
+  SymbolTable = (MACH_NLIST_64 *)((UINTN)Context->MachHeader + (UINTN)SymbolsOffset);
+  if (!OC_ALIGNED (SymbolTable)) {
+    return FALSE;
+  }
+  //
+  // With SymbolTable set, InternalRetrieveSymtabs64() will not look for the
+  // tables at their file offsets.  DYSYMTAB is not needed to locate symbols.
+  //
+  Context->Symtab      = Symtab;
+  Context->SymbolTable = SymbolTable;
+  Context->StringTable = StringTable;
+
+  return TRUE;
+}
+
 UINT32
 MachoGetSymbolTable (
   IN OUT OC_MACHO_CONTEXT     *Context,
@@ -638,3 +638,62 @@ MachoSymbolGetFileOffset64 (
 
   return TRUE;
 }
+
+/**
+  Retrieves the size of the code or data Symbol labels.  It extends to the
+  next higher section symbol or to the end of Symbol's section.
+
+  @param[in,out] Context  Context of the Mach-O.
+  @param[in]     Symbol   Symbol to retrieve the size of.
+  @param[out]    Size     Pointer the size is returned into.
+                          If FALSE is returned, the output is undefined.
+
+  @returns  Whether Symbol labels a valid section address.
+
+**/
+BOOLEAN
+MachoSymbolGetSize64 (
+  IN OUT OC_MACHO_CONTEXT     *Context,
+  IN     CONST MACH_NLIST_64  *Symbol,
+  OUT    UINT64               *Size
+  )
+{
+  CONST MACH_SECTION_64 *Section;
+  CONST MACH_NLIST_64   *Candidate;
+  UINT64                Top;
+  UINT32                Index;
+
+  ASSERT (Context != NULL);
+  ASSERT (Symbol != NULL);
+  ASSERT (Size != NULL);
+
+  if (!MachoSymbolIsSection (Symbol) || !InternalRetrieveSymtabs64 (Context)) {
+    return FALSE;
+  }
+
+  Section = MachoGetSectionByIndex64 (
+              Context,
+              (Symbol->Section - 1)
+              );
+  if ((Section == NULL) || (Symbol->Value < Section->Address)) {
+    return FALSE;
+  }
+
+  Top = (Section->Address + Section->Size);
+  if (Symbol->Value >= Top) {
+    return FALSE;
+  }
+
+  for (Index = 0; Index < Context->Symtab->NumSymbols; ++Index) {
+    Candidate = &Context->SymbolTable[Index];
+    if ((Candidate->Value > Symbol->Value)
+     && (Candidate->Value < Top)
+     && MachoSymbolIsSection (Candidate)) {
+      Top = Candidate->Value;
+    }
+  }
+
+  *Size = (Top - Symbol->Value);
+
+  return TRUE;
+}
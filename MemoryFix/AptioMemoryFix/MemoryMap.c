@@ -38,6 +38,108 @@ STATIC CHAR16 *mEfiMemoryTypeDesc[EfiMaxMemoryType] = {
   L"PAL_code"
 };
 
+/** Swaps two mem map records in place, any descriptor size. */
+STATIC
+VOID
+SwapMemoryDescriptors (
+  IN OUT EFI_MEMORY_DESCRIPTOR  *Desc1,
+  IN OUT EFI_MEMORY_DESCRIPTOR  *Desc2,
+  IN     UINTN                  DescriptorSize
+  )
+{
+  UINT8   *Byte1;
+  UINT8   *Byte2;
+  UINT8   Temp;
+
+  Byte1 = (UINT8 *)Desc1;
+  Byte2 = (UINT8 *)Desc2;
+  while (DescriptorSize-- > 0) {
+    Temp     = *Byte1;
+    *Byte1++ = *Byte2;
+    *Byte2++ = Temp;
+  }
+}
+
+/** Heap sort step: moves the record at Root down the heap of the first End records. */
+STATIC
+VOID
+SiftMemoryDescriptor (
+  IN OUT EFI_MEMORY_DESCRIPTOR  *MemoryMap,
+  IN     UINTN                  DescriptorSize,
+  IN     UINTN                  Root,
+  IN     UINTN                  End
+  )
+{
+  UINTN                   Child;
+  EFI_MEMORY_DESCRIPTOR   *RootDesc;
+  EFI_MEMORY_DESCRIPTOR   *Desc;
+
+  while ((Child = 2 * Root + 1) < End) {
+    Desc = MEMORY_DESCRIPTOR_AT (MemoryMap, Child, DescriptorSize);
+    if (Child + 1 < End && Desc->PhysicalStart < NEXT_MEMORY_DESCRIPTOR (Desc, DescriptorSize)->PhysicalStart) {
+      Child++;
+      Desc = NEXT_MEMORY_DESCRIPTOR (Desc, DescriptorSize);
+    }
+    RootDesc = MEMORY_DESCRIPTOR_AT (MemoryMap, Root, DescriptorSize);
+    if (RootDesc->PhysicalStart >= Desc->PhysicalStart) {
+      break;
+    }
+    SwapMemoryDescriptors (RootDesc, Desc, DescriptorSize);
+    Root = Child;
+  }
+}
+
+VOID
+SortMemoryMap (
+  IN     UINTN                  MemoryMapSize,
+  IN OUT EFI_MEMORY_DESCRIPTOR  *MemoryMap,
+  IN     UINTN                  DescriptorSize
+  )
+{
+  UINTN                   NumEntries;
+  UINTN                   Index;
+
+  NumEntries = MemoryMapSize / DescriptorSize;
+
+  //
+  // Firmware maps are nearly always sorted already.
+  //
+  for (Index = 1; Index < NumEntries; Index++) {
+    if (MEMORY_DESCRIPTOR_AT (MemoryMap, Index - 1, DescriptorSize)->PhysicalStart >
+      MEMORY_DESCRIPTOR_AT (MemoryMap, Index, DescriptorSize)->PhysicalStart) {
+      break;
+    }
+  }
+  if (Index >= NumEntries) {
+    return;
+  }
+
+  //
+  // Heap sort: in place and with no allocations, which matters in the GetMemoryMap override.
+  //
+  for (Index = NumEntries / 2; Index > 0; Index--) {
+    SiftMemoryDescriptor (MemoryMap, DescriptorSize, Index - 1, NumEntries);
+  }
+  for (Index = NumEntries - 1; Index > 0; Index--) {
+    SwapMemoryDescriptors (MemoryMap, MEMORY_DESCRIPTOR_AT (MemoryMap, Index, DescriptorSize), DescriptorSize);
+    SiftMemoryDescriptor (MemoryMap, DescriptorSize, 0, Index);
+  }
+}
+
+/** Memory types that may be reported as one free block once boot.efi gets the map. */
+STATIC
+BOOLEAN
+IsJoinableMemoryType (
+  IN UINT32  Type
+  )
+{
+  return Type == EfiBootServicesCode ||
+    Type == EfiBootServicesData ||
+    Type == EfiConventionalMemory ||
+    Type == EfiLoaderCode ||
+    Type == EfiLoaderData;
+}
+
 VOID
 ShrinkMemMap (
   IN OUT UINTN                  *MemoryMapSize,
@@ -45,66 +147,118 @@ ShrinkMemMap (
   IN     UINTN                  DescriptorSize
   )
 {
-  UINTN                   SizeFromDescToEnd;
-  UINT64                  Bytes;
+  UINTN                   NumEntries;
+  UINTN                   Index;
   EFI_MEMORY_DESCRIPTOR   *PrevDesc;
   EFI_MEMORY_DESCRIPTOR   *Desc;
-  BOOLEAN                 CanBeJoined;
-  BOOLEAN                 HasEntriesToRemove;
-
-  PrevDesc           = MemoryMap;
-  Desc               = NEXT_MEMORY_DESCRIPTOR (PrevDesc, DescriptorSize);
-  SizeFromDescToEnd  = *MemoryMapSize - DescriptorSize;
-  *MemoryMapSize     = DescriptorSize;
-  HasEntriesToRemove = FALSE;
-
-  while (SizeFromDescToEnd > 0) {
-    Bytes = EFI_PAGES_TO_SIZE (PrevDesc->NumberOfPages);
-    CanBeJoined = FALSE;
-    if (Desc->Attribute == PrevDesc->Attribute && PrevDesc->PhysicalStart + Bytes == Desc->PhysicalStart) {
-      //
-      // It *should* be safe to join this with conventional memory, because the firmware should not use
-      // GetMemoryMap for allocation, and for the kernel it does not matter, since it joins them.
-      //
-      CanBeJoined = (Desc->Type == EfiBootServicesCode ||
-        Desc->Type == EfiBootServicesData ||
-        Desc->Type == EfiConventionalMemory ||
-        Desc->Type == EfiLoaderCode ||
-        Desc->Type == EfiLoaderData) && (
-        PrevDesc->Type == EfiBootServicesCode ||
-        PrevDesc->Type == EfiBootServicesData ||
-        PrevDesc->Type == EfiConventionalMemory ||
-        PrevDesc->Type == EfiLoaderCode ||
-        PrevDesc->Type == EfiLoaderData);
-    }
 
-    if (CanBeJoined) {
-      //
-      // Two entries are the same/similar - join them
-      //
+  NumEntries = *MemoryMapSize / DescriptorSize;
+  if (NumEntries < 2) {
+    return;
+  }
+
+  SortMemoryMap (*MemoryMapSize, MemoryMap, DescriptorSize);
+
+  //
+  // PrevDesc is the last record kept, so every record is written at most once.
+  //
+  PrevDesc = MemoryMap;
+  Desc     = NEXT_MEMORY_DESCRIPTOR (PrevDesc, DescriptorSize);
+
+  for (Index = 1; Index < NumEntries; Index++) {
+    //
+    // It *should* be safe to join this with conventional memory, because the firmware should not use
+    // GetMemoryMap for allocation, and for the kernel it does not matter, since it joins them.
+    //
+    if (Desc->Attribute == PrevDesc->Attribute &&
+      PrevDesc->PhysicalStart + EFI_PAGES_TO_SIZE (PrevDesc->NumberOfPages) == Desc->PhysicalStart &&
+      IsJoinableMemoryType (Desc->Type) && IsJoinableMemoryType (PrevDesc->Type)) {
       PrevDesc->Type = EfiConventionalMemory;
       PrevDesc->NumberOfPages += Desc->NumberOfPages;
-      HasEntriesToRemove = TRUE;
     } else {
-      //
-      // Cannot be joined - we need to move to next
-      //
-      *MemoryMapSize += DescriptorSize;
       PrevDesc = NEXT_MEMORY_DESCRIPTOR (PrevDesc, DescriptorSize);
-      if (HasEntriesToRemove) {
-        //
-        // Have entries between PrevDesc and Desc which are joined to PrevDesc,
-        // we need to copy [Desc, end of list] to PrevDesc + 1
-        //
-        CopyMem(PrevDesc, Desc, SizeFromDescToEnd);
-        Desc = PrevDesc;
-        HasEntriesToRemove = FALSE;
+      if (PrevDesc != Desc) {
+        CopyMem (PrevDesc, Desc, DescriptorSize);
       }
     }
 
     Desc = NEXT_MEMORY_DESCRIPTOR (Desc, DescriptorSize);
-    SizeFromDescToEnd -= DescriptorSize;
   }
+
+  *MemoryMapSize = (UINT8 *)PrevDesc - (UINT8 *)MemoryMap + DescriptorSize;
+}
+
+UINTN
+BuildFreeMemoryIndex (
+  IN OUT UINTN                  *MemoryMapSize,
+  IN OUT EFI_MEMORY_DESCRIPTOR  *MemoryMap,
+  IN     UINTN                  DescriptorSize
+  )
+{
+  UINTN                   NumEntries;
+  UINTN                   Index;
+  UINTN                   Count;
+  EFI_MEMORY_DESCRIPTOR   *FreeDesc;
+  EFI_MEMORY_DESCRIPTOR   *Desc;
+
+  NumEntries = *MemoryMapSize / DescriptorSize;
+  Desc       = MemoryMap;
+  Count      = 0;
+
+  for (Index = 0; Index < NumEntries; Index++) {
+    if (Desc->Type == EfiConventionalMemory) {
+      FreeDesc = MEMORY_DESCRIPTOR_AT (MemoryMap, Count, DescriptorSize);
+      if (FreeDesc != Desc) {
+        CopyMem (FreeDesc, Desc, DescriptorSize);
+      }
+      Count++;
+    }
+    Desc = NEXT_MEMORY_DESCRIPTOR (Desc, DescriptorSize);
+  }
+
+  //
+  // Sort, and join free neighbours with equal attributes the firmware left apart.
+  //
+  *MemoryMapSize = Count * DescriptorSize;
+  if (Count > 1) {
+    ShrinkMemMap (MemoryMapSize, MemoryMap, DescriptorSize);
+    Count = *MemoryMapSize / DescriptorSize;
+  }
+
+  return Count;
+}
+
+EFI_MEMORY_DESCRIPTOR *
+FindFreeMemoryBelow (
+  IN UINTN                  IndexSize,
+  IN EFI_MEMORY_DESCRIPTOR  *Index,
+  IN UINTN                  DescriptorSize,
+  IN EFI_PHYSICAL_ADDRESS   Address
+  )
+{
+  UINTN                   Low;
+  UINTN                   High;
+  UINTN                   Middle;
+
+  //
+  // Count the records starting below Address, the last of them is the answer.
+  //
+  Low  = 0;
+  High = IndexSize / DescriptorSize;
+  while (Low < High) {
+    Middle = Low + (High - Low) / 2;
+    if (MEMORY_DESCRIPTOR_AT (Index, Middle, DescriptorSize)->PhysicalStart < Address) {
+      Low = Middle + 1;
+    } else {
+      High = Middle;
+    }
+  }
+
+  if (Low == 0) {
+    return NULL;
+  }
+
+  return MEMORY_DESCRIPTOR_AT (Index, Low - 1, DescriptorSize);
 }
 
 /** AMI CSM module allocates up to two regions for legacy video output.
@@ -310,7 +464,6 @@ AllocatePagesFromTop (
   UINTN                   MapKey;
   UINTN                   DescriptorSize;
   UINT32                  DescriptorVersion;
-  EFI_MEMORY_DESCRIPTOR   *MemoryMapEnd;
   EFI_MEMORY_DESCRIPTOR   *Desc;
 
   Status = GetMemoryMapAlloc (NULL, &MemoryMapSize, &MemoryMap, &MapKey, &DescriptorSize, &DescriptorVersion);
@@ -320,15 +473,17 @@ AllocatePagesFromTop (
 
   Status = EFI_NOT_FOUND;
 
-  MemoryMapEnd = NEXT_MEMORY_DESCRIPTOR (MemoryMap, MemoryMapSize);
-  Desc = PREV_MEMORY_DESCRIPTOR (MemoryMapEnd, DescriptorSize);
+  //
+  // Only free records starting below Memory can hold the allocation, walk them from the top.
+  //
+  BuildFreeMemoryIndex (&MemoryMapSize, MemoryMap, DescriptorSize);
+  Desc = FindFreeMemoryBelow (MemoryMapSize, MemoryMap, DescriptorSize, *Memory);
 
-  for ( ; Desc >= MemoryMap; Desc = PREV_MEMORY_DESCRIPTOR (Desc, DescriptorSize)) {
+  for ( ; Desc != NULL && Desc >= MemoryMap; Desc = PREV_MEMORY_DESCRIPTOR (Desc, DescriptorSize)) {
     //
     // We are looking for some free memory descriptor that contains enough space below the specified memory
     // 
-    if (Desc->Type == EfiConventionalMemory && Pages <= Desc->NumberOfPages &&
-      Desc->PhysicalStart + EFI_PAGES_TO_SIZE (Pages) <= *Memory) {
+    if (Pages <= Desc->NumberOfPages && Desc->PhysicalStart + EFI_PAGES_TO_SIZE (Pages) <= *Memory) {
       //
       // Free block found
       //
@@ -13,7 +13,19 @@
 #define PREV_MEMORY_DESCRIPTOR(MemoryDescriptor, Size) \
   ((EFI_MEMORY_DESCRIPTOR *)((UINT8 *)(MemoryDescriptor) - (Size)))
 
-/** Shrinks mem map by joining non-runtime records. */
+/** MemMap record by index */
+#define MEMORY_DESCRIPTOR_AT(MemoryMap, Index, Size) \
+  ((EFI_MEMORY_DESCRIPTOR *)((UINT8 *)(MemoryMap) + (Index) * (Size)))
+
+/** Sorts mem map records by physical address, in place. */
+VOID
+SortMemoryMap (
+  IN     UINTN                  MemoryMapSize,
+  IN OUT EFI_MEMORY_DESCRIPTOR  *MemoryMap,
+  IN     UINTN                  DescriptorSize
+  );
+
+/** Shrinks mem map by sorting it and joining adjacent non-runtime records. */
 VOID
 ShrinkMemMap (
   IN OUT UINTN                  *MemoryMapSize,
@@ -21,6 +33,23 @@ ShrinkMemMap (
   IN     UINTN                  DescriptorSize
   );
 
+/** Compacts mem map in place to its sorted, joined EfiConventionalMemory records. Returns their number. */
+UINTN
+BuildFreeMemoryIndex (
+  IN OUT UINTN                  *MemoryMapSize,
+  IN OUT EFI_MEMORY_DESCRIPTOR  *MemoryMap,
+  IN     UINTN                  DescriptorSize
+  );
+
+/** Returns the highest record of a BuildFreeMemoryIndex map starting below Address, or NULL. */
+EFI_MEMORY_DESCRIPTOR *
+FindFreeMemoryBelow (
+  IN UINTN                  IndexSize,
+  IN EFI_MEMORY_DESCRIPTOR  *Index,
+  IN UINTN                  DescriptorSize,
+  IN EFI_PHYSICAL_ADDRESS   Address
+  );
+
 /** Protects AMI CSM region from being overwritten by the kernel. */
 VOID
 ProtectCsmRegion (
@@ -320,34 +320,20 @@ VmAllocatePages (
   return AllocatedPages;
 }
 
-/** Maps (remaps) 4K page given by VirtualAddr to PhysicalAddr page in PageTable. */
-EFI_STATUS
-VmMapVirtualPage (
+/** Returns PDPE table for the PML4 entry of VA, creating it with 1GB identity mapping if not present. */
+STATIC
+PAGE_MAP_AND_DIRECTORY_POINTER *
+VmGetPdpeTable (
   PAGE_MAP_AND_DIRECTORY_POINTER  *PageTable,
-  EFI_VIRTUAL_ADDRESS             VirtualAddr,
-  EFI_PHYSICAL_ADDRESS            PhysicalAddr
+  VIRTUAL_ADDR                    VA
   )
 {
   EFI_PHYSICAL_ADDRESS            Start;
-  VIRTUAL_ADDR                    VA;
-  VIRTUAL_ADDR                    VAStart;
-  VIRTUAL_ADDR                    VAEnd;
   PAGE_MAP_AND_DIRECTORY_POINTER  *PML4;
   PAGE_MAP_AND_DIRECTORY_POINTER  *PDPE;
-  PAGE_MAP_AND_DIRECTORY_POINTER  *PDE;
-  PAGE_TABLE_4K_ENTRY             *PTE4K;
-  PAGE_TABLE_4K_ENTRY             *PTE4KTmp;
-  PAGE_TABLE_2M_ENTRY             *PTE2M;
   PAGE_TABLE_1G_ENTRY             *PTE1G;
   UINTN                           Index;
 
-  VA.Uint64 = (UINT64)VirtualAddr;
-  //VA_FIX_SIGN_EXTEND(VA);
-  DEBUG ((DEBUG_VERBOSE, "VmMapVirtualPage VA %lx => PA %lx\nPageTable: %p\n", VirtualAddr, PhysicalAddr, PageTable));
-  DEBUG ((DEBUG_VERBOSE, "VA: %lx => Indexes PML4=%x, PDP=%x, PD=%x, PT=%x\n",
-    VA.Uint64, VA.Pg4K.PML4Offset, VA.Pg4K.PDPOffset, VA.Pg4K.PDOffset, VA.Pg4K.PTOffset));
-
-  // PML4
   PML4 = PageTable;
   PML4 += VA.Pg4K.PML4Offset;
   // there is a problem if our PML4 points to the same table as first PML4 entry
@@ -358,21 +344,12 @@ VmMapVirtualPage (
     PML4->Uint64 = 0;
   }
 
-  // prepare region start and end
-  VAStart.Uint64 = 0;
-  VAStart.Pg4K.PML4Offset = VA.Pg4K.PML4Offset;
-  VA_FIX_SIGN_EXTEND(VAStart);
-  VAEnd.Uint64 = ~(UINT64)0;
-  VAEnd.Pg4K.PML4Offset = VA.Pg4K.PML4Offset;
-  VA_FIX_SIGN_EXTEND(VAEnd);
-  // print it
-  DEBUG ((DEBUG_VERBOSE, "PML4[%03x] at %p = %lx Region: %lx - %lx\n", VA.Pg4K.PML4Offset, PML4, PML4->Uint64, VAStart.Uint64, VAEnd.Uint64));
   if (!PML4->Bits.Present) {
-    DEBUG ((DEBUG_VERBOSE, "-> Mapping not present, creating new PML4 entry and page with PDPE entries!\n"));
+    DEBUG ((DEBUG_VERBOSE, "PML4[%03x] not present, creating new PML4 entry and page with PDPE entries!\n", VA.Pg4K.PML4Offset));
     PDPE = (PAGE_MAP_AND_DIRECTORY_POINTER *)VmAllocatePages(1);
     if (PDPE == NULL) {
       DEBUG ((DEBUG_VERBOSE, "No memory - exiting.\n"));
-      return EFI_NO_MAPPING;
+      return NULL;
     }
 
     ZeroMem(PDPE, EFI_PAGE_SIZE);
@@ -393,33 +370,34 @@ VmMapVirtualPage (
     PML4->Bits.ReadWrite = 1;
     PML4->Bits.Present = 1;
     DEBUG ((DEBUG_VERBOSE, "added to PLM4 as %lx\n", PML4->Uint64));
-    // and continue with mapping ...
   }
-  DEBUG ((DEBUG_VERBOSE, "-> Nx:%x|A:%x|PCD:%x|PWT:%x|US:%x|RW:%x|P:%x -> %lx\n",
-    PML4->Bits.Nx, PML4->Bits.Accessed,
-    PML4->Bits.CacheDisabled, PML4->Bits.WriteThrough,
-    PML4->Bits.UserSupervisor, PML4->Bits.ReadWrite, PML4->Bits.Present,
-    (PML4->Uint64 & PT_ADDR_MASK_4K)
-    ));
 
-  // PDPE
-  PDPE = (PAGE_MAP_AND_DIRECTORY_POINTER *)(PML4->Uint64 & PT_ADDR_MASK_4K);
-  PDPE += VA.Pg4K.PDPOffset;
-  VAStart.Pg4K.PDPOffset = VA.Pg4K.PDPOffset;
-  VAEnd.Pg4K.PDPOffset = VA.Pg4K.PDPOffset;
-  DEBUG ((DEBUG_VERBOSE, "PDPE[%03x] at %p = %lx Region: %lx - %lx\n", VA.Pg4K.PDPOffset, PDPE, PDPE->Uint64, VAStart.Uint64, VAEnd.Uint64));
+  return (PAGE_MAP_AND_DIRECTORY_POINTER *)(PML4->Uint64 & PT_ADDR_MASK_4K);
+}
+
+/** Returns PDE table for given PDPE entry, creating it if not present or splitting 1GB page into 2MB pages. */
+STATIC
+PAGE_MAP_AND_DIRECTORY_POINTER *
+VmGetPdeTable (
+  PAGE_MAP_AND_DIRECTORY_POINTER  *PDPE
+  )
+{
+  EFI_PHYSICAL_ADDRESS            Start;
+  PAGE_MAP_AND_DIRECTORY_POINTER  *PDE;
+  PAGE_TABLE_2M_ENTRY             *PTE2M;
+  UINTN                           Index;
+
   if (!PDPE->Bits.Present || (PDPE->Bits.MustBeZero & 0x1)) {
-    DEBUG ((DEBUG_VERBOSE, "-> Mapping not present or mapped as 1GB page, creating new PDPE entry and page with PDE entries!\n"));
+    DEBUG ((DEBUG_VERBOSE, "PDPE at %p = %lx not present or mapped as 1GB page, creating new PDPE entry and page with PDE entries!\n", PDPE, PDPE->Uint64));
     PDE = (PAGE_MAP_AND_DIRECTORY_POINTER *)VmAllocatePages(1);
     if (PDE == NULL) {
       DEBUG ((DEBUG_VERBOSE, "No memory - exiting.\n"));
-      return EFI_NO_MAPPING;
+      return NULL;
     }
     ZeroMem(PDE, EFI_PAGE_SIZE);
 
     if (PDPE->Bits.MustBeZero & 0x1) {
       // was 1GB page - init new PDE array to get the same mapping but with 2MB pages
-      DEBUG ((DEBUG_VERBOSE, "-> was 1GB page, initing new PDE array to get the same mapping but with 2MB pages!\n"));
       PTE2M = (PAGE_TABLE_2M_ENTRY *)PDE;
       Start = (PDPE->Uint64 & PT_ADDR_MASK_1G);
       for (Index = 0; Index < 512; Index++) {
@@ -437,33 +415,34 @@ VmMapVirtualPage (
     PDPE->Bits.ReadWrite = 1;
     PDPE->Bits.Present = 1;
     DEBUG ((DEBUG_VERBOSE, "added to PDPE as %lx\n", PDPE->Uint64));
-    // and continue with mapping ...
   }
-  DEBUG ((DEBUG_VERBOSE, "-> Nx:%x|A:%x|PCD:%x|PWT:%x|US:%x|RW:%x|P:%x -> %lx\n",
-    PDPE->Bits.Nx, PDPE->Bits.Accessed,
-    PDPE->Bits.CacheDisabled, PDPE->Bits.WriteThrough,
-    PDPE->Bits.UserSupervisor, PDPE->Bits.ReadWrite, PDPE->Bits.Present,
-    (PDPE->Uint64 & PT_ADDR_MASK_4K)
-    ));
 
-  // PDE
-  PDE = (PAGE_MAP_AND_DIRECTORY_POINTER *)(PDPE->Uint64 & PT_ADDR_MASK_4K);
-  PDE += VA.Pg4K.PDOffset;
-  VAStart.Pg4K.PDOffset = VA.Pg4K.PDOffset;
-  VAEnd.Pg4K.PDOffset = VA.Pg4K.PDOffset;
-  DEBUG ((DEBUG_VERBOSE, "PDE[%03x] at %p = %lx Region: %lx - %lx\n", VA.Pg4K.PDOffset, PDE, PDE->Uint64, VAStart.Uint64, VAEnd.Uint64));
+  return (PAGE_MAP_AND_DIRECTORY_POINTER *)(PDPE->Uint64 & PT_ADDR_MASK_4K);
+}
+
+/** Returns PTE table for given PDE entry, creating it if not present or splitting 2MB page into 4KB pages. */
+STATIC
+PAGE_TABLE_4K_ENTRY *
+VmGetPteTable (
+  PAGE_MAP_AND_DIRECTORY_POINTER  *PDE
+  )
+{
+  EFI_PHYSICAL_ADDRESS            Start;
+  PAGE_TABLE_4K_ENTRY             *PTE4K;
+  PAGE_TABLE_4K_ENTRY             *PTE4KTmp;
+  UINTN                           Index;
+
   if (!PDE->Bits.Present || (PDE->Bits.MustBeZero & 0x1)) {
-    DEBUG ((DEBUG_VERBOSE, "-> Mapping not present or mapped as 2MB page, creating new PDE entry and page with PTE4K entries!\n"));
+    DEBUG ((DEBUG_VERBOSE, "PDE at %p = %lx not present or mapped as 2MB page, creating new PDE entry and page with PTE4K entries!\n", PDE, PDE->Uint64));
     PTE4K = (PAGE_TABLE_4K_ENTRY *)VmAllocatePages(1);
     if (PTE4K == NULL) {
       DEBUG ((DEBUG_VERBOSE, "No memory - exiting.\n"));
-      return EFI_NO_MAPPING;
+      return NULL;
     }
     ZeroMem(PTE4K, EFI_PAGE_SIZE);
 
     if (PDE->Bits.MustBeZero & 0x1) {
       // was 2MB page - init new PTE array to get the same mapping but with 4KB pages
-      DEBUG ((DEBUG_VERBOSE, "-> was 2MB page - initing new PTE array to get the same mapping but with 4KB pages!\n"));
       PTE4KTmp = (PAGE_TABLE_4K_ENTRY *)PTE4K;
       Start = (PDE->Uint64 & PT_ADDR_MASK_2M);
       for (Index = 0; Index < 512; Index++) {
@@ -480,42 +459,52 @@ VmMapVirtualPage (
     PDE->Bits.ReadWrite = 1;
     PDE->Bits.Present = 1;
     DEBUG ((DEBUG_VERBOSE, "added to PDE as %lx\n", PDE->Uint64));
-    // and continue with mapping ...
   }
-  DEBUG ((DEBUG_VERBOSE, "-> Nx:%x|A:%x|PCD:%x|PWT:%x|US:%x|RW:%x|P:%x -> %lx\n",
-    PDE->Bits.Nx, PDE->Bits.Accessed,
-    PDE->Bits.CacheDisabled, PDE->Bits.WriteThrough,
-    PDE->Bits.UserSupervisor, PDE->Bits.ReadWrite, PDE->Bits.Present,
-    (PDE->Uint64 & PT_ADDR_MASK_4K)
-    ));
 
-  // PTE
-  PTE4K = (PAGE_TABLE_4K_ENTRY *)(PDE->Uint64 & PT_ADDR_MASK_4K);
-  PTE4K += VA.Pg4K.PTOffset;
-  VAStart.Pg4K.PTOffset = VA.Pg4K.PTOffset;
-  VAEnd.Pg4K.PTOffset = VA.Pg4K.PTOffset;
-  DEBUG ((DEBUG_VERBOSE, "PTE[%03x] at %p = %lx Region: %lx - %lx\n", VA.Pg4K.PTOffset, PTE4K, PTE4K->Uint64, VAStart.Uint64, VAEnd.Uint64));
-  if (PTE4K->Bits.Present) {
-    DEBUG ((DEBUG_VERBOSE, "mapping already present - remapping!\n"));
-  }
-  DEBUG ((DEBUG_VERBOSE, "-> Nx:%x|G:%x|PAT:%x|D:%x|A:%x|PCD:%x|PWT:%x|US:%x|RW:%x|P:%x -> %lx\n",
-    PTE4K->Bits.Nx, PTE4K->Bits.Global, PTE4K->Bits.PAT,
-    PTE4K->Bits.Dirty, PTE4K->Bits.Accessed,
-    PTE4K->Bits.CacheDisabled, PTE4K->Bits.WriteThrough,
-    PTE4K->Bits.UserSupervisor, PTE4K->Bits.ReadWrite, PTE4K->Bits.Present,
-    (PTE4K->Uint64 & PT_ADDR_MASK_4K)
-    ));
-  // put it to PTE
-  PTE4K->Uint64 = ((UINT64)PhysicalAddr) & PT_ADDR_MASK_4K;
-  PTE4K->Bits.ReadWrite = 1;
-  PTE4K->Bits.Present = 1;
-  DEBUG ((DEBUG_VERBOSE, "added to PTE4K as %lx\n", PTE4K->Uint64));
+  return (PAGE_TABLE_4K_ENTRY *)(PDE->Uint64 & PT_ADDR_MASK_4K);
+}
 
-  return EFI_SUCCESS;
+/** Maps (remaps) 4K page given by VirtualAddr to PhysicalAddr page in PageTable. */
+EFI_STATUS
+VmMapVirtualPage (
+  PAGE_MAP_AND_DIRECTORY_POINTER  *PageTable,
+  EFI_VIRTUAL_ADDRESS             VirtualAddr,
+  EFI_PHYSICAL_ADDRESS            PhysicalAddr
+  )
+{
+  return VmMapVirtualPages (PageTable, VirtualAddr, 1, PhysicalAddr);
+}
+
+STATIC BOOLEAN mPage1GSupported;
+STATIC BOOLEAN mPage1GSupportedSet;
+
+/** Returns TRUE if the CPU supports 1GB pages (CPUID.80000001h:EDX[26]). */
+STATIC
+BOOLEAN
+VmIsPage1GSupported (
+  VOID
+  )
+{
+  UINT32  MaxExtLeaf;
+  UINT32  Edx;
+
+  if (!mPage1GSupportedSet) {
+    AsmCpuid (0x80000000, &MaxExtLeaf, NULL, NULL, NULL);
+    if (MaxExtLeaf >= 0x80000001) {
+      AsmCpuid (0x80000001, NULL, NULL, NULL, &Edx);
+      mPage1GSupported = (Edx & BIT26) != 0;
+    }
+    mPage1GSupportedSet = TRUE;
+  }
 
+  return mPage1GSupported;
 }
 
-/** Maps (remaps) NumPages 4K pages given by VirtualAddr to PhysicalAddr pages in PageTable. */
+/** Maps (remaps) NumPages 4K pages given by VirtualAddr to PhysicalAddr pages in PageTable.
+  * Tables are walked once per table, not per page, and whole 2MB pages are used
+  * where both addresses are aligned, 1GB pages too if the CPU supports them.
+  * TLB is not flushed, call VmFlushCaches after the batch.
+  */
 EFI_STATUS
 VmMapVirtualPages (
   PAGE_MAP_AND_DIRECTORY_POINTER  *PageTable,
@@ -524,17 +513,86 @@ VmMapVirtualPages (
   EFI_PHYSICAL_ADDRESS            PhysicalAddr
   )
 {
-  EFI_STATUS  Status;
-
-  Status = EFI_SUCCESS;
-  while (NumPages > 0 && (Status == EFI_SUCCESS)) {
-    Status = VmMapVirtualPage(PageTable, VirtualAddr, PhysicalAddr);
-    VirtualAddr += 0x1000;
-    PhysicalAddr += 0x1000;
-    NumPages--;
-    DEBUG ((DEBUG_VERBOSE, "NumPages: %d, %lx => %lx\n", NumPages, VirtualAddr, PhysicalAddr));
+  VIRTUAL_ADDR                    VA;
+  PAGE_MAP_AND_DIRECTORY_POINTER  *PDPE;
+  PAGE_MAP_AND_DIRECTORY_POINTER  *PDE;
+  PAGE_TABLE_4K_ENTRY             *PTE4K;
+  PAGE_TABLE_2M_ENTRY             *PTE2M;
+  PAGE_TABLE_1G_ENTRY             *PTE1G;
+  UINT64                          Size;
+
+  DEBUG ((DEBUG_VERBOSE, "VmMapVirtualPages VA %lx => PA %lx, NumPages: %d\n", VirtualAddr, PhysicalAddr, NumPages));
+
+  //
+  // Tables of the last walk, valid until VA crosses into the region of the next table.
+  //
+  PDPE  = NULL;
+  PDE   = NULL;
+  PTE4K = NULL;
+
+  while (NumPages > 0) {
+    VA.Uint64 = (UINT64)VirtualAddr;
+    if ((VA.Uint64 & (0x200000 - 1)) == 0) {
+      PTE4K = NULL;
+    }
+    if ((VA.Uint64 & (0x40000000 - 1)) == 0) {
+      PDE = NULL;
+    }
+    if ((VA.Uint64 & (0x8000000000 - 1)) == 0) {
+      PDPE = NULL;
+    }
+
+    if (PDPE == NULL) {
+      PDPE = VmGetPdpeTable (PageTable, VA);
+      if (PDPE == NULL) {
+        return EFI_NO_MAPPING;
+      }
+    }
+
+    if (((VirtualAddr | PhysicalAddr) & (0x40000000 - 1)) == 0 && NumPages >= EFI_SIZE_TO_PAGES (0x40000000) &&
+      VmIsPage1GSupported ()) {
+      PTE1G = (PAGE_TABLE_1G_ENTRY *)(PDPE + VA.Pg4K.PDPOffset);
+      PTE1G->Uint64 = ((UINT64)PhysicalAddr) & PT_ADDR_MASK_1G;
+      PTE1G->Bits.ReadWrite = 1;
+      PTE1G->Bits.Present = 1;
+      PTE1G->Bits.MustBe1 = 1;
+      Size = 0x40000000;
+    } else {
+      if (PDE == NULL) {
+        PDE = VmGetPdeTable (PDPE + VA.Pg4K.PDPOffset);
+        if (PDE == NULL) {
+          return EFI_NO_MAPPING;
+        }
+      }
+
+      if (((VirtualAddr | PhysicalAddr) & (0x200000 - 1)) == 0 && NumPages >= EFI_SIZE_TO_PAGES (0x200000)) {
+        PTE2M = (PAGE_TABLE_2M_ENTRY *)(PDE + VA.Pg4K.PDOffset);
+        PTE2M->Uint64 = ((UINT64)PhysicalAddr) & PT_ADDR_MASK_2M;
+        PTE2M->Bits.ReadWrite = 1;
+        PTE2M->Bits.Present = 1;
+        PTE2M->Bits.MustBe1 = 1;
+        Size = 0x200000;
+      } else {
+        if (PTE4K == NULL) {
+          PTE4K = VmGetPteTable (PDE + VA.Pg4K.PDOffset);
+          if (PTE4K == NULL) {
+            return EFI_NO_MAPPING;
+          }
+        }
+
+        PTE4K[VA.Pg4K.PTOffset].Uint64 = ((UINT64)PhysicalAddr) & PT_ADDR_MASK_4K;
+        PTE4K[VA.Pg4K.PTOffset].Bits.ReadWrite = 1;
+        PTE4K[VA.Pg4K.PTOffset].Bits.Present = 1;
+        Size = 0x1000;
+      }
+    }
+
+    VirtualAddr  += Size;
+    PhysicalAddr += Size;
+    NumPages     -= (UINTN)EFI_SIZE_TO_PAGES (Size);
   }
-  return Status;
+
+  return EFI_SUCCESS;
 }
 
 /** Flashes TLB caches. */
@@ -192,7 +192,9 @@ VmMapVirtualPage (
   EFI_PHYSICAL_ADDRESS            PhysicalAddr
   );
 
-/** Maps (remaps) NumPages 4K pages given by VirtualAddr to PhysicalAddr pages in PageTable. */
+/** Maps (remaps) NumPages 4K pages given by VirtualAddr to PhysicalAddr pages in PageTable,
+  * with 2MB/1GB pages where possible. Does not flush TLB.
+  */
 EFI_STATUS
 VmMapVirtualPages (
   PAGE_MAP_AND_DIRECTORY_POINTER  *PageTable,
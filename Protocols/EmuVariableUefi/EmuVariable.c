@@ -274,6 +274,412 @@ GetEndPointer (
   return (VARIABLE_HEADER *) HEADER_ALIGN ((UINTN) VolHeader + VolHeader->Size);
 }
 
+/**
+  Computes the variable index hash of a variable name and vendor GUID.
+
+  @param  VariableName  Name of the variable.
+  @param  NameSize      Size of the name in bytes, including the terminating null.
+  @param  VendorGuid    Vendor GUID of the variable.
+
+  @return FNV-1a hash of the GUID and name bytes.
+
+**/
+UINT32
+VariableIndexHash (
+  IN  CHAR16            *VariableName,
+  IN  UINTN             NameSize,
+  IN  EFI_GUID          *VendorGuid
+  )
+{
+  UINT32  Hash;
+  UINT8   *Bytes;
+  UINTN   Index;
+
+  Hash  = 2166136261U;
+  Bytes = (UINT8 *) VendorGuid;
+  for (Index = 0; Index < sizeof (EFI_GUID); Index++) {
+    Hash = (Hash ^ Bytes[Index]) * 16777619U;
+  }
+  Bytes = (UINT8 *) VariableName;
+  for (Index = 0; Index < NameSize; Index++) {
+    Hash = (Hash ^ Bytes[Index]) * 16777619U;
+  }
+
+  return Hash;
+}
+
+/**
+  Gets the variable a variable index slot refers to.
+
+  @param  Entry         Content of the slot, neither empty nor deleted.
+  @param  Global        Pointer to VARIABLE_GLOBAL structure.
+
+  @return Pointer to the variable header.
+
+**/
+VARIABLE_HEADER *
+VariableIndexGetVariable (
+  IN  UINT32            Entry,
+  IN  VARIABLE_GLOBAL   *Global
+  )
+{
+  if ((Entry & VARIABLE_INDEX_VOLATILE) != 0) {
+    return (VARIABLE_HEADER *) ((UINTN) Global->VolatileVariableBase + (Entry & ~VARIABLE_INDEX_VOLATILE));
+  }
+
+  return (VARIABLE_HEADER *) ((UINTN) Global->NonVolatileVariableBase + Entry);
+}
+
+/**
+  Finds the variable index slot of a variable.
+
+  The slot of a variable is returned whatever the state of the variable is.
+  If the variable is not in the index, the slot to insert it into is returned:
+  the first tombstone on the probe sequence, or the empty slot ending it.
+  The variable index must be allocated.
+
+  @param  VariableName  Name of the variable.
+  @param  NameSize      Size of the name in bytes, including the terminating null.
+  @param  VendorGuid    Vendor GUID of the variable.
+  @param  Global        Pointer to VARIABLE_GLOBAL structure.
+  @param  Found         Set to TRUE if the variable is in the index.
+
+  @return Pointer to the slot.
+
+**/
+UINT32 *
+VariableIndexFindSlot (
+  IN  CHAR16            *VariableName,
+  IN  UINTN             NameSize,
+  IN  EFI_GUID          *VendorGuid,
+  IN  VARIABLE_GLOBAL   *Global,
+  OUT BOOLEAN           *Found
+  )
+{
+  UINT32          *Table;
+  UINT32          *FreeSlot;
+  UINTN           Mask;
+  UINTN           Slot;
+  VARIABLE_HEADER *Variable;
+
+  Table    = mVariableModuleGlobal->VariableIndex;
+  Mask     = mVariableModuleGlobal->VariableIndexSize - 1;
+  FreeSlot = NULL;
+
+  //
+  // The index is never more than 3/4 filled, so probing ends on an empty slot
+  //
+  for (Slot = VariableIndexHash (VariableName, NameSize, VendorGuid) & Mask;
+       Table[Slot] != VARIABLE_INDEX_EMPTY;
+       Slot = (Slot + 1) & Mask) {
+    if (Table[Slot] == VARIABLE_INDEX_DELETED) {
+      if (FreeSlot == NULL) {
+        FreeSlot = &Table[Slot];
+      }
+      continue;
+    }
+    Variable = VariableIndexGetVariable (Table[Slot], Global);
+    if (Variable->NameSize == NameSize &&
+        CompareGuid (VendorGuid, &Variable->VendorGuid) &&
+        CompareMem (VariableName, GET_VARIABLE_NAME_PTR (Variable), NameSize) == 0) {
+      *Found = TRUE;
+      return &Table[Slot];
+    }
+  }
+
+  *Found = FALSE;
+  return (FreeSlot != NULL) ? FreeSlot : &Table[Slot];
+}
+
+/**
+  Rebuilds the variable index from the variable stores.
+
+  Added variables and variables in delete transition are indexed, tombstones are
+  dropped. A copy in delete transition of a variable that also has an added copy
+  is not indexed, it is counted in VariableIndexShadowed instead. At runtime
+  variables without runtime access are left out, they can not be found anymore.
+
+  @param  Global        Pointer to VARIABLE_GLOBAL structure.
+
+**/
+VOID
+VariableIndexRebuild (
+  IN  VARIABLE_GLOBAL   *Global
+  )
+{
+  VARIABLE_STORE_HEADER *VariableStore;
+  VARIABLE_HEADER       *Variable;
+  UINT32                *Slot;
+  BOOLEAN               Found;
+  UINTN                 Index;
+
+  if (mVariableModuleGlobal->VariableIndex == NULL) {
+    return;
+  }
+
+  ZeroMem (mVariableModuleGlobal->VariableIndex, mVariableModuleGlobal->VariableIndexSize * sizeof (UINT32));
+  mVariableModuleGlobal->VariableIndexFilled = 0;
+  mVariableModuleGlobal->VariableIndexShadowed = 0;
+
+  //
+  // 0: Non-Volatile, 1: Volatile
+  //
+  for (Index = 0; Index < 2; Index++) {
+    VariableStore = (VARIABLE_STORE_HEADER *) (UINTN) (Index == 0 ? Global->NonVolatileVariableBase : Global->VolatileVariableBase);
+    if (VariableStore == NULL) {
+      continue;
+    }
+
+    for (Variable = (VARIABLE_HEADER *) HEADER_ALIGN (VariableStore + 1);
+         (Variable < GetEndPointer (VariableStore)) && (Variable != NULL) && (Variable->StartId == VARIABLE_DATA);
+         Variable = GetNextVariablePtr (Variable)) {
+      if (Variable->State != VAR_ADDED && Variable->State != (VAR_ADDED & VAR_IN_DELETED_TRANSITION)) {
+        continue;
+      }
+      if (VariableClassAtRuntime () && ((Variable->Attributes & EFI_VARIABLE_RUNTIME_ACCESS) == 0)) {
+        continue;
+      }
+
+      Slot = VariableIndexFindSlot (GET_VARIABLE_NAME_PTR (Variable), Variable->NameSize, &Variable->VendorGuid, Global, &Found);
+      if (!Found) {
+        mVariableModuleGlobal->VariableIndexFilled++;
+      } else if (Variable->State != VAR_ADDED) {
+        mVariableModuleGlobal->VariableIndexShadowed++;
+        continue;
+      } else if (VariableIndexGetVariable (*Slot, Global)->State != VAR_ADDED) {
+        mVariableModuleGlobal->VariableIndexShadowed++;
+      }
+      *Slot = (UINT32) ((UINTN) Variable - (UINTN) VariableStore) | (Index == 1 ? VARIABLE_INDEX_VOLATILE : 0);
+    }
+  }
+}
+
+/**
+  Adds a variable to the variable index.
+
+  A variable with the same name and GUID already in the index is replaced.
+
+  @param  Variable      The variable, already written to its store.
+  @param  Volatile      TRUE if the variable is in the volatile store.
+  @param  Global        Pointer to VARIABLE_GLOBAL structure.
+
+**/
+VOID
+VariableIndexInsert (
+  IN  VARIABLE_HEADER   *Variable,
+  IN  BOOLEAN           Volatile,
+  IN  VARIABLE_GLOBAL   *Global
+  )
+{
+  UINT32  *Slot;
+  BOOLEAN Found;
+
+  if (mVariableModuleGlobal->VariableIndex == NULL) {
+    return;
+  }
+
+  Slot = VariableIndexFindSlot (GET_VARIABLE_NAME_PTR (Variable), Variable->NameSize, &Variable->VendorGuid, Global, &Found);
+  if (!Found && *Slot == VARIABLE_INDEX_EMPTY) {
+    if ((mVariableModuleGlobal->VariableIndexFilled + 1) * 4 > mVariableModuleGlobal->VariableIndexSize * 3) {
+      //
+      // Too many tombstones, rebuild the index. Variable is in its store, so it is indexed as well.
+      //
+      VariableIndexRebuild (Global);
+      return;
+    }
+    mVariableModuleGlobal->VariableIndexFilled++;
+  }
+
+  if (Volatile) {
+    *Slot = (UINT32) ((UINTN) Variable - (UINTN) Global->VolatileVariableBase) | VARIABLE_INDEX_VOLATILE;
+  } else {
+    *Slot = (UINT32) ((UINTN) Variable - (UINTN) Global->NonVolatileVariableBase);
+  }
+}
+
+/**
+  Removes a variable from the variable index, leaving a tombstone.
+
+  If a copy of the variable in delete transition is left in a store,
+  it takes the place of the removed one, as in VariableIndexRebuild.
+  The stores are only searched for it while such copies are shadowed.
+
+  @param  Variable      The variable, already marked deleted.
+  @param  Global        Pointer to VARIABLE_GLOBAL structure.
+
+**/
+VOID
+VariableIndexRemove (
+  IN  VARIABLE_HEADER   *Variable,
+  IN  VARIABLE_GLOBAL   *Global
+  )
+{
+  VARIABLE_STORE_HEADER *VariableStore;
+  VARIABLE_HEADER       *Next;
+  UINT32                *Slot;
+  UINTN                 Index;
+  BOOLEAN               Found;
+
+  if (mVariableModuleGlobal->VariableIndex == NULL) {
+    return;
+  }
+
+  Slot = VariableIndexFindSlot (GET_VARIABLE_NAME_PTR (Variable), Variable->NameSize, &Variable->VendorGuid, Global, &Found);
+  if (!Found) {
+    return;
+  }
+  *Slot = VARIABLE_INDEX_DELETED;
+  if (mVariableModuleGlobal->VariableIndexShadowed == 0) {
+    return;
+  }
+
+  //
+  // 0: Non-Volatile, 1: Volatile
+  //
+  for (Index = 0; Index < 2; Index++) {
+    VariableStore = (VARIABLE_STORE_HEADER *) (UINTN) (Index == 0 ? Global->NonVolatileVariableBase : Global->VolatileVariableBase);
+    if (VariableStore == NULL) {
+      continue;
+    }
+
+    for (Next = (VARIABLE_HEADER *) HEADER_ALIGN (VariableStore + 1);
+         (Next < GetEndPointer (VariableStore)) && (Next != NULL) && (Next->StartId == VARIABLE_DATA);
+         Next = GetNextVariablePtr (Next)) {
+      if (Next != Variable && Next->State == (VAR_ADDED & VAR_IN_DELETED_TRANSITION) &&
+          !(VariableClassAtRuntime () && ((Next->Attributes & EFI_VARIABLE_RUNTIME_ACCESS) == 0)) &&
+          Next->NameSize == Variable->NameSize &&
+          CompareGuid (&Next->VendorGuid, &Variable->VendorGuid) &&
+          CompareMem (GET_VARIABLE_NAME_PTR (Next), GET_VARIABLE_NAME_PTR (Variable), Variable->NameSize) == 0) {
+        *Slot = (UINT32) ((UINTN) Next - (UINTN) VariableStore) | (Index == 1 ? VARIABLE_INDEX_VOLATILE : 0);
+        mVariableModuleGlobal->VariableIndexShadowed--;
+        return;
+      }
+    }
+  }
+}
+
+/**
+  Checks if a variable store has space left for a new variable.
+
+  The erased StartId after the last variable is kept inside the store,
+  so walking the store always stops there.
+
+  @param  Attributes    Attributes of the new variable, selecting the store.
+  @param  VarSize       Size of the new variable, header included.
+
+  @retval TRUE          The variable fits.
+  @retval FALSE         The store is full.
+
+**/
+BOOLEAN
+VariableStoreHasSpace (
+  IN  UINT32            Attributes,
+  IN  UINTN             VarSize
+  )
+{
+  VARIABLE_GLOBAL       *Global;
+  UINTN                 NonVolatileVarableStoreSize;
+
+  Global = &mVariableModuleGlobal->VariableGlobal[Physical];
+
+  if ((Attributes & EFI_VARIABLE_NON_VOLATILE) != 0) {
+    NonVolatileVarableStoreSize = ((VARIABLE_STORE_HEADER *)(UINTN)(Global->NonVolatileVariableBase))->Size;
+    if (HEADER_ALIGN (VarSize) + sizeof (UINT16) + mVariableModuleGlobal->NonVolatileLastVariableOffset > NonVolatileVarableStoreSize) {
+      return FALSE;
+    }
+    if ((Attributes & EFI_VARIABLE_HARDWARE_ERROR_RECORD) != 0) {
+      return (HEADER_ALIGN (VarSize) + mVariableModuleGlobal->HwErrVariableTotalSize) <= PcdGet32 (PcdHwErrStorageSize);
+    }
+    return (HEADER_ALIGN (VarSize) + mVariableModuleGlobal->CommonVariableTotalSize) <=
+             NonVolatileVarableStoreSize - sizeof (VARIABLE_STORE_HEADER) - PcdGet32 (PcdHwErrStorageSize);
+  }
+
+  return (UINT32) (HEADER_ALIGN (VarSize) + sizeof (UINT16) + mVariableModuleGlobal->VolatileLastVariableOffset) <=
+           ((VARIABLE_STORE_HEADER *) ((UINTN) (Global->VolatileVariableBase)))->Size;
+}
+
+/**
+  Reclaims the space of deleted variables in a variable store.
+
+  Added variables and variables in delete transition are moved down over the
+  deleted ones, the rest of the store is erased and the variable index is rebuilt.
+  Nothing is allocated, so this works at runtime too.
+
+  @param  VolatileStore  TRUE to reclaim the volatile store, FALSE for the non-volatile one.
+  @param  KeepVariable   Variable the caller still works on, kept and updated
+                         to its new location. May point to NULL.
+
+**/
+VOID
+ReclaimVariableStore (
+  IN      BOOLEAN           VolatileStore,
+  IN OUT  VARIABLE_HEADER   **KeepVariable
+  )
+{
+  VARIABLE_GLOBAL       *Global;
+  VARIABLE_STORE_HEADER *VariableStore;
+  VARIABLE_HEADER       *Variable;
+  VARIABLE_HEADER       *NextVariable;
+  VARIABLE_HEADER       *EndVariable;
+  UINT8                 *CurrPtr;
+  UINTN                 VarSize;
+  UINTN                 CommonVariableTotalSize;
+  UINTN                 HwErrVariableTotalSize;
+
+  Global = &mVariableModuleGlobal->VariableGlobal[Physical];
+  if (VolatileStore) {
+    VariableStore = (VARIABLE_STORE_HEADER *) ((UINTN) Global->VolatileVariableBase);
+  } else {
+    VariableStore = (VARIABLE_STORE_HEADER *) ((UINTN) Global->NonVolatileVariableBase);
+  }
+
+  CommonVariableTotalSize = 0;
+  HwErrVariableTotalSize  = 0;
+  EndVariable = GetEndPointer (VariableStore);
+  CurrPtr     = (UINT8 *) HEADER_ALIGN (VariableStore + 1);
+  Variable    = (VARIABLE_HEADER *) CurrPtr;
+
+  while ((Variable < EndVariable) && (Variable->StartId == VARIABLE_DATA)) {
+    NextVariable = GetNextPotentialVariablePtr (Variable);
+    if (NextVariable > EndVariable) {
+      break;
+    }
+    VarSize = (UINTN) NextVariable - (UINTN) Variable;
+
+    if (Variable->State == VAR_ADDED ||
+        Variable->State == (VAR_ADDED & VAR_IN_DELETED_TRANSITION) ||
+        Variable == *KeepVariable) {
+      if ((Variable->Attributes & EFI_VARIABLE_HARDWARE_ERROR_RECORD) != 0) {
+        HwErrVariableTotalSize += VarSize;
+      } else {
+        CommonVariableTotalSize += VarSize;
+      }
+      if (Variable == *KeepVariable) {
+        *KeepVariable = (VARIABLE_HEADER *) CurrPtr;
+      }
+      //
+      // CurrPtr never passes Variable, CopyMem handles the overlap
+      //
+      CopyMem (CurrPtr, Variable, VarSize);
+      CurrPtr += VarSize;
+    }
+
+    Variable = NextVariable;
+  }
+
+  SetMem (CurrPtr, (UINTN) EndVariable - (UINTN) CurrPtr, 0xff);
+
+  if (VolatileStore) {
+    mVariableModuleGlobal->VolatileLastVariableOffset = (UINTN) CurrPtr - (UINTN) VariableStore;
+  } else {
+    mVariableModuleGlobal->NonVolatileLastVariableOffset = (UINTN) CurrPtr - (UINTN) VariableStore;
+    mVariableModuleGlobal->CommonVariableTotalSize = CommonVariableTotalSize;
+    mVariableModuleGlobal->HwErrVariableTotalSize  = HwErrVariableTotalSize;
+  }
+
+  VariableIndexRebuild (Global);
+}
+
 /**
   Routine used to track statistical information about variable usage. 
   The data is stored in the EFI system table so it can be accessed later.
@@ -902,7 +1308,7 @@ UpdateVariable (
   UINTN                   VarDataOffset;
   UINTN                   VarSize;
   VARIABLE_GLOBAL         *Global;
-  UINTN                   NonVolatileVarableStoreSize;
+  BOOLEAN                 Volatile;
 
   Global = &mVariableModuleGlobal->VariableGlobal[Physical];
 
@@ -936,6 +1342,7 @@ UpdateVariable (
     //
     if (DataSize == 0 || (Attributes & (EFI_VARIABLE_RUNTIME_ACCESS | EFI_VARIABLE_BOOTSERVICE_ACCESS)) == 0) {
       Variable->CurrPtr->State &= VAR_DELETED;
+      VariableIndexRemove (Variable->CurrPtr, Global);
       UpdateVariableInfo (VariableName, VendorGuid, Variable->Volatile, FALSE, FALSE, TRUE, FALSE);
       Status = EFI_SUCCESS;
       goto Done;
@@ -990,17 +1397,26 @@ UpdateVariable (
   VarNameSize   = StrSize (VariableName);
   VarDataOffset = VarNameOffset + VarNameSize + GET_PAD_SIZE (VarNameSize);
   VarSize       = VarDataOffset + DataSize + GET_PAD_SIZE (DataSize);
+  Volatile      = (BOOLEAN) ((Attributes & EFI_VARIABLE_NON_VOLATILE) == 0);
 
-  if ((Attributes & EFI_VARIABLE_NON_VOLATILE) != 0) {
-    NonVolatileVarableStoreSize = ((VARIABLE_STORE_HEADER *)(UINTN)(Global->NonVolatileVariableBase))->Size;
-    if ((((Attributes & EFI_VARIABLE_HARDWARE_ERROR_RECORD) != 0) 
-      && ((HEADER_ALIGN (VarSize) + mVariableModuleGlobal->HwErrVariableTotalSize) > PcdGet32 (PcdHwErrStorageSize)))
-      || (((Attributes & EFI_VARIABLE_HARDWARE_ERROR_RECORD) == 0) 
-      && ((HEADER_ALIGN (VarSize) + mVariableModuleGlobal->CommonVariableTotalSize) > NonVolatileVarableStoreSize - sizeof (VARIABLE_STORE_HEADER) - PcdGet32 (PcdHwErrStorageSize)))) {
+  if (!VariableStoreHasSpace (Attributes, VarSize)) {
+    //
+    // Deleted variables are only marked, reclaim their space and try again
+    //
+    ReclaimVariableStore (Volatile, &Variable->CurrPtr);
+    if (!VariableStoreHasSpace (Attributes, VarSize)) {
+      //
+      // Keep the old variable, it is not replaced
+      //
+      if (Variable->CurrPtr != NULL && Variable->CurrPtr->State == (VAR_ADDED & VAR_IN_DELETED_TRANSITION)) {
+        Variable->CurrPtr->State = VAR_ADDED;
+      }
       Status = EFI_OUT_OF_RESOURCES;
       goto Done;
     }
+  }
 
+  if (!Volatile) {
     NextVariable  = (VARIABLE_HEADER *) (UINT8 *) (mVariableModuleGlobal->NonVolatileLastVariableOffset
                       + (UINTN) Global->NonVolatileVariableBase);
     mVariableModuleGlobal->NonVolatileLastVariableOffset += HEADER_ALIGN (VarSize);
@@ -1011,13 +1427,6 @@ UpdateVariable (
       mVariableModuleGlobal->CommonVariableTotalSize += HEADER_ALIGN (VarSize);
     }
   } else {
-    if ((UINT32) (HEADER_ALIGN (VarSize) + mVariableModuleGlobal->VolatileLastVariableOffset) >
-          ((VARIABLE_STORE_HEADER *) ((UINTN) (Global->VolatileVariableBase)))->Size
-          ) {
-      Status = EFI_OUT_OF_RESOURCES;
-      goto Done;
-    }
-
     NextVariable    = (VARIABLE_HEADER *) (UINT8 *) (mVariableModuleGlobal->VolatileLastVariableOffset
                         + (UINTN) Global->VolatileVariableBase);
     mVariableModuleGlobal->VolatileLastVariableOffset += HEADER_ALIGN (VarSize);
@@ -1054,6 +1463,7 @@ UpdateVariable (
   if (Variable->CurrPtr != NULL) {
     Variable->CurrPtr->State &= VAR_DELETED;
   }
+  VariableIndexInsert (NextVariable, Volatile, Global);
 
   UpdateVariableInfo (VariableName, VendorGuid, Variable->Volatile, FALSE, TRUE, FALSE, FALSE);
 
@@ -1095,7 +1505,11 @@ FindVariable (
 {
   VARIABLE_HEADER       *Variable[2];
   VARIABLE_STORE_HEADER *VariableStoreHeader[2];
+  VARIABLE_HEADER       *InDeletedVariable;
+  UINTN                 InDeletedIndex;
   UINTN                 Index;
+  UINT32                *Slot;
+  BOOLEAN               Found;
 
   //
   // 0: Non-Volatile, 1: Volatile
@@ -1114,13 +1528,50 @@ FindVariable (
     return EFI_INVALID_PARAMETER;
   }
   //
-  // Find the variable by walk through non-volatile and volatile variable store
+  // Look the variable up in the index if there is one. The index holds the added
+  // copy of a variable, or its copy in delete transition if there is no other.
   //
+  if (VariableName[0] != 0 && mVariableModuleGlobal->VariableIndex != NULL) {
+    Slot = VariableIndexFindSlot (VariableName, StrSize (VariableName), VendorGuid, Global, &Found);
+    if (Found) {
+      Index           = ((*Slot & VARIABLE_INDEX_VOLATILE) != 0) ? 1 : 0;
+      Variable[Index] = VariableIndexGetVariable (*Slot, Global);
+      if ((Variable[Index]->State == VAR_ADDED || Variable[Index]->State == (VAR_ADDED & VAR_IN_DELETED_TRANSITION)) &&
+          !(VariableClassAtRuntime () && ((Variable[Index]->Attributes & EFI_VARIABLE_RUNTIME_ACCESS) == 0))) {
+        PtrTrack->StartPtr  = (VARIABLE_HEADER *) HEADER_ALIGN (VariableStoreHeader[Index] + 1);
+        PtrTrack->EndPtr    = GetEndPointer (VariableStoreHeader[Index]);
+        PtrTrack->CurrPtr   = Variable[Index];
+        PtrTrack->Volatile  = (BOOLEAN) Index;
+        return EFI_SUCCESS;
+      }
+    }
+    //
+    // Not found, the walk below would end in the volatile store
+    //
+    PtrTrack->StartPtr  = (VARIABLE_HEADER *) HEADER_ALIGN (VariableStoreHeader[1] + 1);
+    PtrTrack->EndPtr    = GetEndPointer (VariableStoreHeader[1]);
+    PtrTrack->CurrPtr   = NULL;
+    return EFI_NOT_FOUND;
+  }
+  //
+  // Find the variable by walk through non-volatile and volatile variable store.
+  // A copy in delete transition is only returned if there is no added one.
+  //
+  InDeletedVariable = NULL;
+  InDeletedIndex    = 0;
   for (Index = 0; Index < 2; Index++) {
     PtrTrack->StartPtr  = (VARIABLE_HEADER *) HEADER_ALIGN (VariableStoreHeader[Index] + 1);
     PtrTrack->EndPtr    = GetEndPointer (VariableStoreHeader[Index]);
 
     while ((Variable[Index] < GetEndPointer (VariableStoreHeader[Index])) && (Variable[Index] != NULL)) {
+      if (Variable[Index]->StartId == VARIABLE_DATA && Variable[Index]->State == (VAR_ADDED & VAR_IN_DELETED_TRANSITION) &&
+          InDeletedVariable == NULL && VariableName[0] != 0 &&
+          !(VariableClassAtRuntime () && ((Variable[Index]->Attributes & EFI_VARIABLE_RUNTIME_ACCESS) == 0)) &&
+          CompareGuid (VendorGuid, &Variable[Index]->VendorGuid) &&
+          CompareMem (VariableName, GET_VARIABLE_NAME_PTR (Variable[Index]), Variable[Index]->NameSize) == 0) {
+        InDeletedVariable = Variable[Index];
+        InDeletedIndex    = Index;
+      }
       if (Variable[Index]->StartId == VARIABLE_DATA && Variable[Index]->State == VAR_ADDED) {
         if (!(VariableClassAtRuntime () && ((Variable[Index]->Attributes & EFI_VARIABLE_RUNTIME_ACCESS) == 0))) {
           if (VariableName[0] == 0) {
@@ -1142,6 +1593,13 @@ FindVariable (
       Variable[Index] = GetNextVariablePtr (Variable[Index]);
     }
   }
+  if (InDeletedVariable != NULL) {
+    PtrTrack->StartPtr  = (VARIABLE_HEADER *) HEADER_ALIGN (VariableStoreHeader[InDeletedIndex] + 1);
+    PtrTrack->EndPtr    = GetEndPointer (VariableStoreHeader[InDeletedIndex]);
+    PtrTrack->CurrPtr   = InDeletedVariable;
+    PtrTrack->Volatile  = (BOOLEAN) InDeletedIndex;
+    return EFI_SUCCESS;
+  }
   PtrTrack->CurrPtr = NULL;
   return EFI_NOT_FOUND;
 }
@@ -1704,6 +2162,11 @@ InitializeVariableStore (
   VariableStore->Reserved   = 0;
   VariableStore->Reserved1  = 0;
 
+  //
+  // Index the variables of a store kept across resets
+  //
+  VariableIndexRebuild (&mVariableModuleGlobal->VariableGlobal[Physical]);
+
   if (!VolatileStore) {
     //
     // Get HOB variable store.
@@ -1771,6 +2234,7 @@ VariableCommonInitialize (
   )
 {
   EFI_STATUS  Status;
+  UINTN       IndexSize;
 
   //
   // Allocate memory for mVariableModuleGlobal
@@ -1782,6 +2246,17 @@ VariableCommonInitialize (
     return EFI_OUT_OF_RESOURCES;
   }
 
+  //
+  // Allocate the variable index with twice as many slots as both stores can hold
+  // variables, so it never has to grow at runtime. Without it variables are searched
+  // by walking the stores.
+  //
+  for (IndexSize = 1; IndexSize < 2 * 2 * PcdGet32 (PcdVariableStoreSize) / VARIABLE_INDEX_MIN_VARIABLE_SIZE; IndexSize <<= 1);
+  mVariableModuleGlobal->VariableIndex = (UINT32 *) AllocateRuntimeZeroPool (IndexSize * sizeof (UINT32));
+  if (mVariableModuleGlobal->VariableIndex != NULL) {
+    mVariableModuleGlobal->VariableIndexSize = IndexSize;
+  }
+
   EfiInitializeLock(&mVariableModuleGlobal->VariableGlobal[Physical].VariableServicesLock, TPL_NOTIFY);
 
   //
@@ -1789,6 +2264,9 @@ VariableCommonInitialize (
   //
   Status = InitializeVariableStore (TRUE);
   if (EFI_ERROR (Status)) {
+    if (mVariableModuleGlobal->VariableIndex != NULL) {
+      FreePool (mVariableModuleGlobal->VariableIndex);
+    }
     FreePool(mVariableModuleGlobal);
     return Status;
   }
@@ -201,6 +201,7 @@ VariableClassAddressChangeEvent (
   gRT->ConvertPointer (0x0, (VOID **) &mVariableModuleGlobal->PlatformLangCodes);
   gRT->ConvertPointer (0x0, (VOID **) &mVariableModuleGlobal->LangCodes);
   gRT->ConvertPointer (0x0, (VOID **) &mVariableModuleGlobal->PlatformLang);
+  gRT->ConvertPointer (0x0, (VOID **) &mVariableModuleGlobal->VariableIndex);
   gRT->ConvertPointer (
     0x0,
     (VOID **) &mVariableModuleGlobal->VariableGlobal[Physical].NonVolatileVariableBase
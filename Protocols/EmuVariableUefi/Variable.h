@@ -74,6 +74,19 @@ typedef struct {
   EFI_LOCK              VariableServicesLock;
 } VARIABLE_GLOBAL;
 
+///
+/// Variable index slots hold the offset of a variable in its store,
+/// with VARIABLE_INDEX_VOLATILE set for the volatile store.
+///
+#define VARIABLE_INDEX_EMPTY      0
+#define VARIABLE_INDEX_DELETED    MAX_UINT32
+#define VARIABLE_INDEX_VOLATILE   BIT31
+
+///
+/// Smallest variable a store can hold: header, one character name and one data byte.
+///
+#define VARIABLE_INDEX_MIN_VARIABLE_SIZE  HEADER_ALIGN (sizeof (VARIABLE_HEADER) + 2 * sizeof (CHAR16) + 1)
+
 typedef struct {
   VARIABLE_GLOBAL VariableGlobal[2];
   UINTN           VolatileLastVariableOffset;
@@ -84,6 +97,10 @@ typedef struct {
   CHAR8           *LangCodes;
   CHAR8           *PlatformLang;
   CHAR8           Lang[ISO_639_2_ENTRY_SIZE + 1];
+  UINT32          *VariableIndex;         ///< (GUID, name) hash table, NULL if not allocated
+  UINTN           VariableIndexSize;      ///< number of slots, a power of 2
+  UINTN           VariableIndexFilled;    ///< slots holding a variable or a tombstone
+  UINTN           VariableIndexShadowed;  ///< copies in delete transition left out for an added copy
 } ESAL_VARIABLE_GLOBAL;
 
 ///
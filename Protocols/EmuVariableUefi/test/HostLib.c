@@ -0,0 +1,282 @@
+/** @file
+
+  Host stand-ins for the EDK2 library functions EmuVariable.c links against.
+
+**/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Variable.h"
+
+UINT32    mHostPcdVariableStoreSize           = 0x10000;
+UINT32    mHostPcdMaxVariableSize             = 0x2000;
+UINT64    mHostPcdEmuVariableNvStoreReserved  = 0;
+BOOLEAN   mHostAtRuntime                      = FALSE;
+
+EFI_GUID  gEfiVariableGuid        = EFI_VARIABLE_GUID;
+EFI_GUID  gEfiGlobalVariableGuid  = EFI_GLOBAL_VARIABLE;
+
+BOOLEAN
+VariableClassAtRuntime (
+  VOID
+  )
+{
+  return mHostAtRuntime;
+}
+
+VOID *
+EFIAPI
+CopyMem (
+  OUT VOID       *DestinationBuffer,
+  IN CONST VOID  *SourceBuffer,
+  IN UINTN       Length
+  )
+{
+  return memmove (DestinationBuffer, SourceBuffer, Length);
+}
+
+VOID *
+EFIAPI
+SetMem (
+  OUT VOID  *Buffer,
+  IN UINTN  Length,
+  IN UINT8  Value
+  )
+{
+  return memset (Buffer, Value, Length);
+}
+
+VOID *
+EFIAPI
+ZeroMem (
+  OUT VOID  *Buffer,
+  IN UINTN  Length
+  )
+{
+  return memset (Buffer, 0, Length);
+}
+
+INTN
+EFIAPI
+CompareMem (
+  IN CONST VOID  *DestinationBuffer,
+  IN CONST VOID  *SourceBuffer,
+  IN UINTN       Length
+  )
+{
+  return memcmp (DestinationBuffer, SourceBuffer, Length);
+}
+
+BOOLEAN
+EFIAPI
+CompareGuid (
+  IN CONST GUID  *Guid1,
+  IN CONST GUID  *Guid2
+  )
+{
+  return memcmp (Guid1, Guid2, sizeof (GUID)) == 0;
+}
+
+GUID *
+EFIAPI
+CopyGuid (
+  OUT GUID       *DestinationGuid,
+  IN CONST GUID  *SourceGuid
+  )
+{
+  return memcpy (DestinationGuid, SourceGuid, sizeof (GUID));
+}
+
+UINTN
+EFIAPI
+StrLen (
+  IN CONST CHAR16  *String
+  )
+{
+  UINTN Length;
+
+  for (Length = 0; String[Length] != 0; Length++);
+  return Length;
+}
+
+UINTN
+EFIAPI
+StrSize (
+  IN CONST CHAR16  *String
+  )
+{
+  return (StrLen (String) + 1) * sizeof (CHAR16);
+}
+
+INTN
+EFIAPI
+StrnCmp (
+  IN CONST CHAR16  *FirstString,
+  IN CONST CHAR16  *SecondString,
+  IN UINTN         Length
+  )
+{
+  for (; Length > 0; Length--, FirstString++, SecondString++) {
+    if (*FirstString != *SecondString || *FirstString == 0) {
+      return *FirstString - *SecondString;
+    }
+  }
+  return 0;
+}
+
+INTN
+EFIAPI
+StrCmp (
+  IN CONST CHAR16  *FirstString,
+  IN CONST CHAR16  *SecondString
+  )
+{
+  return StrnCmp (FirstString, SecondString, MAX_UINTN);
+}
+
+UINTN
+EFIAPI
+AsciiStrLen (
+  IN CONST CHAR8  *String
+  )
+{
+  return strlen (String);
+}
+
+UINTN
+EFIAPI
+AsciiStrSize (
+  IN CONST CHAR8  *String
+  )
+{
+  return strlen (String) + 1;
+}
+
+INTN
+EFIAPI
+AsciiStrnCmp (
+  IN CONST CHAR8  *FirstString,
+  IN CONST CHAR8  *SecondString,
+  IN UINTN        Length
+  )
+{
+  return strncmp (FirstString, SecondString, Length);
+}
+
+VOID *
+EFIAPI
+AllocateRuntimePool (
+  IN UINTN  AllocationSize
+  )
+{
+  return malloc (AllocationSize);
+}
+
+VOID *
+EFIAPI
+AllocateRuntimeZeroPool (
+  IN UINTN  AllocationSize
+  )
+{
+  return calloc (1, AllocationSize);
+}
+
+VOID *
+EFIAPI
+AllocateRuntimeCopyPool (
+  IN UINTN       AllocationSize,
+  IN CONST VOID  *Buffer
+  )
+{
+  VOID  *Memory;
+
+  Memory = malloc (AllocationSize);
+  if (Memory != NULL) {
+    memcpy (Memory, Buffer, AllocationSize);
+  }
+  return Memory;
+}
+
+VOID
+EFIAPI
+FreePool (
+  IN VOID  *Buffer
+  )
+{
+  free (Buffer);
+}
+
+VOID *
+EFIAPI
+GetFirstGuidHob (
+  IN CONST EFI_GUID  *Guid
+  )
+{
+  return NULL;
+}
+
+EFI_LOCK *
+EFIAPI
+EfiInitializeLock (
+  IN OUT EFI_LOCK  *Lock,
+  IN EFI_TPL       Priority
+  )
+{
+  Lock->Tpl       = Priority;
+  Lock->OwnerTpl  = TPL_APPLICATION;
+  Lock->Lock      = EfiLockReleased;
+  return Lock;
+}
+
+VOID
+EFIAPI
+EfiAcquireLock (
+  IN EFI_LOCK  *Lock
+  )
+{
+  if (Lock->Lock != EfiLockReleased) {
+    abort ();
+  }
+  Lock->Lock = EfiLockAcquired;
+}
+
+VOID
+EFIAPI
+EfiReleaseLock (
+  IN EFI_LOCK  *Lock
+  )
+{
+  if (Lock->Lock != EfiLockAcquired) {
+    abort ();
+  }
+  Lock->Lock = EfiLockReleased;
+}
+
+VOID
+EFIAPI
+DebugPrint (
+  IN UINTN        ErrorLevel,
+  IN CONST CHAR8  *Format,
+  ...
+  )
+{
+}
+
+BOOLEAN
+EFIAPI
+DebugPrintEnabled (
+  VOID
+  )
+{
+  return FALSE;
+}
+
+BOOLEAN
+EFIAPI
+DebugPrintLevelEnabled (
+  IN CONST UINTN  ErrorLevel
+  )
+{
+  return FALSE;
+}
@@ -0,0 +1,31 @@
+/** @file
+
+  Host environment for building EmuVariable.c as a user space program.
+  Stands in for the AutoGen PCD definitions of the EDK2 build.
+
+**/
+
+#ifndef _HOST_SHIM_H_
+#define _HOST_SHIM_H_
+
+//
+// Before the EDK2 headers, which make everything that follows hidden
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <PiDxe.h>
+
+extern UINT32   mHostPcdVariableStoreSize;
+extern UINT32   mHostPcdMaxVariableSize;
+extern UINT64   mHostPcdEmuVariableNvStoreReserved;
+
+#define _PCD_GET_MODE_32_PcdVariableStoreSize               mHostPcdVariableStoreSize
+#define _PCD_GET_MODE_32_PcdMaxVariableSize                 mHostPcdMaxVariableSize
+#define _PCD_GET_MODE_32_PcdMaxHardwareErrorVariableSize    0x8000
+#define _PCD_GET_MODE_32_PcdHwErrStorageSize                0
+#define _PCD_GET_MODE_64_PcdEmuVariableNvStoreReserved      mHostPcdEmuVariableNvStoreReserved
+#define _PCD_GET_MODE_BOOL_PcdVariableCollectStatistics     FALSE
+
+#endif
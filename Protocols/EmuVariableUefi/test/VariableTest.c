@@ -0,0 +1,444 @@
+/** @file
+
+  Host test for the EmuVariable store, its variable index and store reclaim.
+
+  Random SetVariable/GetVariable/GetNextVariableName sequences are checked
+  against a plain model, once with the variable index and once with the
+  linear walk; both runs must return the same status for every call.
+  Stores preserved across a reset with copies in delete transition are
+  checked against the EDK2 rule: such a copy is found only if there is no
+  added copy of the variable.
+
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Variable.h"
+
+extern UINT32   mHostPcdVariableStoreSize;
+extern UINT64   mHostPcdEmuVariableNvStoreReserved;
+
+VARIABLE_HEADER *GetNextVariablePtr (VARIABLE_HEADER *Variable);
+VOID VariableIndexRebuild (VARIABLE_GLOBAL *Global);
+
+#define NAME_COUNT      48
+#define MAX_DATA_SIZE   200
+#define OP_COUNT        200000
+
+typedef struct {
+  BOOLEAN   Present;
+  UINTN     Size;
+  UINT8     Data[MAX_DATA_SIZE];
+} MODEL_VARIABLE;
+
+STATIC MODEL_VARIABLE mModel[NAME_COUNT];
+STATIC EFI_STATUS     mLog[OP_COUNT];
+STATIC UINTN          mFailures;
+
+STATIC EFI_GUID mGuids[2] = {
+  { 0x7c436110, 0xab2a, 0x4bbb, { 0xa8, 0x80, 0xfe, 0x41, 0x99, 0x5c, 0x9f, 0x82 } },
+  { 0x4d1ede05, 0x38c7, 0x4a6a, { 0x9c, 0xc6, 0x4b, 0xcc, 0xa8, 0xb3, 0x8c, 0x14 } }
+};
+
+#define CHECK(Cond) \
+  do { \
+    if (!(Cond)) { \
+      printf ("%s:%d: check failed: %s\n", __FILE__, __LINE__, #Cond); \
+      mFailures++; \
+    } \
+  } while (0)
+
+STATIC VARIABLE_GLOBAL *
+Global (
+  VOID
+  )
+{
+  return &mVariableModuleGlobal->VariableGlobal[Physical];
+}
+
+STATIC VOID
+MakeName (
+  UINTN   Index,
+  CHAR16  *Name
+  )
+{
+  Name[0] = L'V';
+  Name[1] = L'a';
+  Name[2] = L'r';
+  Name[3] = (CHAR16) (L'0' + Index / 10);
+  Name[4] = (CHAR16) (L'0' + Index % 10);
+  Name[5] = 0;
+}
+
+STATIC UINT32
+Attributes (
+  UINTN   Index
+  )
+{
+  if (Index % 3 == 0) {
+    return EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS;
+  }
+  return EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS;
+}
+
+STATIC EFI_STATUS
+Set (
+  UINTN   Index,
+  UINTN   Size,
+  VOID    *Data
+  )
+{
+  CHAR16  Name[8];
+
+  MakeName (Index, Name);
+  return EmuSetVariable (
+           Name, &mGuids[Index % 2], Attributes (Index), Size, Data, Global (),
+           &mVariableModuleGlobal->VolatileLastVariableOffset,
+           &mVariableModuleGlobal->NonVolatileLastVariableOffset
+           );
+}
+
+STATIC EFI_STATUS
+Get (
+  UINTN   Index,
+  UINTN   *Size,
+  VOID    *Data
+  )
+{
+  CHAR16  Name[8];
+
+  MakeName (Index, Name);
+  *Size = MAX_DATA_SIZE;
+  return EmuGetVariable (Name, &mGuids[Index % 2], NULL, Size, Data, Global ());
+}
+
+/**
+  Frees the stores and the index, a reserved non-volatile store is kept.
+**/
+STATIC VOID
+FreeStores (
+  VOID
+  )
+{
+  if (mVariableModuleGlobal == NULL) {
+    return;
+  }
+  FreePool ((VOID *) (UINTN) Global ()->VolatileVariableBase);
+  if (Global ()->NonVolatileVariableBase != mHostPcdEmuVariableNvStoreReserved) {
+    FreePool ((VOID *) (UINTN) Global ()->NonVolatileVariableBase);
+  }
+  if (mVariableModuleGlobal->VariableIndex != NULL) {
+    FreePool (mVariableModuleGlobal->VariableIndex);
+  }
+  FreePool (mVariableModuleGlobal);
+  mVariableModuleGlobal = NULL;
+}
+
+/**
+  Sets up fresh stores, with or without the variable index.
+**/
+STATIC VOID
+InitStores (
+  BOOLEAN   UseIndex
+  )
+{
+  EFI_STATUS  Status;
+
+  FreeStores ();
+  Status = VariableCommonInitialize (NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    printf ("VariableCommonInitialize failed: %lx\n", (unsigned long) Status);
+    exit (1);
+  }
+  if (!UseIndex && mVariableModuleGlobal->VariableIndex != NULL) {
+    FreePool (mVariableModuleGlobal->VariableIndex);
+    mVariableModuleGlobal->VariableIndex      = NULL;
+    mVariableModuleGlobal->VariableIndexSize  = 0;
+  }
+}
+
+STATIC VOID
+CheckVariable (
+  UINTN   Index
+  )
+{
+  UINT8       Data[MAX_DATA_SIZE];
+  UINTN       Size;
+  EFI_STATUS  Status;
+
+  Status = Get (Index, &Size, Data);
+  if (mModel[Index].Present) {
+    CHECK (Status == EFI_SUCCESS);
+    CHECK (Size == mModel[Index].Size);
+    CHECK (Status != EFI_SUCCESS || memcmp (Data, mModel[Index].Data, Size) == 0);
+  } else {
+    CHECK (Status == EFI_NOT_FOUND);
+  }
+}
+
+STATIC VOID
+CheckEnumeration (
+  VOID
+  )
+{
+  CHAR16      Name[64];
+  EFI_GUID    Guid;
+  UINTN       NameSize;
+  UINTN       Index;
+  UINTN       Count;
+  UINTN       Expected;
+  EFI_STATUS  Status;
+
+  Expected = 0;
+  for (Index = 0; Index < NAME_COUNT; Index++) {
+    if (mModel[Index].Present) {
+      Expected++;
+    }
+  }
+
+  Count   = 0;
+  Name[0] = 0;
+  for (;;) {
+    NameSize  = sizeof (Name);
+    Status    = EmuGetNextVariableName (&NameSize, Name, &Guid, Global ());
+    if (Status == EFI_NOT_FOUND) {
+      break;
+    }
+    CHECK (Status == EFI_SUCCESS);
+    if (Status != EFI_SUCCESS) {
+      break;
+    }
+    Index = (Name[3] - L'0') * 10 + (Name[4] - L'0');
+    CHECK (Index < NAME_COUNT && mModel[Index].Present);
+    CHECK (Index < NAME_COUNT && CompareGuid (&Guid, &mGuids[Index % 2]));
+    Count++;
+  }
+  CHECK (Count == Expected);
+}
+
+/**
+  Runs the random sequence against the model, logging every status.
+**/
+STATIC VOID
+RunRandom (
+  BOOLEAN   UseIndex
+  )
+{
+  UINT8       Data[MAX_DATA_SIZE];
+  UINTN       Op;
+  UINTN       Index;
+  UINTN       Size;
+  UINTN       Byte;
+  UINTN       Kind;
+  EFI_STATUS  Status;
+
+  memset (mModel, 0, sizeof (mModel));
+  mHostPcdVariableStoreSize = 0x1000;
+  InitStores (UseIndex);
+  srand (1);
+
+  for (Op = 0; Op < OP_COUNT; Op++) {
+    Index = (UINTN) rand () % NAME_COUNT;
+    Kind  = (UINTN) rand () % 20;
+    if (Kind < 5) {
+      Status = Set (Index, 0, NULL);
+      CHECK (Status == (mModel[Index].Present ? EFI_SUCCESS : EFI_NOT_FOUND));
+      mModel[Index].Present = FALSE;
+    } else if (Kind < 8 && mModel[Index].Present) {
+      memcpy (Data, mModel[Index].Data, mModel[Index].Size);
+      Status = Set (Index, mModel[Index].Size, Data);
+      CHECK (Status == EFI_SUCCESS);
+    } else {
+      Size = 1 + (UINTN) rand () % MAX_DATA_SIZE;
+      for (Byte = 0; Byte < Size; Byte++) {
+        Data[Byte] = (UINT8) rand ();
+      }
+      Status = Set (Index, Size, Data);
+      CHECK (Status == EFI_SUCCESS || Status == EFI_OUT_OF_RESOURCES);
+      if (Status == EFI_SUCCESS) {
+        mModel[Index].Present = TRUE;
+        mModel[Index].Size    = Size;
+        memcpy (mModel[Index].Data, Data, Size);
+      }
+    }
+    mLog[Op] = Status;
+
+    CheckVariable (Index);
+    if (Op % 1000 == 0) {
+      for (Index = 0; Index < NAME_COUNT; Index++) {
+        CheckVariable (Index);
+      }
+      CheckEnumeration ();
+    }
+  }
+
+  //
+  // The store filled up, so reclaim and the out of resources path did run
+  //
+  for (Op = 0; Op < OP_COUNT && mLog[Op] != EFI_OUT_OF_RESOURCES; Op++);
+  CHECK (Op < OP_COUNT);
+
+  //
+  // Without copies in delete transition left in the stores, deletes never rescan them
+  //
+  CHECK (mVariableModuleGlobal->VariableIndexShadowed == 0);
+}
+
+/**
+  Finds the copy of a variable with the given data in the non-volatile store.
+**/
+STATIC VARIABLE_HEADER *
+FindCopy (
+  UINTN   Index,
+  UINT8   Value
+  )
+{
+  VARIABLE_STORE_HEADER *Store;
+  VARIABLE_HEADER       *Variable;
+  CHAR16                Name[8];
+
+  MakeName (Index, Name);
+  Store = (VARIABLE_STORE_HEADER *) (UINTN) Global ()->NonVolatileVariableBase;
+  for (Variable = (VARIABLE_HEADER *) HEADER_ALIGN (Store + 1);
+       Variable != NULL && Variable->StartId == VARIABLE_DATA;
+       Variable = GetNextVariablePtr (Variable)) {
+    if (Variable->NameSize == StrSize (Name) &&
+        memcmp ((UINT8 *) Variable + sizeof (VARIABLE_HEADER), Name, Variable->NameSize) == 0 &&
+        *((UINT8 *) Variable + sizeof (VARIABLE_HEADER) + Variable->NameSize + GET_PAD_SIZE (Variable->NameSize)) == Value) {
+      return Variable;
+    }
+  }
+  return NULL;
+}
+
+/**
+  A store kept across a reset that stopped in the middle of an update: both
+  the old copy, in delete transition, and the new one are left in it.
+**/
+STATIC VOID
+RunInTransition (
+  BOOLEAN   UseIndex
+  )
+{
+  VARIABLE_HEADER *Copy;
+  UINT8           Data[MAX_DATA_SIZE];
+  UINT8           Value;
+  UINTN           Size;
+
+  mHostPcdVariableStoreSize = 0x4000;
+  InitStores (UseIndex);
+
+  //
+  // Var01 has an added copy and an older one in delete transition
+  //
+  Value = 1;
+  CHECK (Set (1, 1, &Value) == EFI_SUCCESS);
+  Value = 2;
+  CHECK (Set (1, 1, &Value) == EFI_SUCCESS);
+  Copy = FindCopy (1, 1);
+  CHECK (Copy != NULL && Copy->State == (VAR_ADDED & VAR_IN_DELETED_TRANSITION & VAR_DELETED));
+  if (Copy == NULL) {
+    return;
+  }
+  Copy->State = VAR_ADDED & VAR_IN_DELETED_TRANSITION;
+
+  //
+  // Var02 only has a copy in delete transition
+  //
+  Value = 3;
+  CHECK (Set (2, 1, &Value) == EFI_SUCCESS);
+  Copy = FindCopy (2, 3);
+  CHECK (Copy != NULL);
+  if (Copy == NULL) {
+    return;
+  }
+  Copy->State = VAR_ADDED & VAR_IN_DELETED_TRANSITION;
+
+  VariableIndexRebuild (Global ());
+  if (UseIndex) {
+    CHECK (mVariableModuleGlobal->VariableIndexShadowed == 1);
+  }
+
+  //
+  // The added copy wins, once it is deleted the older one is found
+  //
+  CHECK (Get (1, &Size, Data) == EFI_SUCCESS && Size == 1 && Data[0] == 2);
+  CHECK (Set (1, 0, NULL) == EFI_SUCCESS);
+  CHECK (Get (1, &Size, Data) == EFI_SUCCESS && Size == 1 && Data[0] == 1);
+  CHECK (mVariableModuleGlobal->VariableIndexShadowed == 0);
+  CHECK (Set (1, 0, NULL) == EFI_SUCCESS);
+  CHECK (Get (1, &Size, Data) == EFI_NOT_FOUND);
+
+  //
+  // The lone copy in delete transition is found and can be replaced
+  //
+  CHECK (Get (2, &Size, Data) == EFI_SUCCESS && Size == 1 && Data[0] == 3);
+  Value = 4;
+  CHECK (Set (2, 1, &Value) == EFI_SUCCESS);
+  CHECK (Get (2, &Size, Data) == EFI_SUCCESS && Size == 1 && Data[0] == 4);
+  Copy = FindCopy (2, 3);
+  CHECK (Copy != NULL && Copy->State == (VAR_ADDED & VAR_IN_DELETED_TRANSITION & VAR_DELETED));
+}
+
+/**
+  A reserved non-volatile store is kept and indexed at initialization.
+**/
+STATIC VOID
+RunReservedStore (
+  VOID
+  )
+{
+  UINT8     *Reserved;
+  UINT8     Data[MAX_DATA_SIZE];
+  UINT8     Value;
+  UINTN     Size;
+  UINTN     Index;
+
+  mHostPcdVariableStoreSize = 0x4000;
+  Reserved = malloc (mHostPcdVariableStoreSize);
+  memset (Reserved, 0xff, mHostPcdVariableStoreSize);
+  mHostPcdEmuVariableNvStoreReserved = (UINT64) (UINTN) Reserved;
+
+  InitStores (TRUE);
+  for (Index = 1; Index < NAME_COUNT; Index += 3) {
+    Value = (UINT8) Index;
+    CHECK (Set (Index, 1, &Value) == EFI_SUCCESS);
+  }
+
+  InitStores (TRUE);
+  for (Index = 1; Index < NAME_COUNT; Index += 3) {
+    CHECK (Get (Index, &Size, Data) == EFI_SUCCESS && Size == 1 && Data[0] == Index);
+  }
+
+  FreeStores ();
+  mHostPcdEmuVariableNvStoreReserved = 0;
+  free (Reserved);
+}
+
+int
+main (
+  int   argc,
+  char  **argv
+  )
+{
+  STATIC EFI_STATUS IndexLog[OP_COUNT];
+
+  RunRandom (TRUE);
+  memcpy (IndexLog, mLog, sizeof (mLog));
+  RunRandom (FALSE);
+  CHECK (memcmp (IndexLog, mLog, sizeof (mLog)) == 0);
+
+  RunInTransition (TRUE);
+  RunInTransition (FALSE);
+  RunReservedStore ();
+  FreeStores ();
+
+  if (mFailures != 0) {
+    printf ("%lu checks failed\n", (unsigned long) mFailures);
+    return 1;
+  }
+  printf ("all checks passed\n");
+  return 0;
+}
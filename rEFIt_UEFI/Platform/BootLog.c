@@ -111,39 +111,214 @@ EFI_FILE_PROTOCOL* GetDebugLogFile()
 }
 
 
-VOID SaveMessageToDebugLogFile(IN CHAR8 *LastMessage)
+//
+// DEBUG_LOG writer.
+// The mem log already holds every message, so it is the buffer: the file
+// is kept open and gets the part of the mem log not written yet, once
+// DEBUG_LOG_FLUSH_SIZE bytes are pending, DEBUG_LOG_FLUSH_PERIOD has
+// passed since the last write, or a message reports an error or warning,
+// so the lines before a hang or a fatal error are on disk. It is also
+// written before StartImage, on CheckError/CheckFatalError and from the
+// started image's ExitBootServices call, before the firmware's one runs.
+// All flushes run synchronously from DebugLog() or explicit calls, never
+// from an event, so the mem log is never read while it is being grown.
+// Nothing is written after ExitBootServices: KPDebug output of the kernel
+// and kext patchers, and anything else logged from the ExitBootServices
+// event, stays in the mem log and does not reach DEBUG_LOG.
+//
+#define DEBUG_LOG_FLUSH_SIZE    0x2000
+#define DEBUG_LOG_FLUSH_PERIOD  1           // seconds
+
+STATIC EFI_FILE_PROTOCOL  *mDebugLogFile = NULL;
+STATIC UINTN              mDebugLogSaved = 0;       // mem log bytes already in the file
+STATIC UINT64             mDebugLogLastTsc = 0;
+STATIC BOOLEAN            mDebugLogBusy = FALSE;
+STATIC BOOLEAN            mDebugLogClosed = FALSE;
+STATIC BOOLEAN            mDebugLogHeld = FALSE;    // an image runs, flush on explicit calls only
+STATIC EFI_EXIT_BOOT_SERVICES mDebugLogExitBootServices = NULL;
+
+VOID FlushDebugLog(VOID)
 {
-  STATIC BOOLEAN          FirstTimeSave = TRUE;
-//  STATIC UINTN            Position = 0;
+  EFI_STATUS              Status;
   CHAR8                   *MemLogBuffer;
   UINTN                   MemLogLen;
-  CHAR8                   *Text;
   UINTN                   TextLen;
-  EFI_FILE_HANDLE         LogFile;
-  
+  EFI_FILE_INFO           *Info;
+
+  if (!GlobalConfig.DebugLog || mDebugLogClosed || mDebugLogBusy) {
+    return;
+  }
   MemLogBuffer = GetMemLogBuffer();
   MemLogLen = GetMemLogLen();
-  Text = LastMessage;
-  TextLen = AsciiStrLen(LastMessage);
+  if (MemLogBuffer == NULL || MemLogLen <= mDebugLogSaved) {
+    return;
+  }
+  mDebugLogBusy = TRUE;
+  mDebugLogLastTsc = AsmReadTsc();
 
-  LogFile = GetDebugLogFile();
-  
-  // Write to the log file
-  if (LogFile != NULL) {
-    // Advance to the EOF so we append
-    EFI_FILE_INFO *Info = EfiLibFileInfo(LogFile);
-    if (Info) {
-      LogFile->SetPosition(LogFile, Info->FileSize);
-      // If we haven't had root before this write out whole log
-      if (FirstTimeSave) {
-        Text = MemLogBuffer;
-        TextLen = MemLogLen;
-        FirstTimeSave = FALSE;
+  if (mDebugLogFile == NULL) {
+    mDebugLogFile = GetDebugLogFile();
+    if (mDebugLogFile != NULL) {
+      // Advance to the EOF so we append
+      Info = EfiLibFileInfo(mDebugLogFile);
+      if (Info) {
+        mDebugLogFile->SetPosition(mDebugLogFile, Info->FileSize);
+        FreePool(Info);
+      } else {
+        mDebugLogFile->Close(mDebugLogFile);
+        mDebugLogFile = NULL;
       }
-      // Write out this message
-      LogFile->Write(LogFile, &TextLen, Text);
     }
-    LogFile->Close(LogFile);
+  }
+
+  if (mDebugLogFile != NULL) {
+    // The first write puts out whole log so far
+    TextLen = MemLogLen - mDebugLogSaved;
+    Status = mDebugLogFile->Write(mDebugLogFile, &TextLen, MemLogBuffer + mDebugLogSaved);
+    if (!EFI_ERROR(Status)) {
+      mDebugLogSaved += TextLen;
+      Status = mDebugLogFile->Flush(mDebugLogFile);
+    }
+    if (EFI_ERROR(Status)) {
+      // reopen on next flush
+      mDebugLogFile->Close(mDebugLogFile);
+      mDebugLogFile = NULL;
+    }
+  }
+
+  mDebugLogBusy = FALSE;
+}
+
+// Final flush when Clover returns to firmware, or from ExitBootServices.
+// Until ResumeDebugLog() later messages stay in the mem log only, so
+// nothing touches the file system from the ExitBootServices handler.
+VOID CloseDebugLog(VOID)
+{
+  FlushDebugLog();
+  mDebugLogClosed = TRUE;
+  if (mDebugLogFile != NULL) {
+    mDebugLogFile->Close(mDebugLogFile);
+    mDebugLogFile = NULL;
+  }
+}
+
+// The memory map key after our own writes changed the map. The map is not
+// freed, that would change it again.
+STATIC EFI_STATUS GetMemoryMapKey(OUT UINTN *MapKey)
+{
+  EFI_STATUS              Status;
+  EFI_MEMORY_DESCRIPTOR   *MemoryMap = NULL;
+  UINTN                   MemoryMapSize = 0;
+  UINTN                   DescriptorSize;
+  UINT32                  DescriptorVersion;
+
+  Status = gBS->GetMemoryMap(&MemoryMapSize, MemoryMap, MapKey, &DescriptorSize, &DescriptorVersion);
+  while (Status == EFI_BUFFER_TOO_SMALL) {
+    if (MemoryMap != NULL) {
+      FreePool(MemoryMap);
+    }
+    // room for the descriptors this allocation adds
+    MemoryMapSize += 4 * DescriptorSize;
+    MemoryMap = AllocatePool(MemoryMapSize);
+    if (MemoryMap == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    Status = gBS->GetMemoryMap(&MemoryMapSize, MemoryMap, MapKey, &DescriptorSize, &DescriptorVersion);
+  }
+  return Status;
+}
+
+// gBS->ExitBootServices while an image started by Clover runs: the last
+// point where DEBUG_LOG can be written. If that changed the memory map,
+// MapKey is stale, so ExitBootServices is retried once with a fresh key,
+// as AptioMemoryFix does. The loader's map differs only in boot services
+// pool, which the OS takes over anyway.
+STATIC EFI_STATUS EFIAPI DebugLogExitBootServices(IN EFI_HANDLE ImageHandle, IN UINTN MapKey)
+{
+  EFI_STATUS              Status;
+  BOOLEAN                 Written;
+
+  Written = GlobalConfig.DebugLog && !mDebugLogClosed && GetMemLogLen() > mDebugLogSaved;
+  if (Written) {
+    CloseDebugLog();
+  }
+  mDebugLogClosed = TRUE;
+
+  Status = mDebugLogExitBootServices(ImageHandle, MapKey);
+  if (Status == EFI_INVALID_PARAMETER && Written && !EFI_ERROR(GetMemoryMapKey(&MapKey))) {
+    Status = mDebugLogExitBootServices(ImageHandle, MapKey);
+  }
+  return Status;
+}
+
+// Flush before StartImage. While the image runs, messages come from events
+// and are only written from its ExitBootServices call.
+VOID HoldDebugLog(VOID)
+{
+  FlushDebugLog();
+  mDebugLogHeld = TRUE;
+  if (mDebugLogExitBootServices == NULL) {
+    mDebugLogExitBootServices = gBS->ExitBootServices;
+    gBS->ExitBootServices = DebugLogExitBootServices;
+    gBS->Hdr.CRC32 = 0;
+    gBS->CalculateCrc32(gBS, gBS->Hdr.HeaderSize, &gBS->Hdr.CRC32);
+  }
+}
+
+// The started image came back to Clover, keep writing DEBUG_LOG.
+VOID ResumeDebugLog(VOID)
+{
+  // leave it if someone hooked it after us
+  if (mDebugLogExitBootServices != NULL && gBS->ExitBootServices == DebugLogExitBootServices) {
+    gBS->ExitBootServices = mDebugLogExitBootServices;
+    gBS->Hdr.CRC32 = 0;
+    gBS->CalculateCrc32(gBS, gBS->Hdr.HeaderSize, &gBS->Hdr.CRC32);
+    mDebugLogExitBootServices = NULL;
+  }
+  mDebugLogHeld = FALSE;
+  mDebugLogClosed = FALSE;
+}
+
+// Messages that report a problem are written at once.
+STATIC CONST CHAR8 *mDebugLogErrorWords[] = {
+  "rror", "RROR", "arning", "ARNING", "fail", "Fail", "FAIL"
+};
+
+STATIC BOOLEAN IsErrorMessage(IN CHAR8 *Message)
+{
+  UINTN                   Index;
+
+  for (Index = 0; Index < sizeof(mDebugLogErrorWords) / sizeof(mDebugLogErrorWords[0]); Index++) {
+    if (AsciiStrStr(Message, mDebugLogErrorWords[Index]) != NULL) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+VOID SaveMessageToDebugLogFile(IN CHAR8 *LastMessage)
+{
+  STATIC BOOLEAN          FirstTimeSave = TRUE;
+  UINT64                  TscPeriod;
+
+  if (mDebugLogClosed || mDebugLogHeld) {
+    return;
+  }
+
+  if (FirstTimeSave) {
+    FirstTimeSave = FALSE;
+    FlushDebugLog();
+    return;
+  }
+
+  if (GetMemLogLen() - mDebugLogSaved >= DEBUG_LOG_FLUSH_SIZE ||
+      (LastMessage != NULL && IsErrorMessage(LastMessage))) {
+    FlushDebugLog();
+    return;
+  }
+  TscPeriod = MultU64x32(GetMemLogTscTicksPerSecond(), DEBUG_LOG_FLUSH_PERIOD);
+  if (TscPeriod != 0 && AsmReadTsc() - mDebugLogLastTsc >= TscPeriod) {
+    FlushDebugLog();
   }
 }
 
@@ -1072,17 +1072,14 @@ VOID findCPU(UINT8* dsdt, UINT32 length)
 // we suppose that buffer allocation is more then len+offset
 UINT32 move_data(UINT32 start, UINT8* buffer, UINT32 len, INT32 offset)
 {
-  UINT32 i;
-
+  // CopyMem handles overlapping buffers in both directions
   if (offset<0) {
-    for (i=start; i<len+offset; i++) {
-      buffer[i] = buffer[i-offset];
+    if (len + offset > start) {
+      CopyMem(buffer + start, buffer + start - offset, len + offset - start);
     }
   }
-  else  if (offset>0 && len >=1) { // data move to back
-    for (i=len-1; i>=start; i--) {
-      buffer[i+offset] = buffer[i];
-    }
+  else  if (offset>0 && len > start) { // data move to back
+    CopyMem(buffer + start + offset, buffer + start, len - start);
   }
   return len + offset;
 }
@@ -1294,20 +1291,26 @@ INT32 CmpDev(UINT8 *dsdt, UINT32 i, UINT8 *Name)
 // return position or -1 if not found
 INT32 FindBin (UINT8 *dsdt, UINT32 len, UINT8* bin, UINT32 N)
 {
-  UINT32 i, j;
-  BOOLEAN eq;
+  UINT8  *p, *end;
 
-  for (i=0; len >= N && i < len - N; i++) {
-    eq = TRUE;
-    for (j=0; j<N; j++) {
-      if (dsdt[i+j] != bin[j]) {
-        eq = FALSE;
-        break;
-      }
+  if (len <= N) {
+    return -1;
+  }
+  if (N == 0) {
+    return 0;
+  }
+  // candidates are the first byte matches, ScanMem8 is much faster than a byte loop
+  p = dsdt;
+  end = dsdt + len - N;
+  while (p < end) {
+    p = ScanMem8(p, end - p, bin[0]);
+    if (p == NULL) {
+      break;
     }
-    if (eq) {
-      return (INT32)i;
+    if (CompareMem(p + 1, bin + 1, N - 1) == 0) {
+      return (INT32)(p - dsdt);
     }
+    p++;
   }
   return -1;
 }
@@ -1701,20 +1704,18 @@ UINT32 FixADP1 (UINT8* dsdt, UINT32 len)
   return len;
 }
 
-UINT32 FixAny (UINT8* dsdt, UINT32 len, UINT8* ToFind, UINT32 LenTF, UINT8* ToReplace, UINT32 LenTR)
+#define FIX_ANY_WINDOW  8
+
+//
+// The old way, one occurence at a time with a move of the whole tail.
+// Used when there is no memory to collect the occurences.
+//
+STATIC UINT32 FixAnyOneByOne (UINT8* dsdt, UINT32 len, UINT8* ToFind, UINT32 LenTF, UINT8* ToReplace, UINT32 LenTR)
 {
   INT32 sizeoffset, adr;
   UINT32 i;
   BOOLEAN found = FALSE;
-  if (!ToFind || !LenTF || !LenTR) {
-    DBG(" invalid patches!\n");
-    return len;
-  }
-  MsgLog(" pattern %02x%02x%02x%02x,", ToFind[0], ToFind[1], ToFind[2], ToFind[3]);
-  if ((LenTF + sizeof(EFI_ACPI_DESCRIPTION_HEADER)) > len) {
-    MsgLog(" the patch is too large!\n");
-    return len;
-  }
+
   sizeoffset = LenTR - LenTF;
   for (i = 20; i < len; ) {
     adr = FindBin(dsdt + i, len - i, ToFind, LenTF);
@@ -1745,6 +1746,116 @@ UINT32 FixAny (UINT8* dsdt, UINT32 len, UINT8* ToFind, UINT32 LenTF, UINT8* ToRe
   return len;
 }
 
+//
+// All occurences are found first and the DSDT is rebuilt with one pass of
+// data moves, instead of a move of the whole tail for every occurence.
+// Outer sizes are then corrected hit by hit in ascending order. Bytes before
+// a hit are the same as when it would be patched alone, so the corrections
+// are identical to patching one occurence at a time.
+// The outer search also reads up to FIX_ANY_WINDOW bytes past the start of
+// a hit. When the next occurence is that close, those bytes would already
+// be patched, so such a DSDT goes to FixAnyOneByOne() as a whole. So does
+// one where the list of occurences can not be grown, never a part of them.
+// Unlike the old loop, the search no longer skips an occurence that follows
+// right after a replace whose outer size field got shorter.
+//
+UINT32 FixAny (UINT8* dsdt, UINT32 len, UINT8* ToFind, UINT32 LenTF, UINT8* ToReplace, UINT32 LenTR)
+{
+  INT32   sizeoffset, adr;
+  UINT32  i, j, n, from, to, NumHits = 0, MaxHits = 0, OldLen;
+  UINT32  *Hits = NULL, *NewHits;
+  INT32   shift;
+
+  if (!ToFind || !LenTF || !LenTR) {
+    DBG(" invalid patches!\n");
+    return len;
+  }
+  MsgLog(" pattern %02x%02x%02x%02x,", ToFind[0], ToFind[1], ToFind[2], ToFind[3]);
+  if ((LenTF + sizeof(EFI_ACPI_DESCRIPTION_HEADER)) > len) {
+    MsgLog(" the patch is too large!\n");
+    return len;
+  }
+  sizeoffset = LenTR - LenTF;
+
+  // collect non-overlapping occurences, as the one by one search would see them
+  for (i = 20; i < len; ) {
+    adr = FindBin(dsdt + i, len - i, ToFind, LenTF);
+    if (adr < 0) {
+      break;
+    }
+    if (NumHits == MaxHits) {
+      NewHits = ReallocatePool(MaxHits * sizeof(UINT32), (MaxHits + 32) * sizeof(UINT32), Hits);
+      if (NewHits == NULL) {
+        if (Hits != NULL) {
+          FreePool(Hits);
+        }
+        MsgLog(" no memory for batch,");
+        return FixAnyOneByOne(dsdt, len, ToFind, LenTF, ToReplace, LenTR);
+      }
+      Hits = NewHits;
+      MaxHits += 32;
+    }
+    Hits[NumHits++] = i + adr;
+    i += adr + LenTF;
+  }
+  if (NumHits == 0) {
+    MsgLog(" bin not found / already patched!\n");
+    return len;
+  }
+  // equal sizes need no outer correction, a long replace covers the window
+  if ((sizeoffset != 0) && (LenTR < FIX_ANY_WINDOW)) {
+    for (n = 0; n + 1 < NumHits; n++) {
+      if (Hits[n + 1] < Hits[n] + LenTF + FIX_ANY_WINDOW) {
+        FreePool(Hits);
+        return FixAnyOneByOne(dsdt, len, ToFind, LenTF, ToReplace, LenTR);
+      }
+    }
+  }
+  MsgLog(" patched at: [");
+  for (n = 0; n < NumHits; n++) {
+    MsgLog(" (%x)", Hits[n] - ((n == 0) ? 20 : Hits[n - 1] + LenTF));
+  }
+
+  // move the data between occurences to the final places
+  if (sizeoffset > 0) {
+    to = len + NumHits * sizeoffset;
+    from = len;
+    for (n = NumHits; n-- > 0; ) {
+      j = Hits[n] + LenTF;
+      to -= from - j;
+      CopyMem(dsdt + to, dsdt + j, from - j);
+      to -= LenTR;
+      from = Hits[n];
+    }
+  } else if (sizeoffset < 0) {
+    to = Hits[0];
+    for (n = 0; n < NumHits; n++) {
+      to += LenTR;
+      from = Hits[n] + LenTF;
+      j = (n + 1 < NumHits) ? Hits[n + 1] : len;
+      CopyMem(dsdt + to, dsdt + from, j - from);
+      to += j - from;
+    }
+  }
+  len += NumHits * sizeoffset;
+
+  // place the replaces and correct outers
+  shift = 0;
+  for (n = 0; n < NumHits; n++) {
+    adr = Hits[n] + n * sizeoffset + shift;
+    if (ToReplace != NULL) {
+      CopyMem(dsdt + adr, ToReplace, LenTR);
+    }
+    OldLen = len;
+    len = CorrectOuterMethod(dsdt, len, adr - 2, sizeoffset);
+    len = CorrectOuters(dsdt, len, adr - 3, sizeoffset);
+    shift += len - OldLen;
+  }
+  MsgLog(" ]\n");
+  FreePool(Hits);
+  return len;
+}
+
 //new method. by goodwin_c
 UINT32 FixRenameByBridge2 (UINT8* dsdt, UINT32 len, CHAR8* TgtBrgName, UINT8* ToFind, UINT32 LenTF, UINT8* ToReplace, UINT32 LenTR)
 {
@@ -704,14 +704,6 @@ typedef struct _DRIVERS_FLAGS {
   BOOLEAN APFSLoaded;
 } DRIVERS_FLAGS;
 
-struct Symbol {
-  UINTN         refCount;
-  struct Symbol *next;
-  CHAR8         string[1];
-};
-
-typedef struct Symbol Symbol, *SymbolPtr;
-
 typedef struct {
 
   UINTN  type;
@@ -721,6 +713,8 @@ typedef struct {
   UINTN  offset;
   VOID   *tag;
   VOID   *tagNext;
+  VOID   *index;    // dict only: key hash index built by GetProperty
+  VOID   *arena;    // parsed tags: owning plist arena, NULL if hand made
 
 } TagStruct, *TagPtr;
 
@@ -1769,6 +1763,18 @@ SaveBooterLog (
   IN  CHAR16 *FileName
   );
 
+VOID
+FlushDebugLog (VOID);
+
+VOID
+CloseDebugLog (VOID);
+
+VOID
+HoldDebugLog (VOID);
+
+VOID
+ResumeDebugLog (VOID);
+
 VOID
 EFIAPI
 DebugLog (
@@ -2220,26 +2226,11 @@ GetProperty (
   CONST CHAR8* key
   );
 
-EFI_STATUS
-XMLParseNextTag (
-  CHAR8  *buffer,
-  TagPtr *tag,
-  UINT32 *lenPtr
-  );
-
 VOID
 FreeTag (
   TagPtr tag
   );
 
-EFI_STATUS
-GetNextTag (
-  UINT8  *buffer,
-  CHAR8  **tag,
-  UINT32 *start,
-  UINT32 *length
-  );
-
 INTN
 GetTagCount (
   TagPtr dict
@@ -836,6 +836,11 @@ CopyKernelAndKextPatches (IN OUT  KERNEL_AND_KEXT_PATCHES *Dst,
       Dst->KernelPatches[Dst->NrKernels].Count        = Src->KernelPatches[i].Count;
       Dst->KernelPatches[Dst->NrKernels].MatchOS      = AllocateCopyPool (AsciiStrSize(Src->KernelPatches[i].MatchOS), Src->KernelPatches[i].MatchOS);
       Dst->KernelPatches[Dst->NrKernels].MatchBuild   = AllocateCopyPool (AsciiStrSize(Src->KernelPatches[i].MatchBuild), Src->KernelPatches[i].MatchBuild);
+      if (Src->KernelPatches[i].Procedure != NULL) {
+        Dst->KernelPatches[Dst->NrKernels].Procedure  = AllocateCopyPool (AsciiStrSize(Src->KernelPatches[i].Procedure), Src->KernelPatches[i].Procedure);
+      } else {
+        Dst->KernelPatches[Dst->NrKernels].Procedure  = NULL;
+      }
       if (Src->KernelPatches[i].MaskFind != NULL) {
         Dst->KernelPatches[Dst->NrKernels].MaskFind        = AllocateCopyPool (Src->KernelPatches[i].DataLen, Src->KernelPatches[i].MaskFind);
       } else {
@@ -1264,6 +1269,9 @@ FillinKextPatches (IN OUT KERNEL_AND_KEXT_PATCHES *Patches,
         if (Patches->KernelPatches[i].MatchBuild) {
           FreePool(Patches->KernelPatches[i].MatchBuild);
         }
+        if (Patches->KernelPatches[i].Procedure) {
+          FreePool(Patches->KernelPatches[i].Procedure);
+        }
       }
       Patches->NrKernels = 0;
       FreePool (Patches->KernelPatches);
@@ -1336,6 +1344,7 @@ FillinKextPatches (IN OUT KERNEL_AND_KEXT_PATCHES *Patches,
         Patches->KernelPatches[Patches->NrKernels].Count        = 0;
         Patches->KernelPatches[Patches->NrKernels].MatchOS      = NULL;
         Patches->KernelPatches[Patches->NrKernels].MatchBuild   = NULL;
+        Patches->KernelPatches[Patches->NrKernels].Procedure    = NULL;
         Patches->KernelPatches[Patches->NrKernels].Label        = AllocateCopyPool (AsciiStrSize (KernelPatchesLabel), KernelPatchesLabel);
 
         Dict = GetProperty (Prop2, "Count");
@@ -1356,6 +1365,15 @@ FillinKextPatches (IN OUT KERNEL_AND_KEXT_PATCHES *Patches,
           Patches->KernelPatches[Patches->NrKernels].MatchBuild = AllocateCopyPool (AsciiStrSize (Dict->string), Dict->string);
           DBG(" :: MatchBuild: %a", Patches->KernelPatches[Patches->NrKernels].MatchBuild);
         }
+
+        // search only in the body of this kernel procedure, e.g. _xcpm_idle;
+        // the whole kernel is searched if the kernel has no such symbol
+        // or the pattern is not found there
+        Dict = GetProperty (Prop2, "Procedure");
+        if ((Dict != NULL) && (Dict->type == kTagTypeString) && (Dict->string[0] != '\0')) {
+          Patches->KernelPatches[Patches->NrKernels].Procedure = AllocateCopyPool (AsciiStrSize (Dict->string), Dict->string);
+          DBG(" :: Procedure: %a", Patches->KernelPatches[Patches->NrKernels].Procedure);
+        }
         DBG (" :: data len: %d\n", Patches->KernelPatches[Patches->NrKernels].DataLen);
         Patches->NrKernels++;
       }
@@ -1461,6 +1479,7 @@ FillinKextPatches (IN OUT KERNEL_AND_KEXT_PATCHES *Patches,
         Patches->BootPatches[Patches->NrBoots].Count        = 0;
         Patches->BootPatches[Patches->NrBoots].MatchOS      = NULL;
         Patches->BootPatches[Patches->NrBoots].MatchBuild   = NULL;
+        Patches->BootPatches[Patches->NrBoots].Procedure    = NULL;
         Patches->BootPatches[Patches->NrBoots].Label        = AllocateCopyPool (AsciiStrSize (BootPatchesLabel), BootPatchesLabel);
 
         Dict = GetProperty (Prop2, "Count");
@@ -3454,6 +3473,7 @@ CHAR16* GetBundleVersion(CHAR16 *FullName)
       if (Prop != NULL && Prop->string != NULL) {
         CFBundleVersion = PoolPrint (L"%a", Prop->string);
       }
+      FreeTag(InfoPlistDict);
     }
   }
   if (InfoPlistPtr) {
@@ -3497,7 +3517,10 @@ VOID GetListOfInjectKext(CHAR16 *KextPath)
     mKext->MenuItem.BValue = Blocked;
     mKext->MatchOS = PoolPrint(L"%s", KextPath);
     mKext->Next = InjectKextList;
-    mKext->Version = GetBundleVersion(FullName);
+    mKext->Version = GetCachedKextVersion(FullPath, FullName);
+    if (mKext->Version == NULL) {
+      mKext->Version = GetBundleVersion(FullName);
+    }
     InjectKextList = mKext;
     //   DBG("Added mKext=%s, MatchOS=%s\n", mKext->FileName, mKext->MatchOS);
 
@@ -3516,7 +3539,10 @@ VOID GetListOfInjectKext(CHAR16 *KextPath)
       mPlugInKext->MenuItem.BValue = Blocked;
       mPlugInKext->MatchOS = PoolPrint(L"%s", KextPath);
       mPlugInKext->Next    = mKext->PlugInList;
-      mPlugInKext->Version = GetBundleVersion(PlugInsName);
+      mPlugInKext->Version = GetCachedKextVersion(FullPath, PlugInsName);
+      if (mPlugInKext->Version == NULL) {
+        mPlugInKext->Version = GetBundleVersion(PlugInsName);
+      }
       mKext->PlugInList    = mPlugInKext;
       //      DBG("---| added plugin=%s, MatchOS=%s\n", mPlugInKext->FileName, mPlugInKext->MatchOS);
       FreePool(PlugInsName);
@@ -4193,6 +4219,8 @@ InitTheme(
   UINTN      Rnd;
 
   DbgHeader("InitTheme");
+  // cached menu tiles are made of the old theme images
+  FreeMenuTiles();
   GlobalConfig.TypeSVG = FALSE;
   GlobalConfig.BootCampStyle = FALSE;
   GlobalConfig.Scale = 1.0f;
@@ -4207,6 +4235,7 @@ InitTheme(
     textFace[i].valid = FALSE;
   }
 
+  FreeSVGGlyphCache();
   NSVGfont *nextFont, *font = fontsDB;
   while (font) {
     nextFont = font->next;
@@ -6546,6 +6575,7 @@ CHAR8 *GetOSVersion(IN LOADER_ENTRY *Entry)
         if (Prop != NULL && Prop->string != NULL && Prop->string[0] != '\0') {
           Entry->BuildVersion = AllocateCopyPool (AsciiStrSize (Prop->string), Prop->string);
         }
+        FreeTag (Dict);
       }
     }
   }
@@ -6577,6 +6607,7 @@ CHAR8 *GetOSVersion(IN LOADER_ENTRY *Entry)
         if (Prop != NULL && Prop->string != NULL && Prop->string[0] != '\0') {
           Entry->BuildVersion = AllocateCopyPool (AsciiStrSize (Prop->string), Prop->string);
         }
+        FreeTag (Dict);
       }
     }
 
@@ -6609,6 +6640,7 @@ CHAR8 *GetOSVersion(IN LOADER_ENTRY *Entry)
               OSVersion = AllocateCopyPool (5, "10.7");
             }
           }
+          FreeTag (Dict);
         }
       }
     }
@@ -6655,6 +6687,7 @@ CHAR8 *GetOSVersion(IN LOADER_ENTRY *Entry)
               OSVersion = AllocateCopyPool (AsciiStrSize (Prop->string), Prop->string);
             }
           }
+          FreeTag (Dict);
         }
       }
     }
@@ -6751,6 +6784,7 @@ CHAR8 *GetOSVersion(IN LOADER_ENTRY *Entry)
           if (Prop != NULL && Prop->string != NULL && Prop->string[0] != '\0') {
             Entry->BuildVersion = AllocateCopyPool (AsciiStrSize (Prop->string), Prop->string);
           }
+          FreeTag (Dict);
         }
       }
     }
@@ -6774,6 +6808,7 @@ CHAR8 *GetOSVersion(IN LOADER_ENTRY *Entry)
         if (Prop != NULL && Prop->string != NULL && Prop->string[0] != '\0') {
           Entry->BuildVersion = AllocateCopyPool (AsciiStrSize (Prop->string), Prop->string);
         }
+        FreeTag (Dict);
       }
     } else if (FileExists (Entry->Volume->RootDir, L"\\com.apple.recovery.boot\\boot.efi")) {
       // Special case - com.apple.recovery.boot/boot.efi exists but SystemVersion.plist doesn't --> 10.9 recovery
@@ -6925,6 +6960,7 @@ GetRootUUID (IN  REFIT_VOLUME *Volume)
       Status = StrToGuidLE (Uuid, &Volume->RootUUID);
     }
 
+    FreeTag (Dict);
     FreePool (PlistBuffer);
   }
 
@@ -10,6 +10,8 @@
 #include "LoaderUefi.h"
 #include "device_tree.h"
 
+#include <Library/MachoLib.h>
+
 #include "kernel_patcher.h"
 #include "sse3_patcher.h"
 #include "sse3_5_patcher.h"
@@ -56,6 +58,21 @@ UINT32     PrelinkInfoLoadCmdAddr = 0;
 UINT32     PrelinkInfoAddr = 0;
 UINT32     PrelinkInfoSize = 0;
 
+// notes:
+// - kernel symbols are looked up in the symbol table of the kernel as boot.efi
+//   loaded it, so patches can search only the procedure they belong to
+// - symbol values are unslid; a value lives at KernelData + (value - __TEXT vmaddr)
+// - we run from the ExitBootServices event and must not allocate, so a name
+//   lookup is one pass over the symbol table
+// - without symbols (32-bit or stripped kernel) lookups fail and callers fall
+//   back to scanning KernelData
+#define KERNEL_MAX_IMAGE_SIZE 0x10000000
+
+STATIC OC_MACHO_CONTEXT  KernelContext;
+STATIC UINT64            KernelTextAddr = 0;
+STATIC BOOLEAN           KernelSymbolsInited = FALSE;
+STATIC BOOLEAN           KernelSymbolsFound = FALSE;
+
 
 VOID SetKernelRelocBase()
 {
@@ -70,6 +87,72 @@ VOID SetKernelRelocBase()
   return;
 }
 
+STATIC BOOLEAN InitKernelSymbols()
+{
+  MACH_SEGMENT_COMMAND_64  *Segment;
+
+  if (KernelSymbolsInited) {
+    return KernelSymbolsFound;
+  }
+  KernelSymbolsInited = TRUE;
+
+  if ((KernelData != NULL) && is64BitKernel &&
+      MachoInitializeLoadedContext(&KernelContext, KernelData, KERNEL_MAX_IMAGE_SIZE)) {
+    Segment = MachoGetSegmentByName64(&KernelContext, "__TEXT");
+    if ((Segment != NULL) && (Segment->FileOffset == 0)) {
+      KernelTextAddr = Segment->VirtualAddress;
+      KernelSymbolsFound = TRUE;
+    }
+  }
+
+  DBG("Kernel symbols %a\n", KernelSymbolsFound ? "found" : "not found, patches will scan the kernel");
+  return KernelSymbolsFound;
+}
+
+//
+// Returns the body of kernel procedure (or object) Name and its size,
+// or NULL if the kernel has no symbol for it.
+//
+STATIC UINT8 *FindKernelProc(IN CONST CHAR8 *Name, OUT UINTN *ProcSize)
+{
+  MACH_NLIST_64  *Symbol;
+  UINT64         Size;
+
+  if (!InitKernelSymbols()) {
+    return NULL;
+  }
+
+  Symbol = MachoGetLocalDefinedSymbolByName(&KernelContext, Name);
+  if ((Symbol == NULL) || (Symbol->Value < KernelTextAddr) ||
+      !MachoSymbolGetSize64(&KernelContext, Symbol, &Size)) {
+    DBG("%a: no symbol\n", Name);
+    return NULL;
+  }
+
+  *ProcSize = (UINTN)Size;
+  return (UINT8 *)KernelData + (UINTN)(Symbol->Value - KernelTextAddr);
+}
+
+//
+// Returns the contents of kernel section SegmentName,SectionName and its size, or NULL.
+//
+STATIC UINT8 *FindKernelSection(IN CONST CHAR8 *SegmentName, IN CONST CHAR8 *SectionName, OUT UINTN *SectionSize)
+{
+  MACH_SECTION_64  *Section;
+
+  if (!InitKernelSymbols()) {
+    return NULL;
+  }
+
+  Section = MachoGetSegmentSectionByName64(&KernelContext, SegmentName, SectionName);
+  if ((Section == NULL) || (Section->Address < KernelTextAddr)) {
+    return NULL;
+  }
+
+  *SectionSize = (UINTN)Section->Size;
+  return (UINT8 *)KernelData + (UINTN)(Section->Address - KernelTextAddr);
+}
+
 //TimeWalker - extended and corrected for systems up to Yosemite
 VOID KernelPatcher_64(VOID* kernelData, LOADER_ENTRY *Entry)
 {
@@ -494,7 +577,7 @@ STATIC UINT8 CataSearchModel[]      = {0x44, 0x89, 0xE0, 0xC0, 0xE8, 0x04};
 STATIC UINT8 CataSearchExt[]        = {0x44, 0x89, 0xE0, 0xC1, 0xE8, 0x10};
 STATIC UINT8 CataReplaceMovEax[]    = {0xB8, 0x00, 0x00, 0x00, 0x00, 0x90}; // mov eax, val || nop
 
-BOOLEAN PatchCPUID(UINT8* bytes, UINT8* Location, INT32 LenLoc,
+BOOLEAN PatchCPUID(UINT8* bytes, INT32 Size, UINT8* Location, INT32 LenLoc,
                    UINT8* Search4, UINT8* Search10, UINT8* ReplaceModel,
                    UINT8* ReplaceExt, INT32 Len, LOADER_ENTRY *Entry)
 {
@@ -504,7 +587,7 @@ BOOLEAN PatchCPUID(UINT8* bytes, UINT8* Location, INT32 LenLoc,
   UINT8 FakeModel = (Entry->KernelAndKextPatches->FakeCPUID >> 4) & 0x0f;
   UINT8 FakeExt = (Entry->KernelAndKextPatches->FakeCPUID >> 0x10) & 0x0f;
   for (Num = 0; Num < 2; Num++) {
-    Adr = FindBin(&bytes[Adr], 0x800000 - Adr, Location, LenLoc);
+    Adr = FindBin(&bytes[Adr], Size - Adr, Location, LenLoc);
     if (Adr < 0) {
       break;
     }
@@ -527,72 +610,83 @@ BOOLEAN PatchCPUID(UINT8* bytes, UINT8* Location, INT32 LenLoc,
   return Patched;
 }
 
-VOID KernelCPUIDPatch(UINT8* kernelData, LOADER_ENTRY *Entry)
+STATIC BOOLEAN KernelCPUIDPatchArea(UINT8* kernelData, INT32 Size, LOADER_ENTRY *Entry)
 {
 // Snow Leopard patterns
   DBG_RT(Entry, "CPUID: try Snow Leopard patch...\n");
-  if (PatchCPUID(kernelData, &StrCpuid1[0], sizeof(StrCpuid1), &SnowSearchModel[0],
+  if (PatchCPUID(kernelData, Size, &StrCpuid1[0], sizeof(StrCpuid1), &SnowSearchModel[0],
                  &SnowSearchExt[0], &SnowReplaceModel[0], &SnowReplaceModel[0],
                  sizeof(SnowSearchModel), Entry)) {
     DBG_RT(Entry, "...done!\n");
-    return;
+    return TRUE;
   }
 // Lion patterns
   DBG_RT(Entry, "CPUID: try Lion patch...\n");
-  if (PatchCPUID(kernelData, &StrMsr8b[0], sizeof(StrMsr8b), &LionSearchModel[0],
+  if (PatchCPUID(kernelData, Size, &StrMsr8b[0], sizeof(StrMsr8b), &LionSearchModel[0],
                  &LionSearchExt[0], &LionReplaceModel[0], &LionReplaceModel[0],
                  sizeof(LionSearchModel), Entry)) {
     DBG_RT(Entry, "...done!\n");
-    return;
+    return TRUE;
   }
 // Mountain Lion/Mavericks patterns
   DBG_RT(Entry, "CPUID: try Mountain Lion/Mavericks patch...\n");
-  if (PatchCPUID(kernelData, &StrMsr8b[0], sizeof(StrMsr8b), &MLMavSearchModel[0],
+  if (PatchCPUID(kernelData, Size, &StrMsr8b[0], sizeof(StrMsr8b), &MLMavSearchModel[0],
                  &MLMavSearchExt[0], &MLMavReplaceModel[0], &MLMavReplaceExt[0],
                  sizeof(MLMavSearchModel), Entry)) {
     DBG_RT(Entry, "...done!\n");
-    return;
+    return TRUE;
   }
 // Yosemite/El Capitan/Sierra patterns
   DBG_RT(Entry, "CPUID: try Yosemite/El Capitan/Sierra patch...\n");
-  if (PatchCPUID(kernelData, &StrMsr8b[0], sizeof(StrMsr8b), &YosECSieSearchModel[0],
+  if (PatchCPUID(kernelData, Size, &StrMsr8b[0], sizeof(StrMsr8b), &YosECSieSearchModel[0],
                  &YosECSieSearchExt[0], &LionReplaceModel[0], &LionReplaceModel[0],
                  sizeof(YosECSieSearchModel), Entry)) {
     DBG_RT(Entry, "...done!\n");
-    return;
+    return TRUE;
   }
 // High Sierra/Mojave patterns
 // Sherlocks: 10.13/10.14
   DBG_RT(Entry, "CPUID: try High Sierra/Mojave patch...\n");
-  if (PatchCPUID(kernelData, &StrMsr8b[0], sizeof(StrMsr8b), &HSieMojSearchModel[0],
+  if (PatchCPUID(kernelData, Size, &StrMsr8b[0], sizeof(StrMsr8b), &HSieMojSearchModel[0],
                  &YosECSieSearchExt[0], &LionReplaceModel[0], &LionReplaceModel[0],
                  sizeof(HSieMojSearchModel), Entry)) {
     DBG_RT(Entry, "...done!\n");
-    return;
+    return TRUE;
   }
 // Catalina patterns
 // PMheart: 10.15.DP1
   DBG_RT(Entry, "CPUID: try Catalina patch...\n");
-  if (PatchCPUID(kernelData, &StrMsr8b[0], sizeof(StrMsr8b), &CataSearchModel[0],
+  if (PatchCPUID(kernelData, Size, &StrMsr8b[0], sizeof(StrMsr8b), &CataSearchModel[0],
                  &CataSearchExt[0], &CataReplaceMovEax[0], &CataReplaceMovEax[0],
                  sizeof(CataSearchModel), Entry)) {
     DBG_RT(Entry, "...done!\n");
+    return TRUE;
+  }
+  return FALSE;
+}
+
+VOID KernelCPUIDPatch(UINT8* kernelData, LOADER_ENTRY *Entry)
+{
+  UINT8  *Proc;
+  UINTN  ProcSize;
+
+  // the patterns are in _cpuid_set_generic_info, which newer kernels inline
+  // into _cpuid_set_info; search there first, then the kernel
+  Proc = FindKernelProc("_cpuid_set_generic_info", &ProcSize);
+  if (Proc == NULL) {
+    Proc = FindKernelProc("_cpuid_set_info", &ProcSize);
+  }
+  if ((Proc != NULL) && KernelCPUIDPatchArea(Proc, (INT32)ProcSize, Entry)) {
     return;
   }
+  KernelCPUIDPatchArea(kernelData, 0x800000, Entry);
 }
 
 // new way by RehabMan 2017-08-13
 #define CompareWithMask(x,m,c) (((x) & (m)) == (c))
 
-BOOLEAN KernelPatchPm(VOID *kernelData, LOADER_ENTRY *Entry)
+STATIC BOOLEAN KernelPatchPmArea(UINT64 *Ptr, UINT64 *End)
 {
-  UINT64* Ptr = (UINT64*)kernelData;
-  UINT64* End = Ptr + 0x1000000/sizeof(UINT64);
-  if (Ptr == NULL) {
-    return FALSE;
-  }
-  // Credits to RehabMan for the kernel patch information
-  DBG("Patching kernel power management...\n");
   for (; Ptr < End; Ptr += 2) {
     // check for xcpm_scope_msr common 0xe2 prologue
     //    e2000000 xxxx0000 00000000 00000000 xx040000 00000000
@@ -623,6 +717,44 @@ BOOLEAN KernelPatchPm(VOID *kernelData, LOADER_ENTRY *Entry)
       }
     }
   }
+  return FALSE;
+}
+
+BOOLEAN KernelPatchPm(VOID *kernelData, LOADER_ENTRY *Entry)
+{
+  STATIC CONST CHAR8 *ScopeMsrs[] = { "_xcpm_core_scope_msrs", "_xcpm_SMT_scope_msrs", "_xcpm_pkg_scope_msrs" };
+  UINT8   *Start = NULL, *End = NULL, *Table;
+  UINTN   TableSize, i;
+
+  if (kernelData == NULL) {
+    return FALSE;
+  }
+  // Credits to RehabMan for the kernel patch information
+  DBG("Patching kernel power management...\n");
+
+  // the entries are in the xcpm_scope_msr tables; search those first,
+  // keeping the 16 byte stride of the full scan
+  for (i = 0; i < ARRAY_SIZE(ScopeMsrs); i++) {
+    Table = FindKernelProc(ScopeMsrs[i], &TableSize);
+    if (Table != NULL) {
+      if ((Start == NULL) || (Table < Start)) {
+        Start = Table;
+      }
+      if (Table + TableSize > End) {
+        End = Table + TableSize;
+      }
+    }
+  }
+  if (Start != NULL) {
+    Start = (UINT8*)kernelData + (((UINTN)(Start - (UINT8*)kernelData)) & ~(UINTN)0xF);
+    if (KernelPatchPmArea((UINT64*)Start, (UINT64*)End)) {
+      return TRUE;
+    }
+  }
+
+  if (KernelPatchPmArea((UINT64*)kernelData, (UINT64*)kernelData + 0x1000000/sizeof(UINT64))) {
+    return TRUE;
+  }
   DBG("Kernel power management: LAST patch region not found!\n");
   return FALSE;
 }
@@ -632,8 +764,21 @@ STATIC UINT8 PanicNoKextDumpFind[6]    = {0x00, 0x25, 0x2E, 0x2A, 0x73, 0x00};
 
 BOOLEAN KernelPanicNoKextDump(VOID *kernelData)
 {
-  UINT8      *bytes = (UINT8*)kernelData;
+  UINT8      *bytes;
   INT32      patchLocation;
+  UINTN      size;
+
+  // the format string is in __TEXT,__cstring, search only there if we know where it is
+  bytes = FindKernelSection("__TEXT", "__cstring", &size);
+  if (bytes != NULL) {
+    patchLocation = FindBin(bytes, (UINT32)size, PanicNoKextDumpFind, 6);
+    if (patchLocation >= 0) {
+      bytes[patchLocation + 1] = 0;
+      return TRUE;
+    }
+  }
+
+  bytes = (UINT8*)kernelData;
   patchLocation = FindBin(bytes, 0xF00000, PanicNoKextDumpFind, 6);
   if (patchLocation > 0) {
     bytes[patchLocation + 1] = 0;
@@ -825,17 +970,50 @@ BOOLEAN (*EnableExtCpuXCPM)(VOID *kernelData, LOADER_ENTRY *Entry, BOOLEAN use_x
 
 //
 // syscl - applyKernPatch a wrapper for SearchAndReplace() to make the CpuPM patch tidy and clean
+// comment names the kernel procedure patched: if the kernel has symbols only its body
+// is searched, the whole kernel is scanned when it has not or the pattern is not there.
+// The named procedure is the only site these patterns are meant for, so once they are
+// replaced there other occurrences elsewhere in the kernel are left alone.
 //
 static inline VOID applyKernPatch(UINT8 *kern, UINT8 *find, UINTN size, UINT8 *repl, const CHAR8 *comment)
 {
+    UINT8 *proc;
+    UINTN procSize = 0;
+
     DBG("Searching %a...\n", comment);
-    if (SearchAndReplace(kern, KERNEL_MAX_SIZE, find, size, repl, 0)) {
+    proc = FindKernelProc(comment, &procSize);
+    if (((proc != NULL) && SearchAndReplace(proc, procSize, find, size, repl, 0)) ||
+        SearchAndReplace(kern, KERNEL_MAX_SIZE, find, size, repl, 0)) {
         DBG("Found %a\nApplied %a patch\n", comment, comment);
     } else {
         DBG("%a no found, patched already?\n", comment);
     }
 }
 
+//
+// Finds the call in _xcpm_init that brings up _xcpm_pkg_scope_msrs:
+//   mov esi, 7; xor edx, edx; call ...
+// Returns the address of the call, or NULL.
+//
+STATIC UINT8 *FindXcpmPkgScopeMsrsCall(UINT8 *kern)
+{
+  STATIC UINT8 find[] = { 0xBE, 0x07, 0x00, 0x00, 0x00, 0x31, 0xD2, 0xE8 };
+  UINT8  *proc;
+  UINTN  procSize;
+  INT32  patchLocation;
+
+  proc = FindKernelProc("_xcpm_init", &procSize);
+  if (proc != NULL) {
+    patchLocation = FindBin(proc, (UINT32)procSize, find, sizeof(find));
+    if (patchLocation >= 0) {
+      return proc + patchLocation + 7;
+    }
+  }
+
+  patchLocation = FindBin(kern, 0x1000000, find, sizeof(find));
+  return (patchLocation >= 0) ? kern + patchLocation + 7 : NULL;
+}
+
 // PMHeart
 // Global XCPM patches compatibility
 // Currently 10.8.5 - 10.15
@@ -865,8 +1043,7 @@ BOOLEAN HaswellEXCPM(VOID *kernelData, LOADER_ENTRY *Entry, BOOLEAN use_xcpm_idl
   DBG("HaswellEXCPM() ===>\n");
   UINT8       *kern = (UINT8*)kernelData;
   CHAR8       *comment;
-  UINT32      i;
-  UINT32      patchLocation;
+  UINT8       *patchLocation;
   UINT64      os_version = AsciiOSVersionToUint64(Entry->OSVersion);
 
   // check OS version suit for patches
@@ -974,20 +1151,11 @@ BOOLEAN HaswellEXCPM(VOID *kernelData, LOADER_ENTRY *Entry, BOOLEAN use_xcpm_idl
     applyKernPatch(kern, find, sizeof(find), repl, comment);
   } else {
     // 10.10+
-    patchLocation = 0; // clean out the value just in case
-    for (i = 0; i < 0x1000000; i++) {
-      if (kern[i+0] == 0xBE && kern[i+1] == 0x07 && kern[i+2] == 0x00 && kern[i+3] == 0x00 &&
-          kern[i+4] == 0x00 && kern[i+5] == 0x31 && kern[i+6] == 0xD2 && kern[i+7] == 0xE8) {
-        patchLocation = i+7;
-        DBG("Found _xcpm_pkg_scope_msr\n");
-        break;
-      }
-    }
+    patchLocation = FindXcpmPkgScopeMsrsCall(kern);
 
-    if (patchLocation) {
-      for (i = 0; i < 5; i++) {
-        kern[patchLocation+i] = 0x90;
-      }
+    if (patchLocation != NULL) {
+      DBG("Found _xcpm_pkg_scope_msr\n");
+      SetMem(patchLocation, 5, 0x90);
       DBG("Applied _xcpm_pkg_scope_msr patch\n");
     } else {
       DBG("_xcpm_pkg_scope_msr not found, patch aborted\n");
@@ -1007,8 +1175,7 @@ BOOLEAN BroadwellEPM(VOID *kernelData, LOADER_ENTRY *Entry, BOOLEAN use_xcpm_idl
 {
   DBG("BroadwellEPM() ===>\n");
   UINT8       *kern = (UINT8*)kernelData;
-  UINT32      i;
-  UINT32      patchLocation;
+  UINT8       *patchLocation;
   UINT64      os_version = AsciiOSVersionToUint64(Entry->OSVersion);
 
   // check OS version suit for patches
@@ -1024,20 +1191,11 @@ BOOLEAN BroadwellEPM(VOID *kernelData, LOADER_ENTRY *Entry, BOOLEAN use_xcpm_idl
   DBG("Searching _xcpm_pkg_scope_msr ...\n");
   if (os_version >= AsciiOSVersionToUint64("10.12")) {
     // 10.12+
-    patchLocation = 0; // clean out the value just in case
-    for (i = 0; i < 0x1000000; i++) {
-      if (kern[i+0] == 0xBE && kern[i+1] == 0x07 && kern[i+2] == 0x00 && kern[i+3] == 0x00 &&
-          kern[i+4] == 0x00 && kern[i+5] == 0x31 && kern[i+6] == 0xD2 && kern[i+7] == 0xE8) {
-        patchLocation = i+7;
-        DBG("Found _xcpm_pkg_scope_msr\n");
-        break;
-      }
-    }
+    patchLocation = FindXcpmPkgScopeMsrsCall(kern);
 
-    if (patchLocation) {
-      for (i = 0; i < 5; i++) {
-        kern[patchLocation+i] = 0x90;
-      }
+    if (patchLocation != NULL) {
+      DBG("Found _xcpm_pkg_scope_msr\n");
+      SetMem(patchLocation, 5, 0x90);
       DBG("Applied _xcpm_pkg_scope_msr patch\n");
     } else {
       DBG("_xcpm_pkg_scope_msr not found, patch aborted\n");
@@ -1130,8 +1288,7 @@ BOOLEAN KernelIvyBridgeXCPM(VOID *kernelData, LOADER_ENTRY *Entry, BOOLEAN use_x
 {
   UINT8       *kern = (UINT8*)kernelData;
   CHAR8       *comment;
-  UINT32      i;
-  UINT32      patchLocation;
+  UINT8       *patchLocation;
   UINT64      os_version = AsciiOSVersionToUint64(Entry->OSVersion);
 
   // check whether Ivy Bridge
@@ -1156,20 +1313,11 @@ BOOLEAN KernelIvyBridgeXCPM(VOID *kernelData, LOADER_ENTRY *Entry, BOOLEAN use_x
   DBG("Searching _xcpm_pkg_scope_msr ...\n");
   if (os_version >= AsciiOSVersionToUint64("10.12")) {
     // 10.12+
-    patchLocation = 0; // clean out the value just in case
-    for (i = 0; i < 0x1000000; i++) {
-      if (kern[i+0] == 0xBE && kern[i+1] == 0x07 && kern[i+2] == 0x00 && kern[i+3] == 0x00 &&
-          kern[i+4] == 0x00 && kern[i+5] == 0x31 && kern[i+6] == 0xD2 && kern[i+7] == 0xE8) {
-        patchLocation = i+7;
-        DBG("Found _xcpm_pkg_scope_msr\n");
-        break;
-      }
-    }
+    patchLocation = FindXcpmPkgScopeMsrsCall(kern);
 
-    if (patchLocation) {
-      for (i = 0; i < 5; i++) {
-        kern[patchLocation+i] = 0x90;
-      }
+    if (patchLocation != NULL) {
+      DBG("Found _xcpm_pkg_scope_msr\n");
+      SetMem(patchLocation, 5, 0x90);
       DBG("Applied _xcpm_pkg_scope_msr patch\n");
     } else {
       DBG("_xcpm_pkg_scope_msr not found, patch aborted\n");
@@ -1214,8 +1362,7 @@ BOOLEAN KernelIvyE5XCPM(VOID *kernelData, LOADER_ENTRY *Entry, BOOLEAN use_xcpm_
 {
   UINT8       *kern = (UINT8*)kernelData;
   CHAR8       *comment;
-  UINT32      i;
-  UINT32      patchLocation;
+  UINT8       *patchLocation;
   UINT64      os_version = AsciiOSVersionToUint64(Entry->OSVersion);
   
   // check whether Ivy Bridge-E5
@@ -1273,20 +1420,11 @@ BOOLEAN KernelIvyE5XCPM(VOID *kernelData, LOADER_ENTRY *Entry, BOOLEAN use_xcpm_
     applyKernPatch(kern, find, sizeof(find), repl, comment);
   } else {
     // 10.10+
-    patchLocation = 0; // clean out the value just in case
-    for (i = 0; i < 0x1000000; i++) {
-      if (kern[i+0] == 0xBE && kern[i+1] == 0x07 && kern[i+2] == 0x00 && kern[i+3] == 0x00 &&
-          kern[i+4] == 0x00 && kern[i+5] == 0x31 && kern[i+6] == 0xD2 && kern[i+7] == 0xE8) {
-        patchLocation = i+7;
-        DBG("Found _xcpm_pkg_scope_msr\n");
-        break;
-      }
-    }
+    patchLocation = FindXcpmPkgScopeMsrsCall(kern);
     
-    if (patchLocation) {
-      for (i = 0; i < 5; i++) {
-        kern[patchLocation+i] = 0x90;
-      }
+    if (patchLocation != NULL) {
+      DBG("Found _xcpm_pkg_scope_msr\n");
+      SetMem(patchLocation, 5, 0x90);
       DBG("Applied _xcpm_pkg_scope_msr patch\n");
     } else {
       DBG("_xcpm_pkg_scope_msr not found, patch aborted\n");
@@ -1720,75 +1858,119 @@ FindBootArgs(IN LOADER_ENTRY *Entry)
   }
 }
 
-BOOLEAN
-KernelUserPatch(IN UINT8 *UKernelData, LOADER_ENTRY *Entry)
+//
+// Applies enabled KernelToPatch/BootPatches entries to Data, in config order.
+// Patches are matched together by the multi-pattern patcher, so Data
+// is walked once per MULTI_PATCH_MAX patches instead of once per patch.
+// A patch which depends on an earlier one starts a new sweep.
+// A kernel patch with a Procedure whose symbol is found is applied to
+// that procedure alone, after the patches before it; if the procedure
+// has no match or no symbol the whole kernel is searched as before.
+// Returns number of patches which were applied at least once.
+//
+STATIC INTN
+ApplyKernelPatches(IN UINT8 *Data, IN UINT64 DataSize, IN KERNEL_PATCH *KernelPatches, IN INTN NrPatches, LOADER_ENTRY *Entry)
 {
-  INTN Num, i = 0, y = 0;
-  for (; i < Entry->KernelAndKextPatches->NrKernels; ++i) {
-    DBG_RT(Entry, "Patch[%d]: %a\n", i, Entry->KernelAndKextPatches->KernelPatches[i].Label);
-    if (!Entry->KernelAndKextPatches->KernelPatches[i].MenuItem.BValue) {
-      //DBG_RT(Entry, "Patch[%d]: %a :: is not allowed for booted OS %a\n", i, Entry->KernelAndKextPatches->KernelPatches[i].Label, Entry->OSVersion);
-      DBG_RT(Entry, "==> disabled\n");
-      continue;
+  STATIC MULTI_PATCHER  Patcher;
+  STATIC MULTI_PATCH    Patches[MULTI_PATCH_MAX];
+  STATIC INTN           PatchIndex[MULTI_PATCH_MAX];
+  INTN                  i = 0, j, Nr, y = 0;
+  UINTN                 Num;
+  UINT8                 *Proc;
+  UINTN                 ProcSize;
+
+  while (i < NrPatches) {
+    Proc = NULL;
+    for (Nr = 0; i < NrPatches && Nr < MULTI_PATCH_MAX; ++i) {
+      if (!KernelPatches[i].MenuItem.BValue) {
+        DBG_RT(Entry, "Patch[%d]: %a\n", i, KernelPatches[i].Label);
+        DBG_RT(Entry, "==> disabled\n");
+        continue;
+      }
+      if ((KernelPatches[i].Procedure != NULL) && (Data == (UINT8*)KernelData)) {
+        Proc = FindKernelProc(KernelPatches[i].Procedure, &ProcSize);
+        if (Proc != NULL) {
+          // apply the patches before it first
+          break;
+        }
+        DBG_RT(Entry, "Patch[%d]: %a\n", i, KernelPatches[i].Label);
+        DBG_RT(Entry, "==> procedure %a not found, searching the kernel\n", KernelPatches[i].Procedure);
+      }
+      Patches[Nr].Search      = KernelPatches[i].Data;
+      Patches[Nr].MaskSearch  = KernelPatches[i].MaskFind;
+      Patches[Nr].Replace     = KernelPatches[i].Patch;
+      Patches[Nr].MaskReplace = KernelPatches[i].MaskReplace;
+      Patches[Nr].SearchSize  = (KernelPatches[i].DataLen > 0) ? (UINTN)KernelPatches[i].DataLen : 0;
+      Patches[Nr].MaxReplaces = KernelPatches[i].Count;
+      if (MultiPatchDepends(Patches, Nr, &Patches[Nr])) {
+        // apply the patches before it first
+        break;
+      }
+      PatchIndex[Nr] = i;
+      Nr++;
     }
 
-    Num = SearchAndReplaceMask(
-                               UKernelData,
-                               KERNEL_MAX_SIZE,
-                               Entry->KernelAndKextPatches->KernelPatches[i].Data,
-                               Entry->KernelAndKextPatches->KernelPatches[i].MaskFind,
-                               Entry->KernelAndKextPatches->KernelPatches[i].DataLen,
-                               Entry->KernelAndKextPatches->KernelPatches[i].Patch,
-                               Entry->KernelAndKextPatches->KernelPatches[i].MaskReplace,
-                               Entry->KernelAndKextPatches->KernelPatches[i].Count
-                               );
-
-    if (Num) {
-      y++;
+    if (Nr > 0) {
+      MultiPatcherInit(&Patcher, Patches, Nr);
+      MultiPatcherRun(&Patcher, Data, DataSize);
+
+      for (j = 0; j < Nr; ++j) {
+        Num = Patches[j].NumReplaces;
+        if (Num) {
+          y++;
+        }
+        DBG_RT(Entry, "Patch[%d]: %a\n", PatchIndex[j], KernelPatches[PatchIndex[j]].Label);
+        DBG_RT(Entry, "==> %a : %d replaces done\n", Num ? "Success" : "Error", Num);
+      }
     }
 
-    DBG_RT(Entry, "==> %a : %d replaces done\n", Num ? "Success" : "Error", Num);
+    if (Proc != NULL) {
+      // patches before it are done, apply it alone: to its procedure or,
+      // if the pattern is not there, to the whole kernel
+      DBG_RT(Entry, "Patch[%d]: %a\n", i, KernelPatches[i].Label);
+      Num = SearchAndReplaceMask(Proc, ProcSize,
+                                 KernelPatches[i].Data, KernelPatches[i].MaskFind, (UINTN)KernelPatches[i].DataLen,
+                                 KernelPatches[i].Patch, KernelPatches[i].MaskReplace, KernelPatches[i].Count);
+      if (Num) {
+        DBG_RT(Entry, "==> Success : %d replaces done in %a\n", Num, KernelPatches[i].Procedure);
+      } else {
+        DBG_RT(Entry, "==> not found in %a, searching the kernel\n", KernelPatches[i].Procedure);
+        Num = SearchAndReplaceMask(Data, DataSize,
+                                   KernelPatches[i].Data, KernelPatches[i].MaskFind, (UINTN)KernelPatches[i].DataLen,
+                                   KernelPatches[i].Patch, KernelPatches[i].MaskReplace, KernelPatches[i].Count);
+        DBG_RT(Entry, "==> %a : %d replaces done\n", Num ? "Success" : "Error", Num);
+      }
+      if (Num) {
+        y++;
+      }
+      ++i;
+    }
   }
   if (Entry->KernelAndKextPatches->KPDebug) {
     gBS->Stall(2000000);
   }
 
-  return (y != 0);
+  return y;
+}
+
+BOOLEAN
+KernelUserPatch(IN UINT8 *UKernelData, LOADER_ENTRY *Entry)
+{
+  return ApplyKernelPatches(UKernelData,
+                            KERNEL_MAX_SIZE,
+                            Entry->KernelAndKextPatches->KernelPatches,
+                            Entry->KernelAndKextPatches->NrKernels,
+                            Entry) != 0;
 }
 
 BOOLEAN
 BooterPatch(IN UINT8 *BooterData, IN UINT64 BooterSize, LOADER_ENTRY *Entry)
 {
-  INTN Num, i = 0, y = 0;
-  for (; i < Entry->KernelAndKextPatches->NrBoots; ++i) {
-    DBG_RT(Entry, "Patch[%d]: %a\n", i, Entry->KernelAndKextPatches->BootPatches[i].Label);
-    if (!Entry->KernelAndKextPatches->BootPatches[i].MenuItem.BValue) {
-      DBG_RT(Entry, "==> disabled\n");
-      continue;
-    }
-    
-    Num = SearchAndReplaceMask(
-                               BooterData,
-                               BooterSize,
-                               Entry->KernelAndKextPatches->BootPatches[i].Data,
-                               Entry->KernelAndKextPatches->BootPatches[i].MaskFind,
-                               Entry->KernelAndKextPatches->BootPatches[i].DataLen,
-                               Entry->KernelAndKextPatches->BootPatches[i].Patch,
-                               Entry->KernelAndKextPatches->BootPatches[i].MaskReplace,
-                               Entry->KernelAndKextPatches->BootPatches[i].Count
-                               );
-    
-    if (Num) {
-      y++;
-    }
-    
-    DBG_RT(Entry, "==> %a : %d replaces done\n", Num ? "Success" : "Error", Num);
-  }
-  if (Entry->KernelAndKextPatches->KPDebug) {
-    gBS->Stall(2000000);
-  }
-  
-  return (y != 0);
+  return ApplyKernelPatches(BooterData,
+                            BooterSize,
+                            Entry->KernelAndKextPatches->BootPatches,
+                            Entry->KernelAndKextPatches->NrBoots,
+                            Entry) != 0;
 }
 
 VOID
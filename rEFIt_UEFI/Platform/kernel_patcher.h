@@ -151,4 +151,48 @@ UINTN SearchAndReplace(UINT8 *Source, UINT64 SourceSize, UINT8 *Search, UINTN Se
 
 UINTN SearchAndReplaceMask(UINT8 *Source, UINT64 SourceSize, UINT8 *Search, UINT8 *MaskSearch, UINTN SearchSize, UINT8 *Replace, UINT8 *MaskReplace, INTN MaxReplaces);
 
+//
+// Multi-pattern patcher: applies a set of masked patches to Source
+// in one sweep instead of one SearchAndReplaceMask() pass per patch.
+//
+// Every patch keeps SearchAndReplaceMask() semantics: it is replaced
+// up to MaxReplaces times (no restriction if MaxReplaces <= 0) and
+// after a hit the search for the same patch continues behind it.
+// At one offset patches are tried in array order, so a later patch
+// sees bytes already written by an earlier one at that offset, but not
+// what earlier patches write further on. Callers keep patches for which
+// MultiPatchDepends() is TRUE out of the same sweep, so the result is the
+// same as with one SearchAndReplaceMask() per patch in config order.
+//
+#define MULTI_PATCH_MAX           64
+
+typedef struct MULTI_PATCH MULTI_PATCH;
+struct MULTI_PATCH
+{
+  UINT8       *Search;
+  UINT8       *MaskSearch;
+  UINT8       *Replace;
+  UINT8       *MaskReplace;
+  UINTN       SearchSize;
+  INTN        MaxReplaces;
+  UINTN       NumReplaces;   // out: number of replaces done
+  // private
+  UINT8       *NextPos;
+  INTN        Next;
+  BOOLEAN     Done;
+};
+
+typedef struct {
+  MULTI_PATCH *Patches;
+  INTN        NrPatches;
+  INTN        NrActive;
+  INTN        Bucket[256];     // first patch with given first byte, -1 if none
+  INTN        AnyFirst;        // patches with masked first byte
+  UINT8       PairFilter[0x2000];  // bitmap of possible first two bytes
+} MULTI_PATCHER;
+
+VOID  MultiPatcherInit(MULTI_PATCHER *Patcher, MULTI_PATCH *Patches, INTN NrPatches);
+UINTN MultiPatcherRun(MULTI_PATCHER *Patcher, UINT8 *Source, UINT64 SourceSize);
+BOOLEAN MultiPatchDepends(MULTI_PATCH *Patches, INTN Nr, MULTI_PATCH *Patch);
+
 #endif /* !__LIBSAIO_KERNEL_PATCHER_H */
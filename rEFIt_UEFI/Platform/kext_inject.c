@@ -75,6 +75,85 @@ EFI_STATUS EFIAPI ThinFatFile(IN OUT UINT8 **binary, IN OUT UINTN *length, IN cp
   return EFI_SUCCESS;
 }
 
+// Same as ThinFatFile, but for an open file: finds where the slice of
+// archCpuType is so that only the slice needs to be read
+STATIC EFI_STATUS GetFatFileSlice(IN EFI_FILE *File, IN cpu_type_t archCpuType, OUT UINT32 *Offset, OUT UINT32 *Size)
+{
+  EFI_STATUS      Status;
+  EFI_FILE_INFO   *Info;
+  UINT64          FileSize;
+  FAT_HEADER      fh;
+  FAT_ARCH        fa;
+  UINTN           ReadSize;
+  UINT32          nfat, swapped = 0;
+  cpu_type_t      fapcputype;
+  UINT32          fapoffset;
+  UINT32          fapsize;
+
+  *Offset = 0;
+  *Size = 0;
+  Info = EfiLibFileInfo(File);
+  if (Info == NULL) {
+    return EFI_NOT_FOUND;
+  }
+  FileSize = Info->FileSize;
+  FreePool(Info);
+  if (FileSize < sizeof(UINT32) || FileSize > MAX_UINT32) {
+    return EFI_NOT_FOUND;
+  }
+
+  ZeroMem(&fh, sizeof(fh));
+  ReadSize = (FileSize < sizeof(fh)) ? (UINTN)FileSize : sizeof(fh);
+  Status = File->Read(File, &ReadSize, &fh);
+  if (EFI_ERROR(Status)) {
+    return Status;
+  }
+
+  if (fh.magic == FAT_MAGIC) {
+    nfat = fh.nfat_arch;
+  } else if (fh.magic == FAT_CIGAM) {
+    nfat = SwapBytes32(fh.nfat_arch);
+    swapped = 1;
+    //already thin
+  } else if (fh.magic == THIN_X64 || fh.magic == THIN_IA32) {
+    if (archCpuType == ((fh.magic == THIN_X64) ? CPU_TYPE_X86_64 : CPU_TYPE_I386)) {
+      *Size = (UINT32)FileSize;
+      return EFI_SUCCESS;
+    }
+    return EFI_NOT_FOUND;
+  } else {
+    MsgLog("Thinning fails\n");
+    return EFI_NOT_FOUND;
+  }
+
+  for (; nfat > 0; nfat--) {
+    ReadSize = sizeof(fa);
+    Status = File->Read(File, &ReadSize, &fa);
+    if (EFI_ERROR(Status) || ReadSize != sizeof(fa)) {
+      return EFI_NOT_FOUND;
+    }
+    if (swapped) {
+      fapcputype = SwapBytes32(fa.cputype);
+      fapoffset = SwapBytes32(fa.offset);
+      fapsize = SwapBytes32(fa.size);
+    } else {
+      fapcputype = fa.cputype;
+      fapoffset = fa.offset;
+      fapsize = fa.size;
+    }
+    if (fapcputype == archCpuType) {
+      if (fapoffset > FileSize || fapsize > FileSize - fapoffset) {
+        return EFI_NOT_FOUND;
+      }
+      *Offset = fapoffset;
+      *Size = fapsize;
+      break;
+    }
+  }
+  // no slice for the arch leaves an empty executable, as ThinFatFile does
+  return EFI_SUCCESS;
+}
+
 void toLowerStr(CHAR8 *tstr, CHAR8 *str) {
     UINT16 cnt = 0;
     
@@ -87,17 +166,20 @@ void toLowerStr(CHAR8 *tstr, CHAR8 *str) {
     *tstr = '\0';
 }
 
-BOOLEAN checkOSBundleRequired(UINT8 loaderType, TagPtr dict)
+STATIC VOID getOSBundleRequired(TagPtr dict, CHAR8 *osbundlerequired)
 {
-    BOOLEAN inject = TRUE;
     TagPtr  osBundleRequired;
-    CHAR8   osbundlerequired[256];
-    
+
     osBundleRequired = GetProperty(dict,"OSBundleRequired");
-    if (osBundleRequired)
+    if (osBundleRequired && osBundleRequired->string)
         toLowerStr(osbundlerequired, osBundleRequired->string);
     else
         osbundlerequired[0] = '\0';
+}
+
+STATIC BOOLEAN checkOSBundleRequiredStr(UINT8 loaderType, CHAR8 *osbundlerequired)
+{
+    BOOLEAN inject = TRUE;
 
     if (OSTYPE_IS_OSX_RECOVERY(loaderType)) {
         if (AsciiStrnCmp(osbundlerequired, "root", 4) &&
@@ -117,32 +199,500 @@ BOOLEAN checkOSBundleRequired(UINT8 loaderType, TagPtr dict)
     return inject;
 }
 
+BOOLEAN checkOSBundleRequired(UINT8 loaderType, TagPtr dict)
+{
+    CHAR8   osbundlerequired[256];
+
+    getOSBundleRequired(dict, osbundlerequired);
+    return checkOSBundleRequiredStr(loaderType, osbundlerequired);
+}
+
 extern VOID KernelAndKextPatcherInit(IN LOADER_ENTRY *Entry);
 extern VOID AnyKextPatch(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32 InfoPlistSize, INT32 N, LOADER_ENTRY *Entry);
+extern CHAR8 gKextBundleIdentifier[];
+extern VOID ExtractKextBundleIdentifier(CHAR8 *Plist);
+extern BOOLEAN isPatchNameMatch(CHAR8 *BundleIdentifier, CHAR8 *Name);
+extern VOID AnyKextPatches(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32 InfoPlistSize, INT32 *Matched, INT32 NrMatched, LOADER_ENTRY *Entry);
 
-EFI_STATUS EFIAPI LoadKext(IN LOADER_ENTRY *Entry, IN EFI_FILE *RootDir, IN CHAR16 *FileName, IN cpu_type_t archCpuType, IN OUT _DeviceTreeBuffer *kext)
+////////////////////
+// kext cache
+////////////////////
+//
+// Each kexts\<dir> folder keeps a KEXT_CACHE_FILE with the ready-made
+// _BooterKextFileInfo blob of every kext and plug-in injected from it, next to
+// CFBundleVersion and OSBundleRequired. An entry stays good while size and
+// modification time of its Info.plist and executable do not change, so a warm
+// boot reads one file per folder and only stats the bundles.
+// Offsets inside a blob are relative, so blobs are handed out in place and the
+// file buffer is never freed.
+// The file is only rewritten when its content changes and never on a
+// read-only volume.
+//
+#define KEXT_CACHE_FILE       L".kextcache"
+#define KEXT_CACHE_SIGNATURE  SIGNATURE_32('K','X','C','1')
+
+typedef struct {
+  UINT32    Signature;
+  UINT32    ArchCpuType;
+  UINT32    Count;
+  UINT32    Size;           // whole file
+} KEXT_CACHE_HEADER;
+
+// followed by the strings, then the blob at the next 8 byte boundary
+typedef struct {
+  UINT32    Size;           // whole record, multiple of 8
+  UINT32    BlobSize;
+  UINT32    NameSize;       // CHAR16 bundle path, as given to LoadKext
+  UINT32    PlistNameSize;  // CHAR16, relative to the bundle
+  UINT32    ExecNameSize;   // CHAR16, relative to the bundle, 0 if no executable
+  UINT32    VersionSize;    // CHAR8 CFBundleVersion, 0 if none
+  UINT32    RequiredSize;   // CHAR8 OSBundleRequired, lowercase
+  UINT32    Reserved;
+  UINT64    PlistSize;
+  UINT64    ExecSize;
+  EFI_TIME  PlistTime;
+  EFI_TIME  ExecTime;
+} KEXT_CACHE_RECORD;
+
+typedef struct KEXT_CACHE_ENTRY KEXT_CACHE_ENTRY;
+struct KEXT_CACHE_ENTRY {
+  KEXT_CACHE_ENTRY  *Next;
+  KEXT_CACHE_RECORD Stamp;
+  CHAR16            *Name;
+  CHAR16            *PlistName;
+  CHAR16            *ExecName;
+  CHAR8             *Version;
+  CHAR8             *Required;
+  UINT8             *Blob;
+  BOOLEAN           Checked;    // stamps compared with the bundle
+  BOOLEAN           Valid;
+  BOOLEAN           Used;       // injected this boot, goes to the new file
+};
+
+typedef struct KEXT_CACHE KEXT_CACHE;
+struct KEXT_CACHE {
+  KEXT_CACHE        *Next;
+  CHAR16            *Dir;
+  UINT32            ArchCpuType;
+  KEXT_CACHE_ENTRY  *Entries;
+  UINT8             *FileData;    // file as loaded, NULL if none or not kept
+  UINTN             FileSize;
+  BOOLEAN           Dirty;
+};
+
+STATIC KEXT_CACHE *mKextCaches = NULL;
+
+STATIC BOOLEAN KextCacheTake(IN OUT UINT8 **Ptr, IN OUT UINTN *Left, IN UINT32 Size, IN UINTN CharSize, OUT VOID **Str)
+{
+  *Str = NULL;
+  if (Size > *Left || (Size % CharSize) != 0) {
+    return FALSE;
+  }
+  if (Size > 0) {
+    // strings must be terminated
+    if ((CharSize == sizeof(CHAR16)) ? (*(CHAR16 *)(*Ptr + Size - sizeof(CHAR16)) != L'\0') : ((*Ptr)[Size - 1] != '\0')) {
+      return FALSE;
+    }
+    *Str = *Ptr;
+  }
+  *Ptr += Size;
+  *Left -= Size;
+  return TRUE;
+}
+
+STATIC BOOLEAN KextCacheParse(IN KEXT_CACHE_RECORD *Record, IN UINTN Size, OUT KEXT_CACHE_ENTRY *CacheEntry)
+{
+  UINT8   *Ptr = (UINT8 *)(Record + 1);
+  UINTN   Left;
+  UINTN   Pad;
+
+  if (Size < sizeof(KEXT_CACHE_RECORD) || Record->Size < sizeof(KEXT_CACHE_RECORD) ||
+      Record->Size > Size || (Record->Size & 7) != 0) {
+    return FALSE;
+  }
+  Left = Record->Size - sizeof(KEXT_CACHE_RECORD);
+  if (!KextCacheTake(&Ptr, &Left, Record->NameSize, sizeof(CHAR16), (VOID **)&CacheEntry->Name) ||
+      !KextCacheTake(&Ptr, &Left, Record->PlistNameSize, sizeof(CHAR16), (VOID **)&CacheEntry->PlistName) ||
+      !KextCacheTake(&Ptr, &Left, Record->ExecNameSize, sizeof(CHAR16), (VOID **)&CacheEntry->ExecName) ||
+      !KextCacheTake(&Ptr, &Left, Record->VersionSize, sizeof(CHAR8), (VOID **)&CacheEntry->Version) ||
+      !KextCacheTake(&Ptr, &Left, Record->RequiredSize, sizeof(CHAR8), (VOID **)&CacheEntry->Required) ||
+      CacheEntry->Name == NULL || CacheEntry->PlistName == NULL || CacheEntry->Required == NULL) {
+    return FALSE;
+  }
+  Pad = Left & 7;   // Record->Size is a multiple of 8
+  if (Record->BlobSize < sizeof(_BooterKextFileInfo) || Left - Pad < Record->BlobSize) {
+    return FALSE;
+  }
+  CopyMem(&CacheEntry->Stamp, Record, sizeof(KEXT_CACHE_RECORD));
+  CacheEntry->Blob = Ptr + Pad;
+  return TRUE;
+}
+
+STATIC BOOLEAN KextCacheBlobRange(IN UINT32 Offset, IN UINT32 Length, IN UINT32 BlobSize)
+{
+  return Offset >= sizeof(_BooterKextFileInfo) && (UINT64)Offset + Length <= BlobSize;
+}
+
+// The blob is handed to InjectKexts as is, so every part _BooterKextFileInfo
+// points to must lie inside it. InjectKexts terminates the Info.plist with
+// the byte after it and prints the bundle path.
+STATIC BOOLEAN KextCacheBlobValid(IN KEXT_CACHE_ENTRY *CacheEntry)
+{
+  _BooterKextFileInfo *Info = (_BooterKextFileInfo *)CacheEntry->Blob;
+  UINT32              BlobSize = CacheEntry->Stamp.BlobSize;
+
+  return KextCacheBlobRange(Info->infoDictPhysAddr, Info->infoDictLength, BlobSize) &&
+         (UINT64)Info->infoDictPhysAddr + Info->infoDictLength < BlobSize &&
+         KextCacheBlobRange(Info->executablePhysAddr, Info->executableLength, BlobSize) &&
+         KextCacheBlobRange(Info->bundlePathPhysAddr, Info->bundlePathLength, BlobSize) &&
+         Info->bundlePathLength > 0 &&
+         CacheEntry->Blob[Info->bundlePathPhysAddr + Info->bundlePathLength - 1] == '\0';
+}
+
+// Returns the cache of the kexts folder, loading its file on first use
+STATIC KEXT_CACHE *KextCacheOpen(IN CHAR16 *Dir)
+{
+  KEXT_CACHE          *Cache;
+  KEXT_CACHE_HEADER   *Header;
+  KEXT_CACHE_ENTRY    *CacheEntry;
+  KEXT_CACHE_ENTRY    **Tail;
+  CHAR16              *CacheName;
+  UINT8               *Data = NULL;
+  UINTN               DataSize = 0;
+  UINTN               Offset;
+  UINT32              Index;
+
+  for (Cache = mKextCaches; Cache != NULL; Cache = Cache->Next) {
+    if (StriCmp(Cache->Dir, Dir) == 0) {
+      return Cache;
+    }
+  }
+  if (SelfRootDir == NULL) {
+    return NULL;
+  }
+  Cache = AllocateZeroPool(sizeof(KEXT_CACHE));
+  if (Cache == NULL) {
+    return NULL;
+  }
+  Cache->Dir = EfiStrDuplicate(Dir);
+  Cache->Next = mKextCaches;
+  mKextCaches = Cache;
+
+  CacheName = PoolPrint(L"%s\\%s", Dir, KEXT_CACHE_FILE);
+  egLoadFile(SelfRootDir, CacheName, &Data, &DataSize);
+  FreePool(CacheName);
+  Header = (KEXT_CACHE_HEADER *)Data;
+  if (Data == NULL || DataSize < sizeof(KEXT_CACHE_HEADER) ||
+      Header->Signature != KEXT_CACHE_SIGNATURE || Header->Size != DataSize) {
+    if (Data != NULL) {
+      FreePool(Data);
+    }
+    return Cache;
+  }
+
+  Cache->ArchCpuType = Header->ArchCpuType;
+  Tail = &Cache->Entries;
+  Offset = sizeof(KEXT_CACHE_HEADER);
+  for (Index = 0; Index < Header->Count; Index++) {
+    CacheEntry = AllocateZeroPool(sizeof(KEXT_CACHE_ENTRY));
+    if (CacheEntry == NULL) {
+      break;
+    }
+    if (!KextCacheParse((KEXT_CACHE_RECORD *)(Data + Offset), DataSize - Offset, CacheEntry)) {
+      // keep what was parsed so far, the rest gets rebuilt
+      MsgLog("Kext cache %s is damaged\n", Dir);
+      FreePool(CacheEntry);
+      break;
+    }
+    Offset += CacheEntry->Stamp.Size;
+    if (!KextCacheBlobValid(CacheEntry)) {
+      // the record itself is intact, drop only this kext
+      MsgLog("Kext cache %s: bad entry for %s dropped\n", Dir, CacheEntry->Name);
+      FreePool(CacheEntry);
+      continue;
+    }
+    *Tail = CacheEntry;
+    Tail = &CacheEntry->Next;
+  }
+  if (Cache->Entries == NULL) {
+    FreePool(Data);
+  } else {
+    Cache->FileData = Data;
+    Cache->FileSize = DataSize;
+  }
+  DBG("Kext cache %s: %d entries\n", Dir, Index);
+  return Cache;
+}
+
+STATIC BOOLEAN KextCacheStamp(IN CHAR16 *Bundle, IN CHAR16 *Name, OUT UINT64 *Size, OUT EFI_TIME *Time)
+{
+  EFI_STATUS      Status;
+  EFI_FILE        *File;
+  EFI_FILE_INFO   *Info;
+  CHAR16          FullName[256];
+
+  UnicodeSPrint(FullName, 512, L"%s\\%s", Bundle, Name);
+  Status = SelfRootDir->Open(SelfRootDir, &File, FullName, EFI_FILE_MODE_READ, 0);
+  if (EFI_ERROR(Status)) {
+    return FALSE;
+  }
+  Info = EfiLibFileInfo(File);
+  File->Close(File);
+  if (Info == NULL) {
+    return FALSE;
+  }
+  *Size = Info->FileSize;
+  CopyMem(Time, &Info->ModificationTime, sizeof(EFI_TIME));
+  FreePool(Info);
+  // without a timestamp an edit of the same size would go unnoticed
+  return Time->Year != 0;
+}
+
+STATIC BOOLEAN KextCacheStampMatch(IN CHAR16 *Bundle, IN CHAR16 *Name, IN UINT64 Size, IN EFI_TIME *Time)
+{
+  UINT64    FileSize;
+  EFI_TIME  FileTime;
+
+  return KextCacheStamp(Bundle, Name, &FileSize, &FileTime) &&
+         FileSize == Size && CompareMem(&FileTime, Time, sizeof(EFI_TIME)) == 0;
+}
+
+// Returns the valid entry for the bundle, stats the bundle once per boot
+STATIC KEXT_CACHE_ENTRY *KextCacheFind(IN KEXT_CACHE *Cache, IN CHAR16 *FileName)
+{
+  KEXT_CACHE_ENTRY  *CacheEntry;
+
+  for (CacheEntry = Cache->Entries; CacheEntry != NULL; CacheEntry = CacheEntry->Next) {
+    if (StriCmp(CacheEntry->Name, FileName) != 0) {
+      continue;
+    }
+    if (!CacheEntry->Checked) {
+      CacheEntry->Checked = TRUE;
+      CacheEntry->Valid = KextCacheStampMatch(FileName, CacheEntry->PlistName, CacheEntry->Stamp.PlistSize, &CacheEntry->Stamp.PlistTime) &&
+                          (CacheEntry->ExecName == NULL ||
+                           KextCacheStampMatch(FileName, CacheEntry->ExecName, CacheEntry->Stamp.ExecSize, &CacheEntry->Stamp.ExecTime));
+    }
+    if (CacheEntry->Valid) {
+      return CacheEntry;
+    }
+  }
+  return NULL;
+}
+
+// Entries built for another arch are of no use
+STATIC VOID KextCacheSetArch(IN KEXT_CACHE *Cache, IN cpu_type_t archCpuType)
+{
+  KEXT_CACHE_ENTRY  *CacheEntry;
+
+  if (Cache->ArchCpuType == (UINT32)archCpuType) {
+    return;
+  }
+  for (CacheEntry = Cache->Entries; CacheEntry != NULL; CacheEntry = CacheEntry->Next) {
+    CacheEntry->Checked = TRUE;
+    CacheEntry->Valid = FALSE;
+  }
+  Cache->Dirty = (Cache->Entries != NULL);
+  Cache->ArchCpuType = (UINT32)archCpuType;
+}
+
+STATIC VOID KextCacheAdd(IN KEXT_CACHE *Cache, IN CHAR16 *FileName, IN CHAR16 *PlistName, IN CHAR16 *ExecName OPTIONAL,
+                         IN CHAR8 *Version OPTIONAL, IN CHAR8 *Required, IN _DeviceTreeBuffer *kext)
+{
+  KEXT_CACHE_ENTRY  *CacheEntry;
+
+  CacheEntry = AllocateZeroPool(sizeof(KEXT_CACHE_ENTRY));
+  if (CacheEntry == NULL) {
+    return;
+  }
+  if (!KextCacheStamp(FileName, PlistName, &CacheEntry->Stamp.PlistSize, &CacheEntry->Stamp.PlistTime) ||
+      (ExecName != NULL && !KextCacheStamp(FileName, ExecName, &CacheEntry->Stamp.ExecSize, &CacheEntry->Stamp.ExecTime))) {
+    FreePool(CacheEntry);
+    return;
+  }
+  CacheEntry->Name = EfiStrDuplicate(FileName);
+  CacheEntry->PlistName = EfiStrDuplicate(PlistName);
+  CacheEntry->ExecName = (ExecName != NULL) ? EfiStrDuplicate(ExecName) : NULL;
+  CacheEntry->Version = (Version != NULL) ? AllocateCopyPool(AsciiStrSize(Version), Version) : NULL;
+  CacheEntry->Required = AllocateCopyPool(AsciiStrSize(Required), Required);
+  // the blob is not freed after injection either
+  CacheEntry->Blob = (UINT8 *)(UINTN)kext->paddr;
+  CacheEntry->Stamp.BlobSize = kext->length;
+  CacheEntry->Checked = TRUE;
+  CacheEntry->Valid = TRUE;
+  CacheEntry->Used = TRUE;
+  // a stale entry of the same bundle stays invalid and is dropped on save
+  CacheEntry->Next = Cache->Entries;
+  Cache->Entries = CacheEntry;
+  Cache->Dirty = TRUE;
+}
+
+STATIC UINT32 KextCacheStrSize16(IN CHAR16 *Str)
+{
+  return (Str != NULL) ? (UINT32)StrSize(Str) : 0;
+}
+
+STATIC UINT32 KextCacheStrSize8(IN CHAR8 *Str)
+{
+  return (Str != NULL) ? (UINT32)AsciiStrSize(Str) : 0;
+}
+
+// Rewrites the file with the entries injected this boot, if anything changed
+STATIC VOID KextCacheSave(IN KEXT_CACHE *Cache)
+{
+  EFI_STATUS          Status;
+  KEXT_CACHE_ENTRY    *CacheEntry;
+  KEXT_CACHE_HEADER   *Header;
+  KEXT_CACHE_RECORD   *Record;
+  CHAR16              *CacheName;
+  UINT8               *Data;
+  UINT8               *Ptr;
+  UINTN               Size = sizeof(KEXT_CACHE_HEADER);
+  UINTN               Strings;
+  EFI_FILE_SYSTEM_INFO *FsInfo;
+  BOOLEAN             ReadOnly;
+
+  if (Cache == NULL || !Cache->Dirty) {
+    return;
+  }
+  Cache->Dirty = FALSE;
+
+  FsInfo = EfiLibFileSystemInfo(SelfRootDir);
+  ReadOnly = (FsInfo != NULL) && FsInfo->ReadOnly;
+  if (FsInfo != NULL) {
+    FreePool(FsInfo);
+  }
+  if (ReadOnly) {
+    DBG("Kext cache %s: read-only volume, not saved\n", Cache->Dir);
+    return;
+  }
+
+  for (CacheEntry = Cache->Entries; CacheEntry != NULL; CacheEntry = CacheEntry->Next) {
+    if (!CacheEntry->Used || !CacheEntry->Valid) {
+      continue;
+    }
+    CacheEntry->Stamp.NameSize = KextCacheStrSize16(CacheEntry->Name);
+    CacheEntry->Stamp.PlistNameSize = KextCacheStrSize16(CacheEntry->PlistName);
+    CacheEntry->Stamp.ExecNameSize = KextCacheStrSize16(CacheEntry->ExecName);
+    CacheEntry->Stamp.VersionSize = KextCacheStrSize8(CacheEntry->Version);
+    CacheEntry->Stamp.RequiredSize = KextCacheStrSize8(CacheEntry->Required);
+    Strings = CacheEntry->Stamp.NameSize + CacheEntry->Stamp.PlistNameSize + CacheEntry->Stamp.ExecNameSize +
+              CacheEntry->Stamp.VersionSize + CacheEntry->Stamp.RequiredSize;
+    CacheEntry->Stamp.Size = (UINT32)(ALIGN_VALUE(sizeof(KEXT_CACHE_RECORD) + Strings, 8) +
+                                      ALIGN_VALUE(CacheEntry->Stamp.BlobSize, 8));
+    Size += CacheEntry->Stamp.Size;
+  }
+
+  Data = AllocateZeroPool(Size);
+  if (Data == NULL) {
+    return;
+  }
+  Header = (KEXT_CACHE_HEADER *)Data;
+  Header->Signature = KEXT_CACHE_SIGNATURE;
+  Header->ArchCpuType = Cache->ArchCpuType;
+  Header->Size = (UINT32)Size;
+  Ptr = Data + sizeof(KEXT_CACHE_HEADER);
+  for (CacheEntry = Cache->Entries; CacheEntry != NULL; CacheEntry = CacheEntry->Next) {
+    if (!CacheEntry->Used || !CacheEntry->Valid) {
+      continue;
+    }
+    Record = (KEXT_CACHE_RECORD *)Ptr;
+    CopyMem(Record, &CacheEntry->Stamp, sizeof(KEXT_CACHE_RECORD));
+    Ptr = (UINT8 *)(Record + 1);
+    CopyMem(Ptr, CacheEntry->Name, Record->NameSize);
+    Ptr += Record->NameSize;
+    CopyMem(Ptr, CacheEntry->PlistName, Record->PlistNameSize);
+    Ptr += Record->PlistNameSize;
+    CopyMem(Ptr, CacheEntry->ExecName, Record->ExecNameSize);
+    Ptr += Record->ExecNameSize;
+    CopyMem(Ptr, CacheEntry->Version, Record->VersionSize);
+    Ptr += Record->VersionSize;
+    CopyMem(Ptr, CacheEntry->Required, Record->RequiredSize);
+    Ptr = (UINT8 *)ALIGN_POINTER(Ptr + Record->RequiredSize, 8);
+    CopyMem(Ptr, CacheEntry->Blob, Record->BlobSize);
+    Ptr = (UINT8 *)Record + Record->Size;
+    Header->Count++;
+  }
+
+  if (Cache->FileData != NULL && Cache->FileSize == Size && CompareMem(Cache->FileData, Data, Size) == 0) {
+    // same as on disk
+    FreePool(Data);
+    return;
+  }
+
+  CacheName = PoolPrint(L"%s\\%s", Cache->Dir, KEXT_CACHE_FILE);
+  Status = egSaveFile(SelfRootDir, CacheName, Data, Size);
+  if (EFI_ERROR(Status)) {
+    DBG("Kext cache %s: not saved: %r\n", CacheName, Status);
+  } else {
+    MsgLog("Kext cache %s: %d entries saved\n", CacheName, Header->Count);
+  }
+  FreePool(CacheName);
+  FreePool(Data);
+}
+
+// Version of a bundle in a kexts folder from its cache, NULL if not cached.
+// Caller is responsible for FreePool the result
+CHAR16 *GetCachedKextVersion(IN CHAR16 *KextDir, IN CHAR16 *FileName)
+{
+  KEXT_CACHE        *Cache;
+  KEXT_CACHE_ENTRY  *CacheEntry;
+
+  Cache = KextCacheOpen(KextDir);
+  if (Cache == NULL) {
+    return NULL;
+  }
+  CacheEntry = KextCacheFind(Cache, FileName);
+  if (CacheEntry == NULL || CacheEntry->Version == NULL) {
+    return NULL;
+  }
+  return PoolPrint(L"%a", CacheEntry->Version);
+}
+
+STATIC EFI_STATUS LoadKextBundle(IN LOADER_ENTRY *Entry, IN EFI_FILE *RootDir, IN CHAR16 *FileName, IN cpu_type_t archCpuType, IN OUT _DeviceTreeBuffer *kext, IN KEXT_CACHE *Cache OPTIONAL)
 {
   EFI_STATUS  Status;
   UINT8*      infoDictBuffer = NULL;
   UINTN       infoDictBufferLength = 0;
-  UINT8*      executableFatBuffer = NULL;
-  UINT8*      executableBuffer = NULL;
+  EFI_FILE    *ExecFile = NULL;
+  UINT32      SliceOffset = 0;
+  UINT32      SliceLength = 0;
   UINTN       executableBufferLength = 0;
-  CHAR8*      bundlePathBuffer = NULL;
   UINTN       bundlePathBufferLength = 0;
   CHAR16      TempName[256];
   CHAR16      Executable[256];
+  CHAR16      *PlistName;
+  CHAR16      ExecName[256];
+  CHAR8       *Version = NULL;
+  CHAR8       osbundlerequired[256];
   TagPtr      dict = NULL;
   TagPtr      prop = NULL;
   BOOLEAN     NoContents = FALSE;
   BOOLEAN     inject = FALSE;
   _BooterKextFileInfo *infoAddr = NULL;
+  KEXT_CACHE_ENTRY    *CacheEntry;
+
+  if (Cache != NULL) {
+    CacheEntry = KextCacheFind(Cache, FileName);
+    if (CacheEntry != NULL) {
+      if (!checkOSBundleRequiredStr(Entry->LoaderType, CacheEntry->Required)) {
+        MsgLog("Skipping kext injection by OSBundleRequired : %s\n", FileName);
+        return EFI_UNSUPPORTED;
+      }
+      CacheEntry->Used = TRUE;
+      kext->paddr = (UINT32)(UINTN)CacheEntry->Blob;
+      kext->length = CacheEntry->Stamp.BlobSize;
+      DBG("Kext from cache: %s\n", FileName);
+      return EFI_SUCCESS;
+    }
+  }
 
-  UnicodeSPrint(TempName, 512, L"%s\\%s", FileName, L"Contents\\Info.plist");
+  PlistName = L"Contents\\Info.plist";
+  UnicodeSPrint(TempName, 512, L"%s\\%s", FileName, PlistName);
   Status = egLoadFile(RootDir, TempName, &infoDictBuffer, &infoDictBufferLength);
   if (EFI_ERROR(Status)) {
     //try to find a planar kext, without Contents
-    UnicodeSPrint(TempName, 512, L"%s\\%s", FileName, L"Info.plist");
+    PlistName = L"Info.plist";
+    UnicodeSPrint(TempName, 512, L"%s\\%s", FileName, PlistName);
     Status = egLoadFile(RootDir, TempName, &infoDictBuffer, &infoDictBufferLength);
     if (EFI_ERROR(Status)) {
       MsgLog("Failed to load extra kext (Info.plist not found): %s\n", FileName);
@@ -156,65 +706,121 @@ EFI_STATUS EFIAPI LoadKext(IN LOADER_ENTRY *Entry, IN EFI_FILE *RootDir, IN CHAR
     return EFI_NOT_FOUND;
   }
     
-  inject = checkOSBundleRequired(Entry->LoaderType, dict);
+  getOSBundleRequired(dict, osbundlerequired);
+  inject = checkOSBundleRequiredStr(Entry->LoaderType, osbundlerequired);
   if(!inject) {
       MsgLog("Skipping kext injection by OSBundleRequired : %s\n", FileName);
+      FreeTag(dict);
+      FreePool(infoDictBuffer);
       return EFI_UNSUPPORTED;
   }
     
   prop = GetProperty(dict,"CFBundleExecutable");
   if(prop!=0) {
     AsciiStrToUnicodeStrS(prop->string, Executable, 256);
+  } else {
+    Executable[0] = L'\0';
+  }
+  if (Cache != NULL) {
+    prop = GetProperty(dict,"CFBundleVersion");
+    if (prop != NULL && prop->string != NULL) {
+      Version = AllocateCopyPool(AsciiStrSize(prop->string), prop->string);
+    }
+  }
+  FreeTag(dict);
+  if(Executable[0] != L'\0') {
     if (NoContents) {
-      UnicodeSPrint(TempName, 512, L"%s\\%s", FileName, Executable);
+      UnicodeSPrint(ExecName, 512, L"%s", Executable);
     } else {
-      UnicodeSPrint(TempName, 512, L"%s\\%s\\%s", FileName, L"Contents\\MacOS",Executable);
+      UnicodeSPrint(ExecName, 512, L"%s\\%s", L"Contents\\MacOS",Executable);
     }
-    Status = egLoadFile(RootDir, TempName, &executableFatBuffer, &executableBufferLength);
+    UnicodeSPrint(TempName, 512, L"%s\\%s", FileName, ExecName);
+    Status = RootDir->Open(RootDir, &ExecFile, TempName, EFI_FILE_MODE_READ, 0);
     if (EFI_ERROR(Status)) {
       FreePool(infoDictBuffer);
+      if (Version != NULL) {
+        FreePool(Version);
+      }
       MsgLog("Failed to load extra kext (executable not found): %s\n", FileName);
       return EFI_NOT_FOUND;
     }
-    executableBuffer = executableFatBuffer;
-    if (ThinFatFile(&executableBuffer, &executableBufferLength, archCpuType)) {
+    if (GetFatFileSlice(ExecFile, archCpuType, &SliceOffset, &SliceLength)) {
+      ExecFile->Close(ExecFile);
       FreePool(infoDictBuffer);
-      FreePool(executableBuffer);
+      if (Version != NULL) {
+        FreePool(Version);
+      }
       MsgLog("Thinning failed: %s\n", FileName);
       return EFI_NOT_FOUND;
     }
+    executableBufferLength = SliceLength;
   }
   bundlePathBufferLength = StrLen(FileName) + 1;
-  bundlePathBuffer = AllocateZeroPool(bundlePathBufferLength);
-  UnicodeStrToAsciiStrS(FileName, bundlePathBuffer, bundlePathBufferLength);
 
+  // everything goes straight to its place in the blob, the executable is
+  // read from the file, only the slice of our arch
   kext->length = (UINT32)(sizeof(_BooterKextFileInfo) + infoDictBufferLength + executableBufferLength + bundlePathBufferLength);
   infoAddr = (_BooterKextFileInfo *)AllocatePool(kext->length);
+  if (infoAddr == NULL) {
+    if (ExecFile != NULL) {
+      ExecFile->Close(ExecFile);
+    }
+    FreePool(infoDictBuffer);
+    if (Version != NULL) {
+      FreePool(Version);
+    }
+    MsgLog("Failed to load extra kext (no memory): %s\n", FileName);
+    return EFI_OUT_OF_RESOURCES;
+  }
   infoAddr->infoDictPhysAddr = sizeof(_BooterKextFileInfo);
   infoAddr->infoDictLength = (UINT32)infoDictBufferLength;
   infoAddr->executablePhysAddr = (UINT32)(sizeof(_BooterKextFileInfo) + infoDictBufferLength);
   infoAddr->executableLength = (UINT32)executableBufferLength;
   infoAddr->bundlePathPhysAddr = (UINT32)(sizeof(_BooterKextFileInfo) + infoDictBufferLength + executableBufferLength);
   infoAddr->bundlePathLength = (UINT32)bundlePathBufferLength;
-  kext->paddr = (UINT32)(UINTN)infoAddr; // Note that we cannot free infoAddr because of this
-  CopyMem((CHAR8 *)infoAddr + sizeof(_BooterKextFileInfo), infoDictBuffer, infoDictBufferLength);
-  CopyMem((CHAR8 *)infoAddr + sizeof(_BooterKextFileInfo) + infoDictBufferLength, executableBuffer, executableBufferLength);
-  CopyMem((CHAR8 *)infoAddr + sizeof(_BooterKextFileInfo) + infoDictBufferLength + executableBufferLength, bundlePathBuffer, bundlePathBufferLength);
+  CopyMem((CHAR8 *)infoAddr + infoAddr->infoDictPhysAddr, infoDictBuffer, infoDictBufferLength);
   FreePool(infoDictBuffer);
-  FreePool(executableFatBuffer);
-  FreePool(bundlePathBuffer);
+  if (ExecFile != NULL) {
+    Status = ExecFile->SetPosition(ExecFile, SliceOffset);
+    if (!EFI_ERROR(Status)) {
+      Status = ExecFile->Read(ExecFile, &executableBufferLength, (CHAR8 *)infoAddr + infoAddr->executablePhysAddr);
+    }
+    ExecFile->Close(ExecFile);
+    if (EFI_ERROR(Status) || executableBufferLength != infoAddr->executableLength) {
+      FreePool(infoAddr);
+      if (Version != NULL) {
+        FreePool(Version);
+      }
+      MsgLog("Failed to load extra kext (executable not read): %s\n", FileName);
+      return EFI_NOT_FOUND;
+    }
+  }
+  UnicodeStrToAsciiStrS(FileName, (CHAR8 *)infoAddr + infoAddr->bundlePathPhysAddr, bundlePathBufferLength);
+  kext->paddr = (UINT32)(UINTN)infoAddr; // Note that we cannot free infoAddr because of this
+
+  if (Cache != NULL) {
+    KextCacheAdd(Cache, FileName, PlistName, (Executable[0] != L'\0') ? ExecName : NULL, Version, osbundlerequired, kext);
+    if (Version != NULL) {
+      FreePool(Version);
+    }
+  }
 
   return EFI_SUCCESS;
 }
 
-EFI_STATUS EFIAPI AddKext(IN LOADER_ENTRY *Entry, IN EFI_FILE *RootDir, IN CHAR16 *FileName, IN cpu_type_t archCpuType)
+EFI_STATUS EFIAPI LoadKext(IN LOADER_ENTRY *Entry, IN EFI_FILE *RootDir, IN CHAR16 *FileName, IN cpu_type_t archCpuType, IN OUT _DeviceTreeBuffer *kext)
+{
+  return LoadKextBundle(Entry, RootDir, FileName, archCpuType, kext, NULL);
+}
+
+STATIC EFI_STATUS AddKextBundle(IN LOADER_ENTRY *Entry, IN EFI_FILE *RootDir, IN CHAR16 *FileName, IN cpu_type_t archCpuType, IN KEXT_CACHE *Cache OPTIONAL)
 {
   EFI_STATUS  Status;
   KEXT_ENTRY  *KextEntry;
 
   KextEntry = AllocatePool (sizeof(KEXT_ENTRY));
   KextEntry->Signature = KEXT_SIGNATURE;
-  Status = LoadKext(Entry, RootDir, FileName, archCpuType, &KextEntry->kext);
+  Status = LoadKextBundle(Entry, RootDir, FileName, archCpuType, &KextEntry->kext, Cache);
   if(EFI_ERROR(Status)) {
     FreePool(KextEntry);
   } else {
@@ -224,6 +830,11 @@ EFI_STATUS EFIAPI AddKext(IN LOADER_ENTRY *Entry, IN EFI_FILE *RootDir, IN CHAR1
   return Status;
 }
 
+EFI_STATUS EFIAPI AddKext(IN LOADER_ENTRY *Entry, IN EFI_FILE *RootDir, IN CHAR16 *FileName, IN cpu_type_t archCpuType)
+{
+  return AddKextBundle(Entry, RootDir, FileName, archCpuType, NULL);
+}
+
 UINT32 GetListCount(LIST_ENTRY const* List)
 {
   LIST_ENTRY    *Link;
@@ -284,8 +895,14 @@ VOID AddKexts(IN LOADER_ENTRY *Entry, CHAR16 *SrcDir, CHAR16 *Path, CHAR16 *UniS
   SIDELOAD_KEXT           *CurrentKext;
   SIDELOAD_KEXT           *CurrentPlugInKext;
   EFI_STATUS              Status;
+  KEXT_CACHE              *Cache;
 
   MsgLog("Preparing kexts injection for arch=%s from %s\n", (archCpuType==CPU_TYPE_X86_64)?L"x86_64":(archCpuType==CPU_TYPE_I386)?L"i386":L"", SrcDir);
+  // kexts are taken from SelfVolume, same as the cache
+  Cache = KextCacheOpen(SrcDir);
+  if (Cache != NULL) {
+    KextCacheSetArch(Cache, archCpuType);
+  }
   CurrentKext = InjectKextList;
   while (CurrentKext) {
     DBG("current kext name %s Match %s, while sysver: %s\n", CurrentKext->FileName, CurrentKext->MatchOS, UniSysVers);
@@ -294,7 +911,7 @@ VOID AddKexts(IN LOADER_ENTRY *Entry, CHAR16 *SrcDir, CHAR16 *Path, CHAR16 *UniS
       if (!(CurrentKext->MenuItem.BValue)) {
         // inject require
         MsgLog("Extra kext: %s (v.%s)\n", FileName, CurrentKext->Version);
-        Status = AddKext(Entry, SelfVolume->RootDir, FileName, archCpuType);
+        Status = AddKextBundle(Entry, SelfVolume->RootDir, FileName, archCpuType, Cache);
         if(!EFI_ERROR(Status)) {
         // decide which plugins to inject
         CurrentPlugInKext = CurrentKext->PlugInList;
@@ -303,7 +920,7 @@ VOID AddKexts(IN LOADER_ENTRY *Entry, CHAR16 *SrcDir, CHAR16 *Path, CHAR16 *UniS
           if (!(CurrentPlugInKext->MenuItem.BValue)) {
             // inject PlugIn require
             MsgLog("  |-- PlugIn kext: %s (v.%s)\n", PlugInName, CurrentPlugInKext->Version);
-            AddKext(Entry, SelfVolume->RootDir, PlugInName, archCpuType);
+            AddKextBundle(Entry, SelfVolume->RootDir, PlugInName, archCpuType, Cache);
           } else {
             MsgLog("  |-- Disabled plug-in kext: %s (v.%s)\n", PlugInName, CurrentPlugInKext->Version);
           }
@@ -318,6 +935,7 @@ VOID AddKexts(IN LOADER_ENTRY *Entry, CHAR16 *SrcDir, CHAR16 *Path, CHAR16 *UniS
     CurrentKext = CurrentKext->Next;
   } // end of kext injection
 
+  KextCacheSave(Cache);
 }
 
 EFI_STATUS LoadKexts(IN LOADER_ENTRY *Entry)
@@ -585,22 +1203,35 @@ EFI_STATUS InjectKexts(/*IN EFI_MEMORY_DESCRIPTOR *Desc*/ IN UINT32 deviceTreeP,
       DBG_RT(Entry, " %d - %a\n", Index, (CHAR8 *)(UINTN)drvinfo->bundlePathPhysAddr);
       if (gSettings.KextPatchesAllowed) {
         INT32  i;
+        INT32  Matched[MULTI_PATCH_MAX];
+        INT32  NrMatched = 0;
         CHAR8  SavedValue;
         CHAR8 *InfoPlist = (CHAR8*)(UINTN)drvinfo->infoDictPhysAddr;
         SavedValue = InfoPlist[drvinfo->infoDictLength];
         InfoPlist[drvinfo->infoDictLength] = '\0';
         KernelAndKextPatcherInit(Entry);
+        ExtractKextBundleIdentifier(InfoPlist);
         for (i = 0; i < Entry->KernelAndKextPatches->NrKexts; i++) {
+          // match by bundle identifier; only a Name that is not a bundle
+          // identifier (no dot) falls back to searching the whole Info.plist
+          CHAR8 *Name = Entry->KernelAndKextPatches->KextPatches[i].Name;
           if ((Entry->KernelAndKextPatches->KextPatches[i].DataLen > 0) &&
-              (AsciiStrStr(InfoPlist, Entry->KernelAndKextPatches->KextPatches[i].Name) != NULL)) {
-            AnyKextPatch(
-                         (UINT8*)(UINTN)drvinfo->executablePhysAddr,
-                         drvinfo->executableLength,
-                         InfoPlist,
-                         drvinfo->infoDictLength,
-                         i,
-                         Entry
-                         );
+              (isPatchNameMatch(gKextBundleIdentifier, Name) ||
+               ((AsciiStrStr(Name, ".") == NULL) && (AsciiStrStr(InfoPlist, Name) != NULL)))) {
+            Matched[NrMatched++] = i;
+          }
+          if (NrMatched == MULTI_PATCH_MAX ||
+              (NrMatched > 0 && i == Entry->KernelAndKextPatches->NrKexts - 1)) {
+            AnyKextPatches(
+                           (UINT8*)(UINTN)drvinfo->executablePhysAddr,
+                           drvinfo->executableLength,
+                           InfoPlist,
+                           drvinfo->infoDictLength,
+                           Matched,
+                           NrMatched,
+                           Entry
+                           );
+            NrMatched = 0;
           }
         }
         InfoPlist[drvinfo->infoDictLength] = SavedValue;
@@ -90,6 +90,7 @@ typedef struct
 // functions
 ////////////////////
 EFI_STATUS LoadKexts(IN LOADER_ENTRY *Entry);
+CHAR16 *GetCachedKextVersion(IN CHAR16 *KextDir, IN CHAR16 *FileName);
 EFI_STATUS InjectKexts(IN UINT32 deviceTreeP, IN UINT32* deviceTreeLength, LOADER_ENTRY *Entry);
 
 VOID EFIAPI KernelBooterExtensionsPatch(IN UINT8 *KernelData, LOADER_ENTRY *Entry);
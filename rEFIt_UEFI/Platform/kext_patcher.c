@@ -124,6 +124,188 @@ UINTN SearchAndReplaceMask(UINT8 *Source, UINT64 SourceSize, UINT8 *Search, UINT
   return NumReplaces;
 }
 
+//
+// Builds the first byte index for Patches.
+// Patches with unmasked first byte are chained into Bucket[FirstByte],
+// others are checked at every offset. Chains are kept in array order.
+//
+VOID MultiPatcherInit(MULTI_PATCHER *Patcher, MULTI_PATCH *Patches, INTN NrPatches)
+{
+  INTN        Index;
+  INTN        *Tail[256];
+  INTN        *AnyTail;
+  UINTN       Second;
+  UINTN       Pair;
+  MULTI_PATCH *Patch;
+
+  SetMem(Patcher->Bucket, sizeof(Patcher->Bucket), 0xFF);
+  ZeroMem(Patcher->PairFilter, sizeof(Patcher->PairFilter));
+  Patcher->AnyFirst = -1;
+  Patcher->Patches = Patches;
+  Patcher->NrPatches = NrPatches;
+  Patcher->NrActive = 0;
+
+  for (Index = 0; Index < 256; Index++) {
+    Tail[Index] = &Patcher->Bucket[Index];
+  }
+  AnyTail = &Patcher->AnyFirst;
+
+  for (Index = 0; Index < NrPatches; Index++) {
+    Patch = &Patches[Index];
+    Patch->NumReplaces = 0;
+    Patch->NextPos = NULL;
+    Patch->Next = -1;
+    Patch->Done = (!Patch->Search || !Patch->Replace || !Patch->SearchSize);
+    if (Patch->Done) {
+      continue;
+    }
+    Patcher->NrActive++;
+
+    if (Patch->MaskSearch && Patch->MaskSearch[0] != 0xFF) {
+      *AnyTail = Index;
+      AnyTail = &Patch->Next;
+      continue;
+    }
+
+    *Tail[Patch->Search[0]] = Index;
+    Tail[Patch->Search[0]] = &Patch->Next;
+
+    if (Patch->SearchSize < 2 || (Patch->MaskSearch && Patch->MaskSearch[1] != 0xFF)) {
+      // any second byte is possible
+      for (Second = 0; Second < 256; Second++) {
+        Pair = Patch->Search[0] | (Second << 8);
+        Patcher->PairFilter[Pair >> 3] |= (UINT8)(1 << (Pair & 7));
+      }
+    } else {
+      Pair = Patch->Search[0] | ((UINTN)Patch->Search[1] << 8);
+      Patcher->PairFilter[Pair >> 3] |= (UINT8)(1 << (Pair & 7));
+    }
+  }
+}
+
+//
+// Applies all patches from Patcher to Source in one sweep.
+// Returns total number of replaces done, per patch counts are
+// left in MULTI_PATCH.NumReplaces.
+//
+UINTN MultiPatcherRun(MULTI_PATCHER *Patcher, UINT8 *Source, UINT64 SourceSize)
+{
+  UINTN       Total = 0;
+  UINT8       *Pos;
+  UINT8       *End = Source + SourceSize;
+  UINTN       Pair;
+  INTN        Bi;
+  INTN        Ai;
+  INTN        Index;
+  MULTI_PATCH *Patch;
+  MULTI_PATCH *Patches = Patcher->Patches;
+
+  if (!Source || Patcher->NrActive == 0) {
+    return 0;
+  }
+
+  for (Pos = Source; (Pos < End) && (Patcher->NrActive > 0); Pos++) {
+    Bi = Patcher->Bucket[*Pos];
+    if (Bi >= 0 && (Pos + 1) < End) {
+      Pair = Pos[0] | ((UINTN)Pos[1] << 8);
+      if ((Patcher->PairFilter[Pair >> 3] & (1 << (Pair & 7))) == 0) {
+        Bi = -1;
+      }
+    }
+    Ai = Patcher->AnyFirst;
+
+    // merge both chains so patches are tried in array order
+    while (Bi >= 0 || Ai >= 0) {
+      if (Ai < 0 || (Bi >= 0 && Bi < Ai)) {
+        Index = Bi;
+        Bi = Patches[Bi].Next;
+      } else {
+        Index = Ai;
+        Ai = Patches[Ai].Next;
+      }
+      Patch = &Patches[Index];
+      if (Patch->Done || Pos < Patch->NextPos || (UINTN)(End - Pos) < Patch->SearchSize) {
+        continue;
+      }
+      if (!CompareMemMask(Pos, Patch->Search, Patch->MaskSearch, Patch->SearchSize)) {
+        continue;
+      }
+      CopyMemMask(Pos, Patch->Replace, Patch->MaskReplace, Patch->SearchSize);
+      Patch->NumReplaces++;
+      Patch->NextPos = Pos + Patch->SearchSize;
+      Total++;
+      if (Patch->MaxReplaces > 0 && Patch->NumReplaces >= (UINTN)Patch->MaxReplaces) {
+        Patch->Done = TRUE;
+        Patcher->NrActive--;
+      }
+    }
+  }
+
+  return Total;
+}
+
+
+//
+// Returns TRUE if pattern B can be put over pattern A at some offset
+// so that they overlap and agree on all bits both of them care about.
+//
+STATIC BOOLEAN MaskedPatternsOverlap(UINT8 *A, UINT8 *MaskA, UINTN SizeA, UINT8 *B, UINT8 *MaskB, UINTN SizeB)
+{
+  INTN  Shift;
+  INTN  Ind;
+  INTN  Start;
+  INTN  End;
+  UINT8 M;
+
+  for (Shift = 1 - (INTN)SizeB; Shift < (INTN)SizeA; Shift++) {
+    Start = (Shift > 0) ? Shift : 0;
+    End = (Shift + (INTN)SizeB < (INTN)SizeA) ? Shift + (INTN)SizeB : (INTN)SizeA;
+    for (Ind = Start; Ind < End; Ind++) {
+      M = (MaskA ? MaskA[Ind] : 0xFF) & (MaskB ? MaskB[Ind - Shift] : 0xFF);
+      if (((A[Ind] ^ B[Ind - Shift]) & M) != 0) {
+        break;
+      }
+    }
+    if (Ind == End) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+//
+// Returns TRUE if Patch may interact with one of Patches[0..Nr), ie. a
+// match of it can overlap a match of an earlier patch, before or after that
+// one is replaced. Such a patch must not join the same sweep: one
+// SearchAndReplaceMask() per patch lets it see the whole output of the
+// earlier ones, the sweep would not. Replaced bits not in MaskReplace are
+// taken as unknown, so the check can only err on the safe side.
+//
+BOOLEAN MultiPatchDepends(MULTI_PATCH *Patches, INTN Nr, MULTI_PATCH *Patch)
+{
+  INTN        Index;
+  MULTI_PATCH *Earlier;
+
+  if (!Patch->Search || !Patch->Replace || !Patch->SearchSize) {
+    return FALSE;
+  }
+  for (Index = 0; Index < Nr; Index++) {
+    Earlier = &Patches[Index];
+    if (!Earlier->Search || !Earlier->Replace || !Earlier->SearchSize) {
+      continue;
+    }
+    if (MaskedPatternsOverlap(Earlier->Search, Earlier->MaskSearch, Earlier->SearchSize,
+                              Patch->Search, Patch->MaskSearch, Patch->SearchSize) ||
+        MaskedPatternsOverlap(Earlier->Replace, Earlier->MaskReplace, Earlier->SearchSize,
+                              Patch->Search, Patch->MaskSearch, Patch->SearchSize) ||
+        MaskedPatternsOverlap(Earlier->Search, Earlier->MaskSearch, Earlier->SearchSize,
+                              Patch->Replace, Patch->MaskReplace, Patch->SearchSize)) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
 
 UINTN SearchAndReplaceTxt(UINT8 *Source, UINT64 SourceSize, UINT8 *Search, UINTN SearchSize, UINT8 *Replace, INTN MaxReplaces)
 {
@@ -254,6 +436,273 @@ isPatchNameMatch (CHAR8   *BundleIdentifier, CHAR8   *Name)
 
 
 
+////////////////////////////////////
+//
+// Prelinked kexts index
+//
+// PRELINK_INFO is walked once and for every kext its bundle identifier,
+// _PrelinkExecutableSourceAddr, _PrelinkExecutableSize and Info.plist range
+// are recorded. Kexts are then found by bundle identifier through a hash
+// table instead of searching the XML again for every kext and patch.
+// Only static storage is used since we are called from ExitBootServices().
+//
+
+#define PRELINKED_KEXTS_MAX     1024
+#define PRELINKED_HASH_SIZE     2048    // must be power of 2
+#define PRELINKED_IDS_MAX       8192
+#define PRELINKED_NAMES_SIZE    0x10000
+
+#define PRELINKED_KEY_NONE      0
+#define PRELINKED_KEY_BUNDLEID  1
+#define PRELINKED_KEY_ADDR      2
+#define PRELINKED_KEY_SIZE      3
+
+typedef struct {
+  CHAR8   *BundleId;
+  CHAR8   *InfoStart;
+  CHAR8   *InfoEnd;
+  UINT64  SourceAddr;
+  UINT64  Size;
+  BOOLEAN HasAddr;
+  BOOLEAN HasSize;
+  UINT32  Hash;
+  INT32   Next;
+} PRELINKED_KEXT;
+
+STATIC PRELINKED_KEXT PrelinkedKexts[PRELINKED_KEXTS_MAX];
+STATIC INT32          PrelinkedKextsHash[PRELINKED_HASH_SIZE];
+STATIC UINT32         NrPrelinkedKexts = 0;
+STATIC CHAR8          PrelinkedNames[PRELINKED_NAMES_SIZE];
+STATIC UINT64         PrelinkedIdValue[PRELINKED_IDS_MAX];
+STATIC UINT8          PrelinkedIdValid[PRELINKED_IDS_MAX / 8];
+STATIC BOOLEAN        PrelinkedKextsIndexed = FALSE;
+
+UINT64 GetPlistHexValue(CHAR8 *Plist, CHAR8 *Key, CHAR8 *WholePlist);
+
+STATIC UINT32 PrelinkedHash(CONST CHAR8 *Str)
+{
+  UINT32 Hash = 2166136261U;    // FNV-1a
+
+  while (*Str != '\0') {
+    Hash = (Hash ^ (UINT8)*Str++) * 16777619U;
+  }
+  return Hash;
+}
+
+//
+// Returns indexed kext with given BundleId or NULL.
+//
+STATIC PRELINKED_KEXT *FindPrelinkedKext(CONST CHAR8 *BundleId)
+{
+  UINT32          Hash = PrelinkedHash(BundleId);
+  INT32           Index = PrelinkedKextsHash[Hash & (PRELINKED_HASH_SIZE - 1)];
+  PRELINKED_KEXT  *Kext;
+
+  while (Index >= 0) {
+    Kext = &PrelinkedKexts[Index];
+    if (Kext->Hash == Hash && AsciiStrCmp(Kext->BundleId, BundleId) == 0) {
+      return Kext;
+    }
+    Index = Kext->Next;
+  }
+  return NULL;
+}
+
+//
+// Parses <integer ...> tag at Tag. Values with ID="n" are remembered,
+// IDREF="n" is resolved from values seen before.
+// Returns FALSE if Value can not be determined.
+//
+STATIC BOOLEAN ParsePrelinkedInteger(CHAR8 *Tag, UINT64 *Value)
+{
+  CHAR8   *End;
+  CHAR8   *Attr;
+  UINTN   Id = 0;
+  BOOLEAN HasId = FALSE;
+  BOOLEAN IsRef = FALSE;
+
+  for (End = Tag; *End != '>'; End++) {
+    if (*End == '\0') {
+      return FALSE;
+    }
+  }
+
+  for (Attr = Tag + 8; Attr < End; Attr++) {
+    if (AsciiStrnCmp(Attr, " IDREF=\"", 8) == 0) {
+      Id = AsciiStrDecimalToUintn(Attr + 8);
+      HasId = IsRef = TRUE;
+      break;
+    }
+    if (AsciiStrnCmp(Attr, " ID=\"", 5) == 0) {
+      Id = AsciiStrDecimalToUintn(Attr + 5);
+      HasId = TRUE;
+      break;
+    }
+  }
+
+  if (End[-1] == '/') {
+    // <integer IDREF="26"/>
+    if (!IsRef || Id >= PRELINKED_IDS_MAX || (PrelinkedIdValid[Id >> 3] & (1 << (Id & 7))) == 0) {
+      return FALSE;
+    }
+    *Value = PrelinkedIdValue[Id];
+    return TRUE;
+  }
+
+  // <integer ID="26" size="64">0x2b000</integer>
+  *Value = AsciiStrHexToUint64(End + 1);
+  if (HasId && !IsRef && Id < PRELINKED_IDS_MAX) {
+    PrelinkedIdValue[Id] = *Value;
+    PrelinkedIdValid[Id >> 3] |= (UINT8)(1 << (Id & 7));
+  }
+  return TRUE;
+}
+
+//
+// Closes kext dict: resolves values which could not be parsed
+// on the fly and adds kext to the hash table.
+//
+STATIC VOID AddPrelinkedKext(PRELINKED_KEXT *Kext, CHAR8 *WholePlist)
+{
+  CHAR8   SavedValue;
+  UINT32  Bucket;
+
+  if (!Kext->HasAddr || !Kext->HasSize) {
+    SavedValue = *Kext->InfoEnd;
+    *Kext->InfoEnd = '\0';
+    if (!Kext->HasAddr) {
+      Kext->SourceAddr = GetPlistHexValue(Kext->InfoStart, kPrelinkExecutableSourceKey, WholePlist);
+    }
+    if (!Kext->HasSize) {
+      Kext->Size = GetPlistHexValue(Kext->InfoStart, kPrelinkExecutableSizeKey, WholePlist);
+    }
+    *Kext->InfoEnd = SavedValue;
+  }
+
+  if (Kext->BundleId != NULL) {
+    Kext->Hash = PrelinkedHash(Kext->BundleId);
+    Bucket = Kext->Hash & (PRELINKED_HASH_SIZE - 1);
+    Kext->Next = PrelinkedKextsHash[Bucket];
+    PrelinkedKextsHash[Bucket] = (INT32)(Kext - PrelinkedKexts);
+  }
+}
+
+//
+// Walks PRELINK_INFO once and builds prelinked kexts index.
+// Returns FALSE if index does not fit into static storage.
+//
+BOOLEAN IndexPrelinkedKexts(CHAR8 *WholePlist)
+{
+  CHAR8           *Ptr = WholePlist;
+  CHAR8           *End;
+  INTN            DictLevel = 0;
+  UINTN           KeyType = PRELINKED_KEY_NONE;
+  UINTN           NamesUsed = 0;
+  UINTN           Len;
+  UINT64          Value;
+  PRELINKED_KEXT  *Kext = NULL;
+
+  PrelinkedKextsIndexed = FALSE;
+  NrPrelinkedKexts = 0;
+  SetMem(PrelinkedKextsHash, sizeof(PrelinkedKextsHash), 0xFF);
+  ZeroMem(PrelinkedIdValid, sizeof(PrelinkedIdValid));
+
+  while (*Ptr != '\0') {
+    if (*Ptr != '<') {
+      Ptr++;
+      continue;
+    }
+
+    if (AsciiStrnCmp(Ptr, "<dict>", 6) == 0) {
+      DictLevel++;
+      if (DictLevel == 2) {
+        // kext start
+        if (NrPrelinkedKexts >= PRELINKED_KEXTS_MAX) {
+          return FALSE;
+        }
+        Kext = &PrelinkedKexts[NrPrelinkedKexts++];
+        ZeroMem(Kext, sizeof(PRELINKED_KEXT));
+        Kext->Next = -1;
+        Kext->InfoStart = Ptr;
+      }
+      KeyType = PRELINKED_KEY_NONE;
+      Ptr += 6;
+
+    } else if (AsciiStrnCmp(Ptr, "</dict>", 7) == 0) {
+      if (DictLevel == 2 && Kext != NULL) {
+        // kext end
+        Kext->InfoEnd = Ptr + 7;
+        AddPrelinkedKext(Kext, WholePlist);
+        Kext = NULL;
+      }
+      DictLevel--;
+      KeyType = PRELINKED_KEY_NONE;
+      Ptr += 7;
+
+    } else if (AsciiStrnCmp(Ptr, "<key>", 5) == 0) {
+      Ptr += 5;
+      End = AsciiStrStr(Ptr, "</key>");
+      if (End == NULL) {
+        break;
+      }
+      KeyType = PRELINKED_KEY_NONE;
+      if (DictLevel == 2 && Kext != NULL) {
+        Len = End - Ptr;
+        if (Len == sizeof(kPropCFBundleIdentifier) - 1 &&
+            AsciiStrnCmp(Ptr, kPropCFBundleIdentifier, Len) == 0) {
+          KeyType = PRELINKED_KEY_BUNDLEID;
+        } else if (Len == sizeof(kPrelinkExecutableSourceKey) - 1 &&
+                   AsciiStrnCmp(Ptr, kPrelinkExecutableSourceKey, Len) == 0) {
+          KeyType = PRELINKED_KEY_ADDR;
+        } else if (Len == sizeof(kPrelinkExecutableSizeKey) - 1 &&
+                   AsciiStrnCmp(Ptr, kPrelinkExecutableSizeKey, Len) == 0) {
+          KeyType = PRELINKED_KEY_SIZE;
+        }
+      }
+      Ptr = End + 6;
+
+    } else if (AsciiStrnCmp(Ptr, "<string>", 8) == 0) {
+      Ptr += 8;
+      for (End = Ptr; *End != '<' && *End != '\0'; End++);
+      if (KeyType == PRELINKED_KEY_BUNDLEID) {
+        Len = End - Ptr;
+        if (NamesUsed + Len + 1 > PRELINKED_NAMES_SIZE) {
+          return FALSE;
+        }
+        Kext->BundleId = &PrelinkedNames[NamesUsed];
+        CopyMem(Kext->BundleId, Ptr, Len);
+        Kext->BundleId[Len] = '\0';
+        NamesUsed += Len + 1;
+      }
+      KeyType = PRELINKED_KEY_NONE;
+      Ptr = End;
+
+    } else if (AsciiStrnCmp(Ptr, "<integer", 8) == 0) {
+      // always parsed to remember referenced IDs
+      if (ParsePrelinkedInteger(Ptr, &Value)) {
+        if (KeyType == PRELINKED_KEY_ADDR) {
+          Kext->SourceAddr = Value;
+          Kext->HasAddr = TRUE;
+        } else if (KeyType == PRELINKED_KEY_SIZE) {
+          Kext->Size = Value;
+          Kext->HasSize = TRUE;
+        }
+      }
+      KeyType = PRELINKED_KEY_NONE;
+      Ptr += 8;
+
+    } else {
+      KeyType = PRELINKED_KEY_NONE;
+      Ptr++;
+    }
+  }
+
+  PrelinkedKextsIndexed = TRUE;
+  return TRUE;
+}
+
+
+
 ////////////////////////////////////
 //
 // ATIConnectors patch
@@ -335,7 +784,6 @@ VOID ATIConnectorsPatch(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT
   
   DBG_RT(Entry, "\nATIConnectorsPatch: driverAddr = %x, driverSize = %x\nController = %s\n",
          Driver, DriverSize, Entry->KernelAndKextPatches->KPATIConnectorsController);
-  ExtractKextBundleIdentifier(InfoPlist);
   DBG_RT(Entry, "Kext: %a\n", gKextBundleIdentifier);
   
   // number of occurences od Data should be 1
@@ -542,15 +990,24 @@ VOID AppleRTCPatch(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32 In
 // InjectKexts if no FakeSMC: Detect FakeSMC and if present then
 // disable kext injection InjectKexts()
 //
-// not used since 4242
+// InfoPlist is searched only if prelinked kexts index is not available
+//
 VOID CheckForFakeSMC(CHAR8 *InfoPlist, LOADER_ENTRY *Entry)
 {
+  BOOLEAN Found;
+
   if (OSFLAG_ISSET(Entry->Flags, OSFLAG_CHECKFAKESMC) &&
       OSFLAG_ISSET(Entry->Flags, OSFLAG_WITHKEXTS)) {
-    if (AsciiStrStr(InfoPlist, "<string>org.netkas.driver.FakeSMC</string>") != NULL
-        || AsciiStrStr(InfoPlist, "<string>org.netkas.FakeSMC</string>") != NULL
-        || AsciiStrStr(InfoPlist, "<string>as.vit9696.VirtualSMC</string>") != NULL)
-    {
+    if (PrelinkedKextsIndexed) {
+      Found = FindPrelinkedKext("org.netkas.driver.FakeSMC") != NULL
+           || FindPrelinkedKext("org.netkas.FakeSMC") != NULL
+           || FindPrelinkedKext("as.vit9696.VirtualSMC") != NULL;
+    } else {
+      Found = AsciiStrStr(InfoPlist, "<string>org.netkas.driver.FakeSMC</string>") != NULL
+           || AsciiStrStr(InfoPlist, "<string>org.netkas.FakeSMC</string>") != NULL
+           || AsciiStrStr(InfoPlist, "<string>as.vit9696.VirtualSMC</string>") != NULL;
+    }
+    if (Found) {
       Entry->Flags = OSFLAG_UNSET(Entry->Flags, OSFLAG_WITHKEXTS);
       if (Entry->KernelAndKextPatches->KPDebug) {
         DBG_RT(Entry, "\nFakeSMC or VirtualSMC found, UNSET WITHKEXTS\n");
@@ -963,10 +1420,6 @@ VOID AnyKextPatch(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32 Inf
     return;
   }
 
-  if (Entry->KernelAndKextPatches->KPDebug) {
-    ExtractKextBundleIdentifier(InfoPlist);
-  }
-
   DBG_RT(Entry, "Kext: %a\n", gKextBundleIdentifier);
 
   if (!Entry->KernelAndKextPatches->KextPatches[N].IsPlistPatch) {
@@ -1011,6 +1464,65 @@ VOID AnyKextPatch(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32 Inf
   }
 }
 
+//
+// Applies KextsToPatch entries listed in Matched (at most MULTI_PATCH_MAX)
+// to one kext, gKextBundleIdentifier must be already set. Binary patches are matched together in one sweep over
+// Driver, a patch depending on an earlier one starts a new sweep. Info.plist patches are done by AnyKextPatch()
+// one by one.
+//
+VOID AnyKextPatches(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32 InfoPlistSize, INT32 *Matched, INT32 NrMatched, LOADER_ENTRY *Entry)
+{
+  STATIC MULTI_PATCHER  Patcher;
+  STATIC MULTI_PATCH    Patches[MULTI_PATCH_MAX];
+  STATIC INT32          PatchIndex[MULTI_PATCH_MAX];
+  KEXT_PATCH            *KextPatch;
+  INT32                 Ind = 0;
+  INT32                 Nr;
+  INT32                 j;
+
+  while (Ind < NrMatched) {
+    for (Nr = 0; Ind < NrMatched && Nr < MULTI_PATCH_MAX; Ind++) {
+      KextPatch = &Entry->KernelAndKextPatches->KextPatches[Matched[Ind]];
+      if (KextPatch->IsPlistPatch || !KextPatch->MenuItem.BValue) {
+        AnyKextPatch(Driver, DriverSize, InfoPlist, InfoPlistSize, Matched[Ind], Entry);
+        continue;
+      }
+      Patches[Nr].Search      = KextPatch->Data;
+      Patches[Nr].MaskSearch  = KextPatch->MaskFind;
+      Patches[Nr].Replace     = KextPatch->Patch;
+      Patches[Nr].MaskReplace = KextPatch->MaskReplace;
+      Patches[Nr].SearchSize  = (KextPatch->DataLen > 0) ? (UINTN)KextPatch->DataLen : 0;
+      Patches[Nr].MaxReplaces = -1;
+      if (MultiPatchDepends(Patches, Nr, &Patches[Nr])) {
+        break;
+      }
+      PatchIndex[Nr] = Matched[Ind];
+      Nr++;
+    }
+    if (Nr == 0) {
+      continue;
+    }
+
+    MultiPatcherInit(&Patcher, Patches, Nr);
+    MultiPatcherRun(&Patcher, Driver, DriverSize);
+
+    if (Entry->KernelAndKextPatches->KPDebug) {
+      for (j = 0; j < Nr; j++) {
+        DBG_RT(Entry, "\nAnyKextPatch %d: driverAddr = %x, driverSize = %x\nAnyKext = %a\n",
+               PatchIndex[j], Driver, DriverSize, Entry->KernelAndKextPatches->KextPatches[PatchIndex[j]].Label);
+        DBG_RT(Entry, "Kext: %a\n", gKextBundleIdentifier);
+        DBG_RT(Entry, "Binary patch\n");
+        if (Patches[j].NumReplaces > 0) {
+          DBG_RT(Entry, "==> patched %d times!\n", Patches[j].NumReplaces);
+        } else {
+          DBG_RT(Entry, "==> NOT patched!\n");
+        }
+      }
+      gBS->Stall(2000000);
+    }
+  }
+}
+
 //
 // Called from SetFSInjection(), before boot.efi is started,
 // to allow patchers to prepare FSInject to force load needed kexts.
@@ -1032,12 +1544,24 @@ VOID KextPatcherRegisterKexts(FSINJECTION_PROTOCOL *FSInject, FSI_STRING_LIST *F
 }
 
 //
-// PatchKext is called for every kext from prelinked kernel (kernelcache) or from DevTree (booting with drivers).
+// PatchKextById is called for every kext from prelinked kernel (kernelcache) or from DevTree (booting with drivers)
+// once its BundleId is known. Patches are dispatched by comparing BundleId, Info.plist is not searched.
+// Matching is the same as PatchKext() always did: a Name with a dot must equal BundleId, a short Name
+// like "AppleHDA" only has to be part of it.
 // Add kext detection code here and call kext specific patch function.
 //
-VOID PatchKext(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32 InfoPlistSize, LOADER_ENTRY *Entry)
+VOID PatchKextById(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32 InfoPlistSize, CHAR8 *BundleId, LOADER_ENTRY *Entry)
 {
   INT32 i;
+  INT32 Matched[MULTI_PATCH_MAX];
+  INT32 NrMatched = 0;
+
+  if (BundleId != gKextBundleIdentifier) {
+    if (AsciiStrSize(BundleId) > sizeof(gKextBundleIdentifier)) {
+      return;
+    }
+    AsciiStrCpyS(gKextBundleIdentifier, sizeof(gKextBundleIdentifier), BundleId);
+  }
   
   if (Entry->KernelAndKextPatches->KPATIConnectorsController != NULL) {
     //
@@ -1046,52 +1570,49 @@ VOID PatchKext(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32 InfoPl
     if (!ATIConnectorsPatchInited) {
       ATIConnectorsPatchInit(Entry);
     }
-    if (   AsciiStrStr(InfoPlist, ATIKextBundleId[0]) != NULL  // ATI boundle id
-        || AsciiStrStr(InfoPlist, ATIKextBundleId[1]) != NULL  // AMD boundle id
-        || AsciiStrStr(InfoPlist, "com.apple.kext.ATIFramebuffer") != NULL // SnowLeo
-        || AsciiStrStr(InfoPlist, "com.apple.kext.AMDFramebuffer") != NULL //Maverics
+    if (   AsciiStrCmp(gKextBundleIdentifier, ATIKextBundleId[0]) == 0  // ATI boundle id
+        || AsciiStrCmp(gKextBundleIdentifier, ATIKextBundleId[1]) == 0  // AMD boundle id
+        || AsciiStrCmp(gKextBundleIdentifier, "com.apple.kext.ATIFramebuffer") == 0 // SnowLeo
+        || AsciiStrCmp(gKextBundleIdentifier, "com.apple.kext.AMDFramebuffer") == 0 //Maverics
         ) {
       ATIConnectorsPatch(Driver, DriverSize, InfoPlist, InfoPlistSize, Entry);
       return;
     }
   }
   
-  ExtractKextBundleIdentifier(InfoPlist);
-  
   if (Entry->KernelAndKextPatches->KPAppleIntelCPUPM &&
-      (AsciiStrStr(InfoPlist,
-                   "<string>com.apple.driver.AppleIntelCPUPowerManagement</string>") != NULL)) {
+      (AsciiStrCmp(gKextBundleIdentifier, "com.apple.driver.AppleIntelCPUPowerManagement") == 0)) {
     //
     // AppleIntelCPUPM
     //
     AppleIntelCPUPMPatch(Driver, DriverSize, InfoPlist, InfoPlistSize, Entry);
   } else if (Entry->KernelAndKextPatches->KPAppleRTC &&
-             (AsciiStrStr(InfoPlist, "com.apple.driver.AppleRTC") != NULL)) {
+             (AsciiStrCmp(gKextBundleIdentifier, "com.apple.driver.AppleRTC") == 0)) {
     //
     // AppleRTC
     //
     AppleRTCPatch(Driver, DriverSize, InfoPlist, InfoPlistSize, Entry);
   } else if (Entry->KernelAndKextPatches->KPDELLSMBIOS &&
-           (AsciiStrStr(InfoPlist, "com.apple.driver.AppleSMBIOS") != NULL)) {
+           (AsciiStrCmp(gKextBundleIdentifier, "com.apple.driver.AppleSMBIOS") == 0)) {
     //
     // DellSMBIOSPatch
     //
     DBG_RT(Entry, "Remap SMBIOS Table require, AppleSMBIOS...\n");
     DellSMBIOSPatch(Driver, DriverSize, InfoPlist, InfoPlistSize, Entry);
   } else if (Entry->KernelAndKextPatches->KPDELLSMBIOS &&
-             (AsciiStrStr(InfoPlist, "com.apple.driver.AppleACPIPlatform") != NULL)) {
+             (AsciiStrCmp(gKextBundleIdentifier, "com.apple.driver.AppleACPIPlatform") == 0)) {
     //
     // DellSMBIOS
     //
     // AppleACPIPlatform
     //
     DellSMBIOSPatch(Driver, DriverSize, InfoPlist, InfoPlistSize, Entry);
-  } else if (gBDWEIOPCIFixRequire && (AsciiStrStr(InfoPlist, "com.apple.iokit.IOPCIFamily") != NULL)) {
+  } else if (gBDWEIOPCIFixRequire && (AsciiStrCmp(gKextBundleIdentifier, "com.apple.iokit.IOPCIFamily") == 0)) {
     //
     // Braodwell-E IOPCIFamily Patch
     //
     BDWE_IOPCIPatch(Driver, DriverSize, InfoPlist, InfoPlistSize, Entry);
-  } else if (gSNBEAICPUFixRequire && (AsciiStrStr(InfoPlist, "com.apple.driver.AppleIntelCPUPowerManagement") != NULL)) {
+  } else if (gSNBEAICPUFixRequire && (AsciiStrCmp(gKextBundleIdentifier, "com.apple.driver.AppleIntelCPUPowerManagement") == 0)) {
     //
     // SandyBridge-E AppleIntelCPUPowerManagement Patch implemented by syscl
     //
@@ -1108,9 +1629,16 @@ VOID PatchKext(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32 InfoPl
           isBundle?(AsciiStrCmp(gKextBundleIdentifier, Name) == 0):(AsciiStrStr(gKextBundleIdentifier, Name) != NULL)) {
       //    (AsciiStrStr(InfoPlist, Entry->KernelAndKextPatches->KextPatches[i].Name) != NULL)) {
         DBG_RT(Entry, "\n\nPatch kext: %a\n", Entry->KernelAndKextPatches->KextPatches[i].Name);
-        AnyKextPatch(Driver, DriverSize, InfoPlist, InfoPlistSize, i, Entry);
+        Matched[NrMatched++] = i;
+        if (NrMatched == MULTI_PATCH_MAX) {
+          AnyKextPatches(Driver, DriverSize, InfoPlist, InfoPlistSize, Matched, NrMatched, Entry);
+          NrMatched = 0;
+        }
       }
     }
+    if (NrMatched > 0) {
+      AnyKextPatches(Driver, DriverSize, InfoPlist, InfoPlistSize, Matched, NrMatched, Entry);
+    }
 //  }
   
   //
@@ -1120,6 +1648,15 @@ VOID PatchKext(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32 InfoPl
   // CheckForFakeSMC(InfoPlist, Entry);
 }
 
+//
+// PatchKext is called for kexts whose bundle identifier is not known yet.
+//
+VOID PatchKext(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32 InfoPlistSize, LOADER_ENTRY *Entry)
+{
+  ExtractKextBundleIdentifier(InfoPlist);
+  PatchKextById(Driver, DriverSize, InfoPlist, InfoPlistSize, gKextBundleIdentifier, Entry);
+}
+
 //
 // Returns parsed hex integer key.
 // Plist - kext pist
@@ -1286,6 +1823,8 @@ VOID PatchPrelinkedKexts(LOADER_ENTRY *Entry)
   //INTN      DbgCount = 0;
   UINT32    KextAddr;
   UINT32    KextSize;
+  UINT32    Index;
+  PRELINKED_KEXT *Kext;
   
   
   WholePlist = (CHAR8*)(UINTN)PrelinkInfoAddr;
@@ -1304,8 +1843,37 @@ VOID PatchPrelinkedKexts(LOADER_ENTRY *Entry)
   //Slice
   // I see no reason to disable kext injection if FakeSMC found in cache
   //since rev4240 we have manual kext inject disable
+  IndexPrelinkedKexts(WholePlist);
   CheckForFakeSMC(WholePlist, Entry);
-  
+
+  if (PrelinkedKextsIndexed) {
+    for (Index = 0; Index < NrPrelinkedKexts; Index++) {
+      Kext = &PrelinkedKexts[Index];
+      if (Kext->BundleId == NULL) {
+        continue;
+      }
+      // truncate to 32 bit to get physical addr, KextAddr is always
+      // relative to 0x200000 and must be adjusted for KernelSlide
+      // and AptioFixDrv's KernelRelocBase
+      KextAddr = (UINT32)Kext->SourceAddr + KernelSlide + (UINT32)KernelRelocBase;
+      KextSize = (UINT32)Kext->Size;
+
+      SavedValue = *Kext->InfoEnd;
+      *Kext->InfoEnd = '\0';
+      PatchKextById(
+                    (UINT8*)(UINTN)KextAddr,
+                    KextSize,
+                    Kext->InfoStart,
+                    (UINT32)(Kext->InfoEnd - Kext->InfoStart),
+                    Kext->BundleId,
+                    Entry
+                    );
+      *Kext->InfoEnd = SavedValue;
+    }
+    return;
+  }
+
+  // index does not fit - walk the plist for every kext
   DictPtr = WholePlist;
   while ((DictPtr = AsciiStrStr(DictPtr, "dict>")) != NULL) {
     if (DictPtr[-1] == '<') {
@@ -29,6 +29,7 @@
  */
 //Slice - rewrite for UEFI with more functions like Copyright (c) 2003 Apple Computer
 #include "Platform.h"
+#include "b64cdecode.h"
 
 #ifndef DEBUG_ALL
 #define DEBUG_PLIST 0
@@ -43,28 +44,6 @@
 #endif
 
 
-SymbolPtr gSymbolsHead = NULL;
-TagPtr    gTagsFree = NULL;
-CHAR8* buffer_start = NULL;
-
-// Forward declarations
-EFI_STATUS ParseTagList( CHAR8* buffer, TagPtr * tag, UINT32 type, UINT32 empty, UINT32* lenPtr);
-EFI_STATUS ParseTagKey( char * buffer, TagPtr * tag,UINT32* lenPtr);
-EFI_STATUS ParseTagString(CHAR8* buffer, TagPtr * tag,UINT32* lenPtr);
-EFI_STATUS ParseTagInteger(CHAR8* buffer, TagPtr * tag,UINT32* lenPtr);
-EFI_STATUS ParseTagData(CHAR8* buffer, TagPtr * tag,UINT32* lenPtr);
-EFI_STATUS ParseTagDate(CHAR8* buffer, TagPtr * tag,UINT32* lenPtr);
-EFI_STATUS ParseTagBoolean(CHAR8* buffer, TagPtr * tag, UINT32 type,UINT32* lenPtr);
-//defined in Platform.h
-//EFI_STATUS GetElement( TagPtr dict, INTN id,  TagPtr *dict1);
-//INTN GetTagCount( TagPtr dict );
-
-TagPtr     NewTag( void );
-EFI_STATUS FixDataMatchingTag( CHAR8* buffer, CHAR8* tag,UINT32* lenPtr);
-CHAR8*      NewSymbol(CHAR8* string);
-VOID        FreeSymbol(CHAR8* string);
-SymbolPtr   FindSymbol( char * string, SymbolPtr * prevSymbol );
-
 /* Function for basic XML character entities parsing */
 typedef struct XMLEntity {
   const CHAR8* name;
@@ -187,861 +166,642 @@ EFI_STATUS GetElement( TagPtr dict, INTN id,  TagPtr * dict1)
   return EFI_SUCCESS;
 }
 
-// Expects to see one dictionary in the XML file, the final pos will be returned
-// If the pos is not equal to the strlen, then there are multiple dicts
-// Puts the first dictionary it finds in the
-// tag pointer and returns the end of the dic, or returns -1 if not found.
+//==========================================================================
+// Tag arena
 //
+// A parsed plist lives in one arena: the tags, a private copy of the
+// source where key/string/data text is NUL terminated in place, and the
+// decoded <data>. Parsing does no allocation per tag and FreeTag on the
+// root dict drops the whole plist in one go. Every parsed tag points back
+// to its arena through tag->arena.
+
+#define ARENA_CHUNK_MIN   0x10000
+
+typedef struct ARENA_CHUNK ARENA_CHUNK;
+struct ARENA_CHUNK {
+  ARENA_CHUNK *next;
+  UINT8       *free;
+  UINT8       *end;
+  // chunk memory follows
+};
 
-EFI_STATUS ParseXML(const CHAR8* buffer, TagPtr * dict, UINT32 bufSize)
-{
-  EFI_STATUS  Status;
-  UINT32    length = 0;
-  UINT32    pos = 0;
-  TagPtr    tag = NULL;
-  CHAR8*    configBuffer = NULL;
-  UINT32    bufferSize = 0;
-  UINTN     i;
-
-  if (bufSize) {
-    bufferSize = bufSize;
-  } else {
-    bufferSize = (UINT32)AsciiStrLen(buffer);
-  }
-
-  if(dict == NULL) {
-    return EFI_INVALID_PARAMETER;
-  }
-
-  configBuffer = AllocateZeroPool(bufferSize+1);
-  if(configBuffer == NULL) {
-    return EFI_OUT_OF_RESOURCES;
-  }
-
-  CopyMem(configBuffer, buffer, bufferSize);
-  for (i=0; i<bufferSize; i++) {
-    if (configBuffer[i] == 0) {
-      configBuffer[i] = 0x20;  //replace random zero bytes to spaces
-    }
-  }
-
-  buffer_start = configBuffer;
-  while (TRUE)
-  {
-    Status = XMLParseNextTag(configBuffer + pos, &tag, &length);
-    if (EFI_ERROR(Status)) {
-      DBG("error parsing next tag\n");
-      break;
-    }
+typedef struct PLIST_ARENA PLIST_ARENA;
+struct PLIST_ARENA {
+  TagPtr      root;
+  ARENA_CHUNK *chunks;    // newest first, the last one is first
+  ARENA_CHUNK first;      // sized for all tags, followed by the source copy
+};
 
-    pos += length;
+STATIC VOID* ArenaAlloc(PLIST_ARENA *arena, UINTN size)
+{
+  ARENA_CHUNK *chunk = arena->chunks;
+  UINT8       *ptr;
 
-    if (tag == NULL) {
-      continue;
-    }
-    if (tag->type == kTagTypeDict) {
-      break;
+  size = ALIGN_VALUE(size, sizeof(UINTN));
+  if ((UINTN)(chunk->end - chunk->free) < size) {
+    chunk = (ARENA_CHUNK*)AllocateZeroPool(sizeof(ARENA_CHUNK) + MAX(size, ARENA_CHUNK_MIN));
+    if (chunk == NULL) {
+      return NULL;
     }
+    chunk->free = (UINT8*)(chunk + 1);
+    chunk->end = chunk->free + MAX(size, ARENA_CHUNK_MIN);
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+  }
+  ptr = chunk->free;
+  chunk->free += size;
+  return ptr;   // chunks are zeroed
+}
 
-	  FreeTag(tag); tag = NULL;
-  }
-
-//  FreePool(configBuffer);
+STATIC VOID ArenaFree(PLIST_ARENA *arena)
+{
+  ARENA_CHUNK *chunk;
 
-  if (EFI_ERROR(Status)) {
-    return Status;
+  while (arena->chunks != &arena->first) {
+    chunk = arena->chunks;
+    arena->chunks = chunk->next;
+    FreePool(chunk);
   }
-
-  *dict = tag;
-  return EFI_SUCCESS;
+  FreePool(arena);
 }
 
+//==========================================================================
+// Tokenizer
 //
-// xml
-//
+// Single pass over the arena copy of the source. Tag names and text are
+// NUL terminated in place, keys and strings point into the copy.
 
-#define DOFREE 1
+typedef struct {
+  PLIST_ARENA *arena;
+  CHAR8       *start;
+  CHAR8       *pos;
+  CHAR8       *pushed;    // tag name given back by the key parser
+} PLIST_PARSER;
 
-//==========================================================================
-// GetProperty
+STATIC EFI_STATUS ParseValue(PLIST_PARSER *parser, CHAR8 *name, TagPtr *tag);
 
-TagPtr GetProperty( TagPtr dict, const CHAR8* key )
+// Returns the name of the next tag, or NULL at the end of buffer.
+// Comments, processing instructions and DOCTYPE are skipped.
+STATIC CHAR8* NextTag(PLIST_PARSER *parser)
 {
-  TagPtr tagList, tag;
+  CHAR8 *p;
+  CHAR8 *name;
 
-  if (dict->type != kTagTypeDict) {
-    return NULL;
+  if (parser->pushed != NULL) {
+    name = parser->pushed;
+    parser->pushed = NULL;
+    return name;
   }
 
-  tag = NULL;
-  tagList = dict->tag;
-  while (tagList)
-  {
-    tag = tagList;
-    tagList = tag->tagNext;
-
-    if ((tag->type != kTagTypeKey) || (tag->string == 0)) {
+  p = parser->pos;
+  while (TRUE) {
+    while (*p != '\0' && *p != '<') {
+      p++;
+    }
+    if (*p == '\0') {
+      break;
+    }
+    name = ++p;
+    if (name[0] == '!' && name[1] == '-' && name[2] == '-') {
+      // a comment may contain '>'
+      p += 3;
+      while (*p != '\0' && (p[0] != '-' || p[1] != '-' || p[2] != '>')) {
+        p++;
+      }
+      if (*p == '\0') {
+        break;
+      }
+      p += 3;
       continue;
-
     }
-
-    if (!AsciiStriCmp(tag->string, key)) {
-      return tag->tag;
+    while (*p != '\0' && *p != '>') {
+      p++;
+    }
+    if (*p == '\0') {
+      break;
     }
+    *p++ = '\0';
+    if (name[0] == '?' || name[0] == '!') {
+      continue;
+    }
+    parser->pos = p;
+    return name;
   }
 
+  DBG("unexpected end of buffer\n");
+  parser->pos = p;
   return NULL;
 }
 
-TagPtr GetNextProperty(TagPtr dict)
+// Returns the text of the element just opened and moves past its end tag.
+// The text is NUL terminated in place.
+STATIC CHAR8* TagContent(PLIST_PARSER *parser, CONST CHAR8 *name)
 {
-	TagPtr tagList, tag;
+  CHAR8 *content = parser->pos;
+  CHAR8 *end = content;
+  CHAR8 *endTag;
 
-	if (dict->type != kTagTypeDict) {
-		return NULL;
-	}
-
-	tag = NULL;
-	tagList = dict->tag;
-	while (tagList)
-	{
-		tag = tagList;
-		tagList = tag->tagNext;
-
-		if ((tag->type != kTagTypeKey) || (tag->string == 0)) {
-			continue;
-
-		}
-		return tag->tag;
-	}
-
-	return NULL;
+  while (*end != '\0' && *end != '<') {
+    end++;
+  }
+  parser->pos = end;
+  do {
+    endTag = NextTag(parser);
+    if (endTag == NULL) {
+      return NULL;
+    }
+  } while (endTag[0] != '/' || AsciiStrCmp(endTag + 1, name));
+  *end = '\0';
+  return content;
 }
 
-
-
-//==========================================================================
-// ParseNextTag
-
-EFI_STATUS XMLParseNextTag(CHAR8* buffer, TagPtr* tag, UINT32* lenPtr)
+STATIC TagPtr NewTag(PLIST_PARSER *parser, UINTN type)
 {
-  EFI_STATUS  Status;
-  UINT32      length = 0;
-  UINT32      pos = 0;
-  CHAR8*      tagName = NULL;
-
-  *lenPtr=0;
-
-  Status = GetNextTag((UINT8*)buffer, &tagName, 0, &length);
-  if (EFI_ERROR(Status)) {
-    DBG("NextTag error %r\n", Status);
-    return Status;
-  }
-
-  pos = length;
-  if (!AsciiStrnCmp(tagName, kXMLTagPList, 6)) {
-    length=0;
-    Status=EFI_SUCCESS;
-  }
-  /***** dict ****/
-  else if (!AsciiStrCmp(tagName, kXMLTagDict))
-  {
-    DBG("begin dict len=%d\n", length);
-    Status = ParseTagList(buffer + pos, tag, kTagTypeDict, 0, &length);
-  }
-  else if (!AsciiStrCmp(tagName, kXMLTagDict "/"))
-  {
-    DBG("end dict len=%d\n", length);
-    Status = ParseTagList(buffer + pos, tag, kTagTypeDict, 1, &length);
-  }
-  else if (!AsciiStrnCmp(tagName, kXMLTagDict " ", 5))
-  {
-    DBG("space dict len=%d\n", length);
-    Status = ParseTagList(buffer + pos, tag, kTagTypeDict, 0, &length);
-  }
-  /***** key ****/
-  else if (!AsciiStrCmp(tagName, kXMLTagKey))
-  {
-    DBG("parse key\n");
-    Status = ParseTagKey(buffer + pos, tag, &length);
-  }
-  /***** string ****/
-  else if (!AsciiStrCmp(tagName, kXMLTagString))
-  {
-    DBG("parse String\n");
-    Status = ParseTagString(buffer + pos, tag, &length);
-  }
-   /***** string ****/
-  else if (!AsciiStrnCmp(tagName, kXMLTagString " ", 7))
-  {
-    DBG("parse String len=%d\n", length);
-    Status = ParseTagString(buffer + pos, tag, &length);
-  }
-  /***** integer ****/
-  else if (!AsciiStrCmp(tagName, kXMLTagInteger))
-  {
-    Status = ParseTagInteger(buffer + pos, tag, &length);
-  }
-  else if (!AsciiStrnCmp(tagName, kXMLTagInteger " ", 8))
-  {
-    Status = ParseTagInteger(buffer + pos, tag, &length);
-  }
-
-  /***** data ****/
-  else if (!AsciiStrCmp(tagName, kXMLTagData))
-  {
-    Status = ParseTagData(buffer + pos, tag, &length);
-  }
-  else if (!AsciiStrnCmp(tagName, kXMLTagData " ", 5))
-  {
-    Status = ParseTagData(buffer + pos, tag, &length);
-  }
-  /***** date ****/
-  else if (!AsciiStrCmp(tagName, kXMLTagDate))
-  {
-    Status = ParseTagDate(buffer + pos, tag, &length);
-  }
-  /***** FALSE ****/
-  else if (!AsciiStrCmp(tagName, kXMLTagFalse))
-  {
-    Status = ParseTagBoolean(buffer + pos, tag, kTagTypeFalse, &length);
-  }
-  /***** TRUE ****/
-  else if (!AsciiStrCmp(tagName, kXMLTagTrue))
-  {
-    Status = ParseTagBoolean(buffer + pos, tag, kTagTypeTrue, &length);
-  }
-  /***** array ****/
-  else if (!AsciiStrCmp(tagName, kXMLTagArray))
-  {
-    Status = ParseTagList(buffer + pos, tag, kTagTypeArray, 0, &length);
-  }
-  else if (!AsciiStrnCmp(tagName, kXMLTagArray " ", 6))
-  {
-    DBG("begin array len=%d\n", length);
-    Status = ParseTagList(buffer + pos, tag, kTagTypeArray, 0, &length);
-  }
-  else if (!AsciiStrCmp(tagName, kXMLTagArray "/"))
-  {
-    DBG("end array len=%d\n", length);
-    Status = ParseTagList(buffer + pos, tag, kTagTypeArray, 1, &length);
-  }
-  /***** unknown ****/
-  else
-  {
-    *tag = NULL;
-    length = 0;
-  }
+  TagPtr tag = (TagPtr)ArenaAlloc(parser->arena, sizeof(TagStruct));
 
-  if (EFI_ERROR(Status)) {
-    return Status;
+  if (tag != NULL) {
+    tag->type = type;
+    tag->arena = parser->arena;
+    tag->offset = (UINTN)(parser->pos - parser->start);
   }
-
-  if (length == -1) {
-    DBG("(length == -1)\n");
-    return EFI_UNSUPPORTED;
-  }
-
-  *lenPtr = pos + length;
-  DBG("  len after success parse next tag %d\n", *lenPtr);
-  return EFI_SUCCESS;
+  return tag;
 }
 
-//==========================================================================
-// ParseTagList
-
-EFI_STATUS ParseTagList( CHAR8* buffer, TagPtr* tag, UINT32 type, UINT32 empty, UINT32* lenPtr)
+// Parses dict or array members up to the closing tag.
+STATIC EFI_STATUS ParseList(PLIST_PARSER *parser, TagPtr list)
 {
-  EFI_STATUS  Status = EFI_SUCCESS;
-  UINT32    pos;
-  TagPtr    tagList;
-  TagPtr    tagTail;
-  TagPtr    tmpTag = NULL;
-  UINT32    length = 0;
-
-  if (type == kTagTypeArray) {
-    DBG("parsing array len=%d\n", *lenPtr);
-  } else if (type == kTagTypeDict) {
-    DBG("parsing dict len=%d\n", *lenPtr);
-  }
-  tagList = NULL;
-  tagTail = NULL;
-  pos = 0;
-
-  if (!empty) {
-    while (TRUE) {
-      Status = XMLParseNextTag(buffer + pos, &tmpTag, &length);
-      if (EFI_ERROR(Status)) {
-        DBG("error XMLParseNextTag in array: %r\n", Status);
-        break;
-      }
-
-      pos += length;
-
-      if (tmpTag == NULL) {
-        break;
-      }
-
-      if (tagTail) {
-        tagTail->tagNext = tmpTag;
-      } else {
-        tagList = tmpTag;
-      }
-      tagTail = tmpTag;
+  EFI_STATUS  Status;
+  CHAR8       *name;
+  TagPtr      tag;
+  TagPtr      tail = NULL;
+
+  while (TRUE) {
+    name = NextTag(parser);
+    if (name == NULL) {
+      return EFI_UNSUPPORTED;
     }
-
+    if (name[0] == '/') {
+      return EFI_SUCCESS;
+    }
+    Status = ParseValue(parser, name, &tag);
     if (EFI_ERROR(Status)) {
-      if (tagList) {
-        FreeTag(tagList);
-      }
       return Status;
     }
-  }
-
-  tmpTag = NewTag();
-  if (tmpTag == NULL) {
-    if (tagList) {
-      FreeTag(tagList);
+    if (tag == NULL) {
+      continue;
     }
-    DBG("next tag is NULL\n");
-    return EFI_OUT_OF_RESOURCES;
-  }
-
-  tmpTag->type = type;
-  tmpTag->string = 0;
-  tmpTag->offset = (UINT32)(buffer_start ? buffer - buffer_start : 0);
-  tmpTag->tag = tagList;
-  tmpTag->tagNext = 0;
-
-  *tag = tmpTag;
-  *lenPtr=pos;
-  DBG(" return from ParseTagList with len=%d\n", *lenPtr);
-  return Status;
-}
-
-//==========================================================================
-// ParseTagKey
-
-EFI_STATUS ParseTagKey( char * buffer, TagPtr* tag, UINT32* lenPtr)
-{
-  EFI_STATUS  Status;
-  UINT32      length = 0;
-  UINT32      length2 = 0;
-  CHAR8*      tmpString;
-  TagPtr      tmpTag;
-  TagPtr      subTag = NULL;
-
-  Status = FixDataMatchingTag(buffer, kXMLTagKey, &length);
-  DBG("fixing key len=%d status=%r\n", length, Status);
-  if (EFI_ERROR(Status)){
-    return Status;
-  }
-
-  Status = XMLParseNextTag(buffer + length, &subTag, &length2);
-  if (EFI_ERROR(Status)) {
-    return Status;
-  }
-  tmpTag = NewTag();
-  if (tmpTag == NULL) {
-    FreeTag(subTag);
-    return EFI_OUT_OF_RESOURCES;
-  }
-
-  tmpString = NewSymbol(buffer);
-  if (tmpString == NULL) {
-    FreeTag(subTag);
-    FreeTag(tmpTag);
-    return EFI_OUT_OF_RESOURCES;
-  }
-
-  tmpTag->type = kTagTypeKey;
-  tmpTag->string = tmpString;
-  tmpTag->tag = subTag;
-  tmpTag->offset = (UINT32)(buffer_start ? buffer - buffer_start: 0);
-  tmpTag->tagNext = 0;
-
-  *tag = tmpTag;
-  *lenPtr = length + length2;
-  DBG("parse key '%a' success len=%d\n", tmpString, *lenPtr);
-  return EFI_SUCCESS;
-}
-
-//==========================================================================
-// ParseTagString
-
-EFI_STATUS ParseTagString(CHAR8* buffer, TagPtr * tag,UINT32* lenPtr)
-{
-  EFI_STATUS  Status;
-  UINT32    length = 0;
-  CHAR8*    tmpString;
-  TagPtr    tmpTag;
-
-  Status = FixDataMatchingTag(buffer, kXMLTagString, &length);
-  if (EFI_ERROR(Status)) {
-    return Status;
-  }
-
-  tmpTag = NewTag();
-  if (tmpTag == NULL) {
-    return EFI_OUT_OF_RESOURCES;
-  }
-
-  tmpString = XMLDecode(buffer);
-  tmpString = NewSymbol(tmpString);
-  if (tmpString == NULL)
-  {
-    FreeTag(tmpTag);
-    return EFI_OUT_OF_RESOURCES;
+    if (tail) {
+      tail->tagNext = tag;
+    } else {
+      list->tag = tag;
+    }
+    tail = tag;
   }
-
-  tmpTag->type = kTagTypeString;
-  tmpTag->string = tmpString;
-  tmpTag->tag = NULL;
-  tmpTag->tagNext = NULL;
-  tmpTag->offset = (UINT32)(buffer_start ? buffer - buffer_start: 0);
-  *tag = tmpTag;
-  *lenPtr = length;
-  DBG(" parse string %a\n", tmpString);
-  return EFI_SUCCESS;
 }
 
-//==========================================================================
-// ParseTagInteger
-
-EFI_STATUS ParseTagInteger(CHAR8* buffer, TagPtr * tag,UINT32* lenPtr)
+STATIC EFI_STATUS ParseInteger(CHAR8 *val, TagPtr tag)
 {
-  EFI_STATUS  Status;
-  UINT32    length = 0;
-  INTN     integer;
-  UINT32    size;
+  INTN      integer = 0;
   BOOLEAN   negative = FALSE;
-  CHAR8*    val = buffer;
-  TagPtr tmpTag;
-
-  Status = FixDataMatchingTag(buffer, kXMLTagInteger,&length);
-  if (EFI_ERROR(Status)) {
-    return Status;
-  }
+  CHAR8     *buffer = val;
 
-  tmpTag = NewTag();
-  if (tmpTag == NULL)  {
-    return EFI_OUT_OF_RESOURCES;
-  }
-  size = length;
-
-  integer = 0;
-  if(buffer[0] == '<') {
-    tmpTag->type = kTagTypeInteger;
-    tmpTag->string = 0;
-    tmpTag->tag = 0;
-    tmpTag->offset =  0;
-    tmpTag->tagNext = 0;
-
-    *tag = tmpTag;
-    length = 0;
-    return EFI_SUCCESS;
-  }
-  if(size > 1 && (val[1] == 'x' || val[1] == 'X')) {  // Hex value
+  if (val[0] == '0' && (val[1] == 'x' || val[1] == 'X')) {  // Hex value
     val += 2;
-    while(*val) {
-      if ((*val >= '0' && *val <= '9')) { // 0 - 9
+    while (*val) {
+      if (*val >= '0' && *val <= '9') {
         integer = (integer * 16) + (*val++ - '0');
-      }
-      else if ((*val >= 'a' && *val <= 'f')) { // a - f
-        integer = (integer * 16) + (*val++ - 'a' + 10);
-      }
-      else if ((*val >= 'A' && *val <= 'F')) {  // A - F
+      } else if (*val >= 'a' && *val <= 'f') {
         integer = (integer * 16) + (*val++ - 'a' + 10);
-      }
-      else {
+      } else if (*val >= 'A' && *val <= 'F') {
+        integer = (integer * 16) + (*val++ - 'A' + 10);
+      } else {
         MsgLog("ParseTagInteger hex error (0x%x) in buffer %a\n", *val, buffer);
-        //        getchar();
-        FreeTag(tmpTag);
         return EFI_UNSUPPORTED;
       }
     }
-  }
-  else if ( size ) {  // Decimal value
+  } else {  // Decimal value
     if (*val == '-') {
       negative = TRUE;
       val++;
-      size--;
     }
-
-    for (integer = 0; size > 0; size--) {
-      if(*val) { // UGLY HACK, fix me.
-        if (*val < '0' || *val > '9') {
-          MsgLog("ParseTagInteger decimal error (0x%x) in buffer %a\n", *val, buffer);
-          //          getchar();
-          FreeTag(tmpTag);
-          return EFI_UNSUPPORTED;
-        }
-        integer = (integer * 10) + (*val++ - '0');
+    while (*val) {
+      if (*val < '0' || *val > '9') {
+        MsgLog("ParseTagInteger decimal error (0x%x) in buffer %a\n", *val, buffer);
+        return EFI_UNSUPPORTED;
       }
+      integer = (integer * 10) + (*val++ - '0');
     }
-
     if (negative) {
       integer = -integer;
     }
   }
 
-
-  tmpTag->type = kTagTypeInteger;
-  tmpTag->string = (CHAR8*)(UINTN)integer;
-  tmpTag->tag = NULL;
-  tmpTag->offset = (UINT32)(buffer_start ? buffer - buffer_start: 0);
-  tmpTag->tagNext = NULL;
-
-  *tag = tmpTag;
-  *lenPtr = length;
+  tag->string = (CHAR8*)(UINTN)integer;
   return EFI_SUCCESS;
 }
 
-//==========================================================================
-// ParseTagData
-
-EFI_STATUS ParseTagData(CHAR8* buffer, TagPtr * tag, UINT32* lenPtr)
+STATIC EFI_STATUS ParseData(PLIST_PARSER *parser, CHAR8 *text, TagPtr tag)
 {
-  EFI_STATUS  Status;
-  UINT32    length = 0;
-  UINTN     len = 0;
-  TagPtr    tmpTag;
-  CHAR8*    tmpString;
+  UINTN               len = AsciiStrLen(text);
+  base64_decodestate  state;
 
-  Status = FixDataMatchingTag(buffer, kXMLTagData,&length);
-  if (EFI_ERROR(Status)) {
-    return Status;
+  //Slice - correction as Apple 2003
+  tag->string = text;
+  if (len == 0) {
+    return EFI_SUCCESS;
   }
-
-  tmpTag = NewTag();
-  if (tmpTag == NULL) {
+  // dmazar: base64 decode data
+  tag->data = (UINT8*)ArenaAlloc(parser->arena, len / 4 * 3 + 3);
+  if (tag->data == NULL) {
     return EFI_OUT_OF_RESOURCES;
   }
-  //Slice - correction as Apple 2003
-  tmpString = NewSymbol(buffer);
-  tmpTag->type = kTagTypeData;
-  tmpTag->string = tmpString;
-  // dmazar: base64 decode data
-  tmpTag->data = (UINT8 *)Base64DecodeClover(tmpTag->string, &len);
-  tmpTag->dataLen = len;
-  tmpTag->tag = NULL;
-  tmpTag->offset = (UINT32)(buffer_start ? buffer - buffer_start: 0);
-  tmpTag->tagNext = NULL;
-
-  *tag = tmpTag;
-  *lenPtr = length;
-
+  base64_init_decodestate(&state);
+  tag->dataLen = base64_decode_block(text, (const int)len, (char*)tag->data, &state);
   return EFI_SUCCESS;
 }
 
 //==========================================================================
-// ParseTagDate
+// ParseValue
+// Parses the element whose start tag was just read. Unknown elements
+// give *tag == NULL.
 
-EFI_STATUS ParseTagDate(CHAR8* buffer, TagPtr * tag,UINT32* lenPtr)
+STATIC EFI_STATUS ParseValue(PLIST_PARSER *parser, CHAR8 *name, TagPtr *tag)
 {
-  EFI_STATUS  Status;
-  UINT32    length = 0;
-  TagPtr    tmpTag;
+  EFI_STATUS  Status = EFI_SUCCESS;
+  UINTN       len = 0;
+  BOOLEAN     empty;
+  CHAR8       *text;
+  CHAR8       *valueName;
+  TagPtr      tmpTag = NULL;
+
+  *tag = NULL;
+  while (name[len] != '\0' && name[len] != ' ' && name[len] != '/') {
+    len++;
+  }
+  empty = (name[len] != '\0' && name[AsciiStrLen(name) - 1] == '/');
+  name[len] = '\0';
+
+  if (!AsciiStrCmp(name, kXMLTagDict) || !AsciiStrCmp(name, kXMLTagArray)) {
+    tmpTag = NewTag(parser, (name[0] == 'd') ? kTagTypeDict : kTagTypeArray);
+    if (tmpTag == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    if (!empty) {
+      Status = ParseList(parser, tmpTag);
+    }
+  } else if (empty) {
+    if (!AsciiStrCmp(name, "true")) {
+      tmpTag = NewTag(parser, kTagTypeTrue);
+    } else if (!AsciiStrCmp(name, "false")) {
+      tmpTag = NewTag(parser, kTagTypeFalse);
+    } else {
+      DBG("skip empty tag <%a/>\n", name);
+      return EFI_SUCCESS;
+    }
+    if (tmpTag == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+  } else if (!AsciiStrCmp(name, kXMLTagKey)) {
+    tmpTag = NewTag(parser, kTagTypeKey);
+    if (tmpTag == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    tmpTag->string = TagContent(parser, kXMLTagKey);
+    if (tmpTag->string == NULL) {
+      return EFI_UNSUPPORTED;
+    }
+    valueName = NextTag(parser);
+    if (valueName == NULL) {
+      return EFI_UNSUPPORTED;
+    }
+    if (valueName[0] == '/') {
+      // key without value, leave the end tag to the list
+      parser->pushed = valueName;
+    } else {
+      Status = ParseValue(parser, valueName, (TagPtr*)&tmpTag->tag);
+    }
+    DBG("parse key '%a'\n", tmpTag->string);
+  } else if (!AsciiStrCmp(name, kXMLTagString) ||
+             !AsciiStrCmp(name, kXMLTagInteger) ||
+             !AsciiStrCmp(name, kXMLTagData) ||
+             !AsciiStrCmp(name, kXMLTagDate)) {
+    tmpTag = NewTag(parser, kTagTypeNone);
+    if (tmpTag == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    text = TagContent(parser, name);
+    if (text == NULL) {
+      return EFI_UNSUPPORTED;
+    }
+    switch (name[0]) {
+      case 's':
+        tmpTag->type = kTagTypeString;
+        tmpTag->string = XMLDecode(text);
+        break;
+      case 'i':
+        tmpTag->type = kTagTypeInteger;
+        Status = ParseInteger(text, tmpTag);
+        break;
+      case 'd':
+        if (name[1] == 'a' && name[2] == 't' && name[3] == 'a') {
+          tmpTag->type = kTagTypeData;
+          Status = ParseData(parser, text, tmpTag);
+        } else {
+          tmpTag->type = kTagTypeDate;
+        }
+        break;
+    }
+  } else {
+    DBG("skip tag <%a>\n", name);
+    return EFI_SUCCESS;
+  }
 
-  Status = FixDataMatchingTag(buffer, kXMLTagDate,&length);
   if (EFI_ERROR(Status)) {
     return Status;
   }
-
-
-  tmpTag = NewTag();
-  if (tmpTag == NULL) {
-    return EFI_OUT_OF_RESOURCES;
-  }
-
-  tmpTag->type = kTagTypeDate;
-  tmpTag->string = NULL;
-  tmpTag->tag = NULL;
-  tmpTag->tagNext = NULL;
-  tmpTag->offset = (UINT32)(buffer_start ? buffer - buffer_start: 0);
-
   *tag = tmpTag;
-  *lenPtr = length;
-
   return EFI_SUCCESS;
 }
 
-//==========================================================================
-// ParseTagBoolean
+// Expects to see one dictionary in the XML file.
+// Puts the first dictionary it finds in the tag pointer.
+// The dictionary and everything under it is released by FreeTag(*dict).
+//
 
-EFI_STATUS ParseTagBoolean(CHAR8* buffer, TagPtr * tag, UINT32 type,UINT32* lenPtr)
+EFI_STATUS ParseXML(const CHAR8* buffer, TagPtr * dict, UINT32 bufSize)
 {
-  TagPtr tmpTag;
+  EFI_STATUS    Status;
+  PLIST_ARENA   *arena;
+  PLIST_PARSER  parser;
+  CHAR8         *name;
+  TagPtr        tag = NULL;
+  UINT32        bufferSize = 0;
+  UINTN         tagsSize;
+  UINTN         i;
 
-  tmpTag = NewTag();
-  if (tmpTag == NULL) {
-    return EFI_OUT_OF_RESOURCES;
+  if (bufSize) {
+    bufferSize = bufSize;
+  } else {
+    bufferSize = (UINT32)AsciiStrLen(buffer);
   }
 
-  tmpTag->type = type;
-  tmpTag->string = NULL;
-  tmpTag->tag = NULL;
-  tmpTag->tagNext = NULL;
-  tmpTag->offset = (UINT32)(buffer_start ? buffer - buffer_start: 0);
-
-  *tag = tmpTag;
-  *lenPtr = 0;
-  return EFI_SUCCESS;
-}
-
-//==========================================================================
-// GetNextTag
-
-EFI_STATUS GetNextTag( UINT8* buffer, CHAR8** tag, UINT32* start, UINT32* length)
-{
-  UINT32 cnt, cnt2;
-
-  if (tag == NULL) {
+  if(dict == NULL) {
     return EFI_INVALID_PARAMETER;
   }
 
-  // Find the start of the tag.
-  cnt = 0;
-  while ((buffer[cnt] != '\0') && (buffer[cnt] != '<')) {
-    cnt++;
-  }
-
-  if (buffer[cnt] == '\0') {
-    DBG("empty buffer at cnt=%d\n", cnt);
-    return EFI_UNSUPPORTED;
-  }
-
-  // Find the end of the tag.
-  cnt2 = cnt + 1;
-  while ((buffer[cnt2] != '\0') && (buffer[cnt2] != '>')) {
-    cnt2++;
-  }
-
-  if (buffer[cnt2] == '\0') {
-    DBG("empty buffer at cnt2=%d\n", cnt2);
-    return EFI_UNSUPPORTED;
+  // every tag takes at least one '<', so the first chunk holds all of them
+  tagsSize = sizeof(TagStruct);
+  for (i = 0; i < bufferSize; i++) {
+    if (buffer[i] == '<') {
+      tagsSize += sizeof(TagStruct);
+    }
   }
 
-  // Fix the tag data.
-  *tag = (CHAR8*)(buffer + cnt + 1);
-  buffer[cnt2] = '\0';
-  if (start) {
-    *start = cnt;
+  arena = (PLIST_ARENA*)AllocatePool(sizeof(PLIST_ARENA) + tagsSize + bufferSize + 1);
+  if (arena == NULL) {
+    return EFI_OUT_OF_RESOURCES;
   }
-
-  *length = cnt2 + 1;  //unreal to be -1. This is UINT32
-
-  if (*length == -1) {
-    DBG("GetNextTag with *length == -1\n");
-    return EFI_UNSUPPORTED;
+  ZeroMem(arena, sizeof(PLIST_ARENA) + tagsSize);
+  arena->chunks = &arena->first;
+  arena->first.free = (UINT8*)(arena + 1);
+  arena->first.end = arena->first.free + tagsSize;
+
+  parser.arena = arena;
+  parser.start = (CHAR8*)arena->first.end;
+  parser.pos = parser.start;
+  parser.pushed = NULL;
+  CopyMem(parser.start, buffer, bufferSize);
+  parser.start[bufferSize] = '\0';
+  for (i = 0; i < bufferSize; i++) {
+    if (parser.start[i] == 0) {
+      parser.start[i] = 0x20;  //replace random zero bytes to spaces
+    }
   }
 
-  return EFI_SUCCESS;
-}
-
-//==========================================================================
-// FixDataMatchingTag
-// Modifies 'buffer' to add a '\0' at the end of the tag matching 'tag'.
-// Returns the length of the data found, counting the end tag,
-// or -1 if the end tag was not found.
-
-EFI_STATUS FixDataMatchingTag( CHAR8* buffer, CHAR8* tag, UINT32* lenPtr)
-{
-  EFI_STATUS  Status;
-  UINT32    length;
-  UINT32    start;
-  UINT32    stop;
-  CHAR8*    endTag;
-
-  start = 0;
-  while (1) {
-    Status = GetNextTag(((UINT8 *)buffer) + start, &endTag, &stop, &length);
+  Status = EFI_UNSUPPORTED;
+  while ((name = NextTag(&parser)) != NULL) {
+    if (name[0] == '/') {
+      continue;
+    }
+    Status = ParseValue(&parser, name, &tag);
     if (EFI_ERROR(Status)) {
-      return Status;
+      DBG("error parsing next tag\n");
+      break;
     }
-
-    if ((*endTag == '/') && !AsciiStrCmp(endTag + 1, tag)) {
+    if (tag != NULL && tag->type == kTagTypeDict) {
       break;
     }
-    start += length;
+    // anything else at top level stays unused in the arena
+    tag = NULL;
+    Status = EFI_UNSUPPORTED;
   }
-  DBG("fix buffer at pos=%d\n", start + stop);
-  buffer[start + stop] = '\0';
-  *lenPtr = start + length;
 
-  if (*lenPtr == -1) {
-    return EFI_UNSUPPORTED;
+  if (EFI_ERROR(Status)) {
+    ArenaFree(arena);
+    return Status;
   }
 
+  arena->root = tag;
+  *dict = tag;
   return EFI_SUCCESS;
 }
 
+
+//
+// xml
+//
+
+#define DOFREE 1
+
 //==========================================================================
-// NewTag
-#define TAGCACHESIZE 0x1000
+// Dict key index
+//
+// GetProperty is called thousands of times over config.plist, so for dicts
+// with many keys an open addressing table of key tags is built on first
+// lookup and kept in dict->index, in the arena of the dict.
+// Keys are compared case insensitive, so is the hash.
+
+#define PROPERTY_INDEX_MIN_KEYS  8
+
+typedef struct {
+  UINTN   mask;       // number of slots - 1
+  TagPtr  slots[1];
+} PropertyIndex;
 
-TagPtr NewTag( void )
+STATIC UINT32 KeyHash(CONST CHAR8 *key)
 {
-  UINT32  cnt;
-  TagPtr  tag;
+  UINT32 hash = 2166136261U;   // FNV-1a over upper case chars
+  CHAR8  c;
 
-  if (gTagsFree == NULL) {
-    tag = (TagPtr)AllocateZeroPool(TAGCACHESIZE * sizeof(TagStruct));
-    if (tag == NULL) {
-      return NULL;
+  while ((c = *key++) != '\0') {
+    if (c >= 'a' && c <= 'z') {
+      c -= 'a' - 'A';
     }
+    hash = (hash ^ (UINT8)c) * 16777619U;
+  }
+  return hash;
+}
 
-    // Initalize the new tags.
-    for (cnt = 0; cnt < TAGCACHESIZE - 1; cnt++) {
-      tag[cnt].type = kTagTypeNone;
-      tag[cnt].tagNext = tag + cnt + 1;
+STATIC PropertyIndex* BuildPropertyIndex( TagPtr dict )
+{
+  PropertyIndex *index;
+  TagPtr        tag;
+  UINTN         count = 0;
+  UINTN         slots = 16;
+  UINTN         size;
+  UINTN         i;
+  PLIST_ARENA   *arena;
+
+  for (tag = dict->tag; tag != NULL; tag = tag->tagNext) {
+    if (tag->type == kTagTypeKey && tag->string != NULL) {
+      count++;
     }
-    tag[TAGCACHESIZE - 1].tagNext = 0;
+  }
+  if (count < PROPERTY_INDEX_MIN_KEYS) {
+    return NULL;
+  }
+  while (slots < count * 2) {
+    slots <<= 1;
+  }
 
-    gTagsFree = tag;
+  size = sizeof(PropertyIndex) + (slots - 1) * sizeof(TagPtr);
+  arena = (PLIST_ARENA*)dict->arena;
+  if (arena != NULL) {
+    index = (PropertyIndex*)ArenaAlloc(arena, size);
+  } else {
+    index = (PropertyIndex*)AllocateZeroPool(size);
   }
+  if (index == NULL) {
+    return NULL;
+  }
+  index->mask = slots - 1;
 
-  tag = gTagsFree;
-  gTagsFree = tag->tagNext;
-  if (gTagsFree == NULL) {  //end of cache
-    gTagsFree = NewTag();
-    tag->tagNext = gTagsFree; //add new cache to old one
+  for (tag = dict->tag; tag != NULL; tag = tag->tagNext) {
+    if (tag->type != kTagTypeKey || tag->string == NULL) {
+      continue;
+    }
+    // first key wins, as in the linear search
+    for (i = KeyHash(tag->string) & index->mask;
+         index->slots[i] != NULL;
+         i = (i + 1) & index->mask) {
+      if (!AsciiStriCmp(index->slots[i]->string, tag->string)) {
+        break;
+      }
+    }
+    if (index->slots[i] == NULL) {
+      index->slots[i] = tag;
+    }
   }
 
-  return tag;
+  dict->index = index;
+  return index;
 }
-#undef TAGCACHESIZE
 
 //==========================================================================
-// XMLFreeTag
+// GetProperty
 
-void FreeTag( TagPtr tag )
+TagPtr GetProperty( TagPtr dict, const CHAR8* key )
 {
-  if (tag == NULL) {
-    return;
+  TagPtr        tagList, tag;
+  PropertyIndex *index;
+  UINTN         i;
+
+  if (dict->type != kTagTypeDict) {
+    return NULL;
   }
 
-  if (tag->type != kTagTypeInteger && tag->string)  {
-    FreeSymbol(tag->string);
+  index = (PropertyIndex*)dict->index;
+  if (index == NULL) {
+    index = BuildPropertyIndex(dict);
   }
-  if (tag->data) {
-    FreePool(tag->data);
+  if (index != NULL) {
+    for (i = KeyHash(key) & index->mask;
+         index->slots[i] != NULL;
+         i = (i + 1) & index->mask) {
+      if (!AsciiStriCmp(index->slots[i]->string, key)) {
+        return index->slots[i]->tag;
+      }
+    }
+    return NULL;
   }
 
-  FreeTag(tag->tag);
-  FreeTag(tag->tagNext);
-
-  // Clear and free the tag.
-  tag->type = kTagTypeNone;
-  tag->string = NULL;
-  tag->data = NULL;
-  tag->dataLen = 0;
-  tag->tag = NULL;
-  tag->offset = 0;
-  tag->tagNext = gTagsFree;
-  gTagsFree = tag;
-}
+  tag = NULL;
+  tagList = dict->tag;
+  while (tagList)
+  {
+    tag = tagList;
+    tagList = tag->tagNext;
 
+    if ((tag->type != kTagTypeKey) || (tag->string == 0)) {
+      continue;
 
-CHAR8* NewSymbol(CHAR8* tmpString)
-{
-#if 0
-  SymbolPtr lastGuy = 0; // never used
-#endif
-  SymbolPtr symbol;
-  UINTN      len;
-  // Look for string in the list of symbols.
-  symbol = FindSymbol(tmpString, 0);
-
-  // Add the new symbol.
-  if (symbol == NULL) {
-    len = AsciiStrLen(tmpString);
-    symbol = (SymbolPtr)AllocateZeroPool(sizeof(Symbol) + len + 1);
-    if (symbol == NULL)  {
-      return NULL;
     }
 
-    // Set the symbol's data.
-    symbol->refCount = 0;
-
-    AsciiStrnCpyS(symbol->string, len+1, tmpString, len);
-
-    // Add the symbol to the list.
-    symbol->next = gSymbolsHead;
-    gSymbolsHead = symbol;
-  }
-
-  // Update the refCount and return the string.
-  symbol->refCount++;
-
-#if 0
-  if (lastGuy && lastGuy->next != 0) { // lastGuy is always 0, accessing to ((SymbolPtr)null)->next can be dangerous.
-    return NULL;
+    if (!AsciiStriCmp(tag->string, key)) {
+      return tag->tag;
+    }
   }
-#endif
 
-  return symbol->string;
+  return NULL;
 }
 
-//==========================================================================
-// FreeSymbol
-
-void FreeSymbol(CHAR8* tmpString)
+TagPtr GetNextProperty(TagPtr dict)
 {
-  SymbolPtr symbol, prev;
-  prev = NULL;
+	TagPtr tagList, tag;
 
-  // Look for string in the list of symbols.
-  symbol = FindSymbol(tmpString, &prev);
-  if (symbol == NULL) {
-    return;
-  }
+	if (dict->type != kTagTypeDict) {
+		return NULL;
+	}
 
-  // Update the refCount.
-  symbol->refCount--;
+	tag = NULL;
+	tagList = dict->tag;
+	while (tagList)
+	{
+		tag = tagList;
+		tagList = tag->tagNext;
 
-  if (symbol->refCount != 0) {
-    return;
-  }
+		if ((tag->type != kTagTypeKey) || (tag->string == 0)) {
+			continue;
 
-  // Remove the symbol from the list.
-  if (prev != NULL) {
-    prev->next = symbol->next;
-  }
-  else {
-    gSymbolsHead = symbol->next;
-  }
+		}
+		return tag->tag;
+	}
 
-  // Free the symbol's memory.
-  FreePool(symbol);
+	return NULL;
 }
 
+
+
+
 //==========================================================================
-// FindSymbol
+// FreeTag
+// Freeing the root of a parsed plist drops its arena. Any other parsed tag
+// lives until its root is freed, so FreeTag on it does nothing: a sub-dict
+// taken out of a parsed plist must not outlive the plist. Hand made tags
+// are freed one by one.
 
-SymbolPtr FindSymbol(CHAR8 *tmpString, SymbolPtr *prevSymbol )
+void FreeTag( TagPtr tag )
 {
-  SymbolPtr symbol, prev;
+  PLIST_ARENA *arena;
 
-  if (tmpString == NULL) {
-    return NULL;
+  if (tag == NULL) {
+    return;
   }
 
-  symbol = gSymbolsHead;
-  prev = NULL;
-
-  while (symbol != NULL) {
-    if (!AsciiStrCmp(symbol->string, tmpString)) {
-      break;
+  arena = (PLIST_ARENA*)tag->arena;
+  if (arena != NULL) {
+    if (arena->root == tag) {
+      ArenaFree(arena);
+    } else {
+      DBG("FreeTag: tag at %d is not a plist root, left to its root\n", tag->offset);
     }
-
-    prev = symbol;
-    symbol = symbol->next;
+    return;
   }
 
-  if ((symbol != NULL) && (prevSymbol != NULL)) {
-    *prevSymbol = prev;
+  FreeTag(tag->tag);
+  FreeTag(tag->tagNext);
+  if (tag->index) {
+    FreePool(tag->index);
   }
-
-  return symbol;
+  FreePool(tag);
 }
@@ -183,6 +183,7 @@ VOID ScanLegacy(VOID)
   UINTN                   VolumeIndex, VolumeIndex2;
   BOOLEAN                 ShowVolume, HideIfOthersFound;
   REFIT_VOLUME            *Volume;
+  UINT64                  StartTsc = AsmReadTsc();
   
   DBG("Scanning legacy ...\n");
   
@@ -251,6 +252,7 @@ VOID ScanLegacy(VOID)
       DBG(" hidden\n");
     }
   }
+  LogVolumeDirCacheStats("ScanLegacy", StartTsc);
 }
 
 // Add custom legacy
@@ -363,7 +363,7 @@ STATIC EFI_STATUS GetOSXVolumeName(LOADER_ENTRY *Entry)
   CHAR8*  fileBuffer;
   CHAR8*  targetString;
   UINTN   fileLen = 0;
-  if(FileExists(Entry->Volume->RootDir, targetNameFile)) {
+  if(VolumeFileExists(Entry->Volume, targetNameFile)) {
     Status = egLoadFile(Entry->Volume->RootDir, targetNameFile, (UINT8 **)&fileBuffer, &fileLen);
     if(!EFI_ERROR(Status)) {
       CHAR16  *tmpName;
@@ -676,7 +676,7 @@ STATIC LOADER_ENTRY *CreateLoaderEntry(IN CHAR16 *LoaderPath,
   Entry->me.ShortcutLetter = (Hotkey == 0) ? ShortcutLetter : Hotkey;
 
   // get custom volume icon if present
-  if (GlobalConfig.CustomIcons && FileExists(Volume->RootDir, L"\\.VolumeIcon.icns")){
+  if (GlobalConfig.CustomIcons && VolumeFileExists(Volume, L"\\.VolumeIcon.icns")){
     Entry->me.Image = LoadIcns(Volume->RootDir, L"\\.VolumeIcon.icns", 128);
     DBG("using VolumeIcon.icns image from Volume\n");
   } else if (Image) {
@@ -964,7 +964,7 @@ STATIC BOOLEAN AddLoaderEntry(IN CHAR16 *LoaderPath, IN CHAR16 *LoaderOptions,
   LOADER_ENTRY *Entry;
   INTN          HVi;
 
-  if ((LoaderPath == NULL) || (Volume == NULL) || (Volume->RootDir == NULL) || !FileExists(Volume->RootDir, LoaderPath)) {
+  if ((LoaderPath == NULL) || (Volume == NULL) || (Volume->RootDir == NULL) || !VolumeFileExists(Volume, LoaderPath)) {
     return FALSE;
   }
 
@@ -1027,9 +1027,9 @@ VOID AddPRSEntry(REFIT_VOLUME *Volume)
 //  CONST INTN Rock = 2;
 //  CONST INTN Scissor = 4;
 
-  WhatBoot |= FileExists(Volume->RootDir, RockBoot)?Rock:0;
-  WhatBoot |= FileExists(Volume->RootDir, PaperBoot)?Paper:0;
-  WhatBoot |= FileExists(Volume->RootDir, ScissorBoot)?Scissor:0;
+  WhatBoot |= VolumeFileExists(Volume, RockBoot)?Rock:0;
+  WhatBoot |= VolumeFileExists(Volume, PaperBoot)?Paper:0;
+  WhatBoot |= VolumeFileExists(Volume, ScissorBoot)?Scissor:0;
   switch (WhatBoot) {
     case Paper:
     case (Paper | Rock):
@@ -1058,6 +1058,7 @@ VOID ScanLoader(VOID)
   UINTN         VolumeIndex, Index;
   REFIT_VOLUME *Volume;
   EFI_GUID     *PartGUID;
+  UINT64        StartTsc = AsmReadTsc();
 
   //DBG("Scanning loaders...\n");
   DbgHeader("ScanLoader");
@@ -1091,15 +1092,15 @@ VOID ScanLoader(VOID)
 
     // check for Mac OS X Install Data
     // 1st stage - createinstallmedia
-    if (FileExists(Volume->RootDir, L"\\.IABootFiles\\boot.efi")) {
-      if (FileExists(Volume->RootDir, L"\\Install OS X Mavericks.app") ||
-          FileExists(Volume->RootDir, L"\\Install OS X Yosemite.app") ||
-          FileExists(Volume->RootDir, L"\\Install OS X El Capitan.app")) {
+    if (VolumeFileExists(Volume, L"\\.IABootFiles\\boot.efi")) {
+      if (VolumeFileExists(Volume, L"\\Install OS X Mavericks.app") ||
+          VolumeFileExists(Volume, L"\\Install OS X Yosemite.app") ||
+          VolumeFileExists(Volume, L"\\Install OS X El Capitan.app")) {
         AddLoaderEntry(L"\\.IABootFiles\\boot.efi", NULL, L"OS X Install", Volume, NULL, OSTYPE_OSX_INSTALLER, 0); // 10.9 - 10.11
       } else {
         AddLoaderEntry(L"\\.IABootFiles\\boot.efi", NULL, L"macOS Install", Volume, NULL, OSTYPE_OSX_INSTALLER, 0); // 10.12 - 10.13.3
       }
-    } else if (FileExists(Volume->RootDir, L"\\.IAPhysicalMedia") && FileExists(Volume->RootDir, MACOSX_LOADER_PATH)) {
+    } else if (VolumeFileExists(Volume, L"\\.IAPhysicalMedia") && VolumeFileExists(Volume, MACOSX_LOADER_PATH)) {
       AddLoaderEntry(MACOSX_LOADER_PATH, NULL, L"macOS Install", Volume, NULL, OSTYPE_OSX_INSTALLER, 0); // 10.13.4+
     }
     // 2nd stage - InstallESD/AppStore/startosinstall/Fusion Drive
@@ -1114,26 +1115,26 @@ VOID ScanLoader(VOID)
 
     // Use standard location for boot.efi, according to the install files is present
     // That file indentifies a DVD/ESD/BaseSystem/Fusion Drive Install Media, so when present, check standard path to avoid entry duplication
-    if (FileExists(Volume->RootDir, MACOSX_LOADER_PATH)) {
-      if (FileExists(Volume->RootDir, L"\\System\\Installation\\CDIS\\Mac OS X Installer.app")) {
+    if (VolumeFileExists(Volume, MACOSX_LOADER_PATH)) {
+      if (VolumeFileExists(Volume, L"\\System\\Installation\\CDIS\\Mac OS X Installer.app")) {
         // InstallDVD/BaseSystem
         AddLoaderEntry(MACOSX_LOADER_PATH, NULL, L"Mac OS X Install", Volume, NULL, OSTYPE_OSX_INSTALLER, 0); // 10.6/10.7
-      } else if (FileExists(Volume->RootDir, L"\\System\\Installation\\CDIS\\OS X Installer.app")) {
+      } else if (VolumeFileExists(Volume, L"\\System\\Installation\\CDIS\\OS X Installer.app")) {
         // BaseSystem
         AddLoaderEntry(MACOSX_LOADER_PATH, NULL, L"OS X Install", Volume, NULL, OSTYPE_OSX_INSTALLER, 0); // 10.8 - 10.11
-      } else if (FileExists(Volume->RootDir, L"\\System\\Installation\\CDIS\\macOS Installer.app")) {
+      } else if (VolumeFileExists(Volume, L"\\System\\Installation\\CDIS\\macOS Installer.app")) {
         // BaseSystem
         AddLoaderEntry(MACOSX_LOADER_PATH, NULL, L"macOS Install", Volume, NULL, OSTYPE_OSX_INSTALLER, 0); // 10.12+
-      } else if (FileExists(Volume->RootDir, L"\\BaseSystem.dmg") && FileExists(Volume->RootDir, L"\\mach_kernel")) {
+      } else if (VolumeFileExists(Volume, L"\\BaseSystem.dmg") && VolumeFileExists(Volume, L"\\mach_kernel")) {
         // InstallESD
-        if (FileExists(Volume->RootDir, L"\\MacOSX_Media_Background.png")) {
+        if (VolumeFileExists(Volume, L"\\MacOSX_Media_Background.png")) {
           AddLoaderEntry(MACOSX_LOADER_PATH, NULL, L"Mac OS X Install", Volume, NULL, OSTYPE_OSX_INSTALLER, 0); // 10.7
         } else {
           AddLoaderEntry(MACOSX_LOADER_PATH, NULL, L"OS X Install", Volume, NULL, OSTYPE_OSX_INSTALLER, 0); // 10.8
         }
-      } else if (FileExists(Volume->RootDir, L"\\com.apple.boot.R\\System\\Library\\PrelinkedKernels\\prelinkedkernel") ||
-                 FileExists(Volume->RootDir, L"\\com.apple.boot.P\\System\\Library\\PrelinkedKernels\\prelinkedkernel") ||
-                 FileExists(Volume->RootDir, L"\\com.apple.boot.S\\System\\Library\\PrelinkedKernels\\prelinkedkernel")) {
+      } else if (VolumeFileExists(Volume, L"\\com.apple.boot.R\\System\\Library\\PrelinkedKernels\\prelinkedkernel") ||
+                 VolumeFileExists(Volume, L"\\com.apple.boot.P\\System\\Library\\PrelinkedKernels\\prelinkedkernel") ||
+                 VolumeFileExists(Volume, L"\\com.apple.boot.S\\System\\Library\\PrelinkedKernels\\prelinkedkernel")) {
         if (StriStr(Volume->VolName, L"Recovery") != NULL) {
           // FileVault of HFS+
           // TODO: need info for 10.11 and lower
@@ -1142,12 +1143,12 @@ VOID ScanLoader(VOID)
           // Fusion Drive
           AddLoaderEntry(MACOSX_LOADER_PATH, NULL, L"OS X Install", Volume, NULL, OSTYPE_OSX_INSTALLER, 0); // 10.11
         }
-      } else if (!FileExists(Volume->RootDir, L"\\.IAPhysicalMedia")) {
+      } else if (!VolumeFileExists(Volume, L"\\.IAPhysicalMedia")) {
         // Installed
         if (EFI_ERROR(GetRootUUID(Volume)) || isFirstRootUUID(Volume)) {
-          if (!FileExists(Volume->RootDir, L"\\System\\Library\\CoreServices\\NotificationCenter.app") && !FileExists(Volume->RootDir, L"\\System\\Library\\CoreServices\\Siri.app")) {
+          if (!VolumeFileExists(Volume, L"\\System\\Library\\CoreServices\\NotificationCenter.app") && !VolumeFileExists(Volume, L"\\System\\Library\\CoreServices\\Siri.app")) {
             AddLoaderEntry(MACOSX_LOADER_PATH, NULL, L"Mac OS X", Volume, NULL, OSTYPE_OSX, 0); // 10.6 - 10.7
-          } else if (FileExists(Volume->RootDir, L"\\System\\Library\\CoreServices\\NotificationCenter.app") && !FileExists(Volume->RootDir, L"\\System\\Library\\CoreServices\\Siri.app")) {
+          } else if (VolumeFileExists(Volume, L"\\System\\Library\\CoreServices\\NotificationCenter.app") && !VolumeFileExists(Volume, L"\\System\\Library\\CoreServices\\Siri.app")) {
             AddLoaderEntry(MACOSX_LOADER_PATH, NULL, L"OS X", Volume, NULL, OSTYPE_OSX, 0); // 10.8 - 10.11
           } else {
             AddLoaderEntry(MACOSX_LOADER_PATH, NULL, L"macOS", Volume, NULL, OSTYPE_OSX, 0); // 10.12+
@@ -1202,10 +1203,10 @@ VOID ScanLoader(VOID)
       // check for Android loaders
       for (Index = 0; Index < AndroidEntryDataCount; ++Index) {
         UINTN aIndex, aFound;
-        if (FileExists(Volume->RootDir, AndroidEntryData[Index].Path)) {
+        if (VolumeFileExists(Volume, AndroidEntryData[Index].Path)) {
           aFound = 0;
           for (aIndex = 0; aIndex < ANDX86_FINDLEN; ++aIndex) {
-            if ((AndroidEntryData[Index].Find[aIndex] == NULL) || FileExists(Volume->RootDir, AndroidEntryData[Index].Find[aIndex])) ++aFound;
+            if ((AndroidEntryData[Index].Find[aIndex] == NULL) || VolumeFileExists(Volume, AndroidEntryData[Index].Find[aIndex])) ++aFound;
           }
           if (aFound && (aFound == aIndex)) {
             AddLoaderEntry(AndroidEntryData[Index].Path, L"", AndroidEntryData[Index].Title, Volume,
@@ -1470,6 +1471,7 @@ VOID ScanLoader(VOID)
     }
   }
 
+  LogVolumeDirCacheStats("ScanLoader", StartTsc);
 }
 
 STATIC VOID AddCustomEntry(IN UINTN                CustomIndex,
@@ -1593,7 +1595,7 @@ STATIC VOID AddCustomEntry(IN UINTN                CustomIndex,
       continue;
     }
     /*
-    if (StriCmp(CustomPath, MACOSX_LOADER_PATH) == 0 && FileExists(Volume->RootDir, L"\\.IAPhysicalMedia")) {
+    if (StriCmp(CustomPath, MACOSX_LOADER_PATH) == 0 && VolumeFileExists(Volume, L"\\.IAPhysicalMedia")) {
       DBG("skipped standard macOS path because volume is 2nd stage Install Media\n");
       continue;
     } */
@@ -1744,7 +1746,7 @@ STATIC VOID AddCustomEntry(IN UINTN                CustomIndex,
           Custom->KernelScan = KERNEL_SCAN_ALL;
           break;
       }
-    } else if (!FileExists(Volume->RootDir, CustomPath)) {
+    } else if (!VolumeFileExists(Volume, CustomPath)) {
       DBG("skipped because path does not exist\n");
       continue;
     }
@@ -77,7 +77,7 @@ STATIC BOOLEAN AddToolEntry(IN CHAR16 *LoaderPath, IN CHAR16 *FullTitle, IN CHAR
   LOADER_ENTRY *Entry;
   // Check the loader exists
   if ((LoaderPath == NULL) || (Volume == NULL) || (Volume->RootDir == NULL) ||
-      !FileExists(Volume->RootDir, LoaderPath)) {
+      !VolumeFileExists(Volume, LoaderPath)) {
     return FALSE;
   }
   // Allocate the entry
@@ -182,10 +182,13 @@ VOID ScanTool(VOID)
   UINTN                   VolumeIndex;
   REFIT_VOLUME            *Volume;
   VOID                    *Interface;
+  UINT64                  StartTsc;
 
   if (GlobalConfig.DisableFlags & HIDEUI_FLAG_TOOLS)
     return;
 
+  StartTsc = AsmReadTsc();
+
   //    Print(L"Scanning for tools...\n");
 
   // look for the EFI shell
@@ -222,7 +225,7 @@ VOID ScanTool(VOID)
           DBG(" Deleted /EFI label\n");
         }
 
-        if (FileExists(Volume->RootDir, CLOVER_MEDIA_FILE_NAME)) {
+        if (VolumeFileExists(Volume, CLOVER_MEDIA_FILE_NAME)) {
           DBG(" Found Clover\n");
           // Volume->BootType = BOOTING_BY_EFI;
           AddCloverEntry(CLOVER_MEDIA_FILE_NAME, L"Clover Boot Options", Volume);
@@ -231,6 +234,7 @@ VOID ScanTool(VOID)
       }
     }
 //  }
+  LogVolumeDirCacheStats("ScanTool", StartTsc);
 }
 
 // Add custom tool entries
@@ -303,7 +307,7 @@ VOID AddCustomTool(VOID)
         }
       }
       // Check the tool exists on the volume
-      if (!FileExists(Volume->RootDir, Custom->Path)) {
+      if (!VolumeFileExists(Volume, Custom->Path)) {
         DBG("skipped because path does not exist\n");
         continue;
       }
@@ -51,12 +51,228 @@ extern BOOLEAN DayLight;
 textFaces       textFace[4]; //0-help 1-message 2-menu 3-test
 NSVGparser      *mainParser = NULL;  //it must be global variable
 
+//
+// Icon render queue.
+// While ParseSVGTheme runs, ParseSVGIcon cuts the icon out of the theme as
+// before but only queues its rasterization. RenderSVGIcons then empties the
+// queue on every processor MP services report, the BSP included. APs may
+// not call boot services, so each worker gets an arena allocated here and
+// builds a fresh rasterizer in it for every job. Icons whose clip stencils
+// would not fit are left to the BSP with pool memory, as is a job that
+// still outgrows its arena. Every rasterizer starts with the same dither
+// seed, so the result does not depend on who drew what.
+//
+#define SVG_ICON_ARENA_SIZE   0x400000
+#define SVG_ICON_MAX_WORKERS  16
+
+typedef struct {
+  NSVGimage   *Image;
+  EG_IMAGE    *Target;
+  float       tx, ty, Scale;
+  BOOLEAN     InPool;
+  BOOLEAN     Done;
+} SVG_ICON_JOB;
+
+typedef struct {
+  EG_IMAGE    **Target;
+  EG_IMAGE    *Source;
+} SVG_ICON_COPY;
+
+STATIC BOOLEAN          mIconBatch = FALSE;
+STATIC SVG_ICON_JOB     *mIconJobs = NULL;
+STATIC UINTN            mIconJobCount = 0;
+STATIC UINTN            mIconJobSize = 0;
+STATIC SVG_ICON_COPY    *mIconCopies = NULL;
+STATIC UINTN            mIconCopyCount = 0;
+STATIC UINTN            mIconCopySize = 0;
+STATIC UINT8            *mIconArenas = NULL;
+STATIC UINT32           mIconArenaCount = 0;
+STATIC volatile UINT32  mIconNextJob = 0;
+STATIC volatile UINT32  mIconNextWorker = 0;
+
+STATIC VOID RenderIconNow(NSVGimage *Image, float tx, float ty, float Scale, EG_IMAGE *Target)
+{
+  NSVGrasterizer *rast = nsvgCreateRasterizer();
+  if (rast == NULL) {
+    return;
+  }
+  nsvgRasterize(rast, Image, tx, ty, Scale, Scale, (UINT8*)Target->PixelData,
+                (int)Target->Width, (int)Target->Height, (int)Target->Width*4);
+  egImageChanged(Target);
+  nsvgDeleteRasterizer(rast);
+}
+
+STATIC VOID QueueIconRender(NSVGimage *Image, float tx, float ty, float Scale, EG_IMAGE *Target)
+{
+  SVG_ICON_JOB *Job;
+
+  if (mIconJobCount == mIconJobSize) {
+    UINTN NewSize = mIconJobSize ? mIconJobSize * 2 : 64;
+    Job = ReallocatePool(mIconJobSize * sizeof(SVG_ICON_JOB), NewSize * sizeof(SVG_ICON_JOB), mIconJobs);
+    if (Job == NULL) {
+      RenderIconNow(Image, tx, ty, Scale, Target);
+      return;
+    }
+    mIconJobs = Job;
+    mIconJobSize = NewSize;
+  }
+  Job = &mIconJobs[mIconJobCount++];
+  Job->Image = Image;
+  Job->Target = Target;
+  Job->tx = tx;
+  Job->ty = ty;
+  Job->Scale = Scale;
+  Job->InPool = FALSE;
+  Job->Done = FALSE;
+}
+
+// egCopyImage of an icon that may still be waiting in the queue
+STATIC VOID CopyIconImage(EG_IMAGE **Target, EG_IMAGE *Source)
+{
+  SVG_ICON_COPY *Copy;
+
+  if (mIconBatch) {
+    if (mIconCopyCount == mIconCopySize) {
+      UINTN NewSize = mIconCopySize ? mIconCopySize * 2 : 16;
+      Copy = ReallocatePool(mIconCopySize * sizeof(SVG_ICON_COPY), NewSize * sizeof(SVG_ICON_COPY), mIconCopies);
+      if (Copy != NULL) {
+        mIconCopies = Copy;
+        mIconCopySize = NewSize;
+      }
+    }
+    if (mIconCopyCount < mIconCopySize) {
+      mIconCopies[mIconCopyCount].Target = Target;
+      mIconCopies[mIconCopyCount].Source = Source;
+      mIconCopyCount++;
+      return;
+    }
+  }
+  *Target = egCopyImage(Source);
+}
+
+// Runs on the BSP and on every AP; only touches its jobs and its arena.
+STATIC VOID EFIAPI RenderIconWorker(IN OUT VOID *Buffer)
+{
+  UINT32          Worker = InterlockedIncrement(&mIconNextWorker) - 1;
+  UINT32          Index;
+  NSVGarena       Arena;
+  NSVGrasterizer  *rast;
+  SVG_ICON_JOB    *Job;
+
+  if (Worker >= mIconArenaCount) {
+    return;
+  }
+  Arena.base = mIconArenas + Worker * SVG_ICON_ARENA_SIZE;
+  Arena.size = SVG_ICON_ARENA_SIZE;
+  for (;;) {
+    Index = InterlockedIncrement(&mIconNextJob) - 1;
+    if (Index >= mIconJobCount) {
+      break;
+    }
+    Job = &mIconJobs[Index];
+    if (!Job->InPool && SetJump(&Arena.jump) == 0) {
+      rast = nsvgCreateRasterizerArena(&Arena);
+      nsvgRasterize(rast, Job->Image, Job->tx, Job->ty, Job->Scale, Job->Scale,
+                    (UINT8*)Job->Target->PixelData, (int)Job->Target->Width,
+                    (int)Job->Target->Height, (int)Job->Target->Width*4);
+      Job->Done = TRUE;
+    }
+  }
+}
+
+STATIC VOID RenderSVGIcons(VOID)
+{
+  EFI_STATUS                Status;
+  EFI_MP_SERVICES_PROTOCOL  *MpServices = NULL;
+  EFI_EVENT                 ApsDone = NULL;
+  UINTN                     Processors = 1;
+  UINTN                     Enabled = 1;
+  UINTN                     Index;
+  UINTN                     Stencil;
+  UINTN                     Redone = 0;
+  UINT32                    Workers = 1;
+  NSVGclipPath              *Clip;
+  BOOLEAN                   ApsStarted = FALSE;
+
+  mIconBatch = FALSE;
+
+  Status = gBS->LocateProtocol(&gEfiMpServiceProtocolGuid, NULL, (VOID **)&MpServices);
+  if (!EFI_ERROR(Status)) {
+    Status = MpServices->GetNumberOfProcessors(MpServices, &Processors, &Enabled);
+  }
+  if (EFI_ERROR(Status)) {
+    Enabled = 1;
+  }
+  Enabled = MIN(MIN(Enabled, mIconJobCount), SVG_ICON_MAX_WORKERS);
+
+  if (Enabled > 1) {
+    // a bit per pixel for every clip path of the icon
+    for (Index = 0; Index < mIconJobCount; Index++) {
+      Stencil = 0;
+      for (Clip = mIconJobs[Index].Image->clipPaths; Clip != NULL; Clip = Clip->next) {
+        Stencil += (UINTN)(mIconJobs[Index].Target->Width + 7) / 8 * mIconJobs[Index].Target->Height;
+      }
+      mIconJobs[Index].InPool = (Stencil > SVG_ICON_ARENA_SIZE / 2);
+    }
+    mIconArenas = AllocatePages(EFI_SIZE_TO_PAGES(SVG_ICON_ARENA_SIZE * Enabled));
+    if (mIconArenas != NULL) {
+      Workers = mIconArenaCount = (UINT32)Enabled;
+      mIconNextJob = 0;
+      mIconNextWorker = 0;
+      Status = gBS->CreateEvent(0, TPL_CALLBACK, NULL, NULL, &ApsDone);
+      if (!EFI_ERROR(Status)) {
+        Status = MpServices->StartupAllAPs(MpServices, RenderIconWorker, FALSE, ApsDone, 0, NULL, NULL);
+        ApsStarted = !EFI_ERROR(Status);
+      }
+      RenderIconWorker(NULL);
+      if (ApsStarted) {
+        gBS->WaitForEvent(1, &ApsDone, &Index);
+      }
+      if (ApsDone != NULL) {
+        gBS->CloseEvent(ApsDone);
+      }
+      FreePages(mIconArenas, EFI_SIZE_TO_PAGES(SVG_ICON_ARENA_SIZE * Enabled));
+      mIconArenas = NULL;
+      mIconArenaCount = 0;
+    }
+  }
+
+  // serial path, big icons and jobs that ran out of arena
+  for (Index = 0; Index < mIconJobCount; Index++) {
+    if (!mIconJobs[Index].Done) {
+      if (Workers > 1 && !mIconJobs[Index].InPool) {
+        egFillImage(mIconJobs[Index].Target, &MenuBackgroundPixel);
+        Redone++;
+      }
+      RenderIconNow(mIconJobs[Index].Image, mIconJobs[Index].tx, mIconJobs[Index].ty,
+                    mIconJobs[Index].Scale, mIconJobs[Index].Target);
+    } else {
+      egImageChanged(mIconJobs[Index].Target);   // drawn by an AP
+    }
+  }
+  DBG("rendered %d icons on %d processors, %d redone\n", mIconJobCount, Workers, Redone);
+
+  for (Index = 0; Index < mIconCopyCount; Index++) {
+    *mIconCopies[Index].Target = egCopyImage(mIconCopies[Index].Source);
+  }
+
+  if (mIconJobs != NULL) {
+    FreePool(mIconJobs);
+  }
+  if (mIconCopies != NULL) {
+    FreePool(mIconCopies);
+  }
+  mIconJobs = NULL;
+  mIconJobCount = mIconJobSize = 0;
+  mIconCopies = NULL;
+  mIconCopyCount = mIconCopySize = 0;
+}
+
 
 EFI_STATUS ParseSVGIcon(NSVGparser  *p, INTN Id, CHAR8 *IconName, float Scale, EG_IMAGE  **Image)
 {
   EFI_STATUS      Status = EFI_NOT_FOUND;
   NSVGimage       *SVGimage;
-  NSVGrasterizer* rast = nsvgCreateRasterizer();
   SVGimage = p->image;
   NSVGshape   *shape;
   NSVGgroup   *group;
@@ -209,7 +425,11 @@ EFI_STATUS ParseSVGIcon(NSVGparser  *p, INTN Id, CHAR8 *IconName, float Scale, E
     ty = (Height - realHeight) * 0.5f;
   }
 
-  nsvgRasterize(rast, IconImage, tx,ty,Scale,Scale, (UINT8*)NewImage->PixelData, iWidth, iHeight, iWidth*4);
+  if (mIconBatch) {
+    QueueIconRender(IconImage, tx, ty, Scale, NewImage);
+  } else {
+    RenderIconNow(IconImage, tx, ty, Scale, NewImage);
+  }
 //  DBG("%a rastered, blt\n", IconImage);
 #if 0
   BltImageAlpha(NewImage,
@@ -219,7 +439,6 @@ EFI_STATUS ParseSVGIcon(NSVGparser  *p, INTN Id, CHAR8 *IconName, float Scale, E
                 16);
 //  WaitForKeyPress(L"waiting for key press...\n");
 #endif
-  nsvgDeleteRasterizer(rast);
 //  nsvg__deleteParser(p2);
 //  nsvgDelete(p2->image);
   *Image = NewImage;
@@ -277,6 +496,7 @@ EFI_STATUS ParseSVGTheme(CONST CHAR8* buffer, TagPtr * dict, UINT32 bufSize)
 #endif
 
 // --- Make background
+  mIconBatch = TRUE;
   BackgroundImage = egCreateFilledImage(UGAWidth, UGAHeight, TRUE, &BlackPixel);
   if (BigBack) {
     egFreeImage(BigBack);
@@ -344,7 +564,7 @@ EFI_STATUS ParseSVGTheme(CONST CHAR8* buffer, TagPtr * dict, UINT32 bufSize)
       DBG(" icon %d not parsed take common %s\n", i, BuiltinIconTable[i].Path);
       if ((i >= BUILTIN_ICON_VOL_EXTERNAL) && (i <= BUILTIN_ICON_VOL_INTERNAL_REC)) {
         if (BuiltinIconTable[BUILTIN_ICON_VOL_INTERNAL].Image) {
-          BuiltinIconTable[i].Image = egCopyImage(BuiltinIconTable[BUILTIN_ICON_VOL_INTERNAL].Image);
+          CopyIconImage(&BuiltinIconTable[i].Image, BuiltinIconTable[BUILTIN_ICON_VOL_INTERNAL].Image);
         }
       }
     }
@@ -375,11 +595,11 @@ EFI_STATUS ParseSVGTheme(CONST CHAR8* buffer, TagPtr * dict, UINT32 bufSize)
       DBG("OSicon %a not parsed\n", OSIconsTable[i].name);
       if ((i > 0) && (i < 13)) {
         if (OSIconsTable[0].image) {
-          OSIconsTable[i].image = egCopyImage(OSIconsTable[0].image);
+          CopyIconImage(&OSIconsTable[i].image, OSIconsTable[0].image);
         }
       } else if (i < 18) {
         if (OSIconsTable[13].image) {
-          OSIconsTable[i].image = egCopyImage(OSIconsTable[13].image);
+          CopyIconImage(&OSIconsTable[i].image, OSIconsTable[13].image);
         }
       }
     }
@@ -408,6 +628,7 @@ EFI_STATUS ParseSVGTheme(CONST CHAR8* buffer, TagPtr * dict, UINT32 bufSize)
   Anime->NudgeY = INITVALUE;
   GuiAnime = Anime;
 
+  RenderSVGIcons();
   nsvgDeleteRasterizer(rast);
 
   *dict = AllocateZeroPool(sizeof(TagStruct));
@@ -532,15 +753,326 @@ VOID RenderSVGfont(NSVGfont  *fontSVG, UINT32 color)
   return;
 }
 #endif
+//
+// SVG text glyph cache.
+// drawSVGtext used to make a new parser for every string, add each letter
+// as a shape and rasterize them all. Now a letter is rasterized once per
+// font and size into a coverage mask, at GLYPH_PHASES subpixel pen
+// positions, and a string is a row of masked blits in the text color.
+// Fonts are freed on theme change, so are the masks: FreeSVGGlyphCache.
+//
+#define GLYPH_PHASES     4
+#define GLYPH_HASH_SIZE  64
+#define GLYPH_MAX_SIZE   1024
+
+typedef struct {
+  BOOLEAN   Ready;
+  INTN      Left;       // mask position relative to the pen
+  INTN      Top;
+  INTN      Width;
+  INTN      Height;
+  UINT8     *Mask;      // coverage, NULL if the letter is blank
+} SVG_GLYPH_MASK;
+
+typedef struct SVG_GLYPH {
+  struct SVG_GLYPH *Next;
+  CHAR16           Letter;
+  NSVGglyph        *Glyph;    // glyph or missing glyph of the font, may be NULL
+  float            Advance;   // in pixels
+  SVG_GLYPH_MASK   Masks[GLYPH_PHASES];
+} SVG_GLYPH;
+
+typedef struct SVG_GLYPH_ATLAS {
+  struct SVG_GLYPH_ATLAS *Next;
+  NSVGfont               *Font;
+  INTN                   Size;
+  float                  Scale;   // pixels per font unit
+  SVG_GLYPH              *Glyphs[GLYPH_HASH_SIZE];
+} SVG_GLYPH_ATLAS;
+
+STATIC SVG_GLYPH_ATLAS  *mGlyphAtlases = NULL;
+STATIC NSVGparser       *mGlyphParser = NULL;
+STATIC NSVGrasterizer   *mGlyphRast = NULL;
+
+STATIC INTN GlyphFloor(float X)
+{
+  INTN I = (INTN)X;
+  if ((float)I > X) {
+    I--;
+  }
+  return I;
+}
+
+static inline INTN GlyphDiv255(INTN X)
+{
+  return ((X + 1) * 257) >> 16;
+}
+
+VOID FreeSVGGlyphCache(VOID)
+{
+  SVG_GLYPH_ATLAS *Atlas;
+  SVG_GLYPH       *Glyph;
+  UINTN           i, k;
+
+  while (mGlyphAtlases) {
+    Atlas = mGlyphAtlases;
+    mGlyphAtlases = Atlas->Next;
+    for (i = 0; i < GLYPH_HASH_SIZE; i++) {
+      while (Atlas->Glyphs[i]) {
+        Glyph = Atlas->Glyphs[i];
+        Atlas->Glyphs[i] = Glyph->Next;
+        for (k = 0; k < GLYPH_PHASES; k++) {
+          if (Glyph->Masks[k].Mask) {
+            FreePool(Glyph->Masks[k].Mask);
+          }
+        }
+        FreePool(Glyph);
+      }
+    }
+    FreePool(Atlas);
+  }
+  if (mGlyphParser) {
+    if (mGlyphParser->text) {
+      FreePool(mGlyphParser->text);
+      mGlyphParser->text = NULL;
+    }
+    nsvg__deleteParser(mGlyphParser);
+    mGlyphParser = NULL;
+  }
+  if (mGlyphRast) {
+    nsvgDeleteRasterizer(mGlyphRast);
+    mGlyphRast = NULL;
+  }
+}
+
+STATIC SVG_GLYPH_ATLAS *GetGlyphAtlas(NSVGfont *Font, INTN Size, float Scale)
+{
+  SVG_GLYPH_ATLAS *Atlas;
+
+  for (Atlas = mGlyphAtlases; Atlas; Atlas = Atlas->Next) {
+    if (Atlas->Font == Font && Atlas->Size == Size && Atlas->Scale == Scale) {
+      return Atlas;
+    }
+  }
+  Atlas = (SVG_GLYPH_ATLAS*)AllocateZeroPool(sizeof(SVG_GLYPH_ATLAS));
+  if (!Atlas) {
+    return NULL;
+  }
+  Atlas->Font = Font;
+  Atlas->Size = Size;
+  Atlas->Scale = Scale;
+  Atlas->Next = mGlyphAtlases;
+  mGlyphAtlases = Atlas;
+  return Atlas;
+}
+
+// Advance table: the glyph lookup in the font chain is done once per letter
+STATIC SVG_GLYPH *GetGlyph(SVG_GLYPH_ATLAS *Atlas, CHAR16 Letter)
+{
+  SVG_GLYPH *Glyph;
+  NSVGglyph *g;
+  UINTN     Hash = Letter & (GLYPH_HASH_SIZE - 1);
+
+  for (Glyph = Atlas->Glyphs[Hash]; Glyph; Glyph = Glyph->Next) {
+    if (Glyph->Letter == Letter) {
+      return Glyph;
+    }
+  }
+  Glyph = (SVG_GLYPH*)AllocateZeroPool(sizeof(SVG_GLYPH));
+  if (!Glyph) {
+    return NULL;
+  }
+  for (g = Atlas->Font->glyphs; g; g = g->next) {
+    if (g->unicode == Letter) {
+      break;
+    }
+  }
+  if (!g) {
+    g = Atlas->Font->missingGlyph;
+  }
+  Glyph->Letter = Letter;
+  Glyph->Glyph = g;
+  Glyph->Advance = g ? g->horizAdvX * Atlas->Scale : 0.f;
+  Glyph->Next = Atlas->Glyphs[Hash];
+  Atlas->Glyphs[Hash] = Glyph;
+  return Glyph;
+}
+
+// Rasterize the letter alone with the pen at Phase/GLYPH_PHASES pixel.
+// Placement is the same as addLetter+nsvgRasterize give in a whole string.
+STATIC VOID RenderGlyphMask(SVG_GLYPH_ATLAS *Atlas, SVG_GLYPH *Glyph, UINTN Phase)
+{
+  SVG_GLYPH_MASK *Mask = &Glyph->Masks[Phase];
+  NSVGfont       *Font = Atlas->Font;
+  NSVGpath       *Path;
+  float          Scale = Atlas->Scale;
+  float          Pen = (float)Phase / GLYPH_PHASES;
+  float          MinX = 0.f, MinY = 0.f, MaxX = 0.f, MaxY = 0.f;
+  BOOLEAN        Empty = TRUE;
+  UINT8          *Pixels;
+  INTN           Right, Bottom, i;
+
+  Mask->Ready = TRUE;
+  if (!Glyph->Glyph || Scale <= 0.f) {
+    return;
+  }
+  // bezier control points bound the outline
+  for (Path = Glyph->Glyph->path; Path; Path = Path->next) {
+    for (i = 0; i < Path->npts; i++) {
+      float px = Path->pts[i * 2];
+      float py = Path->pts[i * 2 + 1];
+      if (Empty) {
+        MinX = MaxX = px;
+        MinY = MaxY = py;
+        Empty = FALSE;
+        continue;
+      }
+      MinX = (px < MinX) ? px : MinX;
+      MaxX = (px > MaxX) ? px : MaxX;
+      MinY = (py < MinY) ? py : MinY;
+      MaxY = (py > MaxY) ? py : MaxY;
+    }
+  }
+  if (Empty) {
+    return;
+  }
+  //glyphs are mirrored by Y, font bbox[3] is the top line
+  Mask->Left = GlyphFloor(Pen + (MinX - 2.f * Font->bbox[0]) * Scale) - 1;
+  Right = -GlyphFloor(-(Pen + (MaxX - 2.f * Font->bbox[0]) * Scale)) + 1;
+  Mask->Top = GlyphFloor((Font->bbox[3] - MaxY) * Scale) - 1;
+  Bottom = -GlyphFloor(-((Font->bbox[3] - MinY) * Scale)) + 1;
+  Mask->Width = Right - Mask->Left;
+  Mask->Height = Bottom - Mask->Top;
+  if (Mask->Width > GLYPH_MAX_SIZE || Mask->Height > GLYPH_MAX_SIZE) {
+    DBG("glyph 0x%x too big %dx%d\n", Glyph->Letter, Mask->Width, Mask->Height);
+    Mask->Width = Mask->Height = 0;
+    return;
+  }
+
+  if (!mGlyphParser) {
+    mGlyphParser = nsvg__createParser();
+    if (!mGlyphParser) {
+      Mask->Ready = FALSE;
+      return;
+    }
+    mGlyphParser->text = (NSVGtext*)AllocateZeroPool(sizeof(NSVGtext));
+    if (!mGlyphParser->text) {
+      nsvg__deleteParser(mGlyphParser);
+      mGlyphParser = NULL;
+      Mask->Ready = FALSE;
+      return;
+    }
+    nsvg__xformIdentity(mGlyphParser->text->xform);
+    mGlyphParser->isText = TRUE;
+  }
+  if (!mGlyphRast) {
+    mGlyphRast = nsvgCreateRasterizer();
+    if (!mGlyphRast) {
+      Mask->Ready = FALSE;
+      return;
+    }
+  }
+  Pixels = (UINT8*)AllocateZeroPool(Mask->Width * Mask->Height * 4);
+  Mask->Mask = (UINT8*)AllocatePool(Mask->Width * Mask->Height);
+  if (!Pixels || !Mask->Mask) {
+    if (Pixels) {
+      FreePool(Pixels);
+    }
+    if (Mask->Mask) {
+      FreePool(Mask->Mask);
+      Mask->Mask = NULL;
+    }
+    Mask->Ready = FALSE;
+    return;
+  }
+
+  // opaque white, so the alpha is the coverage
+  mGlyphParser->text->font = Font;
+  mGlyphParser->text->fontSize = (float)Atlas->Size;
+  addLetter(mGlyphParser, Glyph->Letter,
+            Pen - Font->bbox[0] * Scale - (float)Mask->Left, -(float)Mask->Top,
+            Scale, 0xFFFFFFFF);
+  nsvgRasterize(mGlyphRast, mGlyphParser->image, 0, 0, 1.f, 1.f, Pixels,
+                (int)Mask->Width, (int)Mask->Height, (int)(Mask->Width * 4));
+  for (i = 0; i < Mask->Width * Mask->Height; i++) {
+    Mask->Mask[i] = Pixels[i * 4 + 3];
+  }
+  FreePool(Pixels);
+  nsvg__deleteShapes(mGlyphParser->image->shapes);
+  mGlyphParser->image->shapes = NULL;
+  mGlyphParser->shapesTail = NULL;
+}
+
+// Blend the letter in color over the buffer, the same "over" the rasterizer
+// does, with the buffer pixels taken as not premultiplied.
+// Returns the pen advance.
+STATIC float DrawGlyph(EG_IMAGE *Buffer, SVG_GLYPH_ATLAS *Atlas, CHAR16 Letter,
+                       float PenX, INTN PosY, UINT32 Color)
+{
+  SVG_GLYPH      *Glyph;
+  SVG_GLYPH_MASK *Mask;
+  INTN           PenPixel = GlyphFloor(PenX);
+  INTN           Phase = (INTN)((PenX - (float)PenPixel) * GLYPH_PHASES + 0.5f);
+  INTN           X0, Y0, X, Y, XStart, XEnd, YStart, YEnd;
+  INTN           Ca = (Color >> 24) & 0xff;
+  INTN           Cc[3];
+  INTN           a, ia, da, na, c, i;
+  UINT8          *Cover;
+  UINT8          *Dst;
+
+  Glyph = GetGlyph(Atlas, Letter);
+  if (!Glyph) {
+    return 0.f;
+  }
+  if (Phase >= GLYPH_PHASES) {
+    Phase = 0;
+    PenPixel++;
+  }
+  Mask = &Glyph->Masks[Phase];
+  if (!Mask->Ready) {
+    RenderGlyphMask(Atlas, Glyph, Phase);
+  }
+  if (!Mask->Mask) {
+    return Glyph->Advance;
+  }
+
+  Cc[0] = Color & 0xff;
+  Cc[1] = (Color >> 8) & 0xff;
+  Cc[2] = (Color >> 16) & 0xff;
+  X0 = PenPixel + Mask->Left;
+  Y0 = PosY + Mask->Top;
+  XStart = (X0 < 0) ? -X0 : 0;
+  YStart = (Y0 < 0) ? -Y0 : 0;
+  XEnd = (X0 + Mask->Width > Buffer->Width) ? Buffer->Width - X0 : Mask->Width;
+  YEnd = (Y0 + Mask->Height > Buffer->Height) ? Buffer->Height - Y0 : Mask->Height;
+  for (Y = YStart; Y < YEnd; Y++) {
+    Cover = Mask->Mask + Y * Mask->Width + XStart;
+    Dst = (UINT8*)(Buffer->PixelData + (Y0 + Y) * Buffer->Width + X0 + XStart);
+    for (X = XStart; X < XEnd; X++, Cover++, Dst += 4) {
+      a = GlyphDiv255(*Cover * Ca);
+      if (a == 0) {
+        continue;
+      }
+      ia = 255 - a;
+      da = Dst[3];
+      na = a + GlyphDiv255(ia * da);
+      for (i = 0; i < 3; i++) {
+        c = GlyphDiv255(Cc[i] * a) + GlyphDiv255(ia * GlyphDiv255(Dst[i] * da));
+        Dst[i] = (UINT8)(c * 255 / na);
+      }
+      Dst[3] = (UINT8)na;
+    }
+  }
+  return Glyph->Advance;
+}
+
 //textType = 0-help 1-message 2-menu 3-test
 //return text width in pixels
 INTN drawSVGtext(EG_IMAGE* TextBufferXY, INTN posX, INTN posY, INTN textType, CONST CHAR16* string, UINTN Cursor)
 {
-  INTN Width;
   UINTN i;
   UINTN len;
-  NSVGparser* p;
-  NSVGrasterizer* rast;
+  SVG_GLYPH_ATLAS *Atlas;
   if (!textFace[textType].valid) {
     for (i=0; i<4; i++) {
       if (textFace[i].valid) {
@@ -557,7 +1089,7 @@ INTN drawSVGtext(EG_IMAGE* TextBufferXY, INTN posX, INTN posY, INTN textType, CO
   UINT32 color = textFace[textType].color;
   INTN Height = (INTN)(textFace[textType].size * GlobalConfig.Scale);
   float Scale, sy;
-  float x, y;
+  float x;
   if (!fontSVG) {
     DBG("no font for drawSVGtext\n");
     return 0;
@@ -566,27 +1098,9 @@ INTN drawSVGtext(EG_IMAGE* TextBufferXY, INTN posX, INTN posY, INTN textType, CO
     DBG("no buffer\n");
     return 0;
   }
-  p = nsvg__createParser();
-  if (!p) {
-    return 0;
-  }
-  NSVGtext* text = (NSVGtext*)AllocateZeroPool(sizeof(NSVGtext));
-  if (!text) {
-    return 0;
-  }
-  text->font = fontSVG;
-  text->fontColor = color;
-  text->fontSize = (float)Height;
-  nsvg__xformIdentity(text->xform);
-  p->text = text;
 
   len = StrLen(string);
-  Width = TextBufferXY->Width;
-//  Height = TextBufferXY->Height;
-//  DBG("Text Height=%d  Buffer Height=%d\n", Height, TextBufferXY->Height);
-
-//  Height = 180; //for test
-//  DBG("textBuffer: [%d,%d], fontUnits=%d\n", Width, TextBufferXY->Height, (int)fontSVG->unitsPerEm);
+//  DBG("textBuffer: [%d,%d], fontUnits=%d\n", TextBufferXY->Width, TextBufferXY->Height, (int)fontSVG->unitsPerEm);
   if (!fontSVG->unitsPerEm) {
     fontSVG->unitsPerEm = 1000.f;
   }
@@ -597,14 +1111,12 @@ INTN drawSVGtext(EG_IMAGE* TextBufferXY, INTN posX, INTN posY, INTN textType, CO
     fH = fontSVG->unitsPerEm?fontSVG->unitsPerEm:1000.0f;  //1000
   }
   sy = (float)Height / fH; //(float)fontSVG->unitsPerEm; // 260./1250.
-  //in font units
-//  float fW = fontSVG->bbox[2] - fontSVG->bbox[0];
-//  sx = (float)Width / (fW * len);
-//  Scale = (sx > sy)?sy:sx;
   Scale = sy;
   x = (float)posX; //0.f;
-  y = (float)posY + fontSVG->bbox[1] * Scale;
-  p->isText = TRUE;
+  Atlas = GetGlyphAtlas(fontSVG, Height, sy);
+  if (!Atlas) {
+    return 0;
+  }
 #ifdef _MSC_VER
   CHAR8 *Str8 = (CHAR8*)string;
 #endif
@@ -620,30 +1132,13 @@ INTN drawSVGtext(EG_IMAGE* TextBufferXY, INTN posX, INTN posY, INTN textType, CO
     if (!letter) {
       break;
     }
-//    DBG("add letter 0x%x\n", letter);
     if (i == Cursor) {
-      addLetter(p, 0x5F, x, y, sy, color);
+      DrawGlyph(TextBufferXY, Atlas, 0x5F, x, posY, color);
     }
-    x = addLetter(p, letter, x, y, sy, color);
-//    DBG("next x=%s\n", PoolPrintFloat(x));
+    x += DrawGlyph(TextBufferXY, Atlas, letter, x, posY, color);
   } //end of string
 
-  p->image->realBounds[0] = fontSVG->bbox[0] * Scale;
-  p->image->realBounds[1] = fontSVG->bbox[1] * Scale;
-  p->image->realBounds[2] = fontSVG->bbox[2] * Scale + x; //last bound
-  p->image->realBounds[3] = fontSVG->bbox[3] * Scale;
-//  DBG("internal Scale=%s\n", PoolPrintFloat(Scale));
-//  DumpFloat2("text bounds", p->image->realBounds, 4);
-  //We made an image, then rasterize it
-  rast = nsvgCreateRasterizer();
-//  DBG("begin raster text, scale=%s\n", PoolPrintFloat(Scale));
-  nsvgRasterize(rast, p->image, 0, 0, 1.f, 1.f, (UINT8*)TextBufferXY->PixelData,
-                (int)TextBufferXY->Width, (int)TextBufferXY->Height, (int)(Width*4));
-  float RealWidth = p->image->realBounds[2] - p->image->realBounds[0];
-//  DBG("end raster text\n");
-  nsvgDeleteRasterizer(rast);
-//  nsvg__deleteParser(p);
-  nsvgDelete(p->image);
+  float RealWidth = fontSVG->bbox[2] * Scale + x - fontSVG->bbox[0] * Scale;
   return (INTN)RealWidth; //x;
 }
 
@@ -58,6 +58,8 @@
 // Basic image handling
 //
 
+STATIC UINTN mImageGeneration = 0;
+
 EG_IMAGE * egCreateImage(IN INTN Width, IN INTN Height, IN BOOLEAN HasAlpha)
 {
   EG_IMAGE        *NewImage;
@@ -78,9 +80,22 @@ EG_IMAGE * egCreateImage(IN INTN Width, IN INTN Height, IN BOOLEAN HasAlpha)
   NewImage->Width = Width;
   NewImage->Height = Height;
   NewImage->HasAlpha = HasAlpha;
+  NewImage->Generation = ++mImageGeneration;
   return NewImage;
 }
 
+//
+// Must be called when the pixels of an existing image are written in place,
+// so that egCopyScaledImage does not return a scaled copy of the old ones.
+// Images written right after egCreateImage need not call it.
+//
+VOID egImageChanged(IN OUT EG_IMAGE *Image)
+{
+  if (Image != NULL) {
+    Image->Generation = ++mImageGeneration;
+  }
+}
+
 EG_IMAGE * egCreateFilledImage(IN INTN Width, IN INTN Height, IN BOOLEAN HasAlpha, IN EG_PIXEL *Color)
 {
   EG_IMAGE        *NewImage;
@@ -108,69 +123,322 @@ EG_IMAGE * egCopyImage(IN EG_IMAGE *Image)
   return NewImage;
 }
 
+//
+// Separable resampler.
+// Every output column and row gets its source taps with fixed point weights
+// that add up to EG_SCALE_ONE, computed once per scale. The filter is a
+// triangle one output pixel wide: bilinear when enlarging, an area average
+// when shrinking. Rows are filtered horizontally first, then the vertical
+// pass accumulates whole rows.
+//
+#define EG_SCALE_BITS   14
+#define EG_SCALE_ONE    (1 << EG_SCALE_BITS)
+#define EG_STEP_BITS    12
+#define EG_STEP_ONE     (1 << EG_STEP_BITS)
+
+typedef struct {
+  INTN    MaxTaps;
+  INTN    *Start;     // first source pixel of every output pixel
+  INTN    *Count;     // number of taps
+  INT32   *Weights;   // MaxTaps per output pixel
+} EG_SCALE_TABLE;
+
+STATIC VOID egFreeScaleTable(IN EG_SCALE_TABLE *Table)
+{
+  if (Table->Start) {
+    FreePool(Table->Start);
+  }
+  if (Table->Count) {
+    FreePool(Table->Count);
+  }
+  if (Table->Weights) {
+    FreePool(Table->Weights);
+  }
+}
+
+// Step is the source distance between output pixels with EG_STEP_BITS fraction
+STATIC BOOLEAN egBuildScaleTable(OUT EG_SCALE_TABLE *Table, IN INTN SrcLen, IN INTN DstLen, IN INTN Step)
+{
+  INTN    i, j, k, First, Center, Radius, Dist, Best;
+  INT32   *Weights;
+  INT32   Total;
+  UINT32  Sum;
+
+  ZeroMem(Table, sizeof(*Table));
+  if (SrcLen <= 0 || DstLen <= 0 || Step <= 0 || Step > 0x7FFFFFFF / (2 * DstLen + 1)) {
+    return FALSE;
+  }
+  Radius = MAX(Step, EG_STEP_ONE);
+  Table->MaxTaps = ((2 * Radius) >> EG_STEP_BITS) + 2;
+  Table->Start = AllocatePool(DstLen * sizeof(INTN));
+  Table->Count = AllocatePool(DstLen * sizeof(INTN));
+  Table->Weights = AllocateZeroPool(DstLen * Table->MaxTaps * sizeof(INT32));
+  if (!Table->Start || !Table->Count || !Table->Weights) {
+    egFreeScaleTable(Table);
+    return FALSE;
+  }
+
+  for (i = 0; i < DstLen; i++) {
+    // pixel centers are at +0.5
+    Center = (((2 * i + 1) * Step) >> 1) - (EG_STEP_ONE >> 1);
+    First = (Center - Radius + SrcLen * EG_STEP_ONE) / EG_STEP_ONE - SrcLen;
+    Weights = Table->Weights + i * Table->MaxTaps;
+    Table->Start[i] = MIN(MAX(First, 0), SrcLen - 1);
+    Table->Count[i] = 0;
+    Sum = 0;
+    // taps outside of the image go to the edge pixel
+    for (j = First; j <= First + Table->MaxTaps; j++) {
+      Dist = j * EG_STEP_ONE - Center;
+      if (Dist < 0) {
+        Dist = -Dist;
+      }
+      if (Dist >= Radius) {
+        continue;
+      }
+      k = MIN(MAX(j, 0), SrcLen - 1) - Table->Start[i];
+      Weights[k] += (INT32)(Radius - Dist);
+      Sum += (UINT32)(Radius - Dist);
+      Table->Count[i] = MAX(Table->Count[i], k + 1);
+    }
+    Total = 0;
+    Best = 0;
+    for (k = 0; k < Table->Count[i]; k++) {
+      Weights[k] = (INT32)DivU64x32(MultU64x32((UINT64)Weights[k], EG_SCALE_ONE) + (Sum >> 1), Sum);
+      Total += Weights[k];
+      if (Weights[k] > Weights[Best]) {
+        Best = k;
+      }
+    }
+    Weights[Best] += EG_SCALE_ONE - Total;
+  }
+  return TRUE;
+}
+
+//
+// Resample Src into the DstW x DstH image Dest, with StepX/StepY source
+// pixels per output pixel. Output pixels beyond the scaled source repeat
+// its edge.
+//
+STATIC BOOLEAN egResample(OUT EG_PIXEL *Dest, IN INTN DstW, IN INTN DstH,
+                          IN EG_PIXEL *Src, IN INTN SrcW, IN INTN SrcH,
+                          IN INTN StepX, IN INTN StepY)
+{
+  EG_SCALE_TABLE  Cols, Rows;
+  EG_PIXEL        *Tmp = NULL, *Line;
+  UINT32          *Acc = NULL;
+  INT32           *Weights, W;
+  INTN            x, y, k, RowFirst, RowLast, Groups;
+  UINT32          b, g, r, a;
+  EG_PIXEL        *Pix;
+  BOOLEAN         Ok = FALSE;
+
+  if (!egBuildScaleTable(&Cols, SrcW, DstW, StepX)) {
+    return FALSE;
+  }
+  if (!egBuildScaleTable(&Rows, SrcH, DstH, StepY)) {
+    egFreeScaleTable(&Cols);
+    return FALSE;
+  }
+
+  // only the source rows used by the vertical taps
+  RowFirst = Rows.Start[0];
+  RowLast = Rows.Start[DstH - 1] + Rows.Count[DstH - 1] - 1;
+  // accumulators of four pixels are kept together as B0..B3 G0..G3 R0..R3 A0..A3
+  Groups = (DstW + 3) >> 2;
+  Tmp = AllocatePool((RowLast - RowFirst + 1) * DstW * sizeof(EG_PIXEL));
+  Acc = AllocatePool(Groups * 16 * sizeof(UINT32));
+  if (!Tmp || !Acc) {
+    goto Done;
+  }
+
+  // horizontal pass
+  Line = Tmp;
+  for (y = RowFirst; y <= RowLast; y++) {
+    for (x = 0; x < DstW; x++) {
+      Pix = Src + y * SrcW + Cols.Start[x];
+      Weights = Cols.Weights + x * Cols.MaxTaps;
+      b = g = r = a = EG_SCALE_ONE >> 1;
+      for (k = 0; k < Cols.Count[x]; k++, Pix++) {
+        W = Weights[k];
+        b += Pix->b * W;
+        g += Pix->g * W;
+        r += Pix->r * W;
+        a += Pix->a * W;
+      }
+      Line->b = (UINT8)(b >> EG_SCALE_BITS);
+      Line->g = (UINT8)(g >> EG_SCALE_BITS);
+      Line->r = (UINT8)(r >> EG_SCALE_BITS);
+      Line->a = (UINT8)(a >> EG_SCALE_BITS);
+      Line++;
+    }
+  }
+
+  // vertical pass
+  for (y = 0; y < DstH; y++) {
+    SetMem32(Acc, Groups * 16 * sizeof(UINT32), EG_SCALE_ONE >> 1);
+    Weights = Rows.Weights + y * Rows.MaxTaps;
+    for (k = 0; k < Rows.Count[y]; k++) {
+      Line = Tmp + (Rows.Start[y] + k - RowFirst) * DstW;
+      W = Weights[k];
+      x = 0;
+#ifdef EG_VECTOR
+      for (; x + 4 <= DstW; x += 4) {
+        EG_VU32  Four = *(EG_VPIX *)(Line + x);
+        EG_VPIX  *Sum = (EG_VPIX *)(Acc + x * 4);
+
+        Sum[0] += (Four & 0xFF) * (UINT32)W;
+        Sum[1] += ((Four >> 8) & 0xFF) * (UINT32)W;
+        Sum[2] += ((Four >> 16) & 0xFF) * (UINT32)W;
+        Sum[3] += (Four >> 24) * (UINT32)W;
+      }
+#endif
+      for (; x < DstW; x++) {
+        UINT32 *Sum = Acc + (x >> 2) * 16 + (x & 3);
+
+        Sum[0] += Line[x].b * W;
+        Sum[4] += Line[x].g * W;
+        Sum[8] += Line[x].r * W;
+        Sum[12] += Line[x].a * W;
+      }
+    }
+    for (x = 0; x < DstW; x++) {
+      UINT32 *Sum = Acc + (x >> 2) * 16 + (x & 3);
+
+      Dest->b = (UINT8)(Sum[0] >> EG_SCALE_BITS);
+      Dest->g = (UINT8)(Sum[4] >> EG_SCALE_BITS);
+      Dest->r = (UINT8)(Sum[8] >> EG_SCALE_BITS);
+      Dest->a = (UINT8)(Sum[12] >> EG_SCALE_BITS);
+      Dest++;
+    }
+  }
+  Ok = TRUE;
+
+Done:
+  if (Tmp) {
+    FreePool(Tmp);
+  }
+  if (Acc) {
+    FreePool(Acc);
+  }
+  egFreeScaleTable(&Cols);
+  egFreeScaleTable(&Rows);
+  return Ok;
+}
+
+//
+// Scaled images cache.
+// Menu entries share a few icons that are scaled again on every redraw, so
+// the last scaled images are kept by source generation, size and ratio.
+// A generation is never reused: a new image or one written in place gets a
+// new one, so a stale or freed source can not hit. egFreeImage drops the
+// entries of its image to give the memory back early.
+//
+#define SCALE_CACHE_SIZE  16
+
+typedef struct {
+  UINTN     Generation;
+  INTN      Width;
+  INTN      Height;
+  INTN      Ratio;
+  UINTN     LastUse;
+  EG_IMAGE  *Scaled;
+} SCALE_CACHE_ENTRY;
+
+STATIC SCALE_CACHE_ENTRY  mScaleCache[SCALE_CACHE_SIZE];
+STATIC UINTN              mScaleCacheClock = 0;
+
+STATIC VOID egDropScaleCache(IN UINTN Generation)
+{
+  INTN      i;
+  EG_IMAGE  *Scaled;
+
+  for (i = 0; i < SCALE_CACHE_SIZE; i++) {
+    if (mScaleCache[i].Scaled && mScaleCache[i].Generation == Generation) {
+      Scaled = mScaleCache[i].Scaled;
+      ZeroMem(&mScaleCache[i], sizeof(SCALE_CACHE_ENTRY));
+      egFreeImage(Scaled);
+    }
+  }
+}
+
+STATIC EG_IMAGE * egScaleImageRatio(IN EG_IMAGE *OldImage, IN INTN Ratio)
+{
+  EG_IMAGE  *NewImage;
+  INTN      i, Slot = 0;
+
+  mScaleCacheClock++;
+  for (i = 0; i < SCALE_CACHE_SIZE; i++) {
+    if (mScaleCache[i].Scaled &&
+        mScaleCache[i].Generation == OldImage->Generation &&
+        mScaleCache[i].Width == OldImage->Width &&
+        mScaleCache[i].Height == OldImage->Height &&
+        mScaleCache[i].Ratio == Ratio &&
+        mScaleCache[i].Scaled->HasAlpha == OldImage->HasAlpha) {
+      mScaleCache[i].LastUse = mScaleCacheClock;
+      return egCopyImage(mScaleCache[i].Scaled);
+    }
+    if (mScaleCache[i].LastUse < mScaleCache[Slot].LastUse) {
+      Slot = i;
+    }
+  }
+
+  NewImage = egCreateImage((OldImage->Width * Ratio) >> 4, (OldImage->Height * Ratio) >> 4, OldImage->HasAlpha);
+  if (NewImage == NULL) {
+    return NULL;
+  }
+  if (!egResample(NewImage->PixelData, NewImage->Width, NewImage->Height,
+                  OldImage->PixelData, OldImage->Width, OldImage->Height,
+                  (16 << EG_STEP_BITS) / Ratio, (16 << EG_STEP_BITS) / Ratio)) {
+    egFreeImage(NewImage);
+    return NULL;
+  }
+
+  if (mScaleCache[Slot].Scaled) {
+    egFreeImage(mScaleCache[Slot].Scaled);
+  }
+  mScaleCache[Slot].Scaled = egCopyImage(NewImage);
+  mScaleCache[Slot].Generation = OldImage->Generation;
+  mScaleCache[Slot].Width = OldImage->Width;
+  mScaleCache[Slot].Height = OldImage->Height;
+  mScaleCache[Slot].Ratio = Ratio;
+  mScaleCache[Slot].LastUse = mScaleCacheClock;
+  return NewImage;
+}
+
 //Scaling functions
 EG_IMAGE * egCopyScaledImage(IN EG_IMAGE *OldImage, IN INTN Ratio) //will be N/16
 {
   //(c)Slice 2012
   BOOLEAN Grey = FALSE;
   EG_IMAGE    *NewImage;
-  INTN        x, x0, x1, x2, y, y0, y1, y2;
-  INTN        NewH, NewW;
   EG_PIXEL    *Dest;
-  EG_PIXEL    *Src;
-  INTN        OldW;
+  INTN        i;
 
   if (Ratio < 0) {
     Ratio = -Ratio;
     Grey = TRUE;
   }
 
-  if (!OldImage) {
+  if (!OldImage || Ratio == 0 ||
+      ((OldImage->Width * Ratio) >> 4) == 0 || ((OldImage->Height * Ratio) >> 4) == 0) {
     return NULL;
   }
-  Src = OldImage->PixelData;
-  OldW = OldImage->Width;
-
-  NewW = (OldImage->Width * Ratio) >> 4;
-  NewH = (OldImage->Height * Ratio) >> 4;
-
 
   if (Ratio == 16) {
     NewImage = egCopyImage(OldImage);
   } else {
-    NewImage = egCreateImage(NewW, NewH, OldImage->HasAlpha);
-    if (NewImage == NULL)
-      return NULL;
-
-    Dest = NewImage->PixelData;
-    for (y = 0; y < NewH; y++) {
-      y1 = (y << 4) / Ratio;
-      y0 = ((y1 > 0)?(y1-1):y1) * OldW;
-      y2 = ((y1 < (OldImage->Height - 1))?(y1+1):y1) * OldW;
-      y1 *= OldW;
-      for (x = 0; x < NewW; x++) {
-        x1 = (x << 4) / Ratio;
-        x0 = (x1 > 0)?(x1-1):x1;
-        x2 = (x1 < (OldW - 1))?(x1+1):x1;
-        Dest->b = (UINT8)(((INTN)Src[x1+y1].b * 2 + Src[x0+y1].b +
-                           Src[x2+y1].b + Src[x1+y0].b + Src[x1+y2].b) / 6);
-        Dest->g = (UINT8)(((INTN)Src[x1+y1].g * 2 + Src[x0+y1].g +
-                           Src[x2+y1].g + Src[x1+y0].g + Src[x1+y2].g) / 6);
-        Dest->r = (UINT8)(((INTN)Src[x1+y1].r * 2 + Src[x0+y1].r +
-                           Src[x2+y1].r + Src[x1+y0].r + Src[x1+y2].r) / 6);
-        Dest->a = Src[x1+y1].a;
-        Dest++;
-      }
-    }
+    NewImage = egScaleImageRatio(OldImage, Ratio);
   }
+  if (NewImage == NULL) {
+    return NULL;
+  }
+
   if (Grey) {
     Dest = NewImage->PixelData;
-    for (y = 0; y < NewH; y++) {
-      for (x = 0; x < NewW; x++) {
-        Dest->b = (UINT8)((INTN)((UINTN)Dest->b + (UINTN)Dest->g + (UINTN)Dest->r) / 3);
-        Dest->g = Dest->r = Dest->b;
-        Dest++;
-      }
+    for (i = 0; i < NewImage->Width * NewImage->Height; i++) {
+      Dest->b = (UINT8)((INTN)((UINTN)Dest->b + (UINTN)Dest->g + (UINTN)Dest->r) / 3);
+      Dest->g = Dest->r = Dest->b;
+      Dest++;
     }
   }
 
@@ -258,6 +526,8 @@ VOID  ScaleImage(OUT EG_IMAGE *NewImage, IN EG_IMAGE *OldImage)
   EG_PIXEL  *Src = OldImage->PixelData;
   EG_PIXEL  *Dest = NewImage->PixelData;
 
+  egImageChanged(NewImage);
+
   W1 = OldImage->Width;
   H1 = OldImage->Height;
   W2 = NewImage->Width;
@@ -268,6 +538,19 @@ VOID  ScaleImage(OUT EG_IMAGE *NewImage, IN EG_IMAGE *OldImage)
     f = (W2 << 12) / W1;
   }
   if (f == 0) return;
+
+  // Without BackgroundSharp the edge rules never fire, which is plain filtering
+  if (GlobalConfig.BackgroundSharp == 0 &&
+      egResample(Dest, W2, H2, Src, W1, H1, (1 << 24) / f, (1 << 24) / f)) {
+    for (i = 0; i < W2 * H2; i++, Dest++) {
+      if (Dest->a == 0) {
+        Dest->r = Dest->g = Dest->b = 0x55;
+      }
+      Dest->a = 0xFF;
+    }
+    return;
+  }
+
   cell = ((f - 1) >> 12) + 1;
 
   for (j = 0; j < H2; j++) {
@@ -281,8 +564,8 @@ VOID  ScaleImage(OUT EG_IMAGE *NewImage, IN EG_IMAGE *OldImage)
       a11 = Src[x + y1];
       a10 = (y == 0)?a11: Src[x + y1 - W1];
       a01 = (x == 0)?a11: Src[x + y1 - 1];
-      a21 = (x >= W1)?a11: Src[x + y1 + 1];
-      a12 = (y >= H1)?a11: Src[x + y1 + W1];
+      a21 = (x >= W1 - 1)?a11: Src[x + y1 + 1];
+      a12 = (y >= H1 - 1)?a11: Src[x + y1 + W1];
 
       if (a11.a == 0) {
         Dest->r = Dest->g = Dest->b = 0x55;
@@ -308,6 +591,7 @@ VOID egFreeImage(IN EG_IMAGE *Image)
 {
   if (Image != NULL) {
     if (Image->PixelData != NULL) {
+      egDropScaleCache(Image->Generation);
       FreePool(Image->PixelData);
       Image->PixelData = NULL; //FreePool will not zero pointer
     }
@@ -396,18 +680,18 @@ EFI_STATUS egFindESP(OUT EFI_FILE_HANDLE *RootDir)
     }
     return Status;
 }
-//if (NULL, ...) then save to EFI partition
-EFI_STATUS egSaveFile(IN EFI_FILE_HANDLE BaseDir OPTIONAL, IN CHAR16 *FileName,
-                      IN UINT8 *FileData, IN UINTN FileDataLength)
+//if (NULL, ...) then open on the EFI partition
+//FileSize is the size that will be written, or 0 when it is not known up front
+EFI_STATUS egOpenFileForWrite(IN EFI_FILE_HANDLE BaseDir OPTIONAL, IN CHAR16 *FileName,
+                              IN UINTN FileSize, OUT EFI_FILE_HANDLE *FileHandle)
 {
   EFI_STATUS          Status;
-  EFI_FILE_HANDLE     FileHandle;
-  UINTN               BufferSize;
   BOOLEAN             CreateNew = TRUE;
   CHAR16              *p = FileName + StrLen(FileName);
   CHAR16              DirName[256];
   UINTN               dirNameLen;
 
+  *FileHandle = NULL;
   if (BaseDir == NULL) {
     Status = egFindESP(&BaseDir);
     if (EFI_ERROR(Status)) {
@@ -415,6 +699,8 @@ EFI_STATUS egSaveFile(IN EFI_FILE_HANDLE BaseDir OPTIONAL, IN CHAR16 *FileName,
       return Status;
     }
   }
+  // the file and maybe its folder are created, cached listings go stale
+  FreeAllVolumeDirCaches();
     
   // syscl - make directory if not exist
   while (*p != L'\\' && p >= FileName) {
@@ -423,23 +709,23 @@ EFI_STATUS egSaveFile(IN EFI_FILE_HANDLE BaseDir OPTIONAL, IN CHAR16 *FileName,
   }
   dirNameLen = p - FileName;
   StrnCpy(DirName, FileName, dirNameLen);
-  Status = BaseDir->Open(BaseDir, &FileHandle, DirName,
+  Status = BaseDir->Open(BaseDir, FileHandle, DirName,
                            EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, EFI_FILE_DIRECTORY);
     
   if (EFI_ERROR(Status)) {
       // make dir
 //    DBG("no dir %r\n", Status);
-      Status = BaseDir->Open(BaseDir, &FileHandle, DirName,
+      Status = BaseDir->Open(BaseDir, FileHandle, DirName,
                                EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE, EFI_FILE_DIRECTORY);
 //    DBG("cant make dir %r\n", Status);
   }
   // end of folder checking
 
   // Delete existing file if it exists
-  Status = BaseDir->Open(BaseDir, &FileHandle, FileName,
+  Status = BaseDir->Open(BaseDir, FileHandle, FileName,
                          EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, 0);
   if (!EFI_ERROR(Status)) {
-    Status = FileHandle->Delete(FileHandle);
+    Status = (*FileHandle)->Delete(*FileHandle);
     if (Status == EFI_WARN_DELETE_FAILURE) {
       //This is READ_ONLY file system
       CreateNew = FALSE; // will write into existing file
@@ -449,28 +735,47 @@ EFI_STATUS egSaveFile(IN EFI_FILE_HANDLE BaseDir OPTIONAL, IN CHAR16 *FileName,
 
   if (CreateNew) {
     // Write new file
-    Status = BaseDir->Open(BaseDir, &FileHandle, FileName,
+    Status = BaseDir->Open(BaseDir, FileHandle, FileName,
                            EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE, 0);
     if (EFI_ERROR(Status)) {
 //      DBG("no write %r\n", Status);
+      *FileHandle = NULL;
       return Status;
     }
   } else {
     //to write into existing file we must sure it size larger then our data
-    EFI_FILE_INFO *Info = EfiLibFileInfo(FileHandle);
+    EFI_FILE_INFO *Info = EfiLibFileInfo(*FileHandle);
     if (Info) {
-      if (Info->FileSize < FileDataLength) {
+      if (Info->FileSize < FileSize) {
 //        DBG("no old file %r\n", Status);
+        FreePool(Info);
+        (*FileHandle)->Close(*FileHandle);
+        *FileHandle = NULL;
         return EFI_NOT_FOUND;
       }
       FreePool(Info);
     }
   }
 
-  if (!FileHandle) {
+  if (!*FileHandle) {
 //    DBG("no FileHandle %r\n", Status);
     return EFI_DEVICE_ERROR;
   }
+  return EFI_SUCCESS;
+}
+
+//if (NULL, ...) then save to EFI partition
+EFI_STATUS egSaveFile(IN EFI_FILE_HANDLE BaseDir OPTIONAL, IN CHAR16 *FileName,
+                      IN UINT8 *FileData, IN UINTN FileDataLength)
+{
+  EFI_STATUS          Status;
+  EFI_FILE_HANDLE     FileHandle;
+  UINTN               BufferSize;
+
+  Status = egOpenFileForWrite(BaseDir, FileName, FileDataLength, &FileHandle);
+  if (EFI_ERROR(Status)) {
+    return Status;
+  }
 
   BufferSize = FileDataLength;
   Status = FileHandle->Write(FileHandle, &BufferSize, FileData);
@@ -494,6 +799,7 @@ EFI_STATUS egMkDir(IN EFI_FILE_HANDLE BaseDir OPTIONAL, IN CHAR16 *DirName)
       return Status;
     }
   }
+  FreeAllVolumeDirCaches();
 
   Status = BaseDir->Open(BaseDir, &FileHandle, DirName,
                          EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, EFI_FILE_DIRECTORY);
@@ -622,7 +928,6 @@ VOID egRestrictImageArea(IN EG_IMAGE *Image,
 
 VOID egFillImage(IN OUT EG_IMAGE *CompImage, IN EG_PIXEL *Color)
 {
-  INTN       i;
   EG_PIXEL    FillColor;
   EG_PIXEL    *PixelPtr;
   if (!CompImage || !Color) {
@@ -633,10 +938,9 @@ VOID egFillImage(IN OUT EG_IMAGE *CompImage, IN EG_PIXEL *Color)
   if (!CompImage->HasAlpha)
     FillColor.a = 0;
 
+  egImageChanged(CompImage);
   PixelPtr = CompImage->PixelData;
-  for (i = 0; i < CompImage->Width * CompImage->Height; i++) {
-    *PixelPtr++ = FillColor;
-  }
+  SetMem32(PixelPtr, CompImage->Width * CompImage->Height * sizeof(EG_PIXEL), *(UINT32 *)&FillColor);
 }
 
 VOID egFillImageArea(IN OUT EG_IMAGE *CompImage,
@@ -644,7 +948,7 @@ VOID egFillImageArea(IN OUT EG_IMAGE *CompImage,
                      IN INTN AreaWidth, IN INTN AreaHeight,
                      IN EG_PIXEL *Color)
 {
-  INTN        x, y;
+  INTN        y;
   INTN    xAreaWidth = AreaWidth;
   INTN    xAreaHeight = AreaHeight;
   EG_PIXEL    FillColor;
@@ -656,16 +960,14 @@ VOID egFillImageArea(IN OUT EG_IMAGE *CompImage,
   egRestrictImageArea(CompImage, AreaPosX, AreaPosY, &xAreaWidth, &xAreaHeight);
 
   if (xAreaWidth > 0) {
+    egImageChanged(CompImage);
     FillColor = *Color;
     if (!CompImage->HasAlpha)
       FillColor.a = 0;
 
     PixelBasePtr = CompImage->PixelData + AreaPosY * CompImage->Width + AreaPosX;
     for (y = 0; y < xAreaHeight; y++) {
-      EG_PIXEL    *PixelPtr = PixelBasePtr;
-      for (x = 0; x < xAreaWidth; x++) {
-        *PixelPtr++ = FillColor;
-      }
+      SetMem32(PixelBasePtr, xAreaWidth * sizeof(EG_PIXEL), *(UINT32 *)&FillColor);
       PixelBasePtr += CompImage->Width;
     }
   }
@@ -675,24 +977,92 @@ VOID egRawCopy(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
                IN INTN Width, IN INTN Height,
                IN INTN CompLineOffset, IN INTN TopLineOffset)
 {
-  INTN       x, y;
+  INTN       y;
 
   if (!CompBasePtr || !TopBasePtr) {
     return;
   }
 
   for (y = 0; y < Height; y++) {
-    EG_PIXEL    *TopPtr = TopBasePtr;
-    EG_PIXEL    *CompPtr = CompBasePtr;
-    for (x = 0; x < Width; x++) {
-      *CompPtr = *TopPtr;
-      TopPtr++, CompPtr++;
-    }
+    CopyMem(CompBasePtr, TopBasePtr, Width * sizeof(EG_PIXEL));
     TopBasePtr += TopLineOffset;
     CompBasePtr += CompLineOffset;
   }
 }
 
+#ifdef EG_VECTOR
+//
+// Vector versions of the compose loops, four pixels at a time.
+// Results are bit-exact with the scalar code: products stay below 2^24, so
+// they are exact in float, and the float quotient never crosses an integer
+// for divisors up to 255*255. x/255 for x <= 255*255 is
+// ((x + 1) + ((x + 1) >> 8)) >> 8.
+// The scalar loops do the remaining pixels.
+//
+STATIC INTN egVectorCompose(IN OUT EG_PIXEL *CompPtr, IN EG_PIXEL *TopPtr, IN INTN Width)
+{
+  INTN     x;
+  EG_VU32  Top, Comp, TopAlpha, CompAlpha, TempAlpha, Alpha, Out, Keep, Take;
+  EG_VF32  FTopAlpha, FTempAlpha, FAlpha;
+
+  for (x = 0; x + 4 <= Width; x += 4, TopPtr += 4, CompPtr += 4) {
+    Top = *(EG_VPIX *)TopPtr;
+    TopAlpha = Top >> 24;
+    Take = (EG_VU32)(TopAlpha == 255);
+    Keep = (EG_VU32)(TopAlpha == 0);
+    if ((Keep[0] & Keep[1] & Keep[2] & Keep[3]) != 0) {
+      continue;
+    }
+    if ((Take[0] & Take[1] & Take[2] & Take[3]) != 0) {
+      *(EG_VPIX *)CompPtr = Top;
+      continue;
+    }
+    Comp = *(EG_VPIX *)CompPtr;
+    CompAlpha = Comp >> 24;
+    TempAlpha = CompAlpha * (255 - TopAlpha);
+    TopAlpha *= 255;
+    Alpha = TopAlpha + TempAlpha;
+
+    FTopAlpha = EG_VFLOAT(TopAlpha);
+    FTempAlpha = EG_VFLOAT(TempAlpha);
+    // no zero divisor in the lanes that are kept anyway
+    FAlpha = EG_VFLOAT(Alpha + ((EG_VU32)(Alpha == 0) & 1));
+
+    Out = EG_VUINT((EG_VFLOAT(Top & 0xFF) * FTopAlpha +
+                    EG_VFLOAT(Comp & 0xFF) * FTempAlpha) / FAlpha);
+    Out |= EG_VUINT((EG_VFLOAT((Top >> 8) & 0xFF) * FTopAlpha +
+                     EG_VFLOAT((Comp >> 8) & 0xFF) * FTempAlpha) / FAlpha) << 8;
+    Out |= EG_VUINT((EG_VFLOAT((Top >> 16) & 0xFF) * FTopAlpha +
+                     EG_VFLOAT((Comp >> 16) & 0xFF) * FTempAlpha) / FAlpha) << 16;
+    Out |= EG_VDIV255(Alpha) << 24;
+
+    *(EG_VPIX *)CompPtr = (Top & Take) | (Comp & Keep) | (Out & ~(Take | Keep));
+  }
+  return x;
+}
+
+STATIC INTN egVectorComposeOnFlat(IN OUT EG_PIXEL *CompPtr, IN EG_PIXEL *TopPtr, IN INTN Width)
+{
+  INTN     x;
+  EG_VU32  Top, Comp, TopAlpha, RevAlpha, Out;
+
+  for (x = 0; x + 4 <= Width; x += 4, TopPtr += 4, CompPtr += 4) {
+    Top = *(EG_VPIX *)TopPtr;
+    Comp = *(EG_VPIX *)CompPtr;
+    TopAlpha = Top >> 24;
+    RevAlpha = 255 - TopAlpha;
+
+    Out = EG_VDIV255((Comp & 0xFF) * RevAlpha + (Top & 0xFF) * TopAlpha);
+    Out |= EG_VDIV255(((Comp >> 8) & 0xFF) * RevAlpha + ((Top >> 8) & 0xFF) * TopAlpha) << 8;
+    Out |= EG_VDIV255(((Comp >> 16) & 0xFF) * RevAlpha + ((Top >> 16) & 0xFF) * TopAlpha) << 16;
+    Out |= 0xFF000000;
+
+    *(EG_VPIX *)CompPtr = Out;
+  }
+  return x;
+}
+#endif
+
 VOID egRawCompose(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
                   IN INTN Width, IN INTN Height,
                   IN INTN CompLineOffset, IN INTN TopLineOffset)
@@ -719,7 +1089,12 @@ VOID egRawCompose(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
   for (y = 0; y < Height; y++) {
     TopPtr = TopBasePtr;
     CompPtr = CompBasePtr;
-    for (x = 0; x < Width; x++) {
+    x = 0;
+#ifdef EG_VECTOR
+    x = egVectorCompose(CompPtr, TopPtr, Width);
+    TopPtr += x, CompPtr += x;
+#endif
+    for (; x < Width; x++) {
       TopAlpha = TopPtr->a & 0xFF; //exclude sign
 
       if (TopAlpha == 255) {
@@ -764,7 +1139,12 @@ VOID egRawComposeOnFlat(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
   for (y = 0; y < Height; y++) {
     TopPtr = TopBasePtr;
     CompPtr = CompBasePtr;
-    for (x = 0; x < Width; x++) {
+    x = 0;
+#ifdef EG_VECTOR
+    x = egVectorComposeOnFlat(CompPtr, TopPtr, Width);
+    TopPtr += x, CompPtr += x;
+#endif
+    for (; x < Width; x++) {
       TopAlpha = TopPtr->a;
       RevAlpha = 255 - TopAlpha;
 
@@ -796,6 +1176,7 @@ VOID egComposeImage(IN OUT EG_IMAGE *CompImage, IN EG_IMAGE *TopImage, IN INTN P
   CompWidth  = TopImage->Width;
   CompHeight = TopImage->Height;
   egRestrictImageArea(CompImage, PosX, PosY, &CompWidth, &CompHeight);
+  egImageChanged(CompImage);
 
   // compose
   if (CompWidth > 0) {
@@ -63,6 +63,7 @@
 #include <Protocol/LegacyBios.h>
 #include <Protocol/LoadedImage.h>
 #include <Protocol/LoadedImage.h>
+#include <Protocol/MpService.h>
 #include <Protocol/PciIo.h>
 #include <Protocol/ScsiIo.h>
 #include <Protocol/ScsiPassThru.h>
@@ -109,6 +110,7 @@
 #include <Library/MemoryAllocationLib.h>
 #include <Library/PcdLib.h>
 #include <Library/PrintLib.h>
+#include <Library/SynchronizationLib.h>
 #include <Library/TimerLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/UefiLib.h>
@@ -138,6 +140,25 @@
 #define EG_EICOMPMODE_RLE           (1)
 #define EG_EICOMPMODE_EFICOMPRESS   (2)
 
+//
+// Vector types for the pixel loops in libeg.
+// SSE2 is always there on X64, so there is nothing to detect; GCC and clang
+// vector extensions are used because the intrinsic headers need a libc.
+// Other compilers and IA32 use the scalar loops.
+//
+#if defined(MDE_CPU_X64) && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 9))
+#define EG_VECTOR 1
+
+typedef UINT32 EG_VU32  __attribute__((vector_size(16)));
+typedef INT32  EG_VI32  __attribute__((vector_size(16)));
+typedef float  EG_VF32  __attribute__((vector_size(16)));
+typedef UINT32 EG_VPIX  __attribute__((vector_size(16), aligned(4), __may_alias__));
+
+#define EG_VDIV255(X)    ((((X) + 1) + (((X) + 1) >> 8)) >> 8)
+#define EG_VFLOAT(X)     __builtin_convertvector((EG_VI32)(X), EG_VF32)
+#define EG_VUINT(X)      ((EG_VU32)__builtin_convertvector((X), EG_VI32))
+#endif
+
 /* types */
 
 typedef enum {
@@ -157,6 +178,7 @@ typedef struct {
   INTN        Height;
   EG_PIXEL    *PixelData;
   BOOLEAN     HasAlpha;
+  UINTN       Generation;   // new on creation and on every write, see egImageChanged
 } EG_IMAGE;
 
 typedef struct {
@@ -307,6 +329,14 @@ egSaveFile (
   IN UINTN           FileDataLength
   );
 
+EFI_STATUS
+egOpenFileForWrite (
+  IN  EFI_FILE_HANDLE BaseDir OPTIONAL,
+  IN  CHAR16          *FileName,
+  IN  UINTN           FileSize,
+  OUT EFI_FILE_HANDLE *FileHandle
+  );
+
 EFI_STATUS
 egMkDir (
   IN EFI_FILE_HANDLE BaseDir OPTIONAL,
@@ -318,6 +348,11 @@ egFindESP (
   OUT EFI_FILE_HANDLE *RootDir
   );
 
+VOID
+egImageChanged (
+  IN OUT EG_IMAGE    *Image
+  );
+
 VOID
 egFillImage (
   IN OUT EG_IMAGE    *CompImage,
@@ -404,6 +439,11 @@ drawSVGtext (
   IN UINTN            Cursor
   );
 
+VOID
+FreeSVGGlyphCache (
+  VOID
+  );
+
 VOID
 testSVG (
   VOID
@@ -656,6 +656,7 @@ egTakeImage (
       AreaHeight = UGAHeight - ScreenPosY;
     }
     
+    egImageChanged(Image);
     if (GraphicsOutput != NULL) {
       GraphicsOutput->Blt(GraphicsOutput,
                           (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)Image->PixelData,
@@ -673,6 +674,160 @@ egTakeImage (
     }
 }
 
+#if defined(LODEPNG)
+//
+// Screenshot file writer: the encoder output is collected in two buffers and
+// one is written in the background with WriteEx while the encoder fills the
+// other. File systems without WriteEx are written to synchronously.
+//
+#define SCREENSHOT_BUFFER_SIZE  SIZE_512KB
+
+typedef struct {
+  EFI_FILE_HANDLE    File;
+  UINT8              *Buffer[2];
+  UINTN              Current;
+  UINTN              Size;      // bytes in Buffer[Current]
+  EFI_FILE_IO_TOKEN  Token;     // the write in flight when Pending
+  BOOLEAN            Pending;
+  BOOLEAN            Async;
+  EFI_STATUS         Status;
+  UINT64             WriteTsc;  // time spent in or waiting for the file system
+} SCREENSHOT_WRITER;
+
+STATIC EFI_STATUS ScreenShotWaitWrite(IN OUT SCREENSHOT_WRITER *Writer)
+{
+  UINTN   Index;
+  UINT64  StartTsc;
+
+  if (Writer->Pending) {
+    StartTsc = AsmReadTsc();
+    gBS->WaitForEvent(1, &Writer->Token.Event, &Index);
+    Writer->WriteTsc += AsmReadTsc() - StartTsc;
+    Writer->Pending = FALSE;
+    if (!EFI_ERROR(Writer->Status)) {
+      Writer->Status = Writer->Token.Status;
+    }
+  }
+  return Writer->Status;
+}
+
+// Writes out Buffer[Current] and switches to the other buffer. There is only
+// one write in flight, so the file is written in order.
+STATIC EFI_STATUS ScreenShotFlush(IN OUT SCREENSHOT_WRITER *Writer)
+{
+  UINTN   BufferSize;
+  UINT64  StartTsc;
+
+  if (EFI_ERROR(ScreenShotWaitWrite(Writer)) || Writer->Size == 0) {
+    return Writer->Status;
+  }
+  StartTsc = AsmReadTsc();
+  if (Writer->Async) {
+    Writer->Token.Status = EFI_SUCCESS;
+    Writer->Token.BufferSize = Writer->Size;
+    Writer->Token.Buffer = Writer->Buffer[Writer->Current];
+    Writer->Status = Writer->File->WriteEx(Writer->File, &Writer->Token);
+    if (Writer->Status == EFI_UNSUPPORTED) {
+      Writer->Async = FALSE;
+    } else {
+      Writer->Pending = !EFI_ERROR(Writer->Status);
+    }
+  }
+  if (!Writer->Async) {
+    BufferSize = Writer->Size;
+    Writer->Status = Writer->File->Write(Writer->File, &BufferSize, Writer->Buffer[Writer->Current]);
+  }
+  Writer->WriteTsc += AsmReadTsc() - StartTsc;
+  Writer->Current ^= 1;
+  Writer->Size = 0;
+  return Writer->Status;
+}
+
+// eglodepng_write_func
+STATIC unsigned ScreenShotWrite(VOID *Context, CONST UINT8 *Data, size_t Size)
+{
+  SCREENSHOT_WRITER *Writer = (SCREENSHOT_WRITER *)Context;
+  UINTN             Part;
+
+  while (Size > 0) {
+    Part = MIN(Size, SCREENSHOT_BUFFER_SIZE - Writer->Size);
+    CopyMem(Writer->Buffer[Writer->Current] + Writer->Size, Data, Part);
+    Writer->Size += Part;
+    Data += Part;
+    Size -= Part;
+    if (Writer->Size == SCREENSHOT_BUFFER_SIZE) {
+      ScreenShotFlush(Writer);
+    }
+  }
+  return EFI_ERROR(Writer->Status) ? 1 : 0;
+}
+
+// Encodes the screen copy in Image (BGRx) as PNG straight into the first
+// screenshotN.png that can be created. Only the file creation is retried,
+// a file left partial by a failed encode or write is deleted.
+STATIC EFI_STATUS egSaveScreenShot(IN EFI_FILE_HANDLE BaseDir OPTIONAL, IN EG_IMAGE *Image)
+{
+  SCREENSHOT_WRITER Writer;
+  unsigned          lode_return;
+  UINT64            StartTsc;
+  UINT64            TotalTsc;
+  UINTN             Index;
+  CHAR16            FileName[128];
+
+  ZeroMem(&Writer, sizeof(Writer));
+  Writer.Status = EFI_NOT_READY;
+  for (Index = 0; Index < 60; Index++) {
+    UnicodeSPrint(FileName, sizeof(FileName), L"EFI\\CLOVER\\misc\\screenshot%d.png", Index);
+    // on the ESP the first name is simply overwritten
+    if (BaseDir != NULL && FileExists(BaseDir, FileName)) {
+      continue;
+    }
+    Writer.Status = egOpenFileForWrite(BaseDir, FileName, 0, &Writer.File);
+    if (!EFI_ERROR(Writer.Status)) {
+      break;
+    }
+  }
+  if (EFI_ERROR(Writer.Status)) {
+    return Writer.Status;
+  }
+  Writer.Buffer[0] = AllocatePool(2 * SCREENSHOT_BUFFER_SIZE);
+  if (Writer.Buffer[0] == NULL) {
+    Writer.File->Delete(Writer.File);
+    return EFI_OUT_OF_RESOURCES;
+  }
+  Writer.Buffer[1] = Writer.Buffer[0] + SCREENSHOT_BUFFER_SIZE;
+  Writer.Async = (Writer.File->Revision >= EFI_FILE_PROTOCOL_REVISION2) &&
+                 !EFI_ERROR(gBS->CreateEvent(0, 0, NULL, NULL, &Writer.Token.Event));
+
+  StartTsc = AsmReadTsc();
+  lode_return = eglodepng_encode_screen((CONST UINT8 *)Image->PixelData, (UINTN)Image->Width, (UINTN)Image->Height,
+                                        ScreenShotWrite, &Writer);
+  if (lode_return == 0) {
+    ScreenShotFlush(&Writer);
+  }
+  ScreenShotWaitWrite(&Writer);
+  TotalTsc = AsmReadTsc() - StartTsc;
+
+  if (Writer.Token.Event != NULL) {
+    gBS->CloseEvent(Writer.Token.Event);
+  }
+  FreePool(Writer.Buffer[0]);
+
+  if (lode_return != 0 && !EFI_ERROR(Writer.Status)) {
+    Writer.Status = (lode_return == 83) ? EFI_OUT_OF_RESOURCES : EFI_INVALID_PARAMETER;
+  }
+  if (EFI_ERROR(Writer.Status)) {
+    Writer.File->Delete(Writer.File);
+  } else {
+    Writer.File->Close(Writer.File);
+  }
+  DebugLog(1, "egScreenShot(): %s %ldx%ld, encode %ld ms, write %ld ms%a: %r\n",
+           FileName, Image->Width, Image->Height, TimeDiff(Writer.WriteTsc, TotalTsc), TimeDiff(0, Writer.WriteTsc),
+           Writer.Async ? " (async)" : "", Writer.Status);
+  return Writer.Status;
+}
+#endif //LODEPNG
+
 //
 // Make a screenshot
 //
@@ -684,10 +839,12 @@ egScreenShot (
 {
     EFI_STATUS      Status = EFI_NOT_READY;
     EG_IMAGE        *Image;
+#if !defined(LODEPNG)
     UINT8           *FileData = NULL;
     UINTN           FileDataLength = 0U;
     UINTN           Index;
     CHAR16          ScreenshotName[128];
+#endif //LODEPNG
       
     if (!egHasGraphics)
         return EFI_NOT_READY;
@@ -708,46 +865,27 @@ egScreenShot (
         UgaDraw->Blt(UgaDraw, (EFI_UGA_PIXEL *)Image->PixelData, EfiUgaVideoToBltBuffer,
                      0, 0, 0, 0, (UINTN)Image->Width, (UINTN)Image->Height, 0);
     }
-// yyyyy
-#if defined(LODEPNG)
-    {
-      EFI_UGA_PIXEL *ImagePNG = (EFI_UGA_PIXEL *)Image->PixelData;
-      UINTN   ImageSize = Image->Width * Image->Height;
-      UINTN   i;
-      unsigned lode_return;
-
-      // Convert BGR to RGBA with Alpha set to 0xFF
-      for (i = 0; i < ImageSize; i++) {
-          UINT8 Temp = ImagePNG[i].Blue;
-          ImagePNG[i].Blue = ImagePNG[i].Red;
-          ImagePNG[i].Red = Temp;
-          ImagePNG[i].Reserved = 0xFF;
-      }
-
-      // Encode raw RGB image to PNG format
-      lode_return = eglodepng_encode(&FileData, &FileDataLength, (CONST UINT8*)ImagePNG, (UINTN)Image->Width, (UINTN)Image->Height);
-      if (lode_return) {
-        DebugLog(1, "egScreenShot(): eglodepng_encode failed on ImagePNG %p, Width %ld, Height %ld with error %u\n",
-                 ImagePNG, Image->Width, Image->Height, lode_return);
-      }
-    }
-#else //LODEPNG
+#if !defined(LODEPNG)
     // encode as BMP
     egEncodeBMP(Image, &FileData, &FileDataLength);
-#endif //LODEPNG
     
     egFreeImage(Image);
     if (FileData == NULL) {
         Print(L"Error egEncode returned NULL\n");
         return EFI_NO_MEDIA;
     }
+#endif //LODEPNG
   
-  for (Index=0; Index < 60; Index++) {
 #if defined(LODEPNG)
-    UnicodeSPrint(ScreenshotName, 256, L"EFI\\CLOVER\\misc\\screenshot%d.png", Index);
+  Status = egSaveScreenShot(SelfRootDir, Image);
+  // else save to file on the ESP, unless the encoder itself failed
+  if (EFI_ERROR(Status) && Status != EFI_OUT_OF_RESOURCES && Status != EFI_INVALID_PARAMETER) {
+    Status = egSaveScreenShot(NULL, Image);
+  }
+  CheckError(Status, L"Error egSaveFile\n");
 #else //LODEPNG
+  for (Index=0; Index < 60; Index++) {
     UnicodeSPrint(ScreenshotName, 256, L"EFI\\CLOVER\\misc\\screenshot%d.bmp", Index);
-#endif //LODEPNG
     if(!FileExists(SelfRootDir, ScreenshotName)){
       Status = egSaveFile(SelfRootDir, ScreenshotName, FileData, FileDataLength);
       if (!EFI_ERROR(Status)) {
@@ -758,11 +896,7 @@ egScreenShot (
   // else save to file on the ESP
   if (EFI_ERROR(Status)) {
     for (Index=0; Index < 60; Index++) {
-#if defined(LODEPNG)
-        UnicodeSPrint(ScreenshotName, 256, L"EFI\\CLOVER\\misc\\screenshot%d.png", Index);
-#else //LODEPNG
         UnicodeSPrint(ScreenshotName, 256, L"EFI\\CLOVER\\misc\\screenshot%d.bmp", Index);
-#endif //LODEPNG
 //     if(!FileExists(NULL, ScreenshotName)){
         Status = egSaveFile(NULL, ScreenshotName, FileData, FileDataLength);
         if (!EFI_ERROR(Status)) {
@@ -772,8 +906,9 @@ egScreenShot (
     }
     CheckError(Status, L"Error egSaveFile\n");
   }
+#endif //LODEPNG
 #if defined(LODEPNG)
-  lodepng_free(FileData);
+  egFreeImage(Image);
 #else //LODEPNG
   FreePool(FileData);
 #endif //LODEPNG
@@ -911,6 +911,13 @@ unsigned compress(std::vector<unsigned char>& out, const std::vector<unsigned ch
 
 #ifdef LODEPNG_COMPILE_ENCODER
 unsigned eglodepng_encode(unsigned char** out, size_t* outsize, const unsigned char* image, size_t w, size_t h);
+
+/*writes size bytes of the PNG file, returns nonzero on failure*/
+typedef unsigned (*eglodepng_write_func)(void* context, const unsigned char* data, size_t size);
+
+/*encodes a w * h BGRx image (EFI blt pixels) as RGB PNG, streaming it out through write*/
+unsigned eglodepng_encode_screen(const unsigned char* image, size_t w, size_t h,
+                                 eglodepng_write_func write, void* context);
 #endif /*LODEPNG_COMPILE_ENCODER*/
 
 #ifdef LODEPNG_COMPILE_DECODER
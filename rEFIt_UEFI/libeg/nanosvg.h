@@ -457,6 +457,7 @@ void nsvg__xformSetScale(float* t, float sx, float sy);
 void nsvg__xformPremultiply(float* t, float* s);
 void nsvg__xformMultiply(float* t, float* s);
 void nsvg__deleteFont(NSVGfont* font);
+void nsvg__deleteShapes(NSVGshape* shape);
 void nsvg__imageBounds(NSVGparser* p, float* bounds);
 float addLetter(NSVGparser* p, CHAR16 letter, float x, float y, float scale, UINT32 color);
 VOID RenderSVGfont(NSVGfont  *fontSVG, UINT32 color);
@@ -469,6 +470,20 @@ typedef void (*recursive_image)(const void *obj, NSVGrasterizer *r, const char *
 // Allocated rasterizer context.
 NSVGrasterizer* nsvgCreateRasterizer(VOID);
 
+// Fixed block of memory for a rasterizer that must not call boot services,
+// as on an AP. The rasterizer and all its buffers come from the block.
+// When it runs out, the allocation does LongJump(&arena->jump, 1), so the
+// caller SetJump()s before rasterizing and treats that as a failed render.
+typedef struct NSVGarena {
+  unsigned char* base;
+  UINTN size;
+  UINTN used;
+  BASE_LIBRARY_JUMP_BUFFER jump;
+} NSVGarena;
+
+// Rasterizer context living in arena, nsvgDeleteRasterizer leaves it there.
+NSVGrasterizer* nsvgCreateRasterizerArena(NSVGarena* arena);
+
 // Rasterizes SVG image, returns RGBA image (non-premultiplied alpha)
 //   r - pointer to rasterizer context
 //   image - pointer to image to rasterize
@@ -528,6 +543,7 @@ typedef struct NSVGcachedPaint {
   float xform[6];
 //  float opacity;
   void *image;
+  unsigned int *seed;   // dither state of the rasterizer
   unsigned int colors[256];
 //  unsigned int colors2[256];
 } NSVGcachedPaint;
@@ -547,6 +563,12 @@ struct NSVGrasterizer
   int nedges;
   int cedges;
 
+  NSVGedge* sorted;   // scratch for the edge sort
+  int* keys;
+  int csorted;
+  int* buckets;
+  int cbuckets;
+
   NSVGpoint* points;
   int npoints;
   int cpoints;
@@ -561,6 +583,7 @@ struct NSVGrasterizer
 
   unsigned char* scanline;
   int cscanline;
+  int* accum;         // coverage deltas for one row, kept zeroed
   NSVGscanlineFunction fscanline;
 
   unsigned char* stencil;
@@ -569,6 +592,9 @@ struct NSVGrasterizer
 
   unsigned char* bitmap;
   int width, height, stride;
+
+  unsigned int seed;
+  NSVGarena* arena;
 };
 
 #endif
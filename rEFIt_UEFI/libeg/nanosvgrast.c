@@ -84,40 +84,100 @@ void DumpFloat (char* s, float* t, int N)
 #endif
 }
 
-void nsvg_qsort(NSVGedge* Array, int Low, int High)
+//
+// Rasterizer memory. Normally pool, but a rasterizer made with an arena
+// takes everything from it and frees nothing: the owner drops the arena.
+// An arena rasterizer may run on an AP, where boot services are off limits.
+// Clover.dsc links refit.inf against UefiMemoryLib unless DEBUG_ON_SERIAL_PORT
+// is set, so CopyMem/SetMem (and memcpy/memset from nanosvg.h) go to gBS;
+// it copies and clears with plain loops, volatile so the compiler does not
+// turn them back into calls.
+//
+static void nsvg__copyMem(NSVGarena* arena, void* dst, const void* src, UINTN n)
 {
-  int i = Low, j = High;
-  NSVGedge Temp;
-  UINTN Size = sizeof(NSVGedge);
-  int Imed;
-  Imed = (Low + High) / 2; // Central element, just pointer
-  float med = Array[Imed].y0;
-  //  Temp = AllocatePool(sizeof(NSVGedge));
-  // Sort around center
-  while (i <= j) {
-    while (Array[i].y0 < med) i++;
-    while (Array[j].y0 > med) j--;
-    // Change
-    if (i <= j) {
-      memcpy(&Temp, &Array[i], Size);
-      memcpy(&Array[i++], &Array[j], Size);
-      memcpy(&Array[j--], &Temp, Size);
+  volatile UINT8* d = (UINT8*)dst;
+  const UINT8* s = (const UINT8*)src;
+
+  if (arena == NULL) {
+    CopyMem(dst, (void*)src, n);
+    return;
+  }
+  if ((((UINTN)d | (UINTN)s) & (sizeof(UINTN) - 1)) == 0) {
+    for (; n >= sizeof(UINTN); n -= sizeof(UINTN)) {
+      *(volatile UINTN*)d = *(const UINTN*)s;
+      d += sizeof(UINTN);
+      s += sizeof(UINTN);
     }
   }
-  //  FreePool(Temp);
-  // Recursion
-  if (j > Low)    nsvg_qsort(Array, Low, j);
-  if (High > i)   nsvg_qsort(Array, i, High);
+  while (n-- > 0) *d++ = *s++;
 }
 
+static void nsvg__zeroMem(NSVGarena* arena, void* dst, UINTN n)
+{
+  volatile UINT8* d = (UINT8*)dst;
 
-void qsort(void* Array, int Num, INTN Size,
-           int (*compare)(const void* a, const void* b))
+  if (arena == NULL) {
+    SetMem(dst, n, 0);
+    return;
+  }
+  if (((UINTN)d & (sizeof(UINTN) - 1)) == 0) {
+    for (; n >= sizeof(UINTN); n -= sizeof(UINTN)) {
+      *(volatile UINTN*)d = 0;
+      d += sizeof(UINTN);
+    }
+  }
+  while (n-- > 0) *d++ = 0;
+}
+
+static void* nsvg__arenaAlloc(NSVGarena* arena, UINTN size)
 {
-  //  QuickSort(Array, 0, Num - 1, Size, compare);
-  nsvg_qsort((NSVGedge*)Array, 0, Num - 1);
+  void* p;
+
+  size = ALIGN_VALUE(size, 16);
+  if (size > arena->size - arena->used) {
+    LongJump(&arena->jump, 1);
+  }
+  p = arena->base + arena->used;
+  arena->used += size;
+  return p;
 }
 
+static void* nsvg__malloc(NSVGrasterizer* r, UINTN size)
+{
+  if (r->arena) return nsvg__arenaAlloc(r->arena, size);
+  return AllocatePool(size);
+}
+
+static void* nsvg__zalloc(NSVGrasterizer* r, UINTN size)
+{
+  void* p;
+
+  if (r->arena == NULL) return AllocateZeroPool(size);
+  p = nsvg__arenaAlloc(r->arena, size);
+  nsvg__zeroMem(r->arena, p, size);
+  return p;
+}
+
+static void* nsvg__realloc(NSVGrasterizer* r, UINTN oldSize, UINTN newSize, void* old)
+{
+  NSVGarena* arena = r->arena;
+  void* p;
+
+  if (arena == NULL) return ReallocatePool(oldSize, newSize, old);
+  // the last block grows in place
+  if (old != NULL && (unsigned char*)old + ALIGN_VALUE(oldSize, 16) == arena->base + arena->used) {
+    arena->used = (unsigned char*)old - arena->base;
+    return nsvg__arenaAlloc(arena, newSize);
+  }
+  p = nsvg__arenaAlloc(arena, newSize);
+  if (old != NULL) nsvg__copyMem(r->arena, p, old, oldSize < newSize ? oldSize : newSize);
+  return p;
+}
+
+static void nsvg__free(NSVGrasterizer* r, void* p)
+{
+  if (r->arena == NULL) FreePool(p);
+}
 
 NSVGrasterizer* nsvgCreateRasterizer()
 {
@@ -125,6 +185,21 @@ NSVGrasterizer* nsvgCreateRasterizer()
   if (r == NULL) return NULL;
   r->tessTol = 0.1f;  //0.25f;
   r->distTol = 0.01f;
+  r->seed = 12345;
+  return r;
+}
+
+NSVGrasterizer* nsvgCreateRasterizerArena(NSVGarena* arena)
+{
+  NSVGrasterizer* r;
+
+  arena->used = 0;
+  r = (NSVGrasterizer*)nsvg__arenaAlloc(arena, sizeof(NSVGrasterizer));
+  nsvg__zeroMem(arena, r, sizeof(NSVGrasterizer));
+  r->tessTol = 0.1f;  //0.25f;
+  r->distTol = 0.01f;
+  r->seed = 12345;
+  r->arena = arena;
   return r;
 }
 
@@ -132,7 +207,7 @@ void nsvgDeleteRasterizer(NSVGrasterizer* r)
 {
   NSVGmemPage* p;
 
-  if (r == NULL) return;
+  if (r == NULL || r->arena != NULL) return;
 
   p = r->pages;
   while (p != NULL) {
@@ -142,9 +217,13 @@ void nsvgDeleteRasterizer(NSVGrasterizer* r)
   }
 
   if (r->edges) FreePool(r->edges);
+  if (r->sorted) FreePool(r->sorted);
+  if (r->keys) FreePool(r->keys);
+  if (r->buckets) FreePool(r->buckets);
   if (r->points) FreePool(r->points);
   if (r->points2) FreePool(r->points2);
   if (r->scanline) FreePool(r->scanline);
+  if (r->accum) FreePool(r->accum);
   if (r->stencil) FreePool(r->stencil);
 
   FreePool(r);
@@ -160,7 +239,7 @@ static NSVGmemPage* nsvg__nextPage(NSVGrasterizer* r, NSVGmemPage* cur)
   }
 
   // Alloc new page
-  newp = (NSVGmemPage*)AllocateZeroPool(sizeof(NSVGmemPage));
+  newp = (NSVGmemPage*)nsvg__zalloc(r, sizeof(NSVGmemPage));
   if (newp == NULL) return NULL;
 
 
@@ -226,9 +305,9 @@ static void nsvg__addPathPoint(NSVGrasterizer* r, NSVGpoint* pt, float* t, int f
     int OldSize = r->cpoints * sizeof(NSVGpoint);
     r->cpoints = r->cpoints > 0 ? r->cpoints * 2 : 64;
     if (OldSize == 0) {
-      r->points = (NSVGpoint*)AllocatePool(64 * sizeof(NSVGpoint));
+      r->points = (NSVGpoint*)nsvg__malloc(r, 64 * sizeof(NSVGpoint));
     } else {
-      r->points = (NSVGpoint*)ReallocatePool(OldSize, sizeof(NSVGpoint) * r->cpoints, r->points);
+      r->points = (NSVGpoint*)nsvg__realloc(r, OldSize, sizeof(NSVGpoint) * r->cpoints, r->points);
     }
     if (r->points == NULL) return;
   }
@@ -247,9 +326,9 @@ static void nsvg__appendPathPoint(NSVGrasterizer* r, NSVGpoint* pt)
     int OldSize = r->cpoints * sizeof(NSVGpoint);
     r->cpoints = r->cpoints > 0 ? r->cpoints * 2 : 64;
     if (OldSize == 0) {
-      r->points = (NSVGpoint*)AllocatePool(64 * sizeof(NSVGpoint));
+      r->points = (NSVGpoint*)nsvg__malloc(r, 64 * sizeof(NSVGpoint));
     } else
-      r->points = (NSVGpoint*)ReallocatePool(OldSize, sizeof(NSVGpoint) * r->cpoints, r->points);
+      r->points = (NSVGpoint*)nsvg__realloc(r, OldSize, sizeof(NSVGpoint) * r->cpoints, r->points);
     if (r->points == NULL) return;
   }
   r->points[r->npoints] = *pt;
@@ -262,14 +341,14 @@ static void nsvg__duplicatePoints(NSVGrasterizer* r)
     int OldSize = r->cpoints2 * sizeof(NSVGpoint);
     r->cpoints2 = r->npoints;
     if (OldSize == 0) {
-      r->points2 = (NSVGpoint*)AllocatePool(r->npoints * sizeof(NSVGpoint));
+      r->points2 = (NSVGpoint*)nsvg__malloc(r, r->npoints * sizeof(NSVGpoint));
     } else
-      r->points2 = (NSVGpoint*)ReallocatePool(OldSize, sizeof(NSVGpoint) * r->cpoints2, r->points2);
+      r->points2 = (NSVGpoint*)nsvg__realloc(r, OldSize, sizeof(NSVGpoint) * r->cpoints2, r->points2);
     if (r->points2 == NULL) return;
   }
 
   if (r->npoints) {
-    memcpy(r->points2, r->points, sizeof(NSVGpoint) * r->npoints);
+    nsvg__copyMem(r->arena, r->points2, r->points, sizeof(NSVGpoint) * r->npoints);
   }
 
   r->npoints2 = r->npoints;
@@ -287,9 +366,9 @@ static void nsvg__addEdge(NSVGrasterizer* r, float x0, float y0, float x1, float
     int OldSize = r->cedges * sizeof(NSVGedge);
     r->cedges = r->cedges > 0 ? r->cedges * 2 : 64;
     if (OldSize == 0) {
-      r->edges = (NSVGedge*)AllocatePool(64 * sizeof(NSVGedge));
+      r->edges = (NSVGedge*)nsvg__malloc(r, 64 * sizeof(NSVGedge));
     } else
-      r->edges = (NSVGedge*)ReallocatePool(OldSize, sizeof(NSVGedge) * r->cedges, r->edges);
+      r->edges = (NSVGedge*)nsvg__realloc(r, OldSize, sizeof(NSVGedge) * r->cedges, r->edges);
     if (r->edges == NULL) return;
   }
 
@@ -925,6 +1004,92 @@ static void nsvg__flattenShapeStroke(NSVGrasterizer* r, NSVGshape* shape, float*
  }
  */
 
+// Subsample scanline where the scan inserts an edge: the first one whose
+// centre is not above y0. n stands for never (below the bitmap or NaN).
+static int nsvg__edgeStart(float y0, int n)
+{
+  int k;
+
+  if (!(y0 <= (float)(n - 1) + 0.5f)) return n;
+  if (y0 <= 0.5f) return 0;
+  k = (int)(y0 - 0.5f);
+  while (k > 0 && y0 <= (float)(k - 1) + 0.5f) k--;
+  while (y0 > (float)k + 0.5f) k++;
+  return k;
+}
+
+static void nsvg__insertSortEdges(NSVGedge* edges, int nedges)
+{
+  NSVGedge t;
+  int i, j;
+
+  for (i = 1; i < nedges; i++) {
+    if (!(edges[i - 1].y0 > edges[i].y0)) continue;
+    t = edges[i];
+    for (j = i; j > 0 && edges[j - 1].y0 > t.y0; j--) {
+      edges[j] = edges[j - 1];
+    }
+    edges[j] = t;
+  }
+}
+
+// Counting sort of the edges by start scanline, which is the only order the
+// scan needs. Buckets cover just the rows the shape spans. If the scratch
+// arrays cannot be had, an insertion sort by y0 does the same job slower.
+static void nsvg__sortEdges(NSVGrasterizer* r)
+{
+  int n = r->height * NSVG__SUBSAMPLES;
+  int i, k, kmin, kmax, nb;
+
+  if (r->nedges < 2) return;
+
+  if (r->csorted < r->cedges) {
+    if (r->sorted) nsvg__free(r, r->sorted);
+    if (r->keys) nsvg__free(r, r->keys);
+    r->sorted = (NSVGedge*)nsvg__malloc(r, r->cedges * sizeof(NSVGedge));
+    r->keys = (int*)nsvg__malloc(r, r->cedges * sizeof(int));
+    r->csorted = (r->sorted != NULL && r->keys != NULL) ? r->cedges : 0;
+  }
+  if (r->csorted == 0) {
+    nsvg__insertSortEdges(r->edges, r->nedges);
+    return;
+  }
+
+  kmin = n;
+  kmax = 0;
+  for (i = 0; i < r->nedges; i++) {
+    k = nsvg__edgeStart(r->edges[i].y0, n);
+    r->keys[i] = k;
+    if (k < kmin) kmin = k;
+    if (k > kmax) kmax = k;
+  }
+  nb = kmax - kmin + 1;
+  if (nb > r->cbuckets) {
+    if (r->buckets) nsvg__free(r, r->buckets);
+    r->buckets = (int*)nsvg__malloc(r, nb * sizeof(int));
+    r->cbuckets = (r->buckets != NULL) ? nb : 0;
+    if (r->buckets == NULL) {
+      nsvg__insertSortEdges(r->edges, r->nedges);
+      return;
+    }
+  }
+
+  nsvg__zeroMem(r->arena, r->buckets, nb * sizeof(int));
+  for (i = 0; i < r->nedges; i++) {
+    r->buckets[r->keys[i] - kmin]++;
+  }
+  // counts -> first index of each bucket
+  for (k = 0, i = 0; k < nb; k++) {
+    int count = r->buckets[k];
+    r->buckets[k] = i;
+    i += count;
+  }
+  for (i = 0; i < r->nedges; i++) {
+    r->sorted[r->buckets[r->keys[i] - kmin]++] = r->edges[i];
+  }
+  nsvg__copyMem(r->arena, r->edges, r->sorted, r->nedges * sizeof(NSVGedge));
+}
+
 static NSVGactiveEdge* nsvg__addActive(NSVGrasterizer* r, NSVGedge* e, float startPoint)
 {
   NSVGactiveEdge* z;
@@ -961,29 +1126,41 @@ static void nsvg__freeActive(NSVGrasterizer* r, NSVGactiveEdge* z)
   r->freelist = z;
 }
 
-static void nsvg__fillScanline(unsigned char* scanline, int len, int x0, int x1, int maxWeight, int* xmin, int* xmax)
+// Coverage goes into the row as deltas, +w where a run starts and -w past
+// its end, so a span costs the same whatever its length. The row is summed
+// once after all its subsamples.
+static void nsvg__fillScanline(int* accum, int len, int x0, int x1, int maxWeight, int* xmin, int* xmax)
 {
   int i = x0 >> NSVG__FIXSHIFT;
   int j = x1 >> NSVG__FIXSHIFT;
+  int c;
   if (i < *xmin) *xmin = i;
   if (j > *xmax) *xmax = j;
   if (i < len && j >= 0) {
     if (i == j) {
       // x0,x1 are the same pixel, so compute combined coverage
-      scanline[i] = (unsigned char)(scanline[i] + ((x1 - x0) * maxWeight >> NSVG__FIXSHIFT));
+      c = (x1 - x0) * maxWeight >> NSVG__FIXSHIFT;
+      accum[i] += c;
+      accum[i + 1] -= c;
     } else {
-      if (i >= 0) // add antialiasing for x0
-        scanline[i] = (unsigned char)(scanline[i] + (((NSVG__FIX - (x0 & NSVG__FIXMASK)) * maxWeight) >> NSVG__FIXSHIFT));
-      else
+      if (i >= 0) { // add antialiasing for x0
+        c = ((NSVG__FIX - (x0 & NSVG__FIXMASK)) * maxWeight) >> NSVG__FIXSHIFT;
+        accum[i] += c;
+        accum[i + 1] -= c;
+      } else
         i = -1; // clip
 
-      if (j < len) // add antialiasing for x1
-        scanline[j] = (unsigned char)(scanline[j] + (((x1 & NSVG__FIXMASK) * maxWeight) >> NSVG__FIXSHIFT));
-      else
+      if (j < len) { // add antialiasing for x1
+        c = ((x1 & NSVG__FIXMASK) * maxWeight) >> NSVG__FIXSHIFT;
+        accum[j] += c;
+        accum[j + 1] -= c;
+      } else
         j = len; // clip
 
-      for (++i; i < j; ++i) // fill pixels between x0 and x1
-        scanline[i] = (unsigned char)(scanline[i] + maxWeight);
+      if (i + 1 < j) { // fill pixels between x0 and x1
+        accum[i + 1] += maxWeight;
+        accum[j] -= maxWeight;
+      }
     }
   }
 }
@@ -991,7 +1168,7 @@ static void nsvg__fillScanline(unsigned char* scanline, int len, int x0, int x1,
 // note: this routine clips fills that extend off the edges... ideally this
 // wouldn't happen, but it could happen if the truetype glyph bounding boxes
 // are wrong, or if the user supplies a too-small bitmap
-static void nsvg__fillActiveEdges(unsigned char* scanline, int len, NSVGactiveEdge* e, int maxWeight, int* xmin, int* xmax, char fillRule)
+static void nsvg__fillActiveEdges(int* accum, int len, NSVGactiveEdge* e, int maxWeight, int* xmin, int* xmax, char fillRule)
 {
   // non-zero winding fill
   int x0 = 0, w = 0;
@@ -1006,7 +1183,7 @@ static void nsvg__fillActiveEdges(unsigned char* scanline, int len, NSVGactiveEd
         int x1 = e->x; w += e->dir;
         // if we went to zero, we need to draw
         if (w == 0)
-          nsvg__fillScanline(scanline, len, x0, x1, maxWeight, xmin, xmax);
+          nsvg__fillScanline(accum, len, x0, x1, maxWeight, xmin, xmax);
       }
       e = e->next;
     }
@@ -1018,7 +1195,7 @@ static void nsvg__fillActiveEdges(unsigned char* scanline, int len, NSVGactiveEd
         x0 = e->x; w = 1;
       } else {
         int x1 = e->x; w = 0;
-        nsvg__fillScanline(scanline, len, x0, x1, maxWeight, xmin, xmax);
+        nsvg__fillScanline(accum, len, x0, x1, maxWeight, xmin, xmax);
       }
       e = e->next;
     }
@@ -1057,11 +1234,97 @@ static unsigned int nsvg__applyOpacity(unsigned int c, float u)
   return nsvg__RGBA((unsigned char)r, (unsigned char)g, (unsigned char)b, (unsigned char)a);
 }
 
+// rndf() and dither() from FloatLib with the state in the rasterizer, so an
+// image comes out the same whatever was drawn before it and wherever.
+static float nsvg__rndf(unsigned int* seed)
+{
+  *seed = *seed * 214013 + 2531011;
+  return (float)*seed / 4294967296.0f;
+}
+
+static int nsvg__dither(unsigned int* seed, float x, int level)
+{
+  int i;
+  float dx;
+
+  if (!level) {
+    return (int)x;
+  }
+  i = (int)(x) * level;
+  dx = x * level - (float)(i);
+  i /= level;
+  if (dx > nsvg__rndf(seed) * level) {
+    i += (int)((0.9999f + nsvg__rndf(seed)) * level);
+  }
+  return i;
+}
+
 static inline int nsvg__div255(int x)
 {
   return ((x+1) * 257) >> 16;
 }
 
+// Blends paint colour c (packed like the bitmap, r in the low byte) over the
+// pixel d, with the paint alpha scaled by cover.
+static inline unsigned int nsvg__blendPixel(unsigned int c, unsigned int d, int cover)
+{
+  int a = nsvg__div255(cover * (int)(c >> 24));
+  int ia = 255 - a;
+  unsigned int r, g, b;
+
+  // Premultiply and blend over
+  r = nsvg__div255((int)(c & 0xff) * a) + nsvg__div255(ia * (int)(d & 0xff));
+  g = nsvg__div255((int)((c >> 8) & 0xff) * a) + nsvg__div255(ia * (int)((d >> 8) & 0xff));
+  b = nsvg__div255((int)((c >> 16) & 0xff) * a) + nsvg__div255(ia * (int)((d >> 16) & 0xff));
+  a += nsvg__div255(ia * (int)(d >> 24));
+  return r | (g << 8) | (b << 16) | ((unsigned int)a << 24);
+}
+
+#ifdef EG_VECTOR
+typedef UINT16 NSVG_VU16 __attribute__((vector_size(16)));
+
+// Same for four pixels. Channels are split into 16-bit lanes, r/b and g/a,
+// so SSE2 has a multiply for them; the a lane gets paint alpha 255, which
+// turns its sum into a + div255(ia * da). EG_VDIV255 rounds like nsvg__div255.
+static inline EG_VU32 nsvg__blend4(EG_VU32 c, EG_VU32 d, EG_VU32 cover)
+{
+  NSVG_VU16 a, ia, rb, ga;
+
+  a = EG_VDIV255((NSVG_VU16)(cover | (cover << 16)) * (NSVG_VU16)((c >> 24) | ((c >> 8) & 0xff0000)));
+  ia = 255 - a;
+  rb = EG_VDIV255((NSVG_VU16)(c & 0xff00ff) * a) + EG_VDIV255((NSVG_VU16)(d & 0xff00ff) * ia);
+  ga = EG_VDIV255((NSVG_VU16)(((c >> 8) & 0xff) | 0xff0000) * a) + EG_VDIV255((NSVG_VU16)((d >> 8) & 0xff00ff) * ia);
+  return (EG_VU32)rb | ((EG_VU32)ga << 8);
+}
+
+#define NSVG__COVER4(p)  ((EG_VU32){ (p)[0], (p)[1], (p)[2], (p)[3] })
+#endif
+
+// Blends a run of per-pixel colours. Empty pixels are left alone and fully
+// covered opaque ones are stored, both give the same bytes as the blend.
+static void nsvg__blendSpan(unsigned int* dst, unsigned int* colors, unsigned char* cover, int count)
+{
+  int i = 0;
+
+#ifdef EG_VECTOR
+  for (; i + 4 <= count; i += 4) {
+    if ((cover[i] | cover[i + 1] | cover[i + 2] | cover[i + 3]) == 0) continue;
+    *(EG_VPIX *)(dst + i) = nsvg__blend4(*(EG_VPIX *)(colors + i), *(EG_VPIX *)(dst + i), NSVG__COVER4(cover + i));
+  }
+#endif
+  for (; i < count; i++) {
+    if (cover[i] == 0) continue;
+    if (cover[i] == 255 && colors[i] >= 0xff000000) {
+      dst[i] = colors[i];
+    } else {
+      dst[i] = nsvg__blendPixel(colors[i], dst[i], cover[i]);
+    }
+  }
+}
+
+// Gradient colours are looked up this many pixels at a time, then blended
+#define NSVG__SPAN_CHUNK  64
+
 static void nsvg__scanlineBit(
                               unsigned char* row, int count, unsigned char* cover, int x, int y,
                               /*   float tx, float ty, float scalex, float scaley, */ NSVGcachedPaint* cache)
@@ -1079,131 +1342,78 @@ static void nsvg__scanlineSolid(unsigned char* row, int count, unsigned char* co
 {
   //  static int once = 0;
   unsigned char* dst = row + x*4;
+  unsigned int* pix = (unsigned int*)dst;
+  unsigned int colors[NSVG__SPAN_CHUNK];
   if (cache->type == NSVG_PAINT_COLOR) {
-    int i, cr, cg, cb, ca;
-    cr = cache->colors[0] & 0xff;
-    cg = (cache->colors[0] >> 8) & 0xff;
-    cb = (cache->colors[0] >> 16) & 0xff;
-    ca = (cache->colors[0] >> 24) & 0xff;
-
-    for (i = 0; i < count; i++) {
-      int r,g,b;
-      int a = nsvg__div255((int)cover[0] * ca);
-      int ia = 255 - a;
-      // Premultiply
-      r = nsvg__div255(cr * a);
-      g = nsvg__div255(cg * a);
-      b = nsvg__div255(cb * a);
-
-      // Blend over
-      r += nsvg__div255(ia * (int)dst[0]);
-      g += nsvg__div255(ia * (int)dst[1]);
-      b += nsvg__div255(ia * (int)dst[2]);
-      a += nsvg__div255(ia * (int)dst[3]);
-
-      dst[0] = (unsigned char)r;
-      dst[1] = (unsigned char)g;
-      dst[2] = (unsigned char)b;
-      dst[3] = (unsigned char)a;
-
-      cover++;
-      dst += 4;
+    unsigned int c = cache->colors[0];
+    int i = 0;
+
+#ifdef EG_VECTOR
+    EG_VU32 c4 = { c, c, c, c };
+    for (; i + 4 <= count; i += 4) {
+      if ((cover[i] | cover[i + 1] | cover[i + 2] | cover[i + 3]) == 0) continue;
+      if (c >= 0xff000000 && (cover[i] & cover[i + 1] & cover[i + 2] & cover[i + 3]) == 255) {
+        *(EG_VPIX *)(pix + i) = c4;
+      } else {
+        *(EG_VPIX *)(pix + i) = nsvg__blend4(c4, *(EG_VPIX *)(pix + i), NSVG__COVER4(cover + i));
+      }
+    }
+#endif
+    for (; i < count; i++) {
+      if (cover[i] == 0) continue;
+      if (cover[i] == 255 && c >= 0xff000000) {
+        pix[i] = c;
+      } else {
+        pix[i] = nsvg__blendPixel(c, pix[i], cover[i]);
+      }
     }
   } else if (cache->type == NSVG_PAINT_LINEAR_GRADIENT) {
     // TODO: spread modes.
-    // TODO: plenty of opportunities to optimize.
     float fx, fy, gy;
     float* t = cache->xform;
+    int i, k, n;
+    int level = cache->coarse;
 
     //    DumpFloat("cache grad xform", t, 6);
-    int i, cr, cg, cb, ca;
-    unsigned int c;
     //x,y - pixels
     fx = (float)x;
     fy = (float)y;
     //    dx = 1.0f;
     gy = fx*t[1] + fy*t[3] + t[5]; //gradient direction. Point at cut
 
-    for (i = 0; i < count; i++) {
-      int r,g,b,a,ia;
-      int level = cache->coarse;
-      c = cache->colors[dither(nsvg__clampf(gy*(255.0f-level), 0, (float)(255-level)), level)]; //assumed gy = 0.0 ... 1.0f
-      cr = (c) & 0xff;
-      cg = (c >> 8) & 0xff;
-      cb = (c >> 16) & 0xff;
-      ca = (c >> 24) & 0xff;
-      a = nsvg__div255((int)cover[0] * ca);
-      ia = 255 - a;
-
-      // Premultiply
-      r = nsvg__div255(cr * a);
-      g = nsvg__div255(cg * a);
-      b = nsvg__div255(cb * a);
-      // Blend over
-      r += nsvg__div255(ia * (int)dst[0]);
-      g += nsvg__div255(ia * (int)dst[1]);
-      b += nsvg__div255(ia * (int)dst[2]);
-      a += nsvg__div255(ia * (int)dst[3]);
-      dst[0] = (unsigned char)r;
-      dst[1] = (unsigned char)g;
-      dst[2] = (unsigned char)b;
-      dst[3] = (unsigned char)a;
-
-      cover++;
-      dst += 4;
-      //      fx += dx;
-      gy += t[1];
+    for (i = 0; i < count; i += n) {
+      n = (count - i < NSVG__SPAN_CHUNK) ? count - i : NSVG__SPAN_CHUNK;
+      for (k = 0; k < n; k++) {
+        colors[k] = cache->colors[nsvg__dither(cache->seed, nsvg__clampf(gy*(255.0f-level), 0, (float)(255-level)), level)]; //assumed gy = 0.0 ... 1.0f
+        gy += t[1];
+      }
+      nsvg__blendSpan(pix + i, colors, cover + i, n);
     }
   } else if (cache->type == NSVG_PAINT_RADIAL_GRADIENT) {
     // TODO: spread modes.
-    // TODO: plenty of opportunities to optimize.
     // TODO: focus (fx,fy)
     float fx, fy, gx, gy, gd;
     float* t = cache->xform;
+    int i, k, n;
+    int level = cache->coarse;
+
     //    DumpFloat("cache grad xform", t, 6);
-    int i, cr, cg, cb, ca;
-    unsigned int c;
     fx = (float)x;
     fy = (float)y;
     //    dx = 1.0f;
     gx = fx*t[0] + fy*t[2] + t[4];
     gy = fx*t[1] + fy*t[3] + t[5];
 
-    for (i = 0; i < count; i++) {
-      int r,g,b,a,ia;
-      gd = sqrtf(gx*gx + gy*gy);
-      //     DBG("gx=%s gy=%s\n", PoolPrintFloat(gx), PoolPrintFloat(gy));
-      int level = cache->coarse;
-      c = cache->colors[dither(nsvg__clampf(gd*(255.0f-level*2), 0, (254.99f-level*2)), level)];
-      cr = (c) & 0xff;
-      cg = (c >> 8) & 0xff;
-      cb = (c >> 16) & 0xff;
-      ca = (c >> 24) & 0xff;
-
-      a = nsvg__div255((int)cover[0] * ca);
-      ia = 255 - a;
-
-      // Premultiply
-      r = nsvg__div255(cr * a);
-      g = nsvg__div255(cg * a);
-      b = nsvg__div255(cb * a);
-
-      // Blend over
-      r += nsvg__div255(ia * (int)dst[0]);
-      g += nsvg__div255(ia * (int)dst[1]);
-      b += nsvg__div255(ia * (int)dst[2]);
-      a += nsvg__div255(ia * (int)dst[3]);
-
-      dst[0] = (unsigned char)r;
-      dst[1] = (unsigned char)g;
-      dst[2] = (unsigned char)b;
-      dst[3] = (unsigned char)a;
-
-      cover++;
-      dst += 4;
-      //      fx += dx;
-      gx += t[0];
-      gy += t[1];
+    for (i = 0; i < count; i += n) {
+      n = (count - i < NSVG__SPAN_CHUNK) ? count - i : NSVG__SPAN_CHUNK;
+      for (k = 0; k < n; k++) {
+        gd = sqrtf(gx*gx + gy*gy);
+        //     DBG("gx=%s gy=%s\n", PoolPrintFloat(gx), PoolPrintFloat(gy));
+        colors[k] = cache->colors[nsvg__dither(cache->seed, nsvg__clampf(gd*(255.0f-level*2), 0, (254.99f-level*2)), level)];
+        gx += t[0];
+        gy += t[1];
+      }
+      nsvg__blendSpan(pix + i, colors, cover + i, n);
     }
   } else if (cache->type == NSVG_PAINT_PATTERN) {
     // TODO
@@ -1211,7 +1421,6 @@ static void nsvg__scanlineSolid(unsigned char* row, int count, unsigned char* co
     float* t = cache->xform;
     EG_IMAGE *Pattern = (EG_IMAGE *)cache->image;
     if (!Pattern) {
-      DBG("no pattern to fill\n");
       return;
     }
     INTN Width = Pattern->Width;
@@ -1227,8 +1436,8 @@ static void nsvg__scanlineSolid(unsigned char* row, int count, unsigned char* co
       int r,g,b,a,ia;
       gx = fx*t[0] + fy*t[2] + t[4];
       gy = fx*t[1] + fy*t[3] + t[5];
-      ix = dither(gx * Width, 2) % Width;
-      iy = dither(gy * Height, 2) % Height;
+      ix = nsvg__dither(cache->seed, gx * Width, 2) % Width;
+      iy = nsvg__dither(cache->seed, gy * Height, 2) % Height;
       j = iy * Width + ix;
       cr = Pattern->PixelData[j].r;
       cb = Pattern->PixelData[j].b;
@@ -1259,57 +1468,31 @@ static void nsvg__scanlineSolid(unsigned char* row, int count, unsigned char* co
 
   } else if (cache->type == NSVG_PAINT_CONIC_GRADIENT) {
     // TODO: spread modes.
-    // TODO: plenty of opportunities to optimize.
     // TODO: focus (fx,fy)
     float fx, fy, gx, gy, gd;
     float* t = cache->xform;
-    //    DumpFloat("cache grad xform", t, 6);
-    int i, cr, cg, cb, ca;
-    unsigned int c;
+    int i, k, n;
 
+    //    DumpFloat("cache grad xform", t, 6);
     fx = (float)x;
     fy = (float)y;
     //     dx = 1.0f;
     gx = fx*t[0] + fy*t[2] + t[4];
     gy = fx*t[1] + fy*t[3] + t[5];
 
-    for (i = 0; i < count; i++) {
-      int r,g,b,a,ia;
-      if ((gx == 0.f) && (gy == 0.f)) {
-        c = 0;
-      } else {
-        gd = (Atan2F(gy, gx) + PI) / PI2;
-        c = cache->colors[dither(nsvg__clampf(gd*254.0f, 0, 253.99f), 1)];
+    for (i = 0; i < count; i += n) {
+      n = (count - i < NSVG__SPAN_CHUNK) ? count - i : NSVG__SPAN_CHUNK;
+      for (k = 0; k < n; k++) {
+        if ((gx == 0.f) && (gy == 0.f)) {
+          colors[k] = 0;
+        } else {
+          gd = (Atan2F(gy, gx) + PI) / PI2;
+          colors[k] = cache->colors[nsvg__dither(cache->seed, nsvg__clampf(gd*254.0f, 0, 253.99f), 1)];
+        }
+        gx += t[0];
+        gy += t[1];
       }
-      cr = (c) & 0xff;
-      cg = (c >> 8) & 0xff;
-      cb = (c >> 16) & 0xff;
-      ca = (c >> 24) & 0xff;
-
-      a = nsvg__div255((int)cover[0] * ca);
-      ia = 255 - a;
-
-      // Premultiply
-      r = nsvg__div255(cr * a);
-      g = nsvg__div255(cg * a);
-      b = nsvg__div255(cb * a);
-
-      // Blend over
-      r += nsvg__div255(ia * (int)dst[0]);
-      g += nsvg__div255(ia * (int)dst[1]);
-      b += nsvg__div255(ia * (int)dst[2]);
-      a += nsvg__div255(ia * (int)dst[3]);
-
-      dst[0] = (unsigned char)r;
-      dst[1] = (unsigned char)g;
-      dst[2] = (unsigned char)b;
-      dst[3] = (unsigned char)a;
-
-      cover++;
-      dst += 4;
-      //        fx += dx;
-      gx += t[0];
-      gy += t[1];
+      nsvg__blendSpan(pix + i, colors, cover + i, n);
     }
   }
 }
@@ -1322,10 +1505,17 @@ static void nsvg__rasterizeSortedEdges(NSVGrasterizer *r,
   int y, s;
   int e = 0;
   int maxWeight = (255 / NSVG__SUBSAMPLES);  // weight per vertical scanline
+  int nsub = r->height * NSVG__SUBSAMPLES;
   int xmin, xmax;
 
   for (y = 0; y < r->height; y++) {
-    gBS->SetMem(r->scanline, r->width, 0);
+    if (active == NULL) {
+      // nothing to draw until the next edge starts
+      if (e >= r->nedges) break;
+      s = nsvg__edgeStart(r->edges[e].y0, nsub) / NSVG__SUBSAMPLES;
+      if (s > y) y = s;
+      if (y >= r->height) break;
+    }
     xmin = r->width;
     xmax = 0;
     for (s = 0; s < NSVG__SUBSAMPLES; ++s) {
@@ -1392,12 +1582,20 @@ static void nsvg__rasterizeSortedEdges(NSVGrasterizer *r,
 
       // now process all active edges in non-zero fashion
       if (active != NULL)
-        nsvg__fillActiveEdges(r->scanline, r->width, active, maxWeight, &xmin, &xmax, fillRule);
+        nsvg__fillActiveEdges(r->accum, r->width, active, maxWeight, &xmin, &xmax, fillRule);
     }
     // Blit
     if (xmin < 0) xmin = 0;
     if (xmax > r->width-1) xmax = r->width-1;
     if (xmin <= xmax) {
+      int p, c = 0;
+      // sum the deltas into coverage, leaving the accumulator zeroed
+      for (p = xmin; p <= xmax; p++) {
+        c += r->accum[p];
+        r->accum[p] = 0;
+        r->scanline[p] = (unsigned char)c;
+      }
+      r->accum[p] = 0;
       //    nsvg__scanlineSolid(&r->bitmap[y * r->stride] + xmin*4, xmax-xmin+1, &r->scanline[xmin], xmin, y, tx,ty, scalex, scaley, cache);
       int i, j;
       for (i = 0; i < clip->count; i++) {
@@ -1423,7 +1621,7 @@ static void nsvg__unpremultiplyAlpha(unsigned char* image, int w, int h, int str
     unsigned char *row = &image[y*stride];
     for (x = 0; x < w; x++) {
       int r = row[0], g = row[1], b = row[2], a = row[3];
-      if (a != 0) {
+      if (a != 0 && a != 255) {
         row[0] = (unsigned char)(r*255/a);
         row[1] = (unsigned char)(g*255/a);
         row[2] = (unsigned char)(b*255/a);
@@ -1474,7 +1672,7 @@ static void nsvg__unpremultiplyAlpha(unsigned char* image, int w, int h, int str
 }
 
 
-static void nsvg__initPaint(NSVGcachedPaint* cache, NSVGpaint* paint, NSVGshape* shape, float *xformShape)
+static void nsvg__initPaint(NSVGrasterizer* r, NSVGcachedPaint* cache, NSVGpaint* paint, NSVGshape* shape, float *xformShape)
 {
   int i, j;
   NSVGgradient* grad = paint->paint.gradient;
@@ -1516,7 +1714,7 @@ static void nsvg__initPaint(NSVGcachedPaint* cache, NSVGpaint* paint, NSVGshape*
     //for (i = 0; i < 256; i++) {
     //  cache->colors[i] = 0;
     //}
-    gBS->SetMem(cache->colors, sizeof(cache->colors), 0);
+    nsvg__zeroMem(r->arena, cache->colors, sizeof(cache->colors));
   } else if (grad->nstops == 1) {
     for (i = 0; i < 256; i++) {
       cache->colors[i] = nsvg__applyOpacity(grad->stops[i].color, opacity);
@@ -1626,11 +1824,20 @@ static void nsvg__rasterizeShapes(NSVGrasterizer* r,
     int oldw = r->cscanline;
     r->cscanline = w;
     if (oldw == 0) {
-      r->scanline = (unsigned char*)AllocatePool(w);
+      r->scanline = (unsigned char*)nsvg__malloc(r, w);
     } else {
-      r->scanline = (unsigned char*)ReallocatePool(oldw, w, r->scanline);
+      r->scanline = (unsigned char*)nsvg__realloc(r, oldw, w, r->scanline);
+    }
+    if (r->accum) nsvg__free(r, r->accum);
+    r->accum = (int*)nsvg__zalloc(r, (w + 1) * sizeof(int));
+    if (r->scanline == NULL || r->accum == NULL) {
+      if (r->scanline) nsvg__free(r, r->scanline);
+      if (r->accum) nsvg__free(r, r->accum);
+      r->scanline = NULL;
+      r->accum = NULL;
+      r->cscanline = 0;
+      return;
     }
-    if (r->scanline == NULL) return;
   }
 
   nsvg__xformSetScale(&xform2[0], scalex, scaley);
@@ -1640,7 +1847,7 @@ static void nsvg__rasterizeShapes(NSVGrasterizer* r,
     if (!(shape->flags & NSVG_VIS_VISIBLE))
       continue;
 
-    memcpy(&xform[0], shape->xform, sizeof(float)*6);
+    nsvg__copyMem(r->arena, &xform[0], shape->xform, sizeof(float)*6);
     //    nsvg__xformMultiply(xform, xform2);
     xform[0] *= scalex;
     xform[1] *= scaley;
@@ -1654,7 +1861,7 @@ static void nsvg__rasterizeShapes(NSVGrasterizer* r,
     }
     shapeLink = shape->link;  //this is <use>
     while (shapeLink) {
-      memcpy(&xform2[0], &xform[0], sizeof(float)*6);
+      nsvg__copyMem(r->arena, &xform2[0], &xform[0], sizeof(float)*6);
       nsvg__xformPremultiply(&xform2[0], shapeLink->xform);
       renderShape(r, shapeLink, &xform2[0], min_scale);
       if (!shape->isSymbol) {
@@ -1677,7 +1884,8 @@ static void renderShape(NSVGrasterizer* r,
   NSVGedge *e = NULL;
   NSVGcachedPaint cache;
   int i;
-  gBS->SetMem(&cache, sizeof(NSVGcachedPaint), 0);
+  nsvg__zeroMem(r->arena, &cache, sizeof(NSVGcachedPaint));
+  cache.seed = &r->seed;
 
   if (shape->fill.type != NSVG_PAINT_NONE) {
     nsvg__resetPool(r);
@@ -1693,10 +1901,10 @@ static void renderShape(NSVGrasterizer* r,
     }
 
     // Rasterize edges
-    qsort(r->edges, r->nedges, sizeof(NSVGedge), NULL);
+    nsvg__sortEdges(r);
 
     // now, traverse the scanlines and find the intersections on each scanline, use non-zero rule
-    nsvg__initPaint(&cache, &shape->fill, shape, xform);
+    nsvg__initPaint(r, &cache, &shape->fill, shape, xform);
     nsvg__rasterizeSortedEdges(r, &cache, shape->fillRule, &shape->clip);
   }
   if (shape->stroke.type != NSVG_PAINT_NONE && (shape->strokeWidth * min_scale) > 0.01f) {
@@ -1713,10 +1921,10 @@ static void renderShape(NSVGrasterizer* r,
     }
 
     // Rasterize edges
-    qsort(r->edges, r->nedges, sizeof(NSVGedge), NULL);
+    nsvg__sortEdges(r);
 
     // now, traverse the scanlines and find the intersections on each scanline, use non-zero rule
-    nsvg__initPaint(&cache, &shape->stroke, shape, xform);
+    nsvg__initPaint(r, &cache, &shape->stroke, shape, xform);
     nsvg__rasterizeSortedEdges(r, &cache, NSVG_FILLRULE_NONZERO, &shape->clip);
   }
 }
@@ -1744,12 +1952,12 @@ void nsvg__rasterizeClipPaths(
   // r->stencil = (unsigned char*)realloc(
   //                                      r->stencil, r->stencilSize * clipPathCount);
   if (oldSize == 0) {
-    r->stencil = (unsigned char*)AllocateZeroPool(r->stencilSize * clipPathCount);
+    r->stencil = (unsigned char*)nsvg__zalloc(r, r->stencilSize * clipPathCount);
     if (r->stencil == NULL) return;
   } else {
-    r->stencil = (unsigned char*)ReallocatePool(oldSize, r->stencilSize * clipPathCount, r->stencil);
+    r->stencil = (unsigned char*)nsvg__realloc(r, oldSize, r->stencilSize * clipPathCount, r->stencil);
     if (r->stencil == NULL) return;
-    gBS->SetMem(r->stencil, r->stencilSize * clipPathCount, 0);
+    nsvg__zeroMem(r->arena, r->stencil, r->stencilSize * clipPathCount);
   }
 
   clipPath = image->clipPaths;
@@ -262,6 +262,7 @@ INTN egRenderText(IN CHAR16 *Text, IN OUT EG_IMAGE *CompImage,
   INTN            RealWidth = 0;
   INTN ScaledWidth = (INTN)(GlobalConfig.CharWidth * GlobalConfig.Scale);
 
+  egImageChanged(CompImage);
   if (GlobalConfig.TypeSVG) {
     return drawSVGtext(CompImage, PosX, PosY, textType, Text, Cursor);
   }
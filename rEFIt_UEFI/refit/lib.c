@@ -456,6 +456,160 @@ EFI_STATUS ExtractLegacyLoaderPaths(EFI_DEVICE_PATH **PathList, UINTN MaxPaths,
 // volume functions
 //
 
+//
+// Boot sector prefetch.
+// ScanVolumeBootcode() reads 2048 bytes at the start of every volume, one
+// device after the other, so a slow USB stick or optical drive holds up all
+// the rest. Before the scan the reads are queued at once through BlockIo2 on
+// every device that has it and collected as they complete; the scan then
+// takes the data from here. Devices without BlockIo2, and reads that did not
+// finish in time, are read synchronously by the scan as before.
+//
+#define BOOT_SECTOR_SIZE          2048
+#define BOOT_SECTOR_READ_TIMEOUT  5000000   // us
+
+typedef struct {
+  EFI_HANDLE              Handle;
+  EFI_BLOCK_IO2_PROTOCOL  *BlockIo2;
+  EFI_LBA                 Lba;
+  EFI_BLOCK_IO2_TOKEN     Token;
+  UINT8                   *Buffer;
+  UINT64                  StartTsc;
+  UINT64                  Ticks;
+  BOOLEAN                 Pending;
+  BOOLEAN                 Done;
+} BOOT_SECTOR_READ;
+
+STATIC BOOT_SECTOR_READ   *mBootSectorReads = NULL;
+STATIC UINTN              mBootSectorReadCount = 0;
+
+STATIC UINT64 TicksToUs(IN UINT64 Ticks)
+{
+  UINT64 TicksPerUs = DivU64x32(gCPUStructure.TSCFrequency, 1000000);
+
+  return (TicksPerUs != 0) ? DivU64x64Remainder(Ticks, TicksPerUs, NULL) : 0;
+}
+
+STATIC VOID PrefetchBootSectors(IN EFI_HANDLE *Handles, IN UINTN HandleCount)
+{
+  EFI_STATUS              Status;
+  BOOT_SECTOR_READ        *Read;
+  EFI_BLOCK_IO2_PROTOCOL  *BlockIo2;
+  UINTN                   Index;
+  UINTN                   Pending = 0;
+  UINTN                   Waited = 0;
+
+  mBootSectorReads = AllocateZeroPool(HandleCount * sizeof(BOOT_SECTOR_READ));
+  if (mBootSectorReads == NULL) {
+    return;
+  }
+  mBootSectorReadCount = HandleCount;
+
+  for (Index = 0; Index < HandleCount; Index++) {
+    Read = &mBootSectorReads[Index];
+    Read->Handle = Handles[Index];
+    Status = gBS->HandleProtocol(Read->Handle, &gEfiBlockIo2ProtocolGuid, (VOID **)&BlockIo2);
+    if (EFI_ERROR(Status) || BlockIo2 == NULL || !BlockIo2->Media->MediaPresent ||
+        BlockIo2->Media->BlockSize > BOOT_SECTOR_SIZE) {
+      continue;
+    }
+    // same offset as ScanVolume sets up
+    Read->Lba = (BlockIo2->Media->BlockSize == 2048) ? 0x10 : 0;
+    Read->Buffer = AllocateAlignedPages(EFI_SIZE_TO_PAGES(BOOT_SECTOR_SIZE), 16);
+    if (Read->Buffer == NULL) {
+      continue;
+    }
+    Status = gBS->CreateEvent(0, 0, NULL, NULL, &Read->Token.Event);
+    if (!EFI_ERROR(Status)) {
+      Read->BlockIo2 = BlockIo2;
+      Read->StartTsc = AsmReadTsc();
+      Status = BlockIo2->ReadBlocksEx(BlockIo2, BlockIo2->Media->MediaId, Read->Lba,
+                                      &Read->Token, BOOT_SECTOR_SIZE, Read->Buffer);
+      if (EFI_ERROR(Status)) {
+        gBS->CloseEvent(Read->Token.Event);
+      }
+    }
+    if (EFI_ERROR(Status)) {
+      Read->BlockIo2 = NULL;
+      FreeAlignedPages(Read->Buffer, EFI_SIZE_TO_PAGES(BOOT_SECTOR_SIZE));
+      Read->Buffer = NULL;
+      continue;
+    }
+    Read->Pending = TRUE;
+    Pending++;
+  }
+  DBG("Boot sector reads queued on %d of %d devices\n", Pending, HandleCount);
+
+  while (Pending > 0 && Waited < BOOT_SECTOR_READ_TIMEOUT) {
+    for (Index = 0; Index < HandleCount; Index++) {
+      Read = &mBootSectorReads[Index];
+      if (!Read->Pending || gBS->CheckEvent(Read->Token.Event) != EFI_SUCCESS) {
+        continue;
+      }
+      Read->Ticks = AsmReadTsc() - Read->StartTsc;
+      Read->Pending = FALSE;
+      Read->Done = TRUE;
+      gBS->CloseEvent(Read->Token.Event);
+      Pending--;
+    }
+    if (Pending > 0) {
+      gBS->Stall(100);
+      Waited += 100;
+    }
+  }
+  // reads still in flight keep their buffers, the scan reads those
+  // devices synchronously
+  if (Pending > 0) {
+    DBG("  %d boot sector reads did not complete\n", Pending);
+  }
+}
+
+STATIC VOID FreeBootSectorReads(VOID)
+{
+  UINTN   Index;
+  BOOLEAN InFlight = FALSE;
+
+  for (Index = 0; Index < mBootSectorReadCount; Index++) {
+    if (mBootSectorReads[Index].Pending) {
+      // the driver still owns the buffer and the token
+      InFlight = TRUE;
+    } else if (mBootSectorReads[Index].Buffer != NULL) {
+      FreeAlignedPages(mBootSectorReads[Index].Buffer, EFI_SIZE_TO_PAGES(BOOT_SECTOR_SIZE));
+    }
+  }
+  if (mBootSectorReads != NULL && !InFlight) {
+    FreePool(mBootSectorReads);
+  }
+  mBootSectorReads = NULL;
+  mBootSectorReadCount = 0;
+}
+
+// Boot sector of the volume as prefetched, or read now
+STATIC EFI_STATUS ReadBootSector(IN REFIT_VOLUME *Volume, OUT UINT8 *SectorBuffer)
+{
+  EFI_STATUS        Status;
+  BOOT_SECTOR_READ  *Read;
+  UINTN             Index;
+  UINT64            StartTsc;
+
+  for (Index = 0; Index < mBootSectorReadCount; Index++) {
+    Read = &mBootSectorReads[Index];
+    if (Read->Done && Read->Handle == Volume->DeviceHandle && Read->Lba == Volume->BlockIOOffset &&
+        Read->BlockIo2->Media->MediaId == Volume->BlockIO->Media->MediaId) {
+      DBG("        boot sector: %ld us, async\n", TicksToUs(Read->Ticks));
+      CopyMem(SectorBuffer, Read->Buffer, BOOT_SECTOR_SIZE);
+      return Read->Token.TransactionStatus;
+    }
+  }
+
+  StartTsc = AsmReadTsc();
+  Status = Volume->BlockIO->ReadBlocks(Volume->BlockIO, Volume->BlockIO->Media->MediaId,
+                                       Volume->BlockIOOffset /*start lba*/,
+                                       BOOT_SECTOR_SIZE, SectorBuffer);
+  DBG("        boot sector: %ld us\n", TicksToUs(AsmReadTsc() - StartTsc));
+  return Status;
+}
+
 static VOID ScanVolumeBootcode(IN OUT REFIT_VOLUME *Volume, OUT BOOLEAN *Bootable)
 {
   EFI_STATUS              Status;
@@ -485,9 +639,7 @@ static VOID ScanVolumeBootcode(IN OUT REFIT_VOLUME *Volume, OUT BOOLEAN *Bootabl
   SectorBuffer = AllocateAlignedPages(EFI_SIZE_TO_PAGES (2048), 16); //align to 16 byte?! Poher
   ZeroMem((CHAR8*)&SectorBuffer[0], 2048);
   // look at the boot sector (this is used for both hard disks and El Torito images!)
-  Status = Volume->BlockIO->ReadBlocks(Volume->BlockIO, Volume->BlockIO->Media->MediaId,
-                                       Volume->BlockIOOffset /*start lba*/,
-                                       2048, SectorBuffer);
+  Status = ReadBootSector(Volume, SectorBuffer);
   if (!EFI_ERROR(Status) && (SectorBuffer[1] != 0)) {
     // calc crc checksum of first 2 sectors - it's used later for legacy boot BIOS drive num detection
     // note: possible future issues with AF 4K disks
@@ -1105,6 +1257,7 @@ VOID ScanVolumes(VOID)
   if (Status == EFI_NOT_FOUND)
     return;
   DBG("Found %d volumes with blockIO\n", HandleCount);
+  PrefetchBootSectors(Handles, HandleCount);
   // first pass: collect information about all handles
   for (HandleIndex = 0; HandleIndex < HandleCount; HandleIndex++) {
     
@@ -1149,6 +1302,7 @@ VOID ScanVolumes(VOID)
       FreePool(Volume);
     }
   }
+  FreeBootSectorReads();
   FreePool(Handles);
   //  DBG("Found %d volumes\n", VolumesCount);
   if (SelfVolume == NULL){
@@ -1247,6 +1401,7 @@ static VOID UninitVolumes(VOID)
   for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
     Volume = Volumes[VolumeIndex];
     
+    FreeVolumeDirCache(Volume);
     if (Volume->RootDir != NULL) {
       Volume->RootDir->Close(Volume->RootDir);
       Volume->RootDir = NULL;
@@ -1282,6 +1437,7 @@ VOID ReinitVolumes(VOID)
       continue;
     }
     DBG("Volume %d at reinit found:\n", VolumeIndex);
+    FreeVolumeDirCache(Volume);
     DBG("Volume->DevicePath=%s\n", FileDevicePathToStr(Volume->DevicePath));
     VolumesFound++;
     if (Volume->DevicePath != NULL) {
@@ -1362,6 +1518,221 @@ BOOLEAN FileExists(IN EFI_FILE *Root, IN CHAR16 *RelativePath)
   return FALSE;
 }
 
+//
+// Directory listing cache for the entry scan.
+// Every probe needs an Open/Close through the file system driver, which is
+// slow on HFS+/APFS/ext4 driven by GrubFS, and the scanners probe dozens of
+// paths per volume. VolumeFileExists() reads the parent directory once and
+// answers from memory until the volumes are reinitialized.
+//
+#define DIR_CACHE_MAX_NAMES   1024
+
+struct REFIT_DIR_CACHE {
+  REFIT_DIR_CACHE     *Next;
+  CHAR16              *Path;        // without the leading backslash
+  BOOLEAN             Missing;      // the directory could not be opened
+  BOOLEAN             Listed;       // FALSE if listing failed or was too long
+  UINTN               Count;
+  CHAR16              **Names;
+};
+
+STATIC struct {
+  UINTN     Probes;
+  UINTN     Listings;
+  UINTN     Passed;       // answered by the file system
+  UINT64    ListTicks;
+} mDirCacheStats;
+
+STATIC UINT64 TicksToMs(IN UINT64 Ticks)
+{
+  UINT64 TicksPerMs = DivU64x32(gCPUStructure.TSCFrequency, 1000);
+
+  return (TicksPerMs != 0) ? DivU64x64Remainder(Ticks, TicksPerMs, NULL) : 0;
+}
+
+// Empty, "." and ".." components and '/' are left to the file system
+STATIC BOOLEAN DirCachePlainPath(IN CHAR16 *Path)
+{
+  CHAR16 *Part = Path;
+
+  for (;;) {
+    if (Part[0] == L'\\' || Part[0] == L'\0' ||
+        (Part[0] == L'.' && (Part[1] == L'\\' || Part[1] == L'\0' ||
+                             (Part[1] == L'.' && (Part[2] == L'\\' || Part[2] == L'\0'))))) {
+      return FALSE;
+    }
+    while (*Part != L'\\' && *Part != L'\0') {
+      if (*Part == L'/') {
+        return FALSE;
+      }
+      Part++;
+    }
+    if (*Part == L'\0') {
+      return TRUE;
+    }
+    Part++;
+  }
+}
+
+STATIC REFIT_DIR_CACHE *GetDirCache(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, IN UINTN PathLen)
+{
+  REFIT_DIR_CACHE   *Dir;
+  REFIT_DIR_ITER    DirIter;
+  EFI_FILE_INFO     *DirEntry;
+  CHAR16            *DirPath;
+  CHAR16            **Names;
+  UINTN             Size = 0;
+  UINT64            StartTsc;
+
+  for (Dir = Volume->DirCache; Dir != NULL; Dir = Dir->Next) {
+    if (StrnCmp(Dir->Path, Path, PathLen) == 0 && Dir->Path[PathLen] == L'\0') {
+      return Dir;
+    }
+  }
+
+  Dir = AllocateZeroPool(sizeof(REFIT_DIR_CACHE));
+  DirPath = AllocateZeroPool((PathLen + 2) * sizeof(CHAR16));
+  if (Dir == NULL || DirPath == NULL) {
+    if (Dir != NULL) {
+      FreePool(Dir);
+    }
+    if (DirPath != NULL) {
+      FreePool(DirPath);
+    }
+    return NULL;
+  }
+  DirPath[0] = L'\\';
+  CopyMem(DirPath + 1, Path, PathLen * sizeof(CHAR16));
+  Dir->Path = DirPath + 1;
+
+  StartTsc = AsmReadTsc();
+  mDirCacheStats.Listings++;
+  DirIterOpen(Volume->RootDir, DirPath, &DirIter);
+  if (EFI_ERROR(DirIter.LastStatus)) {
+    Dir->Missing = TRUE;
+  } else {
+    Dir->Listed = TRUE;
+    while (DirIterNext(&DirIter, 0, NULL, &DirEntry)) {
+      if (Dir->Count == DIR_CACHE_MAX_NAMES) {
+        Dir->Listed = FALSE;
+        break;
+      }
+      if (Dir->Count == Size) {
+        Size = (Size == 0) ? 32 : Size * 2;
+        Names = ReallocatePool(Dir->Count * sizeof(CHAR16 *), Size * sizeof(CHAR16 *), Dir->Names);
+        if (Names == NULL) {
+          Dir->Listed = FALSE;
+          break;
+        }
+        Dir->Names = Names;
+      }
+      Dir->Names[Dir->Count] = EfiStrDuplicate(DirEntry->FileName);
+      if (Dir->Names[Dir->Count] == NULL) {
+        Dir->Listed = FALSE;
+        break;
+      }
+      Dir->Count++;
+    }
+    if (EFI_ERROR(DirIterClose(&DirIter))) {
+      Dir->Listed = FALSE;
+    }
+  }
+  mDirCacheStats.ListTicks += AsmReadTsc() - StartTsc;
+
+  Dir->Next = Volume->DirCache;
+  Volume->DirCache = Dir;
+  return Dir;
+}
+
+// Same answer as FileExists(Volume->RootDir, RelativePath), from the cached
+// listing of the parent directory where possible
+BOOLEAN VolumeFileExists(IN REFIT_VOLUME *Volume, IN CHAR16 *RelativePath)
+{
+  REFIT_DIR_CACHE   *Dir;
+  CHAR16            *Path;
+  CHAR16            *Leaf;
+  UINTN             Index;
+  BOOLEAN           Folded = FALSE;
+
+  if (Volume == NULL || Volume->RootDir == NULL || RelativePath == NULL) {
+    return FALSE;
+  }
+  mDirCacheStats.Probes++;
+
+  Path = RelativePath;
+  while (*Path == L'\\') {
+    Path++;
+  }
+  if (!DirCachePlainPath(Path)) {
+    mDirCacheStats.Passed++;
+    return FileExists(Volume->RootDir, RelativePath);
+  }
+  Leaf = Path + StrLen(Path);
+  while (Leaf > Path && Leaf[-1] != L'\\') {
+    Leaf--;
+  }
+
+  Dir = GetDirCache(Volume, Path, (Leaf > Path) ? (UINTN)(Leaf - Path - 1) : 0);
+  if (Dir != NULL && Dir->Missing) {
+    return FALSE;
+  }
+  if (Dir != NULL && Dir->Listed) {
+    for (Index = 0; Index < Dir->Count; Index++) {
+      if (StrCmp(Dir->Names[Index], Leaf) == 0) {
+        return TRUE;
+      }
+      if (!Folded && StriCmp(Dir->Names[Index], Leaf) == 0) {
+        Folded = TRUE;
+      }
+    }
+    if (!Folded) {
+      return FALSE;
+    }
+    // only the case differs, whether that matches is up to the file system
+  }
+  mDirCacheStats.Passed++;
+  return FileExists(Volume->RootDir, RelativePath);
+}
+
+VOID FreeVolumeDirCache(IN REFIT_VOLUME *Volume)
+{
+  REFIT_DIR_CACHE   *Dir;
+  UINTN             Index;
+
+  while (Volume->DirCache != NULL) {
+    Dir = Volume->DirCache;
+    Volume->DirCache = Dir->Next;
+    for (Index = 0; Index < Dir->Count; Index++) {
+      FreePool(Dir->Names[Index]);
+    }
+    if (Dir->Names != NULL) {
+      FreePool(Dir->Names);
+    }
+    FreePool(Dir->Path - 1);
+    FreePool(Dir);
+  }
+}
+
+// A file handle does not tell which volume it is on, so every file write,
+// create or delete drops the listings of all volumes
+VOID FreeAllVolumeDirCaches(VOID)
+{
+  UINTN Index;
+
+  for (Index = 0; Index < VolumesCount; Index++) {
+    FreeVolumeDirCache(Volumes[Index]);
+  }
+}
+
+// Logs the time since StartTsc with the probe counters, then clears them
+VOID LogVolumeDirCacheStats(IN CHAR8 *Phase, IN UINT64 StartTsc)
+{
+  DBG("%a: %ld ms, %d probes, %d dirs listed in %ld ms, %d passed to file system\n",
+      Phase, TicksToMs(AsmReadTsc() - StartTsc), mDirCacheStats.Probes,
+      mDirCacheStats.Listings, TicksToMs(mDirCacheStats.ListTicks), mDirCacheStats.Passed);
+  ZeroMem(&mDirCacheStats, sizeof(mDirCacheStats));
+}
+
 BOOLEAN DeleteFile(IN EFI_FILE *Root, IN CHAR16 *RelativePath)
 {
   EFI_STATUS  Status;
@@ -1369,6 +1740,7 @@ BOOLEAN DeleteFile(IN EFI_FILE *Root, IN CHAR16 *RelativePath)
   EFI_FILE_INFO   *FileInfo;
   
   //DBG("DeleteFile: %s\n", RelativePath);
+  FreeAllVolumeDirCaches();
   // open file for read/write to see if it exists, need write for delete
   Status = Root->Open(Root, &File, RelativePath, EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, 0);
   //DBG(" Open: %r\n", Status);
@@ -107,6 +107,9 @@ typedef struct {
   EFI_FILE_INFO       *LastFileInfo;
 } REFIT_DIR_ITER;
 
+// listings of the directories probed during the entry scan, see VolumeFileExists()
+typedef struct REFIT_DIR_CACHE REFIT_DIR_CACHE;
+
 typedef struct {
   UINT8 Flags;
   UINT8 StartCHS[3];
@@ -241,6 +244,7 @@ typedef struct {
   UINT32              DriveCRC32;
   EFI_GUID            RootUUID; //for recovery it is UUID of parent partition
   UINT64              SleepImageOffset;
+  REFIT_DIR_CACHE     *DirCache;
 } REFIT_VOLUME;
 
 typedef enum {
@@ -558,6 +562,7 @@ typedef struct {
   INTN        Count;
   CHAR8       *MatchOS;
   CHAR8       *MatchBuild;
+  CHAR8       *Procedure;   // kernel symbol the patch is searched in, NULL for whole kernel
   INPUT_ITEM  MenuItem;
 } KERNEL_PATCH;
 
@@ -732,6 +737,10 @@ VOID ScanVolumes(VOID);
 REFIT_VOLUME *FindVolumeByName(IN CHAR16 *VolName);
 
 BOOLEAN FileExists(IN EFI_FILE *BaseDir, IN CHAR16 *RelativePath);
+BOOLEAN VolumeFileExists(IN REFIT_VOLUME *Volume, IN CHAR16 *RelativePath);
+VOID    FreeVolumeDirCache(IN REFIT_VOLUME *Volume);
+VOID    FreeAllVolumeDirCaches(VOID);
+VOID    LogVolumeDirCacheStats(IN CHAR8 *Phase, IN UINT64 StartTsc);
 
 BOOLEAN DeleteFile(IN EFI_FILE *Root, IN CHAR16 *RelativePath);
 
@@ -841,6 +850,8 @@ VOID BltImage(IN EG_IMAGE *Image, IN INTN XPos, IN INTN YPos);
 VOID BltImageAlpha(IN EG_IMAGE *Image, IN INTN XPos, IN INTN YPos, IN EG_PIXEL *BackgroundPixel, INTN Scale);
 VOID BltImageComposite(IN EG_IMAGE *BaseImage, IN EG_IMAGE *TopImage, IN INTN XPos, IN INTN YPos);
 VOID BltImageCompositeBadge(IN EG_IMAGE *BaseImage, IN EG_IMAGE *TopImage, IN EG_IMAGE *BadgeImage, IN INTN XPos, IN INTN YPos, INTN Scale);
+VOID BltMenuEntryTile(IN VOID *Owner, IN EG_IMAGE *BaseImage, IN EG_IMAGE *TopImage, IN EG_IMAGE *BadgeImage, IN INTN XPos, IN INTN YPos, IN INTN Scale);
+VOID FreeMenuTiles(VOID);
 //VOID BltImageCompositeIndicator(IN EG_IMAGE *BaseImage, IN EG_IMAGE *TopImage, IN INTN XPos, IN INTN YPos, INTN Scale);
 
 BOOLEAN GetAnime(REFIT_MENU_SCREEN *Screen);
@@ -230,7 +230,11 @@ StartEFILoadedImage (
   //
   gBS->SetWatchdogTimer (600, 0x0000, 0x00, NULL);
 
+  // No file I/O from the ExitBootServices handler: DEBUG_LOG is written
+  // here and from the image's ExitBootServices call while it runs
+  HoldDebugLog ();
   ReturnStatus = Status = gBS->StartImage (ChildImageHandle, NULL, NULL);
+  ResumeDebugLog ();
   //
   // Clear the Watchdog Timer after the image returns
   //
@@ -608,6 +612,7 @@ StartLoader (
   // mainParser
   // BuiltinIcons
   // OSIcons
+  FreeSVGGlyphCache();
   font = fontsDB;
   while (font) {
     nextFont = font->next;
@@ -2047,6 +2052,7 @@ RefitMain (
   EFI_TIME          Now;
   BOOLEAN           HaveDefaultVolume;
   CHAR16            *FirstMessage;
+  UINT64            TscStart;
 
   gCPUStructure.TSCCalibr = GetMemLogTscTicksPerSecond (); //ticks for 1second
 
@@ -2196,8 +2202,10 @@ RefitMain (
   }
   if (!gConfigDict[1] || UniteConfigs) {
     SetOEMPath (L"config");
+    TscStart = AsmReadTsc();
     Status = LoadUserSettings (SelfRootDir, L"config", &gConfigDict[0]);
       DBG ("%s\\config.plist%s loaded: %r\n", OEMPath, EFI_ERROR(Status) ? L" not" : L"", Status);
+      DBG ("  load and parse took %ld ms\n", TimeDiff(TscStart, AsmReadTsc()));
   }
   UnicodeSPrint(gSettings.ConfigName, 64, L"%s%s%s",
                                    gConfigDict[0] ? L"config": L"",
@@ -2245,11 +2253,13 @@ RefitMain (
     GetListOfConfigs ();
   }
 
+  TscStart = AsmReadTsc();
   for (i=0; i<2; i++) {
     if (gConfigDict[i]) {
       GetEarlyUserSettings(SelfRootDir, gConfigDict[i]);
     }
   }
+  DBG ("GetEarlyUserSettings took %ld ms\n", TimeDiff(TscStart, AsmReadTsc()));
 
 #ifdef ENABLE_SECURE_BOOT
   // Install secure boot shim
@@ -2364,6 +2374,7 @@ RefitMain (
   }
 
   //Second step. Load config.plist into gSettings
+  TscStart = AsmReadTsc();
   for (i=0; i<2; i++) {
     if (gConfigDict[i]) {
       Status = GetUserSettings(SelfRootDir, gConfigDict[i]);
@@ -2372,6 +2383,7 @@ RefitMain (
       }
     }
   }
+  DBG ("GetUserSettings took %ld ms\n", TimeDiff(TscStart, AsmReadTsc()));
   
 
   if (gSettings.QEMU) {
@@ -2673,6 +2685,7 @@ RefitMain (
 
 //          }
           }
+          FlushDebugLog ();
           // Attempt warm reboot
           gRS->ResetSystem (EfiResetWarm, EFI_SUCCESS, 0, NULL);
           // Warm reboot may not be supported attempt cold reboot
@@ -2884,5 +2897,6 @@ RefitMain (
   if (gEmuVariableControl != NULL) {
     gEmuVariableControl->UninstallEmulation(gEmuVariableControl);
   }
+  CloseDebugLog ();
   return EFI_SUCCESS;
 }
@@ -3792,6 +3792,7 @@ VOID GraphicsMenuStyle(IN REFIT_MENU_SCREEN *Screen, IN SCROLL_STATE *State, IN
 static VOID DrawMainMenuEntry(REFIT_MENU_ENTRY *Entry, BOOLEAN selected, INTN XPos, INTN YPos)
 {
   INTN Scale = GlobalConfig.MainEntriesSize >> 3; //usually it is 128>>3 == 16. if 256>>3 == 32
+  VOID *TileOwner = Entry;
 
   if (((Entry->Tag == TAG_LOADER) || (Entry->Tag == TAG_LEGACY)) &&
       !(GlobalConfig.HideBadges & HDBADGES_SWAP) &&
@@ -3808,6 +3809,8 @@ static VOID DrawMainMenuEntry(REFIT_MENU_ENTRY *Entry, BOOLEAN selected, INTN XP
     if (!MainImage) {
       MainImage = DummyImage(Scale << 3);
     }
+    // a new image every time, don't cache its tiles
+    TileOwner = NULL;
   }
   //  DBG("Entry title=%s; Width=%d\n", Entry->Title, MainImage->Width);
   if (GlobalConfig.TypeSVG) {
@@ -3819,15 +3822,15 @@ static VOID DrawMainMenuEntry(REFIT_MENU_ENTRY *Entry, BOOLEAN selected, INTN XP
     SelectionImages[0]->HasAlpha = TRUE;
     SelectionImages[2]->HasAlpha = TRUE;
     //MainImage->HasAlpha = TRUE;
-    BltImageCompositeBadge(MainImage,
-                           SelectionImages[((Entry->Row == 0) ? 0 : 2) + (selected ? 0 : 1)],
-                           (Entry->Row == 0) ? Entry->BadgeImage:NULL,
-                           XPos, YPos, Scale);
+    BltMenuEntryTile(TileOwner, MainImage,
+                     SelectionImages[((Entry->Row == 0) ? 0 : 2) + (selected ? 0 : 1)],
+                     (Entry->Row == 0) ? Entry->BadgeImage:NULL,
+                     XPos, YPos, Scale);
 
   } else {
-    BltImageCompositeBadge(SelectionImages[((Entry->Row == 0) ? 0 : 2) + (selected ? 0 : 1)],
-                           MainImage, (Entry->Row == 0) ? Entry->BadgeImage:NULL,
-      XPos, YPos, Scale);
+    BltMenuEntryTile(TileOwner, SelectionImages[((Entry->Row == 0) ? 0 : 2) + (selected ? 0 : 1)],
+                     MainImage, (Entry->Row == 0) ? Entry->BadgeImage:NULL,
+                     XPos, YPos, Scale);
   }
 
   // draw BCS indicator
@@ -358,6 +358,7 @@ BOOLEAN CheckFatalError(IN EFI_STATUS Status, IN CHAR16 *where)
     Print(L"Fatal Error: %r %s\n", Status, where);
     gST->ConOut->SetAttribute (gST->ConOut, ATTR_BASIC);
     haveError = TRUE;
+    FlushDebugLog();
     
     //gBS->Exit(ImageHandle, ExitStatus, ExitDataSize, ExitData);
     
@@ -376,6 +377,7 @@ BOOLEAN CheckError(IN EFI_STATUS Status, IN CHAR16 *where)
     Print(L"Error: %r %s\n", Status, where);
     gST->ConOut->SetAttribute (gST->ConOut, ATTR_BASIC);
     haveError = TRUE;
+    FlushDebugLog();
     
     return TRUE;
 }
@@ -412,6 +414,9 @@ BltClearScreen (
 {
   EG_PIXEL *p1;
   INTN i, j, x, x1, x2, y, y1, y2;
+
+  // the background under cached tiles is redrawn
+  FreeMenuTiles();
   if (GlobalConfig.DarkEmbedded) {
     CopyMem (&BlueBackgroundPixel, &DarkEmbeddedBackgroundPixel, sizeof (EG_PIXEL));
   } else {
@@ -482,6 +487,7 @@ BltClearScreen (
         // already scaled
         break;
     }
+    egImageChanged(BackgroundImage);
   }
   
   // Draw background
@@ -517,8 +523,10 @@ BltImage (
   GraphicsScreenDirty = TRUE;
 }
 
-VOID
-BltImageAlpha (
+// Returns the image as it will look on screen at XPos,YPos:
+// scaled by Scale/16 and composed on the background
+STATIC EG_IMAGE *
+ComposeImageOnBackground (
   IN EG_IMAGE *Image,
   IN INTN     XPos,
   IN INTN     YPos,
@@ -531,7 +539,6 @@ BltImageAlpha (
   INTN Width = Scale << 3;
   INTN Height = Width;
 
-  GraphicsScreenDirty = TRUE;
   if (Image) {
     NewImage = egCopyScaledImage(Image, Scale); //will be Scale/16
     Width = NewImage->Width;
@@ -545,12 +552,13 @@ BltImageAlpha (
     egFreeImage(NewImage);
   }
   if (!BackgroundImage) {
-    egDrawImageArea(CompImage, 0, 0, 0, 0, XPos, YPos);
-    egFreeImage(CompImage);
-    return;
+    return CompImage;
   }
   NewImage = egCreateImage(Width, Height, FALSE);
-  if (!NewImage) return;
+  if (!NewImage) {
+    egFreeImage(CompImage);
+    return NULL;
+  }
 //  DBG("draw on background\n");
   egRawCopy(NewImage->PixelData,
             BackgroundImage->PixelData + YPos * BackgroundImage->Width + XPos,
@@ -559,6 +567,23 @@ BltImageAlpha (
             BackgroundImage->Width);
   egComposeImage(NewImage, CompImage, 0, 0);
   egFreeImage(CompImage);
+  return NewImage;
+}
+
+VOID
+BltImageAlpha (
+  IN EG_IMAGE *Image,
+  IN INTN     XPos,
+  IN INTN     YPos,
+  IN EG_PIXEL *BackgroundPixel,
+  IN INTN     Scale
+  )
+{
+  EG_IMAGE *NewImage;
+
+  GraphicsScreenDirty = TRUE;
+  NewImage = ComposeImageOnBackground(Image, XPos, YPos, BackgroundPixel, Scale);
+  if (!NewImage) return;
 
   // blit to screen and clean up
   egDrawImageArea(NewImage, 0, 0, 0, 0, XPos, YPos);
@@ -614,8 +639,10 @@ BltImageComposite (
   BaseImage = MainImage, TopImage = Selection
 */
 
-VOID
-BltImageCompositeBadge (
+// Builds the entry tile as it will look on screen at XPos,YPos, see
+// BltImageCompositeBadge
+STATIC EG_IMAGE *
+ComposeBadgeTile (
   IN EG_IMAGE *BaseImage,
   IN EG_IMAGE *TopImage,
   IN EG_IMAGE *BadgeImage,
@@ -627,6 +654,7 @@ BltImageCompositeBadge (
   INTN TotalWidth, TotalHeight, CompWidth, CompHeight, OffsetX, OffsetY, OffsetXTmp, OffsetYTmp;
   BOOLEAN Selected = TRUE;
   EG_IMAGE *CompImage;
+  EG_IMAGE *TileImage;
   EG_IMAGE *NewBaseImage;
   EG_IMAGE *NewTopImage;
   EG_PIXEL *BackgroundPixel = &EmbeddedBackgroundPixel;
@@ -638,7 +666,7 @@ BltImageCompositeBadge (
   }
 
   if (!BaseImage || !TopImage) {
-    return;
+    return NULL;
   }
   if (Scale < 0) {
     Scale = -Scale;
@@ -659,7 +687,9 @@ BltImageCompositeBadge (
   
   if (!CompImage) {
     DBG("Can't create CompImage\n");
-    return;
+    egFreeImage(NewBaseImage);
+    egFreeImage(NewTopImage);
+    return NULL;
   }
 //  DBG("compose image total=[%d,%d], comp=[%d,%d] at [%d,%d] scale=%d\n", TotalWidth, TotalHeight,
 //      CompWidth, CompHeight, XPos, YPos, Scale);
@@ -728,12 +758,12 @@ BltImageCompositeBadge (
     }
   }
 
-  // blit to screen and clean up
+  // compose on background
 //  if (!IsEmbeddedTheme()) { // regular theme
     if (GlobalConfig.NonSelectedGrey && !Selected) {
-      BltImageAlpha(CompImage, XPos, YPos, &MenuBackgroundPixel, -16);
+      TileImage = ComposeImageOnBackground(CompImage, XPos, YPos, &MenuBackgroundPixel, -16);
     } else {
-      BltImageAlpha(CompImage, XPos, YPos, &MenuBackgroundPixel, 16);
+      TileImage = ComposeImageOnBackground(CompImage, XPos, YPos, &MenuBackgroundPixel, 16);
     }
 /*  } else { // embedded theme - don't use BltImageAlpha as it can't handle refit's built in image
     egDrawImageArea(CompImage, 0, 0, TotalWidth, TotalHeight, XPos, YPos);
@@ -741,8 +771,178 @@ BltImageCompositeBadge (
   egFreeImage(CompImage);
   egFreeImage(NewBaseImage);
   egFreeImage(NewTopImage);
+  return TileImage;
+}
+
+VOID
+BltImageCompositeBadge (
+  IN EG_IMAGE *BaseImage,
+  IN EG_IMAGE *TopImage,
+  IN EG_IMAGE *BadgeImage,
+  IN INTN      XPos,
+  IN INTN      YPos,
+  IN INTN      Scale
+  )
+{
+  EG_IMAGE *TileImage;
+
+  TileImage = ComposeBadgeTile(BaseImage, TopImage, BadgeImage, XPos, YPos, Scale);
+  if (!TileImage) {
+    return;
+  }
+  egDrawImageArea(TileImage, 0, 0, 0, 0, XPos, YPos);
+  egFreeImage(TileImage);
   GraphicsScreenDirty = TRUE;
 }
+
+//
+// Main menu tiles cache.
+// Moving the selection repaints two entries, and each of them was scaled,
+// composed with the selection and badge and put on the background again.
+// The final tiles are kept here, keyed by the entry, its images, position
+// and Scale (which also carries the selected state). The background under
+// the tiles changes only in BltClearScreen and a theme change reloads all
+// the images, so both of them drop the whole cache.
+//
+#define MENU_TILE_CACHE_SIZE   64
+#define MENU_TILE_CACHE_BYTES  0x800000     // 8MB of pixels
+
+typedef struct {
+  VOID      *Owner;
+  EG_IMAGE  *BaseImage;
+  EG_IMAGE  *TopImage;
+  EG_IMAGE  *BadgeImage;
+  INTN      XPos;
+  INTN      YPos;
+  INTN      Scale;
+  EG_IMAGE  *Tile;
+  UINTN     LastUse;
+} MENU_TILE;
+
+STATIC MENU_TILE  mMenuTiles[MENU_TILE_CACHE_SIZE];
+STATIC UINTN      mMenuTileBytes = 0;
+STATIC UINTN      mMenuTileClock = 0;
+STATIC UINTN      mMenuTileHits = 0;
+STATIC UINTN      mMenuTileMisses = 0;
+
+STATIC UINTN
+MenuTileBytes (
+  IN EG_IMAGE *Tile
+  )
+{
+  return (UINTN)(Tile->Width * Tile->Height) * sizeof(EG_PIXEL);
+}
+
+STATIC VOID
+DropMenuTile (
+  IN MENU_TILE *Entry
+  )
+{
+  if (Entry->Tile) {
+    mMenuTileBytes -= MenuTileBytes(Entry->Tile);
+    egFreeImage(Entry->Tile);
+  }
+  ZeroMem(Entry, sizeof(MENU_TILE));
+}
+
+VOID
+FreeMenuTiles (
+  VOID
+  )
+{
+  UINTN i;
+
+  if (mMenuTileHits + mMenuTileMisses != 0) {
+    DBG("menu tiles: %d hits, %d built, %dKB cached\n",
+        mMenuTileHits, mMenuTileMisses, mMenuTileBytes >> 10);
+  }
+  for (i = 0; i < MENU_TILE_CACHE_SIZE; i++) {
+    DropMenuTile(&mMenuTiles[i]);
+  }
+  mMenuTileBytes = 0;
+  mMenuTileHits = 0;
+  mMenuTileMisses = 0;
+}
+
+// Same as BltImageCompositeBadge, but the result is cached for Owner
+VOID
+BltMenuEntryTile (
+  IN VOID     *Owner,
+  IN EG_IMAGE *BaseImage,
+  IN EG_IMAGE *TopImage,
+  IN EG_IMAGE *BadgeImage,
+  IN INTN      XPos,
+  IN INTN      YPos,
+  IN INTN      Scale
+  )
+{
+  UINTN     i;
+  UINTN     Size;
+  MENU_TILE *Entry;
+  MENU_TILE *Oldest;
+  EG_IMAGE  *TileImage;
+
+  mMenuTileClock++;
+  for (i = 0; i < MENU_TILE_CACHE_SIZE; i++) {
+    Entry = &mMenuTiles[i];
+    if (Entry->Tile != NULL &&
+        Entry->Owner == Owner &&
+        Entry->BaseImage == BaseImage &&
+        Entry->TopImage == TopImage &&
+        Entry->BadgeImage == BadgeImage &&
+        Entry->XPos == XPos &&
+        Entry->YPos == YPos &&
+        Entry->Scale == Scale) {
+      Entry->LastUse = mMenuTileClock;
+      mMenuTileHits++;
+      egDrawImageArea(Entry->Tile, 0, 0, 0, 0, XPos, YPos);
+      GraphicsScreenDirty = TRUE;
+      return;
+    }
+  }
+
+  TileImage = ComposeBadgeTile(BaseImage, TopImage, BadgeImage, XPos, YPos, Scale);
+  if (!TileImage) {
+    return;
+  }
+  egDrawImageArea(TileImage, 0, 0, 0, 0, XPos, YPos);
+  GraphicsScreenDirty = TRUE;
+  mMenuTileMisses++;
+
+  Size = MenuTileBytes(TileImage);
+  if (Owner == NULL || Size > MENU_TILE_CACHE_BYTES / 4) {
+    egFreeImage(TileImage);
+    return;
+  }
+
+  // evict least recently used tiles until there is a free slot and room for this one
+  for (;;) {
+    Oldest = NULL;
+    Entry = NULL;
+    for (i = 0; i < MENU_TILE_CACHE_SIZE; i++) {
+      if (mMenuTiles[i].Tile == NULL) {
+        Entry = &mMenuTiles[i];
+      } else if (Oldest == NULL || mMenuTiles[i].LastUse < Oldest->LastUse) {
+        Oldest = &mMenuTiles[i];
+      }
+    }
+    if (Entry != NULL && mMenuTileBytes + Size <= MENU_TILE_CACHE_BYTES) {
+      break;
+    }
+    DropMenuTile(Oldest);
+  }
+
+  Entry->Owner = Owner;
+  Entry->BaseImage = BaseImage;
+  Entry->TopImage = TopImage;
+  Entry->BadgeImage = BadgeImage;
+  Entry->XPos = XPos;
+  Entry->YPos = YPos;
+  Entry->Scale = Scale;
+  Entry->Tile = TileImage;
+  Entry->LastUse = mMenuTileClock;
+  mMenuTileBytes += Size;
+}
     
 #define MAX_SIZE_ANIME 256
 